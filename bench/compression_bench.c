@@ -0,0 +1,178 @@
+/*
+	Compare the size and the load time of a report saved with and without compression.
+	The files are written to the current directory, then removed.
+
+	Usage: compression_bench [address count]
+*/
+
+#include <stdio.h>
+#include <stdlib.h> /* atoi */
+
+#include "samply.h"
+#include "sampler.h"
+#include "report.h"
+#include "string_store.h"
+
+#define DEFAULT_ADDRESS_COUNT (1000 * 1000)
+#define SYMBOL_COUNT (10 * 1000)
+#define FILE_COUNT (2 * 1000)
+#define RUN_COUNT (3)
+
+#define RAW_FILEPATH "compression_bench_raw.bin"
+#define COMPRESSED_FILEPATH "compression_bench_compressed.bin"
+
+typedef struct bench_result bench_result;
+struct bench_result {
+	size_t file_size;
+	double save_seconds;
+	double load_seconds;
+};
+
+/* Deterministic pseudo random numbers, so runs are comparable. */
+static uint64_t next_random(uint64_t* state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 33;
+}
+
+static strv make_name(string_store* s, const char* format, size_t index)
+{
+	char buffer[64];
+	int len = snprintf(buffer, sizeof(buffer), format, index);
+	return *string_store_get_or_create(s, strv_make_from(buffer, len));
+}
+
+static size_t get_file_size(const char* filepath)
+{
+	FILE* f = fopen(filepath, "rb");
+	if (!f)
+	{
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+	return size > 0 ? (size_t)size : 0;
+}
+
+/* Save once, then load the file RUN_COUNT times and keep the best time. */
+static bool run(report* r, const char* filepath, bool compress, bench_result* result)
+{
+	double start = samply_time_now();
+	bool saved = compress
+		? report_save_compressed_to_filepath(r, filepath)
+		: report_save_to_filepath(r, filepath);
+	result->save_seconds = samply_time_now() - start;
+
+	if (!saved)
+	{
+		return false;
+	}
+
+	result->file_size = get_file_size(filepath);
+
+	report loaded;
+	report_init(&loaded);
+
+	bool success = true;
+	for (int i = 0; i < RUN_COUNT && success; i += 1)
+	{
+		start = samply_time_now();
+		success = report_load_from_filepath(&loaded, filepath);
+		double seconds = samply_time_now() - start;
+
+		if (i == 0 || seconds < result->load_seconds)
+		{
+			result->load_seconds = seconds;
+		}
+	}
+
+	report_destroy(&loaded);
+	remove(filepath);
+
+	return success;
+}
+
+static void print_result(const char* name, bench_result* result, size_t raw_size)
+{
+	double mb = (double)raw_size / (1024.0 * 1024.0);
+	printf("%-11s %10zu bytes  save %8.2f ms  load %8.2f ms (%.0f MB/s)\n",
+		name,
+		result->file_size,
+		result->save_seconds * 1000.0,
+		result->load_seconds * 1000.0,
+		result->load_seconds > 0 ? mb / result->load_seconds : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+	size_t address_count = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_ADDRESS_COUNT;
+
+	string_store strings;
+	string_store_init(&strings);
+
+	strv* symbols = SMP_MALLOC(SYMBOL_COUNT * sizeof(strv));
+	strv* files = SMP_MALLOC(FILE_COUNT * sizeof(strv));
+
+	for (size_t i = 0; i < SYMBOL_COUNT; i += 1)
+	{
+		symbols[i] = make_name(&strings, "function_%zu", i);
+	}
+	for (size_t i = 0; i < FILE_COUNT; i += 1)
+	{
+		files[i] = make_name(&strings, "C:/src/file_%zu.c", i);
+	}
+	strv module_name = *string_store_get_or_create(&strings, (strv)STRV("bench.exe"));
+
+	ht results;
+	records_by_address_init(&results, address_count);
+
+	uint64_t state = 42;
+	size_t sample_count = 0;
+
+	for (size_t i = 0; i < address_count; i += 1)
+	{
+		record item = { 0 };
+		item.address = 0x140001000ull + (uint64_t)((i * 2654435761ull) % address_count) * 4;
+
+		record* inserted = (record*)ht_get_or_insert(&results, &item);
+		size_t symbol_index = (size_t)(next_random(&state) % SYMBOL_COUNT);
+		inserted->symbol_name = symbols[symbol_index];
+		inserted->module_name = module_name;
+		inserted->source_file = files[symbol_index % FILE_COUNT];
+		inserted->line_number = 1 + (size_t)(next_random(&state) % 5000);
+		inserted->counter = 1 + (size_t)(next_random(&state) % 10);
+
+		sample_count += inserted->counter;
+	}
+
+	report r;
+	report_init(&r);
+	report_load_from_records(&r, &results, sample_count);
+
+	bench_result raw = { 0 };
+	bench_result compressed = { 0 };
+
+	int exit_code = 0;
+	if (run(&r, RAW_FILEPATH, false, &raw)
+		&& run(&r, COMPRESSED_FILEPATH, true, &compressed))
+	{
+		printf("Records:    %zu\n", r.records.size);
+		print_result("Raw:", &raw, raw.file_size);
+		print_result("Compressed:", &compressed, raw.file_size);
+		printf("Ratio:      %.3f\n", raw.file_size ? (double)compressed.file_size / (double)raw.file_size : 0.0);
+	}
+	else
+	{
+		fprintf(stderr, "Could not save or load the reports.\n");
+		exit_code = 1;
+	}
+
+	report_destroy(&r);
+	ht_destroy(&results);
+	SMP_FREE(symbols);
+	SMP_FREE(files);
+	string_store_destroy(&strings);
+
+	return exit_code;
+}
@@ -0,0 +1,177 @@
+/*
+	Time each stage of the load of a report, from one thread to one per processor.
+	The report is saved with and without compression to the current directory, then removed.
+
+	Usage: load_bench [address count]
+*/
+
+#include <stdio.h>
+#include <stdlib.h> /* atoi */
+
+#include "samply.h"
+#include "sampler.h"
+#include "report.h"
+#include "string_store.h"
+
+#define DEFAULT_ADDRESS_COUNT (2 * 1000 * 1000)
+#define SYMBOL_COUNT (10 * 1000)
+#define FILE_COUNT (2 * 1000)
+#define RUN_COUNT (3)
+
+#define RAW_FILEPATH "load_bench_raw.bin"
+#define COMPRESSED_FILEPATH "load_bench_compressed.bin"
+
+/* Deterministic pseudo random numbers, so runs are comparable. */
+static uint64_t next_random(uint64_t* state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 33;
+}
+
+static strv make_name(string_store* s, const char* format, size_t index)
+{
+	char buffer[64];
+	int len = snprintf(buffer, sizeof(buffer), format, index);
+	return *string_store_get_or_create(s, strv_make_from(buffer, len));
+}
+
+/* Load the file RUN_COUNT times with thread_count threads and keep the timings of the fastest load. */
+static bool run(const char* filepath, size_t thread_count, report_load_timings* best)
+{
+	report loaded;
+	report_init(&loaded);
+	loaded.load_thread_count = thread_count;
+
+	bool success = true;
+	for (int i = 0; i < RUN_COUNT && success; i += 1)
+	{
+		success = report_load_from_filepath(&loaded, filepath);
+
+		if (i == 0 || loaded.load_timings.total < best->total)
+		{
+			*best = loaded.load_timings;
+		}
+	}
+
+	report_destroy(&loaded);
+	return success;
+}
+
+static bool run_all(const char* name, const char* filepath)
+{
+	printf("%s\n", name);
+	printf("threads      read    decomp   summary   records  call graph     total (ms)\n");
+
+	double single_thread_total = 0.0;
+	size_t max_thread_count = samply_cpu_count();
+	for (size_t thread_count = 1; ; thread_count *= 2)
+	{
+		if (thread_count > max_thread_count)
+		{
+			thread_count = max_thread_count;
+		}
+
+		report_load_timings t = { 0 };
+		if (!run(filepath, thread_count, &t))
+		{
+			return false;
+		}
+
+		if (thread_count == 1)
+		{
+			single_thread_total = t.total;
+		}
+
+		printf("%7zu  %8.2f  %8.2f  %8.2f  %8.2f  %10.2f  %8.2f  x%.2f\n",
+			t.thread_count,
+			t.read * 1000.0,
+			t.decompression * 1000.0,
+			t.summary * 1000.0,
+			t.records * 1000.0,
+			t.call_graph * 1000.0,
+			t.total * 1000.0,
+			t.total > 0 ? single_thread_total / t.total : 0.0);
+
+		if (thread_count == max_thread_count)
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t address_count = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_ADDRESS_COUNT;
+
+	string_store strings;
+	string_store_init(&strings);
+
+	strv* symbols = SMP_MALLOC(SYMBOL_COUNT * sizeof(strv));
+	strv* files = SMP_MALLOC(FILE_COUNT * sizeof(strv));
+
+	for (size_t i = 0; i < SYMBOL_COUNT; i += 1)
+	{
+		symbols[i] = make_name(&strings, "function_%zu", i);
+	}
+	for (size_t i = 0; i < FILE_COUNT; i += 1)
+	{
+		files[i] = make_name(&strings, "C:/src/file_%zu.c", i);
+	}
+	strv module_name = *string_store_get_or_create(&strings, (strv)STRV("bench.exe"));
+
+	ht results;
+	records_by_address_init(&results, address_count);
+
+	uint64_t state = 42;
+	size_t sample_count = 0;
+
+	for (size_t i = 0; i < address_count; i += 1)
+	{
+		record item = { 0 };
+		item.address = 0x140001000ull + (uint64_t)((i * 2654435761ull) % address_count) * 4;
+
+		record* inserted = (record*)ht_get_or_insert(&results, &item);
+		size_t symbol_index = (size_t)(next_random(&state) % SYMBOL_COUNT);
+		inserted->symbol_name = symbols[symbol_index];
+		inserted->module_name = module_name;
+		inserted->source_file = files[symbol_index % FILE_COUNT];
+		inserted->line_number = 1 + (size_t)(next_random(&state) % 5000);
+		inserted->counter = 1 + (size_t)(next_random(&state) % 10);
+
+		sample_count += inserted->counter;
+	}
+
+	report r;
+	report_init(&r);
+	report_load_from_records(&r, &results, sample_count);
+
+	int exit_code = 0;
+	if (report_save_to_filepath(&r, RAW_FILEPATH)
+		&& report_save_compressed_to_filepath(&r, COMPRESSED_FILEPATH))
+	{
+		printf("Records: %zu\n", r.records.size);
+		if (!run_all("Raw:", RAW_FILEPATH) || !run_all("Compressed:", COMPRESSED_FILEPATH))
+		{
+			fprintf(stderr, "Could not load the reports.\n");
+			exit_code = 1;
+		}
+	}
+	else
+	{
+		fprintf(stderr, "Could not save the reports.\n");
+		exit_code = 1;
+	}
+
+	remove(RAW_FILEPATH);
+	remove(COMPRESSED_FILEPATH);
+
+	report_destroy(&r);
+	ht_destroy(&results);
+	SMP_FREE(symbols);
+	SMP_FREE(files);
+	string_store_destroy(&strings);
+
+	return exit_code;
+}
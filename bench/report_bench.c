@@ -0,0 +1,105 @@
+/*
+	Measure the time to build a report from the results of a sampler.
+
+	Usage: report_bench [address count]
+*/
+
+#include <stdio.h>
+#include <stdlib.h> /* atoi */
+
+#include "samply.h"
+#include "sampler.h"
+#include "report.h"
+#include "string_store.h"
+
+#define DEFAULT_ADDRESS_COUNT (1000 * 1000)
+#define SYMBOL_COUNT (10 * 1000)
+#define FILE_COUNT (2 * 1000)
+#define RUN_COUNT (3)
+
+/* Deterministic pseudo random numbers, so runs are comparable. */
+static uint64_t next_random(uint64_t* state)
+{
+	*state = *state * 6364136223846793005ull + 1442695040888963407ull;
+	return *state >> 33;
+}
+
+static strv make_name(string_store* s, const char* format, size_t index)
+{
+	char buffer[64];
+	int len = snprintf(buffer, sizeof(buffer), format, index);
+	return *string_store_get_or_create(s, strv_make_from(buffer, len));
+}
+
+int main(int argc, char** argv)
+{
+	size_t address_count = argc > 1 ? (size_t)atoi(argv[1]) : DEFAULT_ADDRESS_COUNT;
+
+	string_store strings;
+	string_store_init(&strings);
+
+	strv* symbols = SMP_MALLOC(SYMBOL_COUNT * sizeof(strv));
+	strv* files = SMP_MALLOC(FILE_COUNT * sizeof(strv));
+
+	for (size_t i = 0; i < SYMBOL_COUNT; i += 1)
+	{
+		symbols[i] = make_name(&strings, "function_%zu", i);
+	}
+	for (size_t i = 0; i < FILE_COUNT; i += 1)
+	{
+		files[i] = make_name(&strings, "C:/src/file_%zu.c", i);
+	}
+	strv module_name = *string_store_get_or_create(&strings, (strv)STRV("bench.exe"));
+
+	ht results;
+	records_by_address_init(&results, address_count);
+
+	uint64_t state = 42;
+	size_t sample_count = 0;
+
+	for (size_t i = 0; i < address_count; i += 1)
+	{
+		record item = { 0 };
+		/* Addresses are unique but inserted in random order, like a real run. */
+		item.address = 0x140001000ull + (uint64_t)((i * 2654435761ull) % address_count) * 4;
+
+		record* inserted = (record*)ht_get_or_insert(&results, &item);
+		size_t symbol_index = (size_t)(next_random(&state) % SYMBOL_COUNT);
+		inserted->symbol_name = symbols[symbol_index];
+		inserted->module_name = module_name;
+		inserted->source_file = files[symbol_index % FILE_COUNT];
+		inserted->line_number = 1 + (size_t)(next_random(&state) % 5000);
+		inserted->counter = 1 + (size_t)(next_random(&state) % 10);
+
+		sample_count += inserted->counter;
+	}
+
+	report r;
+	report_init(&r);
+
+	double best = 0;
+	for (int run = 0; run < RUN_COUNT; run += 1)
+	{
+		double start = samply_time_now();
+		report_load_from_records(&r, &results, sample_count);
+		double seconds = samply_time_now() - start;
+
+		if (run == 0 || seconds < best)
+		{
+			best = seconds;
+		}
+	}
+
+	printf("Addresses: %zu\n", address_count);
+	printf("Records:   %zu\n", r.records.size);
+	printf("Symbols:   %zu\n", r.summary_by_count.size);
+	printf("Build:     %.2f ms (best of %d)\n", best * 1000.0, RUN_COUNT);
+
+	report_destroy(&r);
+	ht_destroy(&results);
+	SMP_FREE(symbols);
+	SMP_FREE(files);
+	string_store_destroy(&strings);
+
+	return 0;
+}
@@ -6,7 +6,9 @@
 /* Forward declarations */
 
 static const char* build_with(const char* config);
+static void build_bench(const char* bench_name, const char* toolchain, const char* config);
 static void my_project(const char* project_name, const char* toolchain, const char* config);
+static void add_samply_dependencies(void);
 
 /* Main */
 
@@ -94,6 +96,48 @@ static const char* build_with(const char* config)
     cb_add_files_recursive("./src/", "*.c");
     cb_add_files_recursive("./src/", "*.cpp");
 
+    add_samply_dependencies();
+
+    if (cb_str_equals(toolchain_name, "msvc"))
+    {
+        cb_add(cb_LFLAGS, "setargv.obj"); /* Expand wildcards of the arguments, for "samply merge *.bin". */
+    }
+
+    const char* exe = cb_bake();
+    if (!exe)
+    {
+        exit(1);
+    }
+
+    build_bench("report_bench", toolchain_name, config);
+    build_bench("compression_bench", toolchain_name, config);
+    build_bench("load_bench", toolchain_name, config);
+
+    return exe;
+}
+
+/* Benchmarks are built from ./bench/<bench_name>.c and the C files of samply, without the GUI. */
+static void build_bench(const char* bench_name, const char* toolchain, const char* config)
+{
+    my_project(bench_name, toolchain, config);
+
+    cb_set(cb_BINARY_TYPE, cb_EXE);
+
+    cb_add_f(cb_FILES, "./bench/%s.c", bench_name);
+    cb_add_files("./src/", "*.c");
+    cb_add_files("./src/utils/", "*.c");
+    cb_add(cb_FILES, "./src/3rdparty/3rdparty_impl.c");
+
+    add_samply_dependencies();
+
+    if (!cb_bake())
+    {
+        exit(1);
+    }
+}
+
+static void add_samply_dependencies(void)
+{
     cb_add_many_vnull(cb_INCLUDE_DIRECTORIES,
         "./src/",
         "./src/gui",
@@ -115,12 +159,4 @@ static const char* build_with(const char* config)
         "winspool",
         NULL
     );
-
-    const char* exe = cb_bake();
-    if (!exe)
-    {
-        exit(1);
-    }
-
-    return exe;
 }
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "call_graph.h"
+
+#include "string.h" /* memset */
+
+#include "samply.h"
+#include "sampler.h" /* call_stack, record */
+#include "report.h"  /* report_print_row_to_file */
+#include "string_store.h"
+
+/* Id of a symbol, names are interned so they are identified by their data pointer. */
+typedef struct symbol_slot symbol_slot;
+struct symbol_slot {
+	strv name;
+	uint32_t id;
+};
+
+/* Counter of an edge, caller id in the high 32 bits of the key and callee id in the low 32 bits. */
+typedef struct pair_slot pair_slot;
+struct pair_slot {
+	uint64_t key;
+	size_t counter;
+	size_t last_stack; /* Last call stack which counted this edge. */
+};
+
+static uint32_t get_symbol_id(call_graph* g, ht* slots, call_counters* last_stacks, strv name);
+static void fill_rows(call_offsets* offsets, call_edges* edges, call_pairs* pairs, bool by_callee, size_t symbol_count);
+static void print_edges(call_graph* g, call_offsets* offsets, call_edges* edges, uint32_t symbol, size_t sample_count, FILE* f);
+
+static ht_hash_t symbol_slot_hash(symbol_slot* item);
+static bool symbol_slot_are_same(symbol_slot* left, symbol_slot* right);
+static void symbol_slot_swap(symbol_slot* left, symbol_slot* right);
+static ht_hash_t pair_slot_hash(pair_slot* item);
+static bool pair_slot_are_same(pair_slot* left, pair_slot* right);
+static void pair_slot_swap(pair_slot* left, pair_slot* right);
+static int compare_call_edge(const call_edge* left, const call_edge* right);
+
+void call_graph_init(call_graph* g)
+{
+	memset(g, 0, sizeof(call_graph));
+
+	darr_init(&g->symbols);
+	darr_init(&g->self_counters);
+	darr_init(&g->total_counters);
+	darr_init(&g->caller_offsets);
+	darr_init(&g->callers);
+	darr_init(&g->callee_offsets);
+	darr_init(&g->callees);
+}
+
+void call_graph_destroy(call_graph* g)
+{
+	darr_destroy(&g->symbols);
+	darr_destroy(&g->self_counters);
+	darr_destroy(&g->total_counters);
+	darr_destroy(&g->caller_offsets);
+	darr_destroy(&g->callers);
+	darr_destroy(&g->callee_offsets);
+	darr_destroy(&g->callees);
+}
+
+void call_graph_clear(call_graph* g)
+{
+	darr_clear(&g->symbols);
+	darr_clear(&g->self_counters);
+	darr_clear(&g->total_counters);
+	darr_clear(&g->caller_offsets);
+	darr_clear(&g->callers);
+	darr_clear(&g->callee_offsets);
+	darr_clear(&g->callees);
+}
+
+bool call_graph_is_empty(call_graph* g)
+{
+	return g->symbols.size == 0;
+}
+
+void call_graph_load_from_call_stacks(call_graph* g, ht* call_stacks, ht* call_stack_frames)
+{
+	call_graph_clear(g);
+
+	ht symbol_slots;
+	ht pair_slots;
+	ht_init(&symbol_slots, sizeof(symbol_slot), symbol_slot_hash, (ht_predicate_t)symbol_slot_are_same, symbol_slot_swap, 1024);
+	ht_init(&pair_slots, sizeof(pair_slot), pair_slot_hash, (ht_predicate_t)pair_slot_are_same, pair_slot_swap, 1024);
+
+	/* Last call stack which counted each symbol, so recursive symbols are only counted once per call stack. */
+	call_counters last_stacks;
+	darr_init(&last_stacks);
+
+	uint32_t ids[SMP_MAX_CALL_STACK_DEPTH];
+	size_t stack_index = 0;
+
+	ht_cursor c;
+	ht_cursor_init(call_stacks, &c);
+	while (ht_cursor_next(&c))
+	{
+		call_stack* stack = ht_cursor_item(&c);
+		stack_index += 1;
+
+		/* Symbol of each frame, consecutive frames of the same symbol are merged. */
+		size_t id_count = 0;
+		for (size_t i = 0; i < stack->frame_count && i < SMP_MAX_CALL_STACK_DEPTH; i += 1)
+		{
+			record item = {0};
+			item.address = stack->frames[i];
+			record* frame = (record*)ht_get_or_insert(call_stack_frames, &item);
+
+			uint32_t id = get_symbol_id(g, &symbol_slots, &last_stacks, frame->symbol_name);
+			if (id_count == 0 || ids[id_count - 1] != id)
+			{
+				ids[id_count] = id;
+				id_count += 1;
+			}
+		}
+		if (id_count == 0)
+		{
+			continue;
+		}
+
+		g->self_counters.data[ids[0]] += stack->counter;
+
+		for (size_t i = 0; i < id_count; i += 1)
+		{
+			if (last_stacks.data[ids[i]] != stack_index)
+			{
+				last_stacks.data[ids[i]] = stack_index;
+				g->total_counters.data[ids[i]] += stack->counter;
+			}
+		}
+
+		/* Frame i + 1 calls frame i. */
+		for (size_t i = 0; i + 1 < id_count; i += 1)
+		{
+			pair_slot value = {0};
+			value.key = ((uint64_t)ids[i + 1] << 32) | ids[i];
+
+			pair_slot* slot = (pair_slot*)ht_get_or_insert(&pair_slots, &value);
+			if (slot->last_stack != stack_index)
+			{
+				slot->last_stack = stack_index;
+				slot->counter += stack->counter;
+			}
+		}
+	}
+
+	call_pairs pairs;
+	darr_init(&pairs);
+	darr_ensure_space(&pairs, pair_slots.filled_bucket_count);
+
+	ht_cursor_init(&pair_slots, &c);
+	while (ht_cursor_next(&c))
+	{
+		pair_slot* slot = ht_cursor_item(&c);
+
+		call_pair pair;
+		pair.caller = (uint32_t)(slot->key >> 32);
+		pair.callee = (uint32_t)(slot->key & UINT32_MAX);
+		pair.counter = slot->counter;
+		pairs.data[pairs.size++] = pair;
+	}
+
+	call_graph_load_edges(g, &pairs);
+
+	darr_destroy(&pairs);
+	darr_destroy(&last_stacks);
+	ht_destroy(&pair_slots);
+	ht_destroy(&symbol_slots);
+}
+
+void call_graph_load_edges(call_graph* g, call_pairs* pairs)
+{
+	size_t symbol_count = g->symbols.size;
+
+	fill_rows(&g->caller_offsets, &g->callers, pairs, true, symbol_count);
+	fill_rows(&g->callee_offsets, &g->callees, pairs, false, symbol_count);
+}
+
+uint32_t call_graph_find_symbol(call_graph* g, strv name)
+{
+	for (size_t i = 0; i < g->symbols.size; i += 1)
+	{
+		if (strv_equals(g->symbols.data[i], name))
+		{
+			return (uint32_t)i;
+		}
+	}
+	return UINT32_MAX;
+}
+
+void call_graph_print_symbol_to_file(call_graph* g, uint32_t symbol, size_t sample_count, FILE* f)
+{
+	strv name = g->symbols.data[symbol];
+	size_t total = g->total_counters.data[symbol];
+	size_t self = g->self_counters.data[symbol];
+
+	fprintf(f, "Callers of " STRV_FMT ":\n", STRV_ARG(name));
+	print_edges(g, &g->caller_offsets, &g->callers, symbol, sample_count, f);
+
+	fprintf(f, STRV_FMT "\t" "Total: %zu (%.2f)" "\t" "Self: %zu (%.2f)\n",
+		STRV_ARG(name),
+		total, sample_count ? (double)total / (double)sample_count : 0.0,
+		self, sample_count ? (double)self / (double)sample_count : 0.0);
+
+	fprintf(f, "Callees of " STRV_FMT ":\n", STRV_ARG(name));
+	print_edges(g, &g->callee_offsets, &g->callees, symbol, sample_count, f);
+}
+
+static uint32_t get_symbol_id(call_graph* g, ht* slots, call_counters* last_stacks, strv name)
+{
+	symbol_slot value;
+	value.name = name;
+	value.id = (uint32_t)g->symbols.size;
+
+	symbol_slot* slot = (symbol_slot*)ht_get_or_insert(slots, &value);
+	if (slot->id == g->symbols.size)
+	{
+		size_t zero = 0;
+		darr_push_back(&g->symbols, name);
+		darr_push_back(&g->self_counters, zero);
+		darr_push_back(&g->total_counters, zero);
+		darr_push_back(last_stacks, zero);
+	}
+	return slot->id;
+}
+
+/* Counting sort of the edges on the caller or on the callee, then each row is sorted by counter. */
+static void fill_rows(call_offsets* offsets, call_edges* edges, call_pairs* pairs, bool by_callee, size_t symbol_count)
+{
+	darr_clear(offsets);
+	darr_ensure_space(offsets, symbol_count + 1);
+	offsets->size = symbol_count + 1;
+	memset(offsets->data, 0, sizeof(uint32_t) * offsets->size);
+
+	for (size_t i = 0; i < pairs->size; i += 1)
+	{
+		uint32_t row = by_callee ? pairs->data[i].callee : pairs->data[i].caller;
+		offsets->data[row + 1] += 1;
+	}
+	for (size_t i = 0; i < symbol_count; i += 1)
+	{
+		offsets->data[i + 1] += offsets->data[i];
+	}
+
+	darr_clear(edges);
+	darr_ensure_space(edges, pairs->size);
+	edges->size = pairs->size;
+
+	/* Next free slot of each row, it ends at the start of the next row. */
+	call_offsets cursors;
+	darr_init(&cursors);
+	darr_ensure_space(&cursors, symbol_count);
+	memcpy(cursors.data, offsets->data, sizeof(uint32_t) * symbol_count);
+
+	for (size_t i = 0; i < pairs->size; i += 1)
+	{
+		call_pair* pair = &pairs->data[i];
+		uint32_t row = by_callee ? pair->callee : pair->caller;
+
+		call_edge* edge = &edges->data[cursors.data[row]++];
+		edge->symbol = by_callee ? pair->caller : pair->callee;
+		edge->counter = pair->counter;
+	}
+
+	darr_destroy(&cursors);
+
+	for (size_t i = 0; i < symbol_count; i += 1)
+	{
+		uint32_t begin = offsets->data[i];
+		uint32_t end = offsets->data[i + 1];
+		samply_qsort(edges->data + begin, end - begin, sizeof(call_edge), compare_call_edge);
+	}
+}
+
+static void print_edges(call_graph* g, call_offsets* offsets, call_edges* edges, uint32_t symbol, size_t sample_count, FILE* f)
+{
+	for (uint32_t i = offsets->data[symbol]; i < offsets->data[symbol + 1]; i += 1)
+	{
+		call_edge* edge = &edges->data[i];
+		report_print_row_to_file(g->symbols.data[edge->symbol], edge->counter, 0, sample_count, false, f);
+	}
+}
+
+static ht_hash_t symbol_slot_hash(symbol_slot* item)
+{
+	return string_store_interned_hash(item->name);
+}
+
+static bool symbol_slot_are_same(symbol_slot* left, symbol_slot* right)
+{
+	return string_store_interned_equals(left->name, right->name);
+}
+
+static void symbol_slot_swap(symbol_slot* left, symbol_slot* right)
+{
+	symbol_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static ht_hash_t pair_slot_hash(pair_slot* item)
+{
+	uint64_t hash = item->key * 0x9E3779B97F4A7C15ull;
+	return (ht_hash_t)(hash ^ (hash >> 32));
+}
+
+static bool pair_slot_are_same(pair_slot* left, pair_slot* right)
+{
+	return left->key == right->key;
+}
+
+static void pair_slot_swap(pair_slot* left, pair_slot* right)
+{
+	pair_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static int SMP_CDECL compare_call_edge(const call_edge* left, const call_edge* right)
+{
+	if (left->counter < right->counter)
+		return 1;
+	if (left->counter > right->counter)
+		return -1;
+	return 0;
+}
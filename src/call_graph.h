@@ -0,0 +1,89 @@
+#ifndef SAMPLY_CALL_GRAPH_H
+#define SAMPLY_CALL_GRAPH_H
+
+#include "stdio.h"   /* FILE */
+#include "stdint.h"  /* uint32_t */
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+#include "insert_only_ht.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Callers and callees of each symbol, aggregated from the sampled call stacks.
+
+	Edges are stored in compressed sparse rows: the callers of the symbol `id` are
+	callers.data[caller_offsets.data[id]] to callers.data[caller_offsets.data[id + 1]],
+	sorted by counter, biggest first. Same thing for the callees.
+
+	The counter of an edge is the number of samples where the caller calls the callee,
+	a call stack is only counted once per edge even if the edge is repeated by a recursion.
+*/
+
+/* Caller or callee of a symbol. */
+typedef struct call_edge call_edge;
+struct call_edge {
+	uint32_t symbol;
+	size_t counter;
+};
+
+/* Edge from caller to callee, only used to build the graph. */
+typedef struct call_pair call_pair;
+struct call_pair {
+	uint32_t caller;
+	uint32_t callee;
+	size_t counter;
+};
+
+typedef darr(strv) call_symbols;
+typedef darr(size_t) call_counters;
+typedef darr(uint32_t) call_offsets;
+typedef darr(call_edge) call_edges;
+typedef darr(call_pair) call_pairs;
+
+typedef struct call_graph call_graph;
+struct call_graph {
+	/* Name of each symbol id. */
+	call_symbols symbols;
+	/* Samples where the symbol is the sampled function, and samples where it's anywhere in the call stack. */
+	call_counters self_counters;
+	call_counters total_counters;
+
+	/* Symbol count + 1 offsets. */
+	call_offsets caller_offsets;
+	call_edges callers;
+	call_offsets callee_offsets;
+	call_edges callees;
+};
+
+void call_graph_init(call_graph* g);
+void call_graph_destroy(call_graph* g);
+
+/* Reset allocated buffers without deallocating them. */
+void call_graph_clear(call_graph* g);
+
+/* There are no call stacks. */
+bool call_graph_is_empty(call_graph* g);
+
+/* Clear graph and build it from the call stacks of a sampler (see sampler.h).
+   Frames are resolved with the records of call_stack_frames, their names must be interned. */
+void call_graph_load_from_call_stacks(call_graph* g, ht* call_stacks, ht* call_stack_frames);
+
+/* Build the sparse rows from the edges. Symbols and their counters must already be set. */
+void call_graph_load_edges(call_graph* g, call_pairs* pairs);
+
+/* Symbol id of name, or UINT32_MAX if the symbol is not in any call stack. */
+uint32_t call_graph_find_symbol(call_graph* g, strv name);
+
+/* Print callers, the symbol and its callees, with the percentage of sample_count. */
+void call_graph_print_symbol_to_file(call_graph* g, uint32_t symbol, size_t sample_count, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_CALL_GRAPH_H */
@@ -0,0 +1,476 @@
+#include "capture.h"
+
+#include <stdio.h> /* FILE */
+
+#include "samply.h"
+#include "utils/file_mapper.h"
+#include "utils/log.h"
+
+static char magic1_samp[4] = { 's', 'a', 'm', 'p' };
+static char magic2_capt[4] = { 'c', 'a', 'p', 't' };
+static uint64_t zero = 0;
+
+/*
+
+Capture Binary Format:
+
+header	   |--------------------------|
+		   | 1) magic number 1        | b8 x 4  | 's' 'a' 'm' 'p'
+		   | 2) magic number 2        | b8 x 4  | 'c' 'a' 'p' 't'
+		   | 3) zero                  | uint64
+		   | 4) version number        | uint64
+		   | 5) version info          | b8 x 32 | // null-terminated string of 32 byte (which include the null-terminated char).
+		   | 6) total sampling count  | uint64
+		   | 7) module count          | uint64
+		   | 8) address count         | uint64
+module 0..N| -------------------
+		   | 1) base address          | uint64
+		   | 2) image size            | uint64
+		   | 3) build id size         | uint64
+		   | 4) build id data         | ...
+		   | 5) path size             | uint64
+		   | 6) path data             | ...
+address 0..N| -------------------
+		   | 1) address               | uint64
+		   | 2) sampling count        | uint64
+*/
+
+typedef struct capture_binary_header_v1 capture_binary_header_v1;
+struct capture_binary_header_v1 {
+	char magic1[4];
+	char magic2[4];
+	uint64_t zero;
+	uint64_t version_number;
+	char version_text[32];
+	uint64_t total_sampling_count;
+	uint64_t module_count;
+	uint64_t address_count;
+};
+
+static int compare_sample_by_address(const capture_sample* left, const capture_sample* right);
+
+static bool find_local_module(capture_module* module, strv search_path, file_mapper* fm, char* buffer, size_t buffer_size, strv* local_path);
+static bool is_matching_module(capture_module* module, file_mapper* fm, strv filepath, bool* mismatch);
+static strv path_last_segment(strv path);
+
+static void write_uint64(FILE* f, uint64_t value);
+static bool read_uint64(FILE* f, uint64_t* v);
+static void write_bytes(FILE* f, strv str);
+static bool read_bytes(FILE* f, re_arena* a, strv* str);
+
+void capture_init(capture* c)
+{
+	memset(c, 0, sizeof(capture));
+
+	darr_init(&c->modules);
+	darr_init(&c->samples);
+
+	size_t min_chunk_capacity = 4 * 1024;
+	re_arena_init(&c->arena, min_chunk_capacity);
+}
+
+void capture_destroy(capture* c)
+{
+	darr_destroy(&c->modules);
+	darr_destroy(&c->samples);
+
+	re_arena_destroy(&c->arena);
+}
+
+void capture_clear(capture* c)
+{
+	c->sample_count = 0;
+
+	darr_clear(&c->modules);
+	darr_clear(&c->samples);
+
+	re_arena_clear(&c->arena);
+}
+
+void capture_load_from_sampler(capture* c, sampler* s)
+{
+	capture_clear(c);
+
+	c->sample_count = s->sample_count;
+
+	ht_cursor cursor;
+	ht_cursor_init(&s->results, &cursor);
+
+	while (ht_cursor_next(&cursor))
+	{
+		record* item = ht_cursor_item(&cursor);
+
+		capture_sample sample;
+		sample.address = item->address;
+		sample.counter = item->counter;
+		darr_push_back(&c->samples, sample);
+	}
+
+	samply_qsort(c->samples.data, c->samples.size, sizeof(capture_sample), compare_sample_by_address);
+
+	/* Modules and samples are both sorted, only keep the modules containing at least one sample. */
+	file_mapper fm;
+	file_mapper_init(&fm);
+
+	symbol_modules* modules = &s->mgr.modules;
+	size_t sample_index = 0;
+
+	for (size_t i = 0; i < modules->size && sample_index < c->samples.size; i += 1)
+	{
+		symbol_module* m = &modules->data[i];
+
+		while (sample_index < c->samples.size && c->samples.data[sample_index].address < m->base)
+		{
+			sample_index += 1;
+		}
+
+		if (sample_index < c->samples.size && c->samples.data[sample_index].address < m->base + m->size)
+		{
+			capture_module module = { 0 };
+			module.base = m->base;
+			module.size = m->size;
+			module.path = m->path;
+
+			if (!capture_read_build_id(&fm, m->path, &module.build_id))
+			{
+				log_warning("No build id found for module: " STRV_FMT, STRV_ARG(m->path));
+			}
+
+			darr_push_back(&c->modules, module);
+		}
+	}
+
+	file_mapper_destroy(&fm);
+}
+
+bool capture_save_to_filepath(capture* c, const char* filepath)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not save to file '%s'", filepath);
+		return false;
+	}
+
+	capture_binary_header_v1 header =
+	{
+		.zero = zero,
+		.version_number = SMP_CAPTURE_VERSION_NUMBER,
+		.version_text = { SMP_CAPTURE_VERSION_TEXT },
+		.total_sampling_count = c->sample_count,
+		.module_count = c->modules.size,
+		.address_count = c->samples.size
+	};
+	memcpy(&header.magic1, &magic1_samp, sizeof(magic1_samp));
+	memcpy(&header.magic2, &magic2_capt, sizeof(magic2_capt));
+
+	fwrite(&header, sizeof(capture_binary_header_v1), 1, f);
+
+	for (size_t i = 0; i < c->modules.size; i += 1)
+	{
+		capture_module* module = &c->modules.data[i];
+		/* 1) base address */
+		write_uint64(f, module->base);
+		/* 2) image size */
+		write_uint64(f, module->size);
+		/* 3) build id size */
+		/* 4) build id data */
+		write_bytes(f, strv_make_from((const char*)module->build_id.bytes, module->build_id.size));
+		/* 5) path size */
+		/* 6) path data */
+		write_bytes(f, module->path);
+	}
+
+	for (size_t i = 0; i < c->samples.size; i += 1)
+	{
+		/* 1) address */
+		write_uint64(f, c->samples.data[i].address);
+		/* 2) sampling count */
+		write_uint64(f, c->samples.data[i].counter);
+	}
+
+	bool success = fclose(f) == 0;
+	return success;
+}
+
+bool capture_load_from_filepath(capture* c, const char* filepath)
+{
+	capture_clear(c);
+
+	FILE* f = fopen(filepath, "rb");
+	if (!f)
+	{
+		log_error("Could not open file '%s'", filepath);
+		return false;
+	}
+
+	capture_binary_header_v1 header;
+	bool success = fread(&header, sizeof(capture_binary_header_v1), 1, f) == 1
+		&& memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) == 0
+		&& memcmp(&header.magic2, &magic2_capt, sizeof(header.magic2)) == 0
+		&& header.zero == zero
+		&& header.version_number == SMP_CAPTURE_VERSION_NUMBER;
+
+	if (!success)
+	{
+		log_error("Invalid capture file '%s'", filepath);
+	}
+
+	c->sample_count = header.total_sampling_count;
+
+	for (uint64_t i = 0; success && i < header.module_count; i += 1)
+	{
+		capture_module module = { 0 };
+		uint64_t base;
+		uint64_t size;
+		strv id;
+
+		success = read_uint64(f, &base)
+			&& read_uint64(f, &size)
+			&& read_bytes(f, &c->arena, &id)
+			&& id.size <= SMP_BUILD_ID_MAX_SIZE
+			&& read_bytes(f, &c->arena, &module.path);
+
+		if (success)
+		{
+			module.base = base;
+			module.size = (size_t)size;
+			memcpy(module.build_id.bytes, id.data, id.size);
+			module.build_id.size = (uint32_t)id.size;
+			darr_push_back(&c->modules, module);
+		}
+	}
+
+	for (uint64_t i = 0; success && i < header.address_count; i += 1)
+	{
+		uint64_t addr;
+		uint64_t counter;
+
+		success = read_uint64(f, &addr)
+			&& read_uint64(f, &counter);
+
+		if (success)
+		{
+			capture_sample sample;
+			sample.address = addr;
+			sample.counter = (size_t)counter;
+			darr_push_back(&c->samples, sample);
+		}
+	}
+
+	if (!success)
+	{
+		log_error("Could not read capture file '%s'", filepath);
+	}
+
+	fclose(f);
+	return success;
+}
+
+bool capture_symbolize(capture* c, symbol_manager* m, strv search_path, report* r)
+{
+	if (!symbol_manager_load_offline(m, search_path))
+	{
+		return false;
+	}
+
+	/* Register the local binaries matching the captured modules. */
+	{
+		file_mapper fm;
+		file_mapper_init(&fm);
+
+		char buffer[SMP_MAX_PATH_BYTE_BUFFER_SIZE];
+
+		for (size_t i = 0; i < c->modules.size; i += 1)
+		{
+			capture_module* module = &c->modules.data[i];
+			strv local_path;
+
+			if (find_local_module(module, search_path, &fm, buffer, sizeof(buffer), &local_path))
+			{
+				symbol_manager_add_module(m, module->base, module->size, local_path);
+			}
+		}
+
+		file_mapper_destroy(&fm);
+	}
+
+	ht results;
+	records_by_address_init(&results, c->samples.size);
+
+	for (size_t i = 0; i < c->samples.size; i += 1)
+	{
+		capture_sample* sample = &c->samples.data[i];
+
+		record item = { 0 };
+		item.address = sample->address;
+
+		record* inserted = (record*)ht_get_or_insert(&results, &item);
+		inserted->counter += sample->counter;
+
+		symbol_location location;
+		symbol_manager_resolve(m, sample->address, &location);
+
+		inserted->symbol_name = location.symbol_name;
+		inserted->module_name = location.module_name;
+		inserted->source_file = location.source_file;
+		inserted->line_number = location.line_number;
+		inserted->function_start = location.function_start;
+		inserted->function_end = location.function_end;
+	}
+
+	report_load_from_records(r, &results, c->sample_count);
+
+	ht_destroy(&results);
+
+	symbol_manager_unload(m);
+
+	return true;
+}
+
+static int SMP_CDECL compare_sample_by_address(const capture_sample* left, const capture_sample* right)
+{
+	if (left->address < right->address)
+		return -1;
+	if (left->address > right->address)
+		return 1;
+	return 0;
+}
+
+bool capture_read_build_id(file_mapper* fm, strv filepath, build_id* id)
+{
+	readonly_file file;
+	if (!file_mapper_open(fm, &file, filepath))
+	{
+		return false;
+	}
+
+	pe_file pe;
+	bool found = pe_file_init(&pe, file.view)
+		&& pe_file_get_build_id(&pe, id);
+
+	file_mapper_close(fm, &file);
+
+	return found;
+}
+
+/* Search binary with the same build id at the original path, then in each directory of the search path. */
+static bool find_local_module(capture_module* module, strv search_path, file_mapper* fm, char* buffer, size_t buffer_size, strv* local_path)
+{
+	bool mismatch = false;
+
+	snprintf(buffer, buffer_size, STRV_FMT, STRV_ARG(module->path));
+	if (is_matching_module(module, fm, strv_make_from_str(buffer), &mismatch))
+	{
+		*local_path = strv_make_from_str(buffer);
+		return true;
+	}
+
+	strv name = path_last_segment(module->path);
+	strv remaining = search_path;
+
+	while (remaining.size)
+	{
+		size_t separator = strv_find_char(remaining, ';');
+		strv directory = separator == STRV_NPOS
+			? remaining
+			: strv_make_from(remaining.data, separator);
+
+		remaining = separator == STRV_NPOS
+			? strv_make()
+			: strv_remove_left(remaining, separator + 1);
+
+		if (directory.size == 0)
+		{
+			continue;
+		}
+
+		snprintf(buffer, buffer_size, STRV_FMT "/" STRV_FMT, STRV_ARG(directory), STRV_ARG(name));
+		if (is_matching_module(module, fm, strv_make_from_str(buffer), &mismatch))
+		{
+			*local_path = strv_make_from_str(buffer);
+			return true;
+		}
+	}
+
+	if (mismatch)
+	{
+		log_warning("Build id mismatch, symbols of '" STRV_FMT "' are ignored.", STRV_ARG(module->path));
+	}
+	else
+	{
+		log_warning("Module not found: " STRV_FMT, STRV_ARG(module->path));
+	}
+
+	return false;
+}
+
+static bool is_matching_module(capture_module* module, file_mapper* fm, strv filepath, bool* mismatch)
+{
+	/* Check existence first to avoid logging an error for each candidate. */
+	FILE* f = fopen(filepath.data, "rb");
+	if (!f)
+	{
+		return false;
+	}
+	fclose(f);
+
+	/* Module captured without build id, there is nothing to check. */
+	if (module->build_id.size == 0)
+	{
+		return true;
+	}
+
+	build_id id;
+	if (capture_read_build_id(fm, filepath, &id) && build_id_equals(&id, &module->build_id))
+	{
+		return true;
+	}
+
+	*mismatch = true;
+	return false;
+}
+
+static strv path_last_segment(strv path)
+{
+	size_t last_separator = strv_find_last_of_chars(path, (strv)STRV("\\/"));
+	return last_separator == STRV_NPOS
+		? path
+		: strv_substr_from(path, last_separator + 1, path.size - (last_separator + 1));
+}
+
+static void write_uint64(FILE* f, uint64_t value)
+{
+	fwrite(&value, sizeof(uint64_t), 1, f);
+}
+
+static bool read_uint64(FILE* f, uint64_t* v)
+{
+	return fread(v, sizeof(uint64_t), 1, f) == 1;
+}
+
+static void write_bytes(FILE* f, strv str)
+{
+	/* Write size first */
+	write_uint64(f, str.size);
+	/* Then write data. */
+	fwrite(str.data, str.size, 1, f);
+}
+
+static bool read_bytes(FILE* f, re_arena* a, strv* str)
+{
+	uint64_t size;
+	if (!read_uint64(f, &size))
+	{
+		return false;
+	}
+
+	void* mem = re_arena_alloc(a, (size_t)size);
+	if (size && fread(mem, (size_t)size, 1, f) != 1)
+	{
+		return false;
+	}
+
+	*str = strv_make_from(mem, (size_t)size);
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef SAMPLY_CAPTURE_H
+#define SAMPLY_CAPTURE_H
+
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+#include "arena_alloc.h"
+#include "utils/pe_file.h" /* build_id */
+#include "utils/file_mapper.h"
+
+#include "sampler.h"
+#include "report.h"
+#include "symbol_manager.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Raw capture: sampled addresses with their counter and the map of the modules.
+	Capturing does not load any symbol, so it stays cheap on the sampled machine.
+	Addresses are symbolized later, on a machine which has the binaries and the debug information.
+*/
+
+typedef struct capture_module capture_module;
+struct capture_module {
+	address base;      /* Load address of the module. */
+	size_t size;       /* Size of the mapped image. */
+	strv path;         /* Path of the module on the captured machine. */
+	build_id build_id; /* To make sure the binary used to symbolize is the one that was sampled. */
+};
+
+typedef struct capture_sample capture_sample;
+struct capture_sample {
+	address address;
+	size_t counter;
+};
+
+typedef darr(capture_module) capture_modules;
+typedef darr(capture_sample) capture_samples;
+
+typedef struct capture capture;
+struct capture {
+	size_t sample_count;
+
+	/* Modules containing at least one sampled address, sorted by base address. */
+	capture_modules modules;
+	/* Samples sorted by address. */
+	capture_samples samples;
+
+	/* Arena to allocate strings loaded from a file. */
+	re_arena arena;
+};
+
+void capture_init(capture* c);
+void capture_destroy(capture* c);
+
+/* Reset allocated buffers without deallocating them. */
+void capture_clear(capture* c);
+
+/* Clear capture and load addresses and modules from sampler. */
+void capture_load_from_sampler(capture* c, sampler* s);
+
+/* Save capture to filepath. */
+bool capture_save_to_filepath(capture* c, const char* filepath);
+
+/* Clear capture and load from filepath. */
+bool capture_load_from_filepath(capture* c, const char* filepath);
+
+/* Resolve addresses with the binaries and debug information found on this machine, then load the report.
+   Binaries are searched at their original path, then in each directory of the semicolon-separated search path.
+   The search path is also used to find the debug information. */
+bool capture_symbolize(capture* c, symbol_manager* m, strv search_path, report* r);
+
+/* Read the build id of the module image at filepath. */
+bool capture_read_build_id(file_mapper* fm, strv filepath, build_id* id);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_CAPTURE_H */
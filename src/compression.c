@@ -0,0 +1,387 @@
+#include "compression.h"
+
+#include "string.h" /* memset, memcpy */
+
+/* Shortest match, shorter ones are written as literals. */
+#define COMPRESSION_MIN_MATCH (4)
+/* Farthest match, offsets are written on 2 bytes. */
+#define COMPRESSION_MAX_OFFSET (65535)
+/* The hash table of the compressor has 2^COMPRESSION_HASH_BITS positions. */
+#define COMPRESSION_HASH_BITS (14)
+/* After 2^COMPRESSION_SKIP_SHIFT positions without match, the compressor looks at every other position, and so on. */
+#define COMPRESSION_SKIP_SHIFT (6)
+/* Size of the header of the compressed blocks, without the stored sizes. */
+#define COMPRESSION_HEADER_SIZE (16)
+
+static uint8_t* write_length(uint8_t* out, size_t length);
+static bool read_length(const uint8_t** cursor, const uint8_t* end, size_t* length);
+static uint8_t* write_sequence(uint8_t* out, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length);
+static uint8_t* write_last_literals(uint8_t* out, const uint8_t* literals, size_t literal_count);
+static uint32_t read_uint32(const uint8_t* p);
+static uint32_t hash_uint32(uint32_t v);
+
+void compression_compress(const void* data, size_t size, compressed_bytes* out)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t uncompressed_size = size;
+	uint64_t block_count = (size + SMP_COMPRESSION_BLOCK_SIZE - 1) / SMP_COMPRESSION_BLOCK_SIZE;
+
+	/* The stored sizes are filled while the blocks are written, the array can move. */
+	size_t header_offset = out->size;
+	size_t header_size = COMPRESSION_HEADER_SIZE + (size_t)block_count * sizeof(uint32_t);
+	darr_ensure_space(out, header_size);
+	memcpy(out->data + out->size, &uncompressed_size, sizeof(uint64_t));
+	memcpy(out->data + out->size + sizeof(uint64_t), &block_count, sizeof(uint64_t));
+	out->size += header_size;
+
+	for (uint64_t i = 0; i < block_count; i += 1)
+	{
+		size_t offset = (size_t)i * SMP_COMPRESSION_BLOCK_SIZE;
+		size_t block_size = size - offset < SMP_COMPRESSION_BLOCK_SIZE ? size - offset : SMP_COMPRESSION_BLOCK_SIZE;
+
+		darr_ensure_space(out, compression_block_bound(block_size));
+
+		uint32_t stored_size = (uint32_t)compression_compress_block(bytes + offset, block_size, out->data + out->size);
+		if (stored_size >= block_size)
+		{
+			memcpy(out->data + out->size, bytes + offset, block_size);
+			stored_size = (uint32_t)block_size;
+		}
+		out->size += stored_size;
+
+		memcpy(out->data + header_offset + COMPRESSION_HEADER_SIZE + i * sizeof(uint32_t), &stored_size, sizeof(uint32_t));
+	}
+}
+
+bool compression_open(compressed_blocks* b, strv compressed)
+{
+	const uint8_t* data = (const uint8_t*)compressed.data;
+	if (compressed.size < COMPRESSION_HEADER_SIZE)
+	{
+		return false;
+	}
+
+	memcpy(&b->uncompressed_size, data, sizeof(uint64_t));
+	memcpy(&b->block_count, data + sizeof(uint64_t), sizeof(uint64_t));
+
+	uint64_t expected_block_count = b->uncompressed_size / SMP_COMPRESSION_BLOCK_SIZE
+		+ (b->uncompressed_size % SMP_COMPRESSION_BLOCK_SIZE ? 1 : 0);
+
+	if (b->block_count != expected_block_count
+		|| b->block_count > (compressed.size - COMPRESSION_HEADER_SIZE) / sizeof(uint32_t))
+	{
+		return false;
+	}
+
+	b->stored_sizes = data + COMPRESSION_HEADER_SIZE;
+	b->blocks = b->stored_sizes + b->block_count * sizeof(uint32_t);
+	b->end = data + compressed.size;
+
+	return true;
+}
+
+bool compression_decompress(compressed_blocks* b, void* out)
+{
+	return compression_decompress_blocks(b, 0, b->block_count, out);
+}
+
+bool compression_decompress_blocks(compressed_blocks* b, uint64_t first_block, uint64_t block_count, void* out)
+{
+	uint8_t* bytes = (uint8_t*)out;
+	const uint8_t* block = b->blocks;
+
+	if (first_block > b->block_count || block_count > b->block_count - first_block)
+	{
+		return false;
+	}
+
+	/* Blocks have different stored sizes, the previous ones are skipped. */
+	uint64_t skipped = 0;
+	for (uint64_t i = 0; i < first_block; i += 1)
+	{
+		skipped += read_uint32(b->stored_sizes + i * sizeof(uint32_t));
+	}
+	if (skipped > (uint64_t)(b->end - block))
+	{
+		return false;
+	}
+	block += skipped;
+
+	for (uint64_t i = first_block; i < first_block + block_count; i += 1)
+	{
+		uint64_t offset = i * SMP_COMPRESSION_BLOCK_SIZE;
+		size_t block_size = (size_t)(b->uncompressed_size - offset < SMP_COMPRESSION_BLOCK_SIZE ? b->uncompressed_size - offset : SMP_COMPRESSION_BLOCK_SIZE);
+
+		uint32_t stored_size = read_uint32(b->stored_sizes + i * sizeof(uint32_t));
+		if (stored_size > (size_t)(b->end - block))
+		{
+			return false;
+		}
+
+		if (stored_size == block_size)
+		{
+			memcpy(bytes + offset, block, block_size);
+		}
+		else if (!compression_decompress_block(block, stored_size, bytes + offset, block_size))
+		{
+			return false;
+		}
+
+		block += stored_size;
+	}
+
+	return true;
+}
+
+bool compression_decompress_range(compressed_blocks* b, uint64_t offset, size_t size, void* out)
+{
+	if (offset > b->uncompressed_size || size > b->uncompressed_size - offset)
+	{
+		return false;
+	}
+
+	/* Blocks are partly copied from this buffer. */
+	uint8_t buffer[SMP_COMPRESSION_BLOCK_SIZE];
+
+	uint8_t* bytes = (uint8_t*)out;
+	const uint8_t* block = b->blocks;
+	uint64_t end = offset + size;
+
+	for (uint64_t i = 0; i < b->block_count; i += 1)
+	{
+		uint64_t block_offset = i * SMP_COMPRESSION_BLOCK_SIZE;
+		if (block_offset >= end)
+		{
+			break;
+		}
+		size_t block_size = (size_t)(b->uncompressed_size - block_offset < SMP_COMPRESSION_BLOCK_SIZE ? b->uncompressed_size - block_offset : SMP_COMPRESSION_BLOCK_SIZE);
+
+		uint32_t stored_size = read_uint32(b->stored_sizes + i * sizeof(uint32_t));
+		if (stored_size > (size_t)(b->end - block))
+		{
+			return false;
+		}
+
+		/* Blocks before the range are only skipped. */
+		if (block_offset + block_size > offset)
+		{
+			const uint8_t* data = block;
+			if (stored_size != block_size)
+			{
+				if (!compression_decompress_block(block, stored_size, buffer, block_size))
+				{
+					return false;
+				}
+				data = buffer;
+			}
+
+			uint64_t first = offset > block_offset ? offset : block_offset;
+			uint64_t last = end < block_offset + block_size ? end : block_offset + block_size;
+			memcpy(bytes + (first - offset), data + (first - block_offset), (size_t)(last - first));
+		}
+
+		block += stored_size;
+	}
+
+	return true;
+}
+
+size_t compression_block_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+/* Greedy parsing: each position is looked up in a hash table of the previous positions,
+   the first match found is extended as far as possible. */
+size_t compression_compress_block(const uint8_t* data, size_t size, uint8_t* out)
+{
+	/* Positions fit in 16 bits, a position of the table is only used if the bytes match. */
+	uint16_t table[1 << COMPRESSION_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	uint8_t* cursor = out;
+	size_t anchor = 0;
+	size_t i = 1;
+	size_t miss_count = 0;
+
+	while (i + COMPRESSION_MIN_MATCH <= size)
+	{
+		uint32_t v = read_uint32(data + i);
+		uint32_t h = hash_uint32(v);
+		size_t candidate = table[h];
+		table[h] = (uint16_t)i;
+
+		if (i - candidate > COMPRESSION_MAX_OFFSET || read_uint32(data + candidate) != v)
+		{
+			/* Incompressible data is skipped faster and faster. */
+			i += 1 + (miss_count >> COMPRESSION_SKIP_SHIFT);
+			miss_count += 1;
+			continue;
+		}
+
+		size_t length = COMPRESSION_MIN_MATCH;
+		while (i + length < size && data[candidate + length] == data[i + length])
+		{
+			length += 1;
+		}
+
+		cursor = write_sequence(cursor, data + anchor, i - anchor, i - candidate, length);
+
+		i += length;
+		anchor = i;
+		miss_count = 0;
+	}
+
+	cursor = write_last_literals(cursor, data + anchor, size - anchor);
+
+	return (size_t)(cursor - out);
+}
+
+bool compression_decompress_block(const uint8_t* data, size_t data_size, uint8_t* out, size_t size)
+{
+	const uint8_t* cursor = data;
+	const uint8_t* end = data + data_size;
+	uint8_t* target = out;
+	uint8_t* target_end = out + size;
+
+	for (;;)
+	{
+		if (cursor >= end)
+		{
+			return false;
+		}
+		uint8_t token = *cursor++;
+
+		size_t literal_count = token >> 4;
+		if (literal_count == 15 && !read_length(&cursor, end, &literal_count))
+		{
+			return false;
+		}
+		if (literal_count > (size_t)(end - cursor) || literal_count > (size_t)(target_end - target))
+		{
+			return false;
+		}
+		memcpy(target, cursor, literal_count);
+		cursor += literal_count;
+		target += literal_count;
+
+		/* The last sequence only has literals. */
+		if (cursor == end)
+		{
+			return target == target_end;
+		}
+
+		if (end - cursor < 2)
+		{
+			return false;
+		}
+		size_t offset = (size_t)cursor[0] | ((size_t)cursor[1] << 8);
+		cursor += 2;
+
+		size_t length = token & 15;
+		if (length == 15 && !read_length(&cursor, end, &length))
+		{
+			return false;
+		}
+		length += COMPRESSION_MIN_MATCH;
+
+		if (offset == 0 || offset > (size_t)(target - out) || length > (size_t)(target_end - target))
+		{
+			return false;
+		}
+
+		/* Overlapping matches repeat the last bytes, they are copied one by one. */
+		const uint8_t* match = target - offset;
+		if (offset >= length)
+		{
+			memcpy(target, match, length);
+			target += length;
+		}
+		else
+		{
+			for (size_t i = 0; i < length; i += 1)
+			{
+				*target++ = *match++;
+			}
+		}
+	}
+}
+
+static uint8_t* write_length(uint8_t* out, size_t length)
+{
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = (uint8_t)length;
+	return out;
+}
+
+static bool read_length(const uint8_t** cursor, const uint8_t* end, size_t* length)
+{
+	uint8_t byte;
+	do
+	{
+		if (*cursor >= end)
+		{
+			return false;
+		}
+		byte = *(*cursor)++;
+		*length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+static uint8_t* write_sequence(uint8_t* out, const uint8_t* literals, size_t literal_count, size_t offset, size_t match_length)
+{
+	size_t length = match_length - COMPRESSION_MIN_MATCH;
+
+	*out++ = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) | (length < 15 ? length : 15));
+	if (literal_count >= 15)
+	{
+		out = write_length(out, literal_count - 15);
+	}
+
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+
+	*out++ = (uint8_t)offset;
+	*out++ = (uint8_t)(offset >> 8);
+
+	if (length >= 15)
+	{
+		out = write_length(out, length - 15);
+	}
+	return out;
+}
+
+static uint8_t* write_last_literals(uint8_t* out, const uint8_t* literals, size_t literal_count)
+{
+	*out++ = (uint8_t)((literal_count < 15 ? literal_count : 15) << 4);
+	if (literal_count >= 15)
+	{
+		out = write_length(out, literal_count - 15);
+	}
+
+	if (literal_count)
+	{
+		memcpy(out, literals, literal_count);
+		out += literal_count;
+	}
+	return out;
+}
+
+static uint32_t read_uint32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(uint32_t));
+	return v;
+}
+
+/* Multiplicative hash, the high bits are the most mixed. */
+static uint32_t hash_uint32(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - COMPRESSION_HASH_BITS);
+}
@@ -0,0 +1,83 @@
+#ifndef SAMPLY_COMPRESSION_H
+#define SAMPLY_COMPRESSION_H
+
+#include "stdint.h"  /* uint8_t */
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Block compression of the saved files (see report.c and sample_log.c), without external library.
+
+	Data is cut in blocks of SMP_COMPRESSION_BLOCK_SIZE bytes, each block is compressed on its own
+	so any block can be decompressed without the others, in any order or from several threads.
+	A block which does not get smaller is stored as it is.
+
+Compressed Blocks Format:
+
+header	   |--------------------------|
+		   | 1) uncompressed size     | uint64
+		   | 2) block count           | uint64
+		   | 3) stored size           | uint32 x block count | // Equal to the uncompressed size of the block if it's stored as it is.
+blocks	   | -------------------
+		   | block 0..N               | ...
+
+	Blocks are LZ77 sequences, like LZ4: a token byte with the literal count in the high 4 bits
+	and the match length minus 4 in the low 4 bits, the literal count continued by bytes of 255 when it's 15,
+	the literals, then the match offset on 2 bytes, little-endian, and the match length continued the same way.
+	The last sequence of a block only has literals.
+*/
+
+/* Uncompressed size of a block, all blocks have this size except the last one. Matches never go back further. */
+#define SMP_COMPRESSION_BLOCK_SIZE (64 * 1024)
+
+typedef darr(uint8_t) compressed_bytes;
+
+/* Blocks of compressed data, pointing into the compressed bytes. */
+typedef struct compressed_blocks compressed_blocks;
+struct compressed_blocks {
+	uint64_t uncompressed_size;
+	uint64_t block_count;
+	const uint8_t* stored_sizes; /* uint32 x block count, not aligned. */
+	const uint8_t* blocks;
+	const uint8_t* end;
+};
+
+/* Append the compressed blocks of data to out. */
+void compression_compress(const void* data, size_t size, compressed_bytes* out);
+
+/* Read the header of compressed blocks. Returns false if it's truncated. */
+bool compression_open(compressed_blocks* b, strv compressed);
+
+/* Decompress all the blocks to out, which must have room for the uncompressed size.
+   Returns false if the data is corrupted. */
+bool compression_decompress(compressed_blocks* b, void* out);
+
+/* Decompress block_count blocks starting at first_block to their place in out, which must have room for the uncompressed size.
+   Blocks are independent, different blocks can be decompressed by different threads. Returns false if the data is corrupted. */
+bool compression_decompress_blocks(compressed_blocks* b, uint64_t first_block, uint64_t block_count, void* out);
+
+/* Decompress size bytes of the uncompressed data starting at offset, only the blocks containing them are decompressed.
+   Returns false if the range is out of bounds or if the data is corrupted. */
+bool compression_decompress_range(compressed_blocks* b, uint64_t offset, size_t size, void* out);
+
+/* Compress one block of at most SMP_COMPRESSION_BLOCK_SIZE bytes, out must have room for compression_block_bound(size) bytes.
+   Returns the compressed size. */
+size_t compression_compress_block(const uint8_t* data, size_t size, uint8_t* out);
+
+/* Largest compressed size of a block of size bytes. */
+size_t compression_block_bound(size_t size);
+
+/* Decompress one block, it must expand to exactly size bytes. Returns false if the data is corrupted. */
+bool compression_decompress_block(const uint8_t* data, size_t data_size, uint8_t* out, size_t size);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_COMPRESSION_H */
@@ -0,0 +1,286 @@
+#include "function_view.h"
+
+#include "string.h" /* memset, memcpy */
+
+#include "samply.h"
+#include "report.h"
+#include "symbol_manager.h"
+#include "utils/file_mapper.h"
+#include "utils/pe_file.h"
+#include "utils/log.h"
+
+static void decode_instructions(function_view* v, instruction_rows* sampled, strv code);
+static bool map_function_code(function_view* v, symbol_module* module, file_mapper* fm, readonly_file* file, strv* code);
+static void push_row(instruction_rows* rows, address addr, size_t counter);
+static int compare_row_by_address(const instruction_row* left, const instruction_row* right);
+
+void function_view_init(function_view* v)
+{
+	memset(v, 0, sizeof(function_view));
+
+	darr_init(&v->rows);
+}
+
+void function_view_destroy(function_view* v)
+{
+	darr_destroy(&v->rows);
+}
+
+void function_view_clear(function_view* v)
+{
+	v->symbol_name = strv_make();
+	v->module_name = strv_make();
+	v->start = 0;
+	v->end = 0;
+	v->counter = 0;
+	v->max_counter = 0;
+	v->has_code = false;
+	darr_clear(&v->rows);
+}
+
+bool function_view_load(function_view* v, report* r, strv symbol_name, symbol_manager* m)
+{
+	function_view_clear(v);
+
+	v->symbol_name = symbol_name;
+
+	/* The most sampled address gives the module and the function. */
+	record* hottest = NULL;
+	for (size_t i = 0; i < r->records.size; i += 1)
+	{
+		record* item = &r->records.data[i];
+		if (strv_equals(item->symbol_name, symbol_name)
+			&& (!hottest || item->counter > hottest->counter))
+		{
+			hottest = item;
+		}
+	}
+
+	if (!hottest)
+	{
+		return false;
+	}
+
+	v->module_name = hottest->module_name;
+	bool has_range = hottest->function_end > hottest->function_start;
+	if (has_range)
+	{
+		v->start = hottest->function_start;
+		v->end = hottest->function_end;
+	}
+
+	/* Sampled addresses of the function. */
+	instruction_rows sampled;
+	darr_init(&sampled);
+
+	address min_address = 0;
+	address max_address = 0;
+
+	for (size_t i = 0; i < r->records.size; i += 1)
+	{
+		record* item = &r->records.data[i];
+		if (!strv_equals(item->symbol_name, symbol_name)
+			|| !strv_equals(item->module_name, v->module_name)
+			|| (has_range && (item->address < v->start || item->address >= v->end)))
+		{
+			continue;
+		}
+
+		if (sampled.size == 0 || item->address < min_address)
+		{
+			min_address = item->address;
+		}
+		if (sampled.size == 0 || item->address > max_address)
+		{
+			max_address = item->address;
+		}
+
+		push_row(&sampled, item->address, item->counter);
+		v->counter += item->counter;
+	}
+
+	/* Unknown function range. */
+	if (!has_range)
+	{
+		v->start = min_address;
+		v->end = max_address + 1;
+	}
+
+	/* Offsets of the rows are 32 bits, and the range is decoded. */
+	if (v->end - v->start > SMP_FUNCTION_VIEW_MAX_SIZE)
+	{
+		log_warning("Addresses of '" STRV_FMT "' span %llu bytes, it's likely several functions with the same name.",
+			STRV_ARG(symbol_name), (unsigned long long)(v->end - v->start));
+		darr_destroy(&sampled);
+		function_view_clear(v);
+		return false;
+	}
+
+	samply_qsort(sampled.data, sampled.size, sizeof(instruction_row), compare_row_by_address);
+
+	symbol_module* module = m ? symbol_manager_find_module(m, v->start) : NULL;
+
+	file_mapper fm;
+	file_mapper_init(&fm);
+
+	readonly_file file;
+	readonly_file_init(&file);
+
+	strv code;
+	if (module && map_function_code(v, module, &fm, &file, &code))
+	{
+		decode_instructions(v, &sampled, code);
+		v->has_code = true;
+	}
+	else
+	{
+		darr_ensure_space(&v->rows, sampled.size);
+		memcpy(v->rows.data, sampled.data, sizeof(instruction_row) * sampled.size);
+		v->rows.size = sampled.size;
+	}
+
+	if (readonly_file_is_opened(&file))
+	{
+		file_mapper_close(&fm, &file);
+	}
+	file_mapper_destroy(&fm);
+	darr_destroy(&sampled);
+
+	for (size_t i = 0; i < v->rows.size; i += 1)
+	{
+		instruction_row* row = &v->rows.data[i];
+		row->offset = (uint32_t)(row->address - v->start);
+		if (row->counter > v->max_counter)
+		{
+			v->max_counter = row->counter;
+		}
+	}
+
+	return true;
+}
+
+void function_view_print_to_file(function_view* v, FILE* f)
+{
+	fprintf(f, "Instructions of " STRV_FMT " [0x%llx, 0x%llx): %zu samples%s\n",
+		STRV_ARG(v->symbol_name),
+		(unsigned long long)v->start,
+		(unsigned long long)v->end,
+		v->counter,
+		v->has_code ? "" : " (module not available, only sampled addresses are listed)");
+
+	for (size_t i = 0; i < v->rows.size; i += 1)
+	{
+		instruction_row* row = &v->rows.data[i];
+
+		/* Up to 15 bytes, 3 characters each. */
+		char bytes[SMP_X86_MAX_INSTRUCTION_LENGTH * 3 + 1];
+		bytes[0] = 0;
+		for (uint8_t j = 0; j < row->length; j += 1)
+		{
+			snprintf(bytes + j * 3, sizeof(bytes) - j * 3, "%02x ", row->bytes[j]);
+		}
+
+		double ratio = v->counter ? (double)row->counter / (double)v->counter : 0.0;
+
+		fprintf(f, "+0x%04x" "\t" "0x%llx" "\t" "%-45s" "\t" "%.2f" "\t" "%zu\n",
+			row->offset,
+			(unsigned long long)row->address,
+			bytes,
+			ratio,
+			row->counter);
+	}
+}
+
+/* Walk the instructions of the function and merge the sampled addresses.
+   A sampled address which is not at an instruction boundary gets its own row. */
+static void decode_instructions(function_view* v, instruction_rows* sampled, strv code)
+{
+	const uint8_t* bytes = (const uint8_t*)code.data;
+	size_t sampled_index = 0;
+	address addr = v->start;
+
+	while (addr < v->end)
+	{
+		size_t offset = (size_t)(addr - v->start);
+		size_t length = x86_decoder_instruction_length(bytes + offset, code.size - offset);
+
+		/* Invalid instruction, or data in the middle of the code. */
+		if (length == 0)
+		{
+			break;
+		}
+
+		while (sampled_index < sampled->size && sampled->data[sampled_index].address < addr)
+		{
+			darr_push_back(&v->rows, sampled->data[sampled_index]);
+			sampled_index += 1;
+		}
+
+		size_t counter = 0;
+		if (sampled_index < sampled->size && sampled->data[sampled_index].address == addr)
+		{
+			counter = sampled->data[sampled_index].counter;
+			sampled_index += 1;
+		}
+
+		push_row(&v->rows, addr, counter);
+
+		instruction_row* row = &v->rows.data[v->rows.size - 1];
+		row->length = (uint8_t)length;
+		memcpy(row->bytes, bytes + offset, length);
+
+		addr += length;
+	}
+
+	while (sampled_index < sampled->size)
+	{
+		darr_push_back(&v->rows, sampled->data[sampled_index]);
+		sampled_index += 1;
+	}
+}
+
+/* Map the module file and get the bytes of the function. */
+static bool map_function_code(function_view* v, symbol_module* module, file_mapper* fm, readonly_file* file, strv* code)
+{
+	if (module->path.size == 0 || !file_mapper_open(fm, file, module->path))
+	{
+		return false;
+	}
+
+	pe_file pe;
+	size_t offset;
+	if (!pe_file_init(&pe, file->view)
+		|| !pe_file_rva_to_offset(&pe, (uint32_t)(v->start - module->base), &offset)
+		|| offset >= file->view.size)
+	{
+		return false;
+	}
+
+	/* The last instruction can go past the end of the range when the function range is unknown. */
+	size_t size = (size_t)(v->end - v->start) + SMP_X86_MAX_INSTRUCTION_LENGTH;
+	if (size > file->view.size - offset)
+	{
+		size = file->view.size - offset;
+	}
+
+	*code = strv_make_from(file->view.data + offset, size);
+	return true;
+}
+
+static void push_row(instruction_rows* rows, address addr, size_t counter)
+{
+	instruction_row row;
+	memset(&row, 0, sizeof(instruction_row));
+	row.address = addr;
+	row.counter = counter;
+	darr_push_back(rows, row);
+}
+
+static int SMP_CDECL compare_row_by_address(const instruction_row* left, const instruction_row* right)
+{
+	if (left->address < right->address)
+		return -1;
+	if (left->address > right->address)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,78 @@
+#ifndef SAMPLY_FUNCTION_VIEW_H
+#define SAMPLY_FUNCTION_VIEW_H
+
+#include "stdio.h"   /* FILE */
+#include "stdint.h"  /* uint8_t, uint32_t */
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+#include "process.h" /* address */
+#include "utils/x86_decoder.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+struct report;
+struct symbol_manager;
+
+/*
+	Samples of each instruction of a function.
+
+	The instructions are decoded from the module file (without disassembling them,
+	only their length is needed), so the instructions which have never been sampled
+	are listed too. If the module file is not available only the sampled addresses are listed.
+*/
+
+/* Largest function range, bigger ranges are sampled addresses of different functions with the same name. */
+#define SMP_FUNCTION_VIEW_MAX_SIZE (1024 * 1024)
+
+typedef struct instruction_row instruction_row;
+struct instruction_row {
+	address address;
+	uint32_t offset;   /* From the start of the function. */
+	uint8_t length;    /* Zero if the address has not been decoded. */
+	uint8_t bytes[SMP_X86_MAX_INSTRUCTION_LENGTH];
+	size_t counter;
+};
+
+typedef darr(instruction_row) instruction_rows;
+
+typedef struct function_view function_view;
+struct function_view {
+	strv symbol_name;
+	/* Module of the most sampled address. */
+	strv module_name;
+	/* Range of the function, or range of the sampled addresses if the function range is unknown. */
+	address start;
+	address end;
+	/* Samples of the function, and samples of its most sampled instruction. */
+	size_t counter;
+	size_t max_counter;
+	/* The instructions have been decoded from the module file. */
+	bool has_code;
+	/* Sorted by address. */
+	instruction_rows rows;
+};
+
+void function_view_init(function_view* v);
+void function_view_destroy(function_view* v);
+
+/* Reset allocated buffers without deallocating them. */
+void function_view_clear(function_view* v);
+
+/* Clear view and build it from the records of the symbol.
+   Only the records of the module and of the function of the most sampled address are used,
+   other functions can have the same name. Modules are looked up in m to decode the instructions, m can be NULL.
+   Returns false if the symbol has not been sampled, or if its range is bigger than SMP_FUNCTION_VIEW_MAX_SIZE. */
+bool function_view_load(function_view* v, struct report* r, strv symbol_name, struct symbol_manager* m);
+
+/* Print one row per instruction, with the percentage of the function samples. */
+void function_view_print_to_file(function_view* v, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_FUNCTION_VIEW_H */
@@ -4,6 +4,8 @@
 
 #include "samply.h"
 #include "report.h"
+#include "statistics.h"
+#include "report_filter.h"
 
 namespace helpers {
 
@@ -39,10 +41,20 @@ gui::gui(struct sampler* s, struct report* r)
     records_of_current_file = record_range_make();
 
     process_init(&process);
+
+    report_filter_index_init(&filter_index);
+    report_filter_result_init(&filter_result);
+
+    function_view_init(&function_view);
 }
 
 gui::~gui()
 {
+    function_view_destroy(&function_view);
+
+    report_filter_result_destroy(&filter_result);
+    report_filter_index_destroy(&filter_index);
+
     file_mapper_destroy(&file_mapper);
 }
 
@@ -86,9 +98,11 @@ bool gui::open_file(strv filepath)
 
     current_opened_filepath = filepath;
 
-    record* records = report->records.data;
-    size_t record_count = report->records.size;
-    records_of_current_file = record_range_for_file(records, record_count, filepath);
+    // Reports loaded from big files only decode the records of a source file when it's opened.
+    bool inserted;
+    report_load_records_of_file(report, filepath, &inserted);
+
+    refresh_records_of_current_file();
 
     tv::string_view content_view = tv::string_view(current_file.view.data, (int)current_file.view.size);
     text_viewer.set_text(content_view);
@@ -110,6 +124,20 @@ void gui::close_current_file()
     }
 
     current_opened_filepath = empty;
+    records_of_current_file = record_range_make();
+}
+
+void gui::refresh_records_of_current_file()
+{
+    if (!current_opened_filepath.size)
+    {
+        records_of_current_file = record_range_make();
+        return;
+    }
+
+    record* records = report->records.data;
+    size_t record_count = report->records.size;
+    records_of_current_file = record_range_for_file(records, record_count, current_opened_filepath);
 }
 
 void gui::clear()
@@ -279,6 +307,9 @@ void gui::display_main_window_header()
         process_init(&process);
         sampler_stop(sampler);
         report_load_from_sampler(report, sampler);
+        refresh_records_of_current_file();
+        filter_index_is_dirty = true;
+        select_symbol(STRV(""));
     }
 
     if (run_pressed)
@@ -313,6 +344,15 @@ void gui::display_main_window_body()
 
             ImGui::EndTabItem();
         }
+
+        if (comparison && ImGui::BeginTabItem("Diff"))
+        {
+            ImGui::PopStyleVar(1); // Restore item spacing.
+
+            show_diff_grid();
+
+            ImGui::EndTabItem();
+        }
 // Hide unused processes tab.
 #if 0
         if (ImGui::BeginTabItem("Processes"))
@@ -390,7 +430,30 @@ void gui::show_report_tab()
 #endif
         // Top Right
         {
-            show_report_grid();
+            // The callers and the callees of the selected symbol are displayed next to the grid.
+            if (report && !call_graph_is_empty(&report->call_graph))
+            {
+                avail_size = ImGui::GetContentRegionAvail();
+
+                static float call_graph_split_pos = avail_size.x * 2.0f / 3.0f; // Position the splitter at two thirds of the area.
+
+                ImGui::SplitterVertical(splitter_width, &call_graph_split_pos, 0, avail_size.x, avail_size.y);
+                {
+                    ImGui::BeginChild("TopLeft", ImVec2(call_graph_split_pos, avail_size.y));
+                    show_report_grid();
+                    ImGui::EndChild();
+                }
+                ImGui::SameLine();
+                {
+                    ImGui::BeginChild("TopRight", ImVec2(0, avail_size.y));
+                    show_call_graph_panel();
+                    ImGui::EndChild();
+                }
+            }
+            else
+            {
+                show_report_grid();
+            }
         }
 
         ImGui::EndChild();
@@ -405,7 +468,20 @@ void gui::show_report_tab()
         float expand_x_but_keep_a_margin_of = -ImGui::GetTextLineHeightWithSpacing();
         ImGui::BeginChild("Bottom", ImVec2(expand_y, expand_x_but_keep_a_margin_of), ImGuiChildFlags_Borders | ImGuiChildFlags_FrameStyle, ImGuiWindowFlags_NoNav);
 
-        show_source_file();
+        if (ImGui::BeginTabBar("BottomTabBar"))
+        {
+            if (ImGui::BeginTabItem("Source"))
+            {
+                show_source_file();
+                ImGui::EndTabItem();
+            }
+            if (ImGui::BeginTabItem("Instructions"))
+            {
+                show_instructions();
+                ImGui::EndTabItem();
+            }
+            ImGui::EndTabBar();
+        }
 
         ImGui::EndChild();
     }
@@ -414,6 +490,8 @@ void gui::show_report_tab()
 enum report_table_column {
     report_table_column_PERCENT,
     report_table_column_COUNTER,
+    report_table_column_ERROR,
+    report_table_column_INTERVAL,
     report_table_column_FILE_ICON,
     report_table_column_SYMBOL,
     report_table_column_MODULE,
@@ -426,10 +504,33 @@ void gui::show_report_grid()
     if (!report)
         return;
 
+    // Search box, see report_filter.h for the syntax.
+    ImGui::SetNextItemWidth(-FLT_MIN);
+    if (ImGui::InputTextWithHint("##Filter", "Filter: module:<pattern> file:<pattern> symbol:<pattern> min:<percent>", filter_buffer, max_filter_char))
+    {
+        // Invalid queries match everything until they are fixed, the error is shown below the search box.
+        report_filter parsed;
+        bool is_valid = report_filter_parse(&parsed, strv_make_from_str(filter_buffer));
+        filter = is_valid ? parsed : report_filter{};
+        memcpy(filter.error, parsed.error, sizeof(filter.error));
+        filter_is_dirty = true;
+    }
+
+    if (filter.error[0])
+    {
+        ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.0f), "%s", filter.error);
+    }
+
     size_t sample_count = report->sample_count;
     summed_record* items = report->summary_by_count.data;
     size_t items_count = report->summary_by_count.size;
 
+    bool has_errors = false;
+    for (size_t i = 0; i < items_count && !has_errors; i += 1)
+    {
+        has_errors = items[i].error > 0;
+    }
+
     static ImGuiTableFlags flags =
         ImGuiTableFlags_ScrollX
         | ImGuiTableFlags_ScrollY
@@ -446,6 +547,9 @@ void gui::show_report_grid()
     } columns[report_table_column_COUNT] = {
         { "%",       ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoHide, 0.0f },
         { "Counter", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending, 0.0f},
+        // Only in heavy-hitter mode, the actual counter is between counter - error and counter.
+        { "Error",   has_errors ? 0 : ImGuiTableColumnFlags_Disabled, 0.0f },
+        { "95% CI",  ImGuiTableColumnFlags_WidthFixed, 0.0f },
         { ICON_LC_FILE_CODE,   ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort, 0.0f },
         { "Symbol",  ImGuiTableColumnFlags_WidthFixed, 180.0f },
         { "Module",  0, 0.0f },
@@ -475,106 +579,353 @@ void gui::show_report_grid()
             {
                 report_table_sort_with_sort_specs(sort_specs, items, items_count);
                 sort_specs->SpecsDirty = false;
+                // Rows of the index follow the order of the summary.
+                filter_index_is_dirty = true;
             }
         }
 
+        // Filtered symbols, percentages are relative to them.
+        if (filter_index_is_dirty)
+        {
+            report_filter_index_build(&filter_index, report);
+            filter_index_is_dirty = false;
+            filter_is_dirty = true;
+        }
+        if (filter_is_dirty)
+        {
+            report_filter_apply(&filter_index, report, &filter, &filter_result);
+            filter_is_dirty = false;
+        }
+        if (!report_filter_is_empty(&filter))
+        {
+            sample_count = filter_result.sample_count;
+        }
+
         double inverse_items_count = 1.0f / (double)sample_count * 100.0f;
-        for (int row_index = 0; row_index < items_count; row_index += 1)
+
+        // Reports can have hundred of thousands of symbols, only the visible rows are submitted.
+        ImGuiListClipper clipper;
+        clipper.Begin((int)filter_result.rows.size);
+        while (clipper.Step())
         {
-            summed_record item = items[row_index];
-            ImGui::TableNextRow();
-            ImGui::TableSetColumnIndex(0);
-
-            static strv unknown_file_location = STRV("<unknown-file-location>");
-            static strv unknown_symbol = STRV("<unknown-symbol>");
-            static strv unknown_module = STRV("<unknown-module>");
-
-            bool has_file = item.source_file_name.size > 0;
-            strv filepath = item.source_file_name.size ? item.source_file_name : unknown_file_location;
-            strv filename = has_file ? path_get_last_segment(item.source_file_name) : filepath;
-            strv symbol = item.symbol_name.size ? item.symbol_name : unknown_symbol;
-            strv mobule = item.module_name.size ? item.module_name : unknown_module;
-
-            bool jump_to_line = false;
-            // Make row selectable
+            for (int row_index = clipper.DisplayStart; row_index < clipper.DisplayEnd; row_index += 1)
             {
-                static void* selected = 0;
-                ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowOverlap;
-                char buf[128];
-                snprintf(buf, 64, "##%p", item.symbol_name.data);
+                summed_record item = items[filter_result.rows.data[row_index]];
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(0);
+
+                static strv unknown_file_location = STRV("<unknown-file-location>");
+                static strv unknown_symbol = STRV("<unknown-symbol>");
+                static strv unknown_module = STRV("<unknown-module>");
+
+                bool has_file = item.source_file_name.size > 0;
+                strv filepath = item.source_file_name.size ? item.source_file_name : unknown_file_location;
+                strv filename = has_file ? path_get_last_segment(item.source_file_name) : filepath;
+                strv symbol = item.symbol_name.size ? item.symbol_name : unknown_symbol;
+                strv mobule = item.module_name.size ? item.module_name : unknown_module;
+
+                bool jump_to_line = false;
+                // Make row selectable
+                {
+                    ImGuiSelectableFlags selectable_flags = ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowOverlap;
+                    char buf[128];
+                    snprintf(buf, 64, "##%p", item.symbol_name.data);
 
-                bool is_selected = item.symbol_name.data == selected;
+                    bool is_selected = item.symbol_name.data == selected_symbol.data;
 
-                if (ImGui::Selectable(buf, is_selected, selectable_flags))
+                    if (ImGui::Selectable(buf, is_selected, selectable_flags))
+                    {
+                        select_symbol(item.symbol_name);
+                    }
+
+                    // @FIXME: It does not feel right to display a hoverable tooltip.
+                    // Insteda display details in a tooltip bar below the grid.
+                    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal) && item.closest_line_number != 0)
+                    {
+                        ImGui::SetTooltip(STRV_FMT " | " STRV_FMT " | line: %zu", STRV_ARG(mobule), STRV_ARG(filename), item.closest_line_number);
+                    }
+
+                    // Jump to file and go to specified line on double click.
+                    if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+                    {
+                        jump_to_line = true;
+                    }
+
+                    ImGui::SameLine();
+                }
+
+                ImGui::Text("%.2f", (double)item.counter * inverse_items_count);
+
+                // Display counter
                 {
-                    selected = (void*)item.symbol_name.data;
+                    ImGui::TableSetColumnIndex(report_table_column_COUNTER);
+                    ImGui::Text("%zu", item.counter);
                 }
 
-                // @FIXME: It does not feel right to display a hoverable tooltip.
-                // Insteda display details in a tooltip bar below the grid.
-                if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNormal) && item.closest_line_number != 0)
+                // Display error
+                if (has_errors)
                 {
-                    ImGui::SetTooltip(STRV_FMT " | " STRV_FMT " | line: %zu", STRV_ARG(mobule), STRV_ARG(filename), item.closest_line_number);
+                    ImGui::TableSetColumnIndex(report_table_column_ERROR);
+                    ImGui::Text("%zu", item.error);
                 }
 
-                // Jump to file and go to specified line on double click.
-                if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left))
+                // Display 95% confidence interval of the percentage.
                 {
-                    jump_to_line = true;
+                    ImGui::TableSetColumnIndex(report_table_column_INTERVAL);
+                    confidence_interval interval = wilson_interval(item.counter, sample_count);
+                    ImGui::Text("%.2f - %.2f", interval.low * 100.0, interval.high * 100.0);
                 }
 
-                ImGui::SameLine();
-            }
+                // Display icon.
+                {
+                    ImGui::TableSetColumnIndex(report_table_column_FILE_ICON);
 
-            ImGui::Text("%.2f", (double)item.counter * inverse_items_count);
+                    if (has_file)
+                    {
+                        char buf[32];
+                        snprintf(buf, 32, ICON_LC_FILE_CODE "##%p", item.symbol_name.data); // ### operator override ID ignoring the preceding label
+
+                        if (ImGui::IconButton(buf))
+                        {
+                            jump_to_line = true;
+                        }
+                        if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone))
+                        {
+                            ImGui::SetTooltip("Open file: " STRV_FMT, STRV_ARG(filepath));
+                        }
+                    }
+                }
 
-            // Display counter
-            {
-                ImGui::TableSetColumnIndex(1);
-                ImGui::Text("%zu", item.counter);
-            }
+                // Display symbol name.
+                {
+                    ImGui::TableSetColumnIndex(report_table_column_SYMBOL);
+                    ImGui::Text(STRV_FMT, STRV_ARG(symbol));
+                }
 
-            // Display icon.
-            {
-                ImGui::TableSetColumnIndex(2);
+                // Display module name.
+                {
+                    ImGui::TableSetColumnIndex(report_table_column_MODULE);
+                    ImGui::Text(STRV_FMT, STRV_ARG(mobule));
+                }
 
-                if (has_file)
+                // Display file name.
                 {
-                    char buf[32];
-                    snprintf(buf, 32, ICON_LC_FILE_CODE "##%p", item.symbol_name.data); // ### operator override ID ignoring the preceding label
+                    ImGui::TableSetColumnIndex(report_table_column_FILE);
+                    ImGui::Text(STRV_FMT, STRV_ARG(filepath));
+                }
 
-                    if (ImGui::IconButton(buf))
-                    {
-                        jump_to_line = true;
-                    }
-                    if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone))
-                    {
-                        ImGui::SetTooltip("Open file: " STRV_FMT, STRV_ARG(filepath));
-                    }
+                if (jump_to_line)
+                {
+                    jump_to_file(item.source_file_name, item.closest_line_number);
                 }
             }
+        }
+        ImGui::EndTable();
+    }
+}
+
+void gui::select_symbol(strv symbol)
+{
+    selected_symbol = symbol;
+    function_view_is_dirty = true;
+    selected_call_symbol = symbol.size ? call_graph_find_symbol(&report->call_graph, symbol) : UINT32_MAX;
+}
+
+enum call_table_column {
+    call_table_column_PERCENT,
+    call_table_column_COUNTER,
+    call_table_column_SYMBOL,
+    call_table_column_COUNT
+};
+
+void gui::show_call_graph_panel()
+{
+    call_graph* g = &report->call_graph;
+
+    if (selected_call_symbol == UINT32_MAX)
+    {
+        ImGui::TextDisabled("Select a symbol to display its callers and callees.");
+        return;
+    }
+
+    uint32_t symbol = selected_call_symbol;
+    double inverse_sample_count = report->sample_count ? 100.0 / (double)report->sample_count : 0.0;
+
+    ImGui::Text(STRV_FMT, STRV_ARG(g->symbols.data[symbol]));
+    ImGui::Text("Total: %.2f%%  Self: %.2f%%",
+        (double)g->total_counters.data[symbol] * inverse_sample_count,
+        (double)g->self_counters.data[symbol] * inverse_sample_count);
+
+    static ImGuiTableFlags flags =
+        ImGuiTableFlags_ScrollY
+        | ImGuiTableFlags_Borders
+        | ImGuiTableFlags_Resizable;
 
-            // Display symbol name.
+    struct edge_table {
+        const char* id;
+        const char* name;
+        call_offsets* offsets;
+        call_edges* edges;
+    } tables[2] = {
+        { "callers_table", "Callers", &g->caller_offsets, &g->callers },
+        { "callees_table", "Callees", &g->callee_offsets, &g->callees },
+    };
+
+    // Each table takes half of the remaining height.
+    float table_height = (ImGui::GetContentRegionAvail().y - ImGui::GetStyle().ItemSpacing.y) / 2.0f;
+
+    // Selecting a caller or a callee makes it the displayed symbol, to walk the call graph.
+    uint32_t clicked = UINT32_MAX;
+
+    for (int t = 0; t < 2; t += 1)
+    {
+        if (ImGui::BeginTable(tables[t].id, call_table_column_COUNT, flags, ImVec2(0.0f, table_height)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("%", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn("Counter", ImGuiTableColumnFlags_WidthFixed);
+            ImGui::TableSetupColumn(tables[t].name);
+            ImGui::TableHeadersRow();
+
+            for (uint32_t i = tables[t].offsets->data[symbol]; i < tables[t].offsets->data[symbol + 1]; i += 1)
             {
-                ImGui::TableSetColumnIndex(3);
-                ImGui::Text(STRV_FMT, STRV_ARG(symbol));
+                call_edge edge = tables[t].edges->data[i];
+                strv name = g->symbols.data[edge.symbol];
+
+                ImGui::TableNextRow();
+                ImGui::TableSetColumnIndex(call_table_column_PERCENT);
+
+                char buf[32];
+                snprintf(buf, 32, "##%s%u", tables[t].id, i);
+                if (ImGui::Selectable(buf, false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowOverlap))
+                {
+                    clicked = edge.symbol;
+                }
+                ImGui::SameLine();
+                ImGui::Text("%.2f", (double)edge.counter * inverse_sample_count);
+
+                ImGui::TableSetColumnIndex(call_table_column_COUNTER);
+                ImGui::Text("%zu", edge.counter);
+
+                ImGui::TableSetColumnIndex(call_table_column_SYMBOL);
+                ImGui::Text(STRV_FMT, STRV_ARG(name));
             }
+            ImGui::EndTable();
+        }
+    }
+
+    if (clicked != UINT32_MAX)
+    {
+        selected_symbol = g->symbols.data[clicked];
+        selected_call_symbol = clicked;
+        function_view_is_dirty = true;
+    }
+}
+
+enum diff_table_column {
+    diff_table_column_DELTA,
+    diff_table_column_RATIO,
+    diff_table_column_OLD,
+    diff_table_column_NEW,
+    diff_table_column_SYMBOL,
+    diff_table_column_MODULE,
+    diff_table_column_COUNT
+};
+
+void gui::show_diff_grid()
+{
+    if (!comparison)
+        return;
+
+    ImGui::Text("Sample count: %zu -> %zu", comparison->old_sample_count, comparison->new_sample_count);
+
+    diff_record* items = comparison->records.data;
+    size_t items_count = comparison->records.size;
+
+    static ImGuiTableFlags flags =
+        ImGuiTableFlags_ScrollX
+        | ImGuiTableFlags_ScrollY
+        | ImGuiTableFlags_Borders
+        | ImGuiTableFlags_Resizable
+        | ImGuiTableFlags_Reorderable
+        | ImGuiTableFlags_Hideable;
 
-            // Display module name.
+    struct col_info {
+        const char* name;
+        int flags;
+        float initial_width; // 0.0f means auto
+    } columns[diff_table_column_COUNT] = {
+        { "Delta %", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoHide, 0.0f },
+        { "Ratio",   ImGuiTableColumnFlags_WidthFixed, 0.0f },
+        { "Old %",   ImGuiTableColumnFlags_WidthFixed, 0.0f },
+        { "New %",   ImGuiTableColumnFlags_WidthFixed, 0.0f },
+        { "Symbol",  ImGuiTableColumnFlags_WidthFixed, 180.0f },
+        { "Module",  0, 0.0f },
+    };
+
+    if (ImGui::BeginTable("diff_table", diff_table_column_COUNT, flags))
+    {
+        ImGui::TableSetupScrollFreeze(1, 1);
+        for (int i = 0; i < diff_table_column_COUNT; i += 1)
+        {
+            if (columns[i].initial_width > 0.0f)
             {
-                ImGui::TableSetColumnIndex(4);
-                ImGui::Text(STRV_FMT, STRV_ARG(mobule));
+                ImGui::TableSetupColumn(columns[i].name, columns[i].flags, columns[i].initial_width);
             }
-
-            // Display file name.
+            else
             {
-                ImGui::TableSetColumnIndex(5);
-                ImGui::Text(STRV_FMT, STRV_ARG(filepath));
+                ImGui::TableSetupColumn(columns[i].name, columns[i].flags);
             }
+        }
+        ImGui::TableHeadersRow();
+
+        static strv unknown_symbol = STRV("<unknown-symbol>");
+        static strv unknown_module = STRV("<unknown-module>");
 
-            if (jump_to_line)
+        // Comparisons can have hundred of thousands of symbols, only the visible rows are submitted.
+        ImGuiListClipper clipper;
+        clipper.Begin((int)items_count);
+        while (clipper.Step())
+        {
+            for (int row_index = clipper.DisplayStart; row_index < clipper.DisplayEnd; row_index += 1)
             {
-                jump_to_file(item.source_file_name, item.closest_line_number);
+                diff_record item = items[row_index];
+                ImGui::TableNextRow();
+
+                strv symbol = item.symbol_name.size ? item.symbol_name : unknown_symbol;
+                strv module_name = item.module_name.size ? item.module_name : unknown_module;
+
+                // Faster is green, slower is red, changes which can be sampling noise are dimmed.
+                ImVec4 color = !item.is_significant
+                    ? ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled)
+                    : item.delta < 0.0
+                        ? ImVec4(0.4f, 0.8f, 0.4f, 1.0f)
+                        : ImVec4(0.9f, 0.4f, 0.4f, 1.0f);
+
+                ImGui::TableSetColumnIndex(diff_table_column_DELTA);
+                ImGui::TextColored(color, "%+.2f", item.delta * 100.0);
+
+                ImGui::TableSetColumnIndex(diff_table_column_RATIO);
+                if (item.old_counter == 0)
+                {
+                    ImGui::Text("new");
+                }
+                else
+                {
+                    ImGui::Text("%.2f", item.ratio);
+                }
+
+                ImGui::TableSetColumnIndex(diff_table_column_OLD);
+                ImGui::Text("%.2f", item.old_ratio * 100.0);
+
+                ImGui::TableSetColumnIndex(diff_table_column_NEW);
+                ImGui::Text("%.2f", item.new_ratio * 100.0);
+
+                ImGui::TableSetColumnIndex(diff_table_column_SYMBOL);
+                ImGui::Text(STRV_FMT, STRV_ARG(symbol));
+
+                ImGui::TableSetColumnIndex(diff_table_column_MODULE);
+                ImGui::Text(STRV_FMT, STRV_ARG(module_name));
             }
         }
         ImGui::EndTable();
@@ -586,6 +937,128 @@ void gui::show_source_file()
     text_viewer.render();
 }
 
+enum instruction_table_column {
+    instruction_table_column_OFFSET,
+    instruction_table_column_ADDRESS,
+    instruction_table_column_BYTES,
+    instruction_table_column_PERCENT,
+    instruction_table_column_COUNTER,
+    instruction_table_column_HISTOGRAM,
+    instruction_table_column_COUNT
+};
+
+void gui::show_instructions()
+{
+    if (!report || selected_symbol.size == 0)
+    {
+        ImGui::TextDisabled("Select a symbol to display the samples of its instructions.");
+        return;
+    }
+
+    if (function_view_is_dirty)
+    {
+        function_view_is_dirty = false;
+        // The addresses of a symbol can be in any source file.
+        bool inserted;
+        report_load_all_records(report, &inserted);
+        if (inserted)
+        {
+            refresh_records_of_current_file();
+        }
+        // Modules are only known in the session which sampled the report.
+        function_view_load(&function_view, report, selected_symbol, sampler ? &sampler->mgr : NULL);
+    }
+
+    if (function_view.rows.size == 0)
+    {
+        ImGui::TextDisabled("No sampled address for this symbol.");
+        return;
+    }
+
+    ImGui::Text(STRV_FMT "  [0x%llx, 0x%llx)  %zu samples",
+        STRV_ARG(function_view.symbol_name),
+        (unsigned long long)function_view.start,
+        (unsigned long long)function_view.end,
+        function_view.counter);
+
+    if (!function_view.has_code)
+    {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(module not available, only sampled addresses are listed)");
+    }
+
+    static ImGuiTableFlags flags =
+        ImGuiTableFlags_ScrollY
+        | ImGuiTableFlags_Borders
+        | ImGuiTableFlags_Resizable;
+
+    if (ImGui::BeginTable("instructions_table", instruction_table_column_COUNT, flags))
+    {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Offset", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Address", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Bytes", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("%", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Counter", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Samples");
+        ImGui::TableHeadersRow();
+
+        double inverse_counter = function_view.counter ? 100.0 / (double)function_view.counter : 0.0;
+
+        ImGuiListClipper clipper;
+        clipper.Begin((int)function_view.rows.size);
+        while (clipper.Step())
+        {
+            for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i += 1)
+            {
+                instruction_row* row = &function_view.rows.data[i];
+
+                ImGui::TableNextRow();
+
+                // Instructions which have never been sampled are dimmed.
+                if (row->counter == 0)
+                {
+                    ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled));
+                }
+
+                ImGui::TableSetColumnIndex(instruction_table_column_OFFSET);
+                ImGui::Text("+0x%04x", row->offset);
+
+                ImGui::TableSetColumnIndex(instruction_table_column_ADDRESS);
+                ImGui::Text("0x%llx", (unsigned long long)row->address);
+
+                ImGui::TableSetColumnIndex(instruction_table_column_BYTES);
+                char bytes[SMP_X86_MAX_INSTRUCTION_LENGTH * 3 + 1];
+                bytes[0] = 0;
+                for (uint8_t j = 0; j < row->length; j += 1)
+                {
+                    snprintf(bytes + j * 3, sizeof(bytes) - j * 3, "%02x ", row->bytes[j]);
+                }
+                ImGui::TextUnformatted(row->length ? bytes : "??");
+
+                ImGui::TableSetColumnIndex(instruction_table_column_PERCENT);
+                ImGui::Text("%.2f", (double)row->counter * inverse_counter);
+
+                ImGui::TableSetColumnIndex(instruction_table_column_COUNTER);
+                ImGui::Text("%zu", row->counter);
+
+                if (row->counter == 0)
+                {
+                    ImGui::PopStyleColor();
+                }
+
+                ImGui::TableSetColumnIndex(instruction_table_column_HISTOGRAM);
+                if (row->counter)
+                {
+                    float fraction = (float)row->counter / (float)function_view.max_counter;
+                    ImGui::ProgressBar(fraction, ImVec2(-FLT_MIN, ImGui::GetTextLineHeight()), "");
+                }
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
 namespace helpers {
     
     void report_table_sort_with_sort_specs(ImGuiTableSortSpecs* sort_specs, summed_record* items, size_t items_count)
@@ -614,8 +1087,14 @@ namespace helpers {
                 // Sort by percentage is equivalent to sort by counter.
             case report_table_column_PERCENT:
                 // FALLTRHOUGH
+            case report_table_column_INTERVAL:
+                // FALLTRHOUGH
             case report_table_column_COUNTER: {
-                delta = (int)(left->counter - right->counter);
+                delta = left->counter < right->counter ? -1 : left->counter > right->counter;
+                break;
+            }
+            case report_table_column_ERROR: {
+                delta = left->error < right->error ? -1 : left->error > right->error;
                 break;
             }
             case report_table_column_SYMBOL: {
@@ -682,10 +1161,11 @@ namespace helpers {
 
             tv::render_text_line(buf, buf + buf_len, ImVec2(), ImGui::GetColorU32(color));
             ImGui::SameLine();
-            // Display more accurage percentage and the actual sampling count.
+            // Display more accurage percentage, the actual sampling count and the 95% confidence interval.
             if (ImGui::IsItemHovered(ImGuiHoveredFlags_DelayNone))
             {
-                ImGui::SetTooltip("%.4f - %zu", percent, count);
+                confidence_interval interval = wilson_interval(count, g->report->sample_count);
+                ImGui::SetTooltip("%.4f - %zu\n95%% CI: %.4f - %.4f", percent, count, interval.low * 100.0, interval.high * 100.0);
             }
         }
     }
@@ -7,6 +7,9 @@
 
 #include "utils/file_mapper.h"
 #include "report.h" // record_range
+#include "report_diff.h"
+#include "report_filter.h"
+#include "function_view.h"
 
 struct sampler;
 
@@ -19,6 +22,26 @@ struct gui : gui_backend {
 
 	sampler* sampler = 0;
 	report* report = 0;
+	// Comparison of two reports, the "Diff" tab is only displayed if there is one.
+	report_comparison* comparison = 0;
+	// Search box of the report grid, the filter points into the buffer.
+	static const int max_filter_char = 255;
+	char filter_buffer[max_filter_char + 1] = {0};
+	report_filter filter = {};
+	report_filter_index filter_index;
+	report_filter_result filter_result;
+	// The index must be rebuilt when the report is loaded or sorted, the result when the filter changes.
+	bool filter_index_is_dirty = true;
+	bool filter_is_dirty = true;
+
+	// Symbol selected in the report grid, and its id in the call graph (UINT32_MAX if it's not in any call stack).
+	strv selected_symbol = {};
+	uint32_t selected_call_symbol = UINT32_MAX;
+
+	// Samples of each instruction of the selected symbol, rebuilt when the selection changes.
+	function_view function_view;
+	bool function_view_is_dirty = true;
+
 	// Process being sampled.
 	process process;
 	bool sampling_started = false;
@@ -58,6 +81,9 @@ struct gui : gui_backend {
 	bool open_file(strv filepath);
 	void close_current_file();
 
+	// Records move when others are inserted, their range in the opened file must be computed again.
+	void refresh_records_of_current_file();
+
 	void clear();
 
 	// Open the specified file if it's not already opened and jump to the specified line.
@@ -92,7 +118,20 @@ private:
 
 	void show_report_grid();
 
+	// Callers and callees of the selected symbol, only if call stacks were sampled.
+	void show_call_graph_panel();
+	void select_symbol(strv symbol);
+
 	void show_source_file();
+
+	// Instructions of the selected symbol with their samples.
+	void show_instructions();
+
+	//
+	// Main Window - Diff Tab
+	//
+
+	void show_diff_grid();
 };
 
 #endif // SAMPLY_GUI_HPP
@@ -0,0 +1,232 @@
+#include "heavy_hitters.h"
+
+#include "string.h" /* memset */
+
+#include "samply.h"
+
+static size_t slot_index_of(heavy_hitters* h, address addr);
+static heavy_hitter_slot* find_slot(heavy_hitters* h, address addr);
+static void insert_slot(heavy_hitters* h, address addr, uint32_t index);
+static void remove_slot(heavy_hitters* h, address addr);
+
+static bool heap_less(heavy_hitters* h, size_t left, size_t right);
+static void heap_swap(heavy_hitters* h, size_t left, size_t right);
+static void heap_sift_up(heavy_hitters* h, size_t position);
+static void heap_sift_down(heavy_hitters* h, size_t position);
+
+void heavy_hitters_init(heavy_hitters* h, size_t capacity)
+{
+	memset(h, 0, sizeof(heavy_hitters));
+
+	SMP_ASSERT(capacity > 0 && capacity < SMP_HEAVY_HITTER_EMPTY_SLOT);
+	h->capacity = capacity;
+
+	/* Keep the table at most half full so the probe sequences stay short. */
+	size_t slot_count = 16;
+	int slot_bits = 4;
+	while (slot_count < capacity * 2)
+	{
+		slot_count *= 2;
+		slot_bits += 1;
+	}
+	h->slot_mask = slot_count - 1;
+	h->slot_shift = 64 - slot_bits;
+
+	h->items = SMP_MALLOC(sizeof(heavy_hitter) * capacity);
+	h->heap = SMP_MALLOC(sizeof(uint32_t) * capacity);
+	h->heap_positions = SMP_MALLOC(sizeof(uint32_t) * capacity);
+	h->slots = SMP_MALLOC(sizeof(heavy_hitter_slot) * slot_count);
+
+	heavy_hitters_clear(h);
+}
+
+void heavy_hitters_destroy(heavy_hitters* h)
+{
+	SMP_FREE(h->items);
+	SMP_FREE(h->heap);
+	SMP_FREE(h->heap_positions);
+	SMP_FREE(h->slots);
+
+	memset(h, 0, sizeof(heavy_hitters));
+}
+
+void heavy_hitters_clear(heavy_hitters* h)
+{
+	h->count = 0;
+
+	for (size_t i = 0; i <= h->slot_mask; i += 1)
+	{
+		h->slots[i].index = SMP_HEAVY_HITTER_EMPTY_SLOT;
+	}
+}
+
+void heavy_hitters_add(heavy_hitters* h, address addr)
+{
+	uint32_t index;
+	heavy_hitter_slot* slot = find_slot(h, addr);
+
+	if (slot)
+	{
+		index = slot->index;
+		h->items[index].counter += 1;
+	}
+	else if (h->count < h->capacity)
+	{
+		index = (uint32_t)h->count;
+		h->count += 1;
+
+		heavy_hitter* item = &h->items[index];
+		item->address = addr;
+		item->counter = 1;
+		item->error = 0;
+
+		h->heap[index] = index;
+		h->heap_positions[index] = index;
+		insert_slot(h, addr, index);
+
+		/* Smallest possible counter, it can only go up in the heap. */
+		heap_sift_up(h, index);
+		return;
+	}
+	else
+	{
+		/* The new address takes the entry with the smallest counter.
+		   It may have been sampled that many times before, that's the error of the entry. */
+		index = h->heap[0];
+
+		heavy_hitter* item = &h->items[index];
+		remove_slot(h, item->address);
+		insert_slot(h, addr, index);
+
+		item->address = addr;
+		item->error = item->counter;
+		item->counter += 1;
+	}
+
+	heap_sift_down(h, h->heap_positions[index]);
+}
+
+static size_t slot_index_of(heavy_hitters* h, address addr)
+{
+	/* Fibonacci hashing, sampled addresses are close to each other. */
+	return (size_t)(((uint64_t)addr * 0x9E3779B97F4A7C15ull) >> h->slot_shift);
+}
+
+static heavy_hitter_slot* find_slot(heavy_hitters* h, address addr)
+{
+	size_t i = slot_index_of(h, addr);
+	for (;;)
+	{
+		heavy_hitter_slot* slot = &h->slots[i];
+		if (slot->index == SMP_HEAVY_HITTER_EMPTY_SLOT)
+		{
+			return NULL;
+		}
+		if (slot->address == addr)
+		{
+			return slot;
+		}
+		i = (i + 1) & h->slot_mask;
+	}
+}
+
+static void insert_slot(heavy_hitters* h, address addr, uint32_t index)
+{
+	size_t i = slot_index_of(h, addr);
+	while (h->slots[i].index != SMP_HEAVY_HITTER_EMPTY_SLOT)
+	{
+		i = (i + 1) & h->slot_mask;
+	}
+
+	h->slots[i].address = addr;
+	h->slots[i].index = index;
+}
+
+/* Backward shift deletion, no tombstone is left so the table never degrades. */
+static void remove_slot(heavy_hitters* h, address addr)
+{
+	heavy_hitter_slot* slot = find_slot(h, addr);
+	SMP_ASSERT(slot);
+
+	size_t i = (size_t)(slot - h->slots);
+	for (;;)
+	{
+		size_t j = i;
+		for (;;)
+		{
+			j = (j + 1) & h->slot_mask;
+			if (h->slots[j].index == SMP_HEAVY_HITTER_EMPTY_SLOT)
+			{
+				h->slots[i].index = SMP_HEAVY_HITTER_EMPTY_SLOT;
+				return;
+			}
+
+			/* The entry at j can fill the hole at i if its ideal slot is not in (i, j]. */
+			size_t ideal = slot_index_of(h, h->slots[j].address);
+			bool ideal_is_between = i <= j
+				? (i < ideal && ideal <= j)
+				: (i < ideal || ideal <= j);
+			if (!ideal_is_between)
+			{
+				break;
+			}
+		}
+
+		h->slots[i] = h->slots[j];
+		i = j;
+	}
+}
+
+static bool heap_less(heavy_hitters* h, size_t left, size_t right)
+{
+	return h->items[h->heap[left]].counter < h->items[h->heap[right]].counter;
+}
+
+static void heap_swap(heavy_hitters* h, size_t left, size_t right)
+{
+	uint32_t tmp = h->heap[left];
+	h->heap[left] = h->heap[right];
+	h->heap[right] = tmp;
+
+	h->heap_positions[h->heap[left]] = (uint32_t)left;
+	h->heap_positions[h->heap[right]] = (uint32_t)right;
+}
+
+static void heap_sift_up(heavy_hitters* h, size_t position)
+{
+	while (position > 0)
+	{
+		size_t parent = (position - 1) / 2;
+		if (!heap_less(h, position, parent))
+		{
+			break;
+		}
+		heap_swap(h, position, parent);
+		position = parent;
+	}
+}
+
+static void heap_sift_down(heavy_hitters* h, size_t position)
+{
+	for (;;)
+	{
+		size_t left = position * 2 + 1;
+		size_t right = left + 1;
+		size_t smallest = position;
+
+		if (left < h->count && heap_less(h, left, smallest))
+		{
+			smallest = left;
+		}
+		if (right < h->count && heap_less(h, right, smallest))
+		{
+			smallest = right;
+		}
+		if (smallest == position)
+		{
+			break;
+		}
+		heap_swap(h, position, smallest);
+		position = smallest;
+	}
+}
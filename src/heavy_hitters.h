@@ -0,0 +1,76 @@
+#ifndef SAMPLY_HEAVY_HITTERS_H
+#define SAMPLY_HEAVY_HITTERS_H
+
+#include "stddef.h"  /* size_t */
+#include "stdint.h"  /* uint32_t */
+#include "stdbool.h" /* bool */
+
+#include "process.h" /* address */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Top addresses of a sampling run, in fixed memory (Space-Saving algorithm, Metwally et al. 2005).
+
+	At most `capacity` addresses are tracked. When a new address is sampled and all the entries
+	are used, the entry with the smallest counter is given to the new address:
+	its counter is incremented and the previous value becomes the error of the entry.
+
+	Guarantees, for N samples:
+		- the actual count of an address is between counter - error and counter,
+		- error <= N / capacity,
+		- an address sampled more than N / capacity times is always tracked,
+		- the sum of the counters is N.
+*/
+
+typedef struct heavy_hitter heavy_hitter;
+struct heavy_hitter {
+	address address;
+	size_t counter;
+	size_t error;
+};
+
+/* Entry of the table to find the index of a tracked address. */
+typedef struct heavy_hitter_slot heavy_hitter_slot;
+struct heavy_hitter_slot {
+	address address;
+	uint32_t index; /* Index in items, SMP_HEAVY_HITTER_EMPTY_SLOT if the slot is free. */
+};
+
+#define SMP_HEAVY_HITTER_EMPTY_SLOT (UINT32_MAX)
+
+typedef struct heavy_hitters heavy_hitters;
+struct heavy_hitters {
+	size_t capacity;
+	size_t count;
+
+	/* Tracked addresses, they are not moved once added. */
+	heavy_hitter* items;
+
+	/* Indexes of the items in a min-heap on their counter, and position of each item in the heap. */
+	uint32_t* heap;
+	uint32_t* heap_positions;
+
+	/* Open addressing table with linear probing, twice the capacity. */
+	heavy_hitter_slot* slots;
+	size_t slot_mask;
+	int slot_shift;
+};
+
+/* Allocate all the memory needed to track capacity addresses, nothing is allocated afterwards. */
+void heavy_hitters_init(heavy_hitters* h, size_t capacity);
+void heavy_hitters_destroy(heavy_hitters* h);
+
+/* Forget all the addresses, keep the memory. */
+void heavy_hitters_clear(heavy_hitters* h);
+
+/* Count one sample of the address. */
+void heavy_hitters_add(heavy_hitters* h, address addr);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_HEAVY_HITTERS_H */
@@ -0,0 +1,349 @@
+#include "jit_symbols.h"
+
+#include <stdio.h>  /* snprintf, FILE */
+#include <string.h> /* memcpy */
+
+#include "samply.h"
+#include "string_store.h"
+#include "utils/log.h"
+
+#define JITDUMP_MAGIC (0x4A695444)
+#define JITDUMP_HEADER_MIN_SIZE (40)
+#define JITDUMP_RECORD_HEADER_SIZE (16)
+/* Flag of the jitdump header, the timestamps are read from the timestamp counter of the processor. */
+#define JITDUMP_FLAGS_ARCH_TIMESTAMP (1)
+
+enum jitdump_record_type {
+	jitdump_record_type_CODE_LOAD = 0,
+	jitdump_record_type_CODE_MOVE = 1,
+	jitdump_record_type_CODE_DEBUG_INFO = 2,
+	jitdump_record_type_CODE_CLOSE = 3,
+	jitdump_record_type_CODE_UNWINDING_INFO = 4
+};
+
+static void source_init(jit_source* source);
+static void source_destroy(jit_source* source);
+static void source_set_path(jit_source* source, const char* directory, const char* format, unsigned long pid);
+
+static bool read_new_bytes(jit_symbols* j, jit_source* source);
+static void insert_range(jit_symbols* j, symbol_range range);
+
+static size_t parse_perf_map(jit_symbols* j, const char* data, size_t size);
+static size_t parse_jitdump(jit_symbols* j, jit_source* source, const char* data, size_t size);
+
+static uint32_t read_u32(const char* data);
+static uint64_t read_u64(const char* data);
+
+void jit_symbols_init(jit_symbols* j, struct string_store* s)
+{
+	memset(j, 0, sizeof(jit_symbols));
+
+	j->string_store = s;
+
+	symbol_index_init(&j->index);
+	source_init(&j->perf_map);
+	source_init(&j->jitdump);
+	darr_init(&j->buffer);
+
+	j->module_name = *string_store_get_or_create(s, (strv)STRV("[jit]"));
+}
+
+void jit_symbols_destroy(jit_symbols* j)
+{
+	symbol_index_destroy(&j->index);
+	source_destroy(&j->perf_map);
+	source_destroy(&j->jitdump);
+	darr_destroy(&j->buffer);
+}
+
+void jit_symbols_open(jit_symbols* j, unsigned long pid)
+{
+	symbol_index_clear(&j->index);
+
+	char directory[SMP_MAX_PATH_BYTE_BUFFER_SIZE];
+#if _WIN32
+	if (!GetTempPathA((DWORD)sizeof(directory), directory))
+	{
+		directory[0] = '\0';
+	}
+#else
+	snprintf(directory, sizeof(directory), "/tmp/");
+#endif
+
+	source_set_path(&j->perf_map, directory, "%sperf-%lu.map", pid);
+	source_set_path(&j->jitdump, directory, "%sjit-%lu.dump", pid);
+}
+
+bool jit_symbols_refresh(jit_symbols* j)
+{
+	j->changed_start = 0;
+	j->changed_end = 0;
+
+	if (read_new_bytes(j, &j->perf_map))
+	{
+		j->perf_map.offset += parse_perf_map(j, j->buffer.data, j->buffer.size);
+	}
+
+	if (read_new_bytes(j, &j->jitdump))
+	{
+		j->jitdump.offset += parse_jitdump(j, &j->jitdump, j->buffer.data, j->buffer.size);
+	}
+
+	return j->changed_end > j->changed_start;
+}
+
+symbol_range* jit_symbols_find(jit_symbols* j, address addr)
+{
+	return symbol_index_find(&j->index, addr);
+}
+
+static void source_init(jit_source* source)
+{
+	memset(source, 0, sizeof(jit_source));
+	darr_init(&source->path);
+}
+
+static void source_destroy(jit_source* source)
+{
+	darr_destroy(&source->path);
+}
+
+static void source_set_path(jit_source* source, const char* directory, const char* format, unsigned long pid)
+{
+	int len = snprintf(NULL, 0, format, directory, pid);
+
+	darr_clear(&source->path);
+	darr_ensure_space(&source->path, (size_t)len + 1);
+	snprintf(source->path.data, (size_t)len + 1, format, directory, pid);
+	source->path.size = (size_t)len;
+
+	source->offset = 0;
+	source->header_read = false;
+	source->has_arch_timestamps = false;
+	source->disabled = false;
+}
+
+/* Read all bytes after the current offset of the source. Returns true if there is anything to parse. */
+static bool read_new_bytes(jit_symbols* j, jit_source* source)
+{
+	darr_clear(&j->buffer);
+
+	if (source->disabled || source->path.size == 0)
+	{
+		return false;
+	}
+
+	/* The file does not exist, or not yet. */
+	FILE* f = fopen(source->path.data, "rb");
+	if (!f)
+	{
+		return false;
+	}
+
+	if (samply_fseek64(f, (int64_t)source->offset, SEEK_SET) == 0)
+	{
+		const size_t chunk_size = 64 * 1024;
+		size_t read_count = 0;
+		do
+		{
+			darr_ensure_space(&j->buffer, chunk_size);
+			read_count = fread(j->buffer.data + j->buffer.size, 1, chunk_size, f);
+			j->buffer.size += read_count;
+		} while (read_count == chunk_size);
+	}
+
+	fclose(f);
+
+	return j->buffer.size > 0;
+}
+
+static void insert_range(jit_symbols* j, symbol_range range)
+{
+	if (range.end <= range.start)
+	{
+		return;
+	}
+
+	if (j->changed_end <= j->changed_start)
+	{
+		j->changed_start = range.start;
+		j->changed_end = range.end;
+	}
+	else
+	{
+		j->changed_start = range.start < j->changed_start ? range.start : j->changed_start;
+		j->changed_end = range.end > j->changed_end ? range.end : j->changed_end;
+	}
+
+	symbol_index_insert(&j->index, range);
+}
+
+/* Returns the number of bytes consumed. Incomplete lines are kept for the next refresh. */
+static size_t parse_perf_map(jit_symbols* j, const char* data, size_t size)
+{
+	size_t consumed = 0;
+
+	/* Entries of the perf map don't have any timestamp. They were written before they are read,
+	   so they get the current time, on the clock of the jitdump timestamps.
+	   Lines read together have the same time, the last one wins like in the file. */
+	uint64_t timestamp = samply_time_now_ns();
+
+	while (consumed < size)
+	{
+		const char* line_begin = data + consumed;
+		const char* line_end = memchr(line_begin, '\n', size - consumed);
+
+		/* Incomplete line, the runtime is likely writing it. */
+		if (!line_end)
+		{
+			break;
+		}
+
+		consumed = (line_end - data) + 1;
+
+		/* Line format is: "<hex start> <hex size> <name>" */
+		strv line = strv_make_from(line_begin, line_end - line_begin);
+		uint64_t start;
+		uint64_t code_size;
+
+		if (!samply_parse_hex(&line, &start) || !samply_parse_hex(&line, &code_size))
+		{
+			continue;
+		}
+
+		/* Name can contain spaces, it is the rest of the line. */
+		strv name = strv_trimmed(line);
+
+		symbol_range range = { 0 };
+		range.start = start;
+		range.end = start + code_size;
+		range.name = *string_store_get_or_create(j->string_store, name);
+		range.module_name = j->module_name;
+		range.timestamp = timestamp;
+
+		insert_range(j, range);
+	}
+
+	return consumed;
+}
+
+/* Returns the number of bytes consumed. Incomplete records are kept for the next refresh. */
+static size_t parse_jitdump(jit_symbols* j, jit_source* source, const char* data, size_t size)
+{
+	size_t consumed = 0;
+
+	if (!source->header_read)
+	{
+		if (size < JITDUMP_HEADER_MIN_SIZE)
+		{
+			return 0;
+		}
+
+		uint32_t magic = read_u32(data);
+		uint32_t header_size = read_u32(data + 8);
+
+		/* A swapped magic number means that the file was written with another endianness. */
+		if (magic != JITDUMP_MAGIC || header_size < JITDUMP_HEADER_MIN_SIZE)
+		{
+			log_warning("Invalid jitdump file: %s", source->path.data);
+			source->disabled = true;
+			return 0;
+		}
+
+		if (size < header_size)
+		{
+			return 0;
+		}
+
+		/* magic (4), version (4), total_size (4), elf_mach (4), pad1 (4), pid (4), timestamp (8), flags (8). */
+		source->header_read = true;
+		source->has_arch_timestamps = (read_u64(data + 32) & JITDUMP_FLAGS_ARCH_TIMESTAMP) != 0;
+		consumed = header_size;
+	}
+
+	/* Timestamps of another clock can't be compared with the ones of the perf map, the read time is used instead. */
+	uint64_t read_timestamp = samply_time_now_ns();
+
+	while (size - consumed >= JITDUMP_RECORD_HEADER_SIZE)
+	{
+		const char* record = data + consumed;
+
+		uint32_t id = read_u32(record);
+		uint32_t total_size = read_u32(record + 4);
+		uint64_t timestamp = source->has_arch_timestamps ? read_timestamp : read_u64(record + 8);
+
+		if (total_size < JITDUMP_RECORD_HEADER_SIZE)
+		{
+			log_warning("Invalid jitdump record in: %s", source->path.data);
+			source->disabled = true;
+			break;
+		}
+
+		/* Incomplete record. */
+		if (size - consumed < total_size)
+		{
+			break;
+		}
+
+		/* Skip pid and tid. */
+		const char* body = record + JITDUMP_RECORD_HEADER_SIZE + 8;
+		const char* record_end = record + total_size;
+
+		if (id == jitdump_record_type_CODE_LOAD && body + 32 < record_end)
+		{
+			/* vma (8), code_addr (8), code_size (8), code_index (8), then null-terminated name. */
+			uint64_t code_addr = read_u64(body + 8);
+			uint64_t code_size = read_u64(body + 16);
+			const char* name_begin = body + 32;
+			const char* name_end = memchr(name_begin, '\0', record_end - name_begin);
+
+			if (name_end)
+			{
+				symbol_range range = { 0 };
+				range.start = code_addr;
+				range.end = code_addr + code_size;
+				range.name = *string_store_get_or_create(j->string_store, strv_make_from(name_begin, name_end - name_begin));
+				range.module_name = j->module_name;
+				range.timestamp = timestamp;
+
+				insert_range(j, range);
+			}
+		}
+		else if (id == jitdump_record_type_CODE_MOVE && body + 40 <= record_end)
+		{
+			/* vma (8), old_code_addr (8), new_code_addr (8), code_size (8), code_index (8). */
+			uint64_t old_code_addr = read_u64(body + 8);
+			uint64_t new_code_addr = read_u64(body + 16);
+			uint64_t code_size = read_u64(body + 24);
+
+			symbol_range* previous = symbol_index_find(&j->index, old_code_addr);
+			if (previous)
+			{
+				symbol_range range = *previous;
+				range.start = new_code_addr;
+				range.end = new_code_addr + code_size;
+				range.timestamp = timestamp;
+
+				insert_range(j, range);
+			}
+		}
+
+		consumed += total_size;
+	}
+
+	return consumed;
+}
+
+static uint32_t read_u32(const char* data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+static uint64_t read_u64(const char* data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
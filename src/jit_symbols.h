@@ -0,0 +1,70 @@
+#ifndef SAMPLY_JIT_SYMBOLS_H
+#define SAMPLY_JIT_SYMBOLS_H
+
+#include <stdint.h> /* uint64_t */
+
+#include "darr.h"
+#include "strv.h" /* strv */
+
+#include "symbol_index.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Symbols of JIT-compiled code, written by the runtime (LuaJIT, JVM agents, V8 etc.) in:
+		- perf-<pid>.map: text format, one "<hex start> <hex size> <name>" per line.
+		- jit-<pid>.dump: binary jitdump format, see tools/perf/Documentation/jitdump-specification.txt in the Linux tree.
+
+	Both files are located in the temporary directory and are read incrementally since they grow during the run.
+*/
+
+/* A file followed while it grows. */
+typedef struct jit_source jit_source;
+struct jit_source {
+	darr(char) path;     /* Null-terminated path of the file. */
+	uint64_t offset;     /* Number of bytes already consumed. */
+	bool header_read;    /* Only used by the jitdump file. */
+	bool has_arch_timestamps; /* Only used by the jitdump file, its timestamps are not on the monotonic clock. */
+	bool disabled;       /* File is invalid, don't read it anymore. */
+};
+
+typedef struct jit_symbols jit_symbols;
+struct jit_symbols {
+	struct string_store* string_store;
+
+	symbol_index index;
+
+	jit_source perf_map;
+	jit_source jitdump;
+
+	/* Reusable buffer containing the bytes read from a file. */
+	darr(char) buffer;
+
+	/* Addresses [start, end) covering the ranges inserted by the last refresh, empty if nothing changed. */
+	address changed_start;
+	address changed_end;
+
+	/* Module name associated with all JIT symbols. */
+	strv module_name;
+};
+
+void jit_symbols_init(jit_symbols* j, struct string_store* s);
+void jit_symbols_destroy(jit_symbols* j);
+
+/* Start following the files of the specified process. Previous symbols are cleared. */
+void jit_symbols_open(jit_symbols* j, unsigned long pid);
+
+/* Read entries appended to the files since the last refresh.
+   Returns true if ranges were inserted, between changed_start and changed_end. */
+bool jit_symbols_refresh(jit_symbols* j);
+
+/* Returns the range containing the address or NULL. */
+symbol_range* jit_symbols_find(jit_symbols* j, address addr);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_JIT_SYMBOLS_H */
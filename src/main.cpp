@@ -2,39 +2,185 @@
 
 #include "string.h"
 #include "stdio.h"
+#include "stdlib.h" // atoi
 
+#include "samply.h"
 #include "process.h"
 #include "sampler.h"
 #include "report.h"
+#include "report_diff.h"
+#include "report_merge.h"
+#include "report_pprof.h"
+#include "report_speedscope.h"
+#include "report_folded.h"
+#include "report_callgrind.h"
+#include "report_filter.h"
+#include "function_view.h"
+#include "capture.h"
+#include "sample_log.h"
+#include "utils/log.h"
 
 #define LITERAL_STREQUAL(str, literal_str) (strncmp(str, literal_str, sizeof(literal_str) - 1) == 0)
 
 cmd_args get_args_to_run(char** argv);
 bool run_process(process* p, sampler* s);
 
+static int symbolize_command(int argc, char** argv);
+static int diff_command(int argc, char** argv);
+static int merge_command(int argc, char** argv);
+static int export_command(int argc, char** argv);
+static int import_command(int argc, char** argv);
+static int view_command(int argc, char** argv);
+static bool save_report(report* r, const char* filepath, bool compress);
+static bool parse_group_by(const char* str, report_group_by* group_by);
+static void print_filtered_report(report* r, report_filter* filter, report_group_by group_by);
+static bool print_callers(report* r, strv symbol);
+static bool print_instructions(report* r, symbol_manager* m, strv symbol);
+
 int main(int argc, char** argv)
 {
-    (void)argc;
-    sampler s;
-    sampler_init(&s);
-    report report;
-    report_init(&report);
+    // Sub-commands.
+    //      samply symbolize capture.raw -o report.bin
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "symbolize"))
+    {
+        return symbolize_command(argc - 2, argv + 2);
+    }
+    //      samply diff old.bin new.bin [--significant] [--gui]
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "diff"))
+    {
+        return diff_command(argc - 2, argv + 2);
+    }
+    //      samply merge *.bin -o fleet.bin
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "merge"))
+    {
+        return merge_command(argc - 2, argv + 2);
+    }
+    //      samply export report.bin -o profile.pb.gz --format pprof --gzip
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "export"))
+    {
+        return export_command(argc - 2, argv + 2);
+    }
+    //      samply import stacks.folded -o report.bin
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "import"))
+    {
+        return import_command(argc - 2, argv + 2);
+    }
+    //      samply view report.bin [--stats]
+    if (argc > 1 && LITERAL_STREQUAL(argv[1], "view"))
+    {
+        return view_command(argc - 2, argv + 2);
+    }
 
     int exit_code = 0;
     bool no_subprocess_error = true;
 
     bool show_gui = true;
+    bool show_statistics = false;
+    const char* capture_path = NULL;
+    const char* log_path = NULL;
+    bool compress = false;
+    report_group_by group_by = report_group_by_SYMBOL;
+    size_t max_address_count = 0;
+    report_filter filter = {};
+    bool collect_call_stacks = false;
+    const char* callers_of = NULL;
+    const char* instructions_of = NULL;
 
-    // Parse arguments.
-    while (argv && *argv)
+    // Parse arguments, everything after "--run" belongs to the child process.
+    while (argv && *argv && !LITERAL_STREQUAL(*argv, "--run"))
     {
         if (LITERAL_STREQUAL(*argv, "--no-gui"))
         {
             show_gui = false;
         }
+        else if (LITERAL_STREQUAL(*argv, "--stats"))
+        {
+            show_statistics = true;
+        }
+        // One row per module, source file or symbol (default).
+        else if (LITERAL_STREQUAL(*argv, "--group-by") && argv[1])
+        {
+            argv += 1;
+            if (!parse_group_by(*argv, &group_by))
+            {
+                log_error("Unknown --group-by value '%s', expected module, file or symbol.", *argv);
+                return 1;
+            }
+        }
+        // Only track the top addresses, in fixed memory, for very long runs.
+        else if (LITERAL_STREQUAL(*argv, "--max-addresses") && argv[1])
+        {
+            argv += 1;
+            int value = atoi(*argv);
+            if (value <= 0)
+            {
+                log_error("Invalid --max-addresses value '%s', expected a positive number.", *argv);
+                return 1;
+            }
+            max_address_count = (size_t)value;
+        }
+        // Only print the symbols matching the query, see report_filter.h.
+        else if (LITERAL_STREQUAL(*argv, "--filter") && argv[1])
+        {
+            argv += 1;
+            if (!report_filter_parse(&filter, strv_make_from_str(*argv)))
+            {
+                log_error("%s", filter.error);
+                return 1;
+            }
+        }
+        // Walk the call stack of each sample, to display the callers and the callees of the symbols.
+        else if (LITERAL_STREQUAL(*argv, "--call-stacks"))
+        {
+            collect_call_stacks = true;
+        }
+        // Only print the callers and the callees of a symbol.
+        else if (LITERAL_STREQUAL(*argv, "--callers") && argv[1])
+        {
+            argv += 1;
+            callers_of = *argv;
+            collect_call_stacks = true;
+            show_gui = false;
+        }
+        // Only print the samples of each instruction of a symbol.
+        else if (LITERAL_STREQUAL(*argv, "--instructions") && argv[1])
+        {
+            argv += 1;
+            instructions_of = *argv;
+            show_gui = false;
+        }
+        // Only capture addresses, they are symbolized later with "samply symbolize".
+        else if (LITERAL_STREQUAL(*argv, "--capture") && argv[1])
+        {
+            argv += 1;
+            capture_path = *argv;
+            show_gui = false;
+        }
+        // Also append the samples to a file while sampling, it can be symbolized even if the session crashed.
+        else if (LITERAL_STREQUAL(*argv, "--log") && argv[1])
+        {
+            argv += 1;
+            log_path = *argv;
+        }
+        // Compress the sample log, see compression.h.
+        else if (LITERAL_STREQUAL(*argv, "--compress"))
+        {
+            compress = true;
+        }
         argv += 1;
     }
 
+    sampler s;
+    sampler_init(&s);
+    report report;
+    report_init(&report);
+
+    s.capture_only = capture_path != NULL;
+    s.log_path = log_path;
+    s.compress_log = compress;
+    s.max_address_count = max_address_count;
+    s.collect_call_stacks = collect_call_stacks;
+
     // If the command line contains "--run" everything after will
     // run from a child process.
     // Example:
@@ -50,7 +196,22 @@ int main(int argc, char** argv)
         {
             no_subprocess_error = run_process(&p, &s);
 
+            /* Raw capture */
+            if (capture_path)
+            {
+                capture c;
+                capture_init(&c);
+                capture_load_from_sampler(&c, &s);
+
+                if (!capture_save_to_filepath(&c, capture_path))
+                {
+                    exit_code = 1;
+                }
+
+                capture_destroy(&c);
+            }
             /* Report */
+            else
             {
                 /* Load report from sampler. */
                 report_load_from_sampler(&report, &s);
@@ -59,7 +220,33 @@ int main(int argc, char** argv)
                 if (!show_gui)
                 {
                     /* Display report in std output. */
-                    report_print_to_file(&report, stdout);
+                    if (callers_of)
+                    {
+                        if (!print_callers(&report, strv_make_from_str(callers_of)))
+                        {
+                            exit_code = 1;
+                        }
+                    }
+                    else if (instructions_of)
+                    {
+                        if (!print_instructions(&report, &s.mgr, strv_make_from_str(instructions_of)))
+                        {
+                            exit_code = 1;
+                        }
+                    }
+                    else if (report_filter_is_empty(&filter))
+                    {
+                        report_print_grouped_to_file(&report, group_by, stdout);
+                    }
+                    else
+                    {
+                        print_filtered_report(&report, &filter, group_by);
+                    }
+
+                    if (show_statistics)
+                    {
+                        symbol_manager_print_statistics(&s.mgr, stdout);
+                    }
 
 /* To test if save/load from/to a file is working. */
 #if 0 
@@ -146,6 +333,495 @@ bool run_process(process* p, sampler* s)
         return false;
     }
     sampler_stop(s);
-   
+
+    // Wait for the sampler to be done with the process before using its results.
+    while (sampler_is_running(s))
+    {
+        thread_yield();
+    }
+
+    return true;
+}
+
+static int symbolize_command(int argc, char** argv)
+{
+    const char* capture_path = NULL;
+    const char* output_path = NULL;
+    const char* symbol_path = "";
+    bool compress = false;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "-o") && i + 1 < argc)
+        {
+            i += 1;
+            output_path = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--symbol-path") && i + 1 < argc)
+        {
+            i += 1;
+            symbol_path = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--compress"))
+        {
+            compress = true;
+        }
+        else
+        {
+            capture_path = argv[i];
+        }
+    }
+
+    if (!capture_path || !output_path)
+    {
+        log_error("Usage: samply symbolize <capture or sample log> -o <report> [--symbol-path <dir;dir>] [--compress]");
+        return 1;
+    }
+
+    report r;
+    report_init(&r);
+
+    // Strings are interned into the report.
+    symbol_manager mgr;
+    symbol_manager_init(&mgr, &r.string_store);
+
+    capture c;
+    capture_init(&c);
+
+    // Sample logs are loaded like captures, even if they are truncated.
+    bool loaded = sample_log_is_log_file(capture_path)
+        ? sample_log_load_from_filepath(&c, capture_path)
+        : capture_load_from_filepath(&c, capture_path);
+
+    bool success = loaded
+        && capture_symbolize(&c, &mgr, strv_make_from_str(symbol_path), &r)
+        && save_report(&r, output_path, compress);
+
+    capture_destroy(&c);
+    symbol_manager_destroy(&mgr);
+    report_destroy(&r);
+
+    return success ? 0 : 1;
+}
+
+static int diff_command(int argc, char** argv)
+{
+    const char* old_path = NULL;
+    const char* new_path = NULL;
+    bool show_gui = false;
+    bool significant_only = false;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "--gui"))
+        {
+            show_gui = true;
+        }
+        // Skip the changes which can be explained by the sampling noise.
+        else if (LITERAL_STREQUAL(argv[i], "--significant"))
+        {
+            significant_only = true;
+        }
+        else if (!old_path)
+        {
+            old_path = argv[i];
+        }
+        else
+        {
+            new_path = argv[i];
+        }
+    }
+
+    if (!old_path || !new_path)
+    {
+        log_error("Usage: samply diff <old report> <new report> [--significant] [--gui]");
+        return 1;
+    }
+
+    report old_report;
+    report_init(&old_report);
+    report new_report;
+    report_init(&new_report);
+
+    int exit_code = 0;
+
+    // The comparison only needs the summaries, the GUI loads the records of the opened files.
+    if (report_load_summary_from_filepath(&old_report, old_path)
+        && report_load_summary_from_filepath(&new_report, new_path))
+    {
+        report_comparison c;
+        report_comparison_init(&c);
+
+        report_diff(&c, &old_report, &new_report);
+
+        if (show_gui)
+        {
+            // The GUI always needs a sampler, even if nothing is sampled.
+            sampler s;
+            sampler_init(&s);
+
+            // The "Reports" tab displays the new report.
+            gui g = { &s, &new_report };
+            g.comparison = &c;
+
+            exit_code = g.show();
+
+            sampler_destroy(&s);
+        }
+        else
+        {
+            report_comparison_print_to_file(&c, significant_only, stdout);
+        }
+
+        report_comparison_destroy(&c);
+    }
+    else
+    {
+        exit_code = 1;
+    }
+
+    report_destroy(&new_report);
+    report_destroy(&old_report);
+
+    return exit_code;
+}
+
+static int merge_command(int argc, char** argv)
+{
+    const char* output_path = NULL;
+    size_t thread_count = samply_cpu_count();
+    bool compress = false;
+
+    // Input paths are compacted at the beginning of argv.
+    const char** input_paths = (const char**)argv;
+    size_t input_count = 0;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "-o") && i + 1 < argc)
+        {
+            i += 1;
+            output_path = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--threads") && i + 1 < argc)
+        {
+            i += 1;
+            int value = atoi(argv[i]);
+            thread_count = value > 0 ? (size_t)value : 1;
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--compress"))
+        {
+            compress = true;
+        }
+        else
+        {
+            input_paths[input_count] = argv[i];
+            input_count += 1;
+        }
+    }
+
+    if (input_count == 0 || !output_path)
+    {
+        log_error("Usage: samply merge <report> [<report>...] -o <report> [--threads <count>] [--compress]");
+        return 1;
+    }
+
+    report r;
+    report_init(&r);
+
+    // Reports which could not be loaded are reported but they don't prevent the merge.
+    bool all_loaded = report_merge_filepaths(&r, input_paths, input_count, thread_count);
+
+    bool success = save_report(&r, output_path, compress);
+
+    report_destroy(&r);
+
+    return all_loaded && success ? 0 : 1;
+}
+
+static int export_command(int argc, char** argv)
+{
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    const char* format = "pprof";
+    bool compress = false;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "-o") && i + 1 < argc)
+        {
+            i += 1;
+            output_path = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--format") && i + 1 < argc)
+        {
+            i += 1;
+            format = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--gzip"))
+        {
+            compress = true;
+        }
+        else
+        {
+            input_path = argv[i];
+        }
+    }
+
+    if (!input_path || !output_path)
+    {
+        log_error("Usage: samply export <report> -o <file> [--format pprof|speedscope|folded|callgrind] [--gzip]");
+        return 1;
+    }
+
+    bool is_pprof = strcmp(format, "pprof") == 0;
+    bool is_speedscope = strcmp(format, "speedscope") == 0;
+    bool is_folded = strcmp(format, "folded") == 0;
+    bool is_callgrind = strcmp(format, "callgrind") == 0;
+    if (!is_pprof && !is_speedscope && !is_folded && !is_callgrind)
+    {
+        log_error("Unknown --format value '%s', expected pprof, speedscope, folded or callgrind.", format);
+        return 1;
+    }
+
+    report r;
+    report_init(&r);
+
+    bool success = report_load_from_filepath(&r, input_path);
+    if (success && is_pprof)
+    {
+        success = report_save_pprof(&r, output_path, compress);
+    }
+    else if (success && is_speedscope)
+    {
+        success = report_save_speedscope(&r, output_path);
+    }
+    else if (success && is_folded)
+    {
+        success = report_save_folded(&r, output_path);
+    }
+    else if (success && is_callgrind)
+    {
+        success = report_save_callgrind(&r, output_path);
+    }
+
+    report_destroy(&r);
+
+    return success ? 0 : 1;
+}
+
+// Convert collapsed stacks from other profilers to a report, see report_folded.h.
+static int import_command(int argc, char** argv)
+{
+    const char* input_path = NULL;
+    const char* output_path = NULL;
+    bool compress = false;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "-o") && i + 1 < argc)
+        {
+            i += 1;
+            output_path = argv[i];
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--compress"))
+        {
+            compress = true;
+        }
+        else
+        {
+            input_path = argv[i];
+        }
+    }
+
+    if (!input_path || !output_path)
+    {
+        log_error("Usage: samply import <stacks.folded> -o <report> [--compress]");
+        return 1;
+    }
+
+    report r;
+    report_init(&r);
+
+    bool success = report_load_from_folded(&r, input_path)
+        && save_report(&r, output_path, compress);
+
+    report_destroy(&r);
+
+    return success ? 0 : 1;
+}
+
+// Display a saved report in the GUI, the records of a source file are only loaded when it's opened.
+static int view_command(int argc, char** argv)
+{
+    const char* input_path = NULL;
+    size_t thread_count = 0;
+    bool show_gui = true;
+    bool show_statistics = false;
+
+    for (int i = 0; i < argc; i += 1)
+    {
+        if (LITERAL_STREQUAL(argv[i], "--threads") && i + 1 < argc)
+        {
+            i += 1;
+            int value = atoi(argv[i]);
+            thread_count = value > 0 ? (size_t)value : 1;
+        }
+        // Print the duration of each stage of the load.
+        else if (LITERAL_STREQUAL(argv[i], "--stats"))
+        {
+            show_statistics = true;
+        }
+        else if (LITERAL_STREQUAL(argv[i], "--no-gui"))
+        {
+            show_gui = false;
+        }
+        else
+        {
+            input_path = argv[i];
+        }
+    }
+
+    if (!input_path)
+    {
+        log_error("Usage: samply view <report> [--threads <count>] [--stats] [--no-gui]");
+        return 1;
+    }
+
+    report r;
+    report_init(&r);
+    r.load_thread_count = thread_count;
+
+    // Records are only decoded when the GUI needs them, without GUI the whole file is loaded.
+    bool loaded = show_gui
+        ? report_load_summary_from_filepath(&r, input_path)
+        : report_load_from_filepath(&r, input_path);
+
+    int exit_code = loaded ? 0 : 1;
+    if (loaded && show_statistics)
+    {
+        report_print_load_timings(&r, stdout);
+    }
+
+    if (loaded && show_gui)
+    {
+        // The GUI always needs a sampler, even if nothing is sampled.
+        sampler s;
+        sampler_init(&s);
+
+        gui g = { &s, &r };
+        exit_code = g.show();
+
+        sampler_destroy(&s);
+    }
+
+    report_destroy(&r);
+
+    return exit_code;
+}
+
+static bool save_report(report* r, const char* filepath, bool compress)
+{
+    return compress
+        ? report_save_compressed_to_filepath(r, filepath)
+        : report_save_to_filepath(r, filepath);
+}
+
+static bool parse_group_by(const char* str, report_group_by* group_by)
+{
+    if (strcmp(str, "symbol") == 0)
+    {
+        *group_by = report_group_by_SYMBOL;
+    }
+    else if (strcmp(str, "module") == 0)
+    {
+        *group_by = report_group_by_MODULE;
+    }
+    else if (strcmp(str, "file") == 0)
+    {
+        *group_by = report_group_by_FILE;
+    }
+    else
+    {
+        return false;
+    }
     return true;
-}
\ No newline at end of file
+}
+
+static void print_filtered_report(report* r, report_filter* filter, report_group_by group_by)
+{
+    report_filter_index index;
+    report_filter_index_init(&index);
+    report_filter_result result;
+    report_filter_result_init(&result);
+
+    report_filter_index_build(&index, r);
+    report_filter_apply(&index, r, filter, &result);
+    report_filter_print_to_file(&index, r, &result, group_by, stdout);
+
+    report_filter_result_destroy(&result);
+    report_filter_index_destroy(&index);
+}
+
+// Print the callers and the callees of the symbol, or of all the symbols containing it if there is no exact match.
+static bool print_callers(report* r, strv symbol)
+{
+    call_graph* g = &r->call_graph;
+
+    uint32_t id = call_graph_find_symbol(g, symbol);
+    if (id != UINT32_MAX)
+    {
+        call_graph_print_symbol_to_file(g, id, r->sample_count, stdout);
+        return true;
+    }
+
+    bool found = false;
+    for (size_t i = 0; i < g->symbols.size; i += 1)
+    {
+        if (strv_find(g->symbols.data[i], symbol) != STRV_NPOS)
+        {
+            call_graph_print_symbol_to_file(g, (uint32_t)i, r->sample_count, stdout);
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        log_error("Symbol '" STRV_FMT "' is not in any sampled call stack.", STRV_ARG(symbol));
+    }
+    return found;
+}
+
+// Print the instructions of the symbol, or of all the symbols containing it if there is no exact match.
+static bool print_instructions(report* r, symbol_manager* m, strv symbol)
+{
+    function_view v;
+    function_view_init(&v);
+
+    bool found = function_view_load(&v, r, symbol, m);
+    if (found)
+    {
+        function_view_print_to_file(&v, stdout);
+    }
+    else
+    {
+        for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+        {
+            strv name = r->summary_by_count.data[i].symbol_name;
+            if (strv_find(name, symbol) != STRV_NPOS
+                && function_view_load(&v, r, name, m))
+            {
+                function_view_print_to_file(&v, stdout);
+                found = true;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        log_error("Symbol '" STRV_FMT "' has not been sampled.", STRV_ARG(symbol));
+    }
+
+    function_view_destroy(&v);
+    return found;
+}
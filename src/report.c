@@ -2,15 +2,104 @@
 
 #include "samply.h"
 #include "sampler.h"
+#include "statistics.h"
+#include "compression.h"
+#include "thread.h"
 #include "utils/log.h"
+#include "utils/varint.h"
 
 static char magic1_samp[4] = { 's', 'a', 'm', 'p' };
 static char magic2_summ[4] = { 's', 'u', 'm', 'm' };
+static char magic_rollups[4] = { 'r', 'o', 'l', 'l' };
+static char magic_errors[4] = { 'e', 'r', 'r', 's' };
+static char magic_call_graph[4] = { 'c', 'a', 'l', 'l' };
+static char magic_section_strings[4] = { 's', 't', 'r', 's' };
+static char magic_section_symbols[4] = { 's', 'y', 'm', 'b' };
+static char magic_section_modules[4] = { 'm', 'o', 'd', 'u' };
+static char magic_section_files[4] = { 'f', 'i', 'l', 'e' };
+static char magic_section_call_symbols[4] = { 'c', 'g', 's', 'y' };
+static char magic_section_call_edges[4] = { 'c', 'g', 'e', 'd' };
+static char magic_section_record_names[4] = { 'r', 'n', 'a', 'm' };
+static char magic_section_records[4] = { 'r', 'e', 'c', 's' };
+static char magic_section_record_index[4] = { 'r', 'i', 'd', 'x' };
 static uint64_t zero = 0;
 
+/* Version of the files written before the string table, they are still readable. */
+#define SUMMARY_VERSION_NUMBER_V1 (1)
+/* Sections start at a multiple of this, so their entries can be read in place. */
+#define SUMMARY_SECTION_ALIGNMENT (8)
+/* Smallest encoded record, one byte per field except the function size. */
+#define SUMMARY_MIN_RECORD_SIZE (8)
+/* Flag of a section stored as compressed blocks. */
+#define SUMMARY_SECTION_FLAG_COMPRESSED (1)
+/* Smaller sections are never compressed. */
+#define SUMMARY_MIN_COMPRESSED_SECTION_SIZE (4 * 1024)
+/* Compressed blocks decompressed by a load job. */
+#define LOAD_BLOCKS_PER_JOB (16)
+/* Symbols read by a load job. */
+#define LOAD_SYMBOLS_PER_JOB (64 * 1024)
+/* Bytes of the record stream decoded by a load job, which only has whole source files. */
+#define LOAD_RECORD_BYTES_PER_JOB (1024 * 1024)
+/* Most threads loading a file. */
+#define LOAD_MAX_THREAD_COUNT (64)
+
 /*
 
-Summary Binary Format:
+Summary Binary Format, version 2:
+
+header	   |--------------------------|
+		   | 1) magic number 1        | b8 x 4  | 's' 'a' 'm' 'p'
+		   | 2) magic number 2        | b8 x 4  | 's' 'u' 'm' 'm'
+		   | 3) zero                  | uint64
+		   | 4) version number        | uint64  | 2
+		   | 5) version info          | b8 x 32 | // null-terminated string of 32 byte (which include the null-terminated char).
+		   | 6) total sampling count  | uint64
+		   | 7) section count         | uint64
+directory  | -------------------       // Right after the header.
+section 0..N| 1) magic number         | b8 x 4
+		   | 2) flags                 | uint32  | // 1: compressed. Zero in the files written before the compression.
+		   | 3) offset                | uint64  | // From the start of the file, multiple of 8.
+		   | 4) size in bytes         | uint64  | // Stored size.
+		   | 5) entry count           | uint64
+sections   | -------------------       // Unknown sections are ignored, missing optional sections are empty.
+		   | 's' 't' 'r' 's'          | Strings, each distinct string is stored once.
+		   | 's' 'y' 'm' 'b'          | Symbols:      counter, error, symbol name, module name, source file name, closest line number.
+		   | 'm' 'o' 'd' 'u'          | Modules:      counter, error, name.
+		   | 'f' 'i' 'l' 'e'          | Source files: counter, error, name.
+		   | 'c' 'g' 's' 'y'          | Optional, symbols of the call graph: name, self counter, total counter.
+		   | 'c' 'g' 'e' 'd'          | Optional, edges of the call graph:   caller index (uint32), callee index (uint32), counter.
+		   | 'r' 'n' 'a' 'm'          | Optional, names used by the records: string.
+		   | 'r' 'e' 'c' 's'          | Optional, address-level records, encoded as a stream of varints (see below).
+		   | 'r' 'i' 'd' 'x'          | Optional, records of each source file: name, offset and size in the record stream, record count,
+		   |                          | line number and address of the previous record.
+
+Entries have a fixed size (see the *_entry_v2 structs), counters and line numbers are uint64,
+strings are (offset in the string section, size) pairs of uint32.
+Loaded from a mapped file, the strings of the report point directly into the mapping.
+
+Sections of the compressed files are stored as compressed blocks (see compression.h), only if they get smaller.
+They are decompressed in the arena of the report when the file is loaded, the other sections are still used in place.
+
+The records are stored in the order of report.records (source file, line number, address).
+Varints are LEB128, signed deltas are zigzag encoded. The stream starts with the record count, then for each record:
+
+		   | 1) source file           | varint  | // Index in the record names.
+		   | 2) line number           | signed delta from the previous record
+		   | 3) address               | signed delta from the previous record
+		   | 4) symbol name           | varint  | // Index in the record names.
+		   | 5) module name           | varint  | // Index in the record names.
+		   | 6) counter               | varint
+		   | 7) error                 | varint
+		   | 8) function start        | varint  | // address - function start + 1, zero if the function range is unknown.
+		   | 9) function size         | varint  | // Only if the function range is known.
+
+The record index gives the bytes of each source file in the stream, with the values their deltas start from,
+so the records of a file are decoded without the other ones (see report_load_summary_from_filepath).
+
+Files are loaded by several threads: the blocks of the compressed sections, ranges of symbols
+and ranges of source files of the record stream are independent jobs, each of them writes to its own part of the report.
+
+Summary Binary Format, version 1 (read only):
 
 header	   |--------------------------|
 		   | 1) magic number 1        | b8 x 4  | 's' 'a' 'm' 'p'
@@ -29,6 +118,35 @@ frame 0..N | -------------------
 		   | 6) source file name size | uint64
 		   | 7) source file name data | ...
 		   | 8) line number           | ...
+rollups    | -------------------       // Optional, computed from the frames when missing.
+		   | 1) magic number          | b8 x 4  | 'r' 'o' 'l' 'l'
+		   | 2) module count          | uint64
+module 0..N| 1) module sampling count | uint64
+		   | 2) module name size      | uint64
+		   | 3) module name data      | ...
+		   | 3) source file count     | uint64
+file 0..N  | 1) file sampling count   | uint64
+		   | 2) file name size        | uint64
+		   | 3) file name data        | ...
+errors     | -------------------       // Optional, only after the rollups, zero when missing.
+		   | 1) magic number          | b8 x 4  | 'e' 'r' 'r' 's'
+		   | 2) symbol count          | uint64
+		   | 3) symbol errors         | uint64 x symbol count, in the order of the frames
+		   | 4) module count          | uint64
+		   | 5) module errors         | uint64 x module count
+		   | 6) source file count     | uint64
+		   | 7) source file errors    | uint64 x source file count
+call graph | -------------------       // Optional, only after the rollups and the errors, only if call stacks were sampled.
+		   | 1) magic number          | b8 x 4  | 'c' 'a' 'l' 'l'
+		   | 2) symbol count          | uint64
+symbol 0..N| 1) symbol name size      | uint64
+		   | 2) symbol name data      | ...
+		   | 3) self sampling count   | uint64
+		   | 4) total sampling count  | uint64
+		   | 3) edge count            | uint64
+edge 0..N  | 1) caller symbol index   | uint64
+		   | 2) callee symbol index   | uint64
+		   | 3) edge sampling count   | uint64
 */
 
 typedef struct summary_binary_header_v1 summary_binary_header_v1;
@@ -42,25 +160,258 @@ struct summary_binary_header_v1 {
 	uint64_t total_entry_count;
 };
 
-static bool summed_record_by_count_predicate_less(const summed_record* left, const summed_record* right);
-static bool record_by_file_predicate_less(const record* left, const record* right);
-static bool record_by_line_predicate_less(const record* left, const record* right);
+typedef struct summary_binary_header_v2 summary_binary_header_v2;
+struct summary_binary_header_v2 {
+	char magic1[4];
+	char magic2[4];
+	uint64_t zero;
+	uint64_t version_number;
+	char version_text[32];
+	uint64_t total_sampling_count;
+	uint64_t section_count;
+};
+
+typedef struct section_entry_v2 section_entry_v2;
+struct section_entry_v2 {
+	char magic[4];
+	uint32_t flags;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t count;
+};
+
+typedef struct string_ref_v2 string_ref_v2;
+struct string_ref_v2 {
+	uint32_t offset;
+	uint32_t size;
+};
+
+typedef struct symbol_entry_v2 symbol_entry_v2;
+struct symbol_entry_v2 {
+	uint64_t counter;
+	uint64_t error;
+	string_ref_v2 symbol_name;
+	string_ref_v2 module_name;
+	string_ref_v2 source_file_name;
+	uint64_t closest_line_number;
+};
+
+typedef struct rollup_entry_v2 rollup_entry_v2;
+struct rollup_entry_v2 {
+	uint64_t counter;
+	uint64_t error;
+	string_ref_v2 name;
+};
+
+typedef darr(rollup_entry_v2) rollup_entries_v2;
+typedef darr(string_ref_v2) string_refs_v2;
+typedef darr(uint8_t) encoded_bytes;
+
+/* Records of a source file in the record stream. */
+typedef struct record_file_entry_v2 record_file_entry_v2;
+struct record_file_entry_v2 {
+	string_ref_v2 name;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t count;
+	uint64_t line;
+	uint64_t address;
+};
+
+typedef darr(record_file_entry_v2) record_file_entries_v2;
+
+typedef struct call_symbol_entry_v2 call_symbol_entry_v2;
+struct call_symbol_entry_v2 {
+	string_ref_v2 name;
+	uint64_t self_counter;
+	uint64_t total_counter;
+};
+
+typedef struct call_edge_entry_v2 call_edge_entry_v2;
+struct call_edge_entry_v2 {
+	uint32_t caller;
+	uint32_t callee;
+	uint64_t counter;
+};
+
+/* Section to write, data is an array of count entries. */
+typedef struct pending_section pending_section;
+struct pending_section {
+	char* magic;
+	const void* data;
+	size_t size;
+	size_t count;
+	/* Compressed blocks of the data, if they are smaller. */
+	compressed_bytes compressed;
+};
+
+/* Reference of a string already in the table. The name points to the string being written. */
+typedef struct string_table_slot string_table_slot;
+struct string_table_slot {
+	strv name;
+	string_ref_v2 ref;
+};
+
+/* Number of entries of the direct-mapped cache of the string table. Must be a power of two. */
+#define STRING_TABLE_CACHE_SIZE (256)
+
+/* Deduplicated strings of a file being written. */
+typedef struct string_table string_table;
+struct string_table {
+	darr(char) bytes;
+	ht slots;
+	/* Recently added strings by data pointer. Names of a report are usually interned,
+	   so the few modules and source files are found without hashing their content. */
+	string_table_slot cache[STRING_TABLE_CACHE_SIZE];
+};
+
+/* Records are sorted by source file, then by line number, then by address.
+   Comparing strings for each comparison is slow, so each source file gets a rank
+   which respects the lexicographical order of the file names, and the records are sorted
+   on (rank, line number, address) packed in integers. */
+typedef struct record_sort_key record_sort_key;
+struct record_sort_key {
+	uint64_t file_and_line; /* Rank of the source file in the high 32 bits, line number in the low 32 bits. */
+	uint64_t address;
+	record* item;           /* Record in the results, they are not moved while the report is built. */
+};
+
+/* Index of the summary entry of a symbol, a module or a source file.
+   Names are interned, so they are identified by their data pointer instead of their content. */
+typedef struct summary_slot summary_slot;
+struct summary_slot {
+	strv name;
+	size_t index;
+};
+
+/* Rank of a source file name. Names are interned so they are identified by their data pointer. */
+typedef struct file_rank file_rank;
+struct file_rank {
+	strv file;
+	uint32_t rank;
+};
+
+enum loaded_section_id {
+	loaded_section_STRINGS,
+	loaded_section_SYMBOLS,
+	loaded_section_MODULES,
+	loaded_section_FILES,
+	loaded_section_RECORD_NAMES,
+	loaded_section_RECORDS,
+	loaded_section_RECORD_INDEX,
+	loaded_section_CALL_SYMBOLS,
+	loaded_section_CALL_EDGES,
+	loaded_section_COUNT
+};
+
+/* Section of the file being loaded. Compressed sections are decompressed in the arena by the load jobs. */
+typedef struct loaded_section loaded_section;
+struct loaded_section {
+	strv data;
+	size_t count;
+	bool is_compressed;
+	compressed_blocks blocks;
+	char* decompressed;
+};
 
-/* Sort by source file, then by line number, then by address. */
-static bool record_predicate_less(const record* left, const record* right);
+/* Part of a stage of the load, done by one thread. */
+typedef struct load_job load_job;
+struct load_job {
+	size_t section;             /* Section of the blocks, to decompress. */
+	size_t begin;               /* First block, symbol or source file. */
+	size_t end;
+	size_t first_record;        /* Index of the first record of the source files. */
+	size_t kernel_sample_count; /* Samples of the kernel module. */
+};
+
+typedef darr(load_job) load_jobs;
+
+typedef struct report_loader report_loader;
+typedef bool (*load_job_procedure)(report_loader* l, load_job* job);
+
+/* State of a file loaded by several threads. */
+struct report_loader {
+	report* r;
+	loaded_section sections[loaded_section_COUNT];
+	/* Byte range of each source file in the record stream. */
+	record_files files;
 
-static void upsert_record(report* r, record* rec);
+	load_jobs jobs;
+	load_job_procedure procedure;
+	thread_atomic_int_t next_job;
+	thread_atomic_int_t failure_count;
+	size_t thread_count;
+};
+
+static bool record_by_file_predicate_less(const record* left, const record* right);
+static bool record_by_line_predicate_less(const record* left, const record* right);
 
-static void update_summary_with(report* r, record* rec);
+static void rank_source_files(ht* results, ht* ranks);
+static void radix_sort_record_keys(record_sort_key* keys, record_sort_key* tmp, size_t count);
+
+static ht_hash_t file_rank_hash(file_rank* item);
+static bool file_rank_are_same(file_rank* left, file_rank* right);
+static void file_rank_swap(file_rank* left, file_rank* right);
+static int compare_file_rank(const file_rank* left, const file_rank* right);
+
+static void update_summary_with(report* r, ht* slots, record* rec);
+static void update_rollup_with(rollup_records* rollup, ht* slots, strv name, size_t counter, size_t error);
+static void summary_slots_init(ht* slots);
+static size_t summary_slot_get_index(ht* slots, strv name, size_t next_index);
+static int compare_rollup_record(const rollup_record* left, const rollup_record* right);
+static void print_rollup(report* r, rollup_records* rollup, bool with_errors, FILE* f);
+static bool read_rollup(FILE* f, re_arena* a, rollup_records* rollup);
+static bool has_error_bounds(report* r);
+static bool read_errors(FILE* f, report* r);
+static void clear_error_bounds(report* r);
+static bool read_call_graph(FILE* f, re_arena* a, call_graph* g);
+static bool read_magic(FILE* f, char* magic, char* expected);
+static void load_v1_from_file(report* r, FILE* f, summary_binary_header_v1* header);
+static bool load_from_filepath(report* r, const char* filepath, bool lazy);
+static bool read_v2_from_file(report* r, FILE* f, summary_binary_header_v1* header);
+static bool load_v2_from_memory(report* r, strv file, bool lazy);
+static bool find_loaded_sections(report_loader* l, strv file, uint64_t section_count);
+static bool decompress_sections(report_loader* l, bool keep_records_compressed);
+static bool load_summary(report_loader* l);
+static bool load_records(report_loader* l, bool lazy);
+static bool load_call_graph(report_loader* l);
+static bool run_load_jobs(report_loader* l, load_job_procedure procedure);
+static int load_worker_procedure(void* user_data);
+static bool decompress_job(report_loader* l, load_job* job);
+static bool read_symbols_job(report_loader* l, load_job* job);
+static bool decode_records_job(report_loader* l, load_job* job);
+static bool read_record_count(loaded_section* stream, bool is_compressed, uint64_t stream_size, uint64_t* count, uint64_t* count_size);
+static bool read_record_index(strv strings, strv section, size_t count, uint64_t stream_size, uint64_t record_count, uint64_t first_offset, record_files* files);
+static bool load_record_file(report* r, record_file* f);
+static bool find_stored_section(strv file, uint64_t section_count, char* magic, strv* section, section_entry_v2* entry);
+static bool get_string(strv strings, string_ref_v2 ref, strv* str);
+static bool read_rollup_entries(strv strings, strv section, size_t count, rollup_records* rollup);
+static void save_to_file(report* r, FILE* f, bool compress);
+static void write_sections(FILE* f, report* r, pending_section* sections, size_t section_count, bool compress);
+static void fill_rollup_entries(string_table* strings, rollup_records* rollup, rollup_entries_v2* entries);
+static void encode_records(string_table* strings, sorted_records* recs, string_refs_v2* names, encoded_bytes* stream, record_file_entries_v2* index);
+static uint64_t get_record_name_index(ht* slots, string_table* strings, string_refs_v2* names, strv name);
+static bool decode_records(strv strings, strv names, size_t name_count, strv stream, sorted_records* recs);
+static bool decode_record_range(strv strings, strv names, size_t name_count, const uint8_t* cursor, const uint8_t* end, uint64_t count, uint64_t line, uint64_t addr, record* out);
+static bool get_record_name(strv strings, strv names, size_t name_count, uint64_t index, strv* name);
+static void write_varint(encoded_bytes* stream, uint64_t v);
+static void string_table_init(string_table* t, size_t string_count);
+static void string_table_destroy(string_table* t);
+static string_ref_v2 string_table_add(string_table* t, strv str);
+static ht_hash_t string_table_slot_hash(string_table_slot* item);
+static bool string_table_slot_are_same(string_table_slot* left, string_table_slot* right);
+static void string_table_slot_swap(string_table_slot* left, string_table_slot* right);
+static ht_hash_t summary_slot_hash(summary_slot* item);
+static bool summary_slot_are_same(summary_slot* left, summary_slot* right);
+static void summary_slot_swap(summary_slot* left, summary_slot* right);
+static bool is_kernel_module(strv module_name);
 static int compare_summed_record(const summed_record* left, const summed_record* right);
 
 static void write_bytes(FILE* f, void* data, size_t byte_count);
 static void read_bytes(FILE* f, void* data, size_t byte_count);
 
-static void write_uint64(FILE* f, uint64_t value);
 static void read_uint64(FILE* f, uint64_t* v);
 
-static void write_strv(FILE* f, strv str);
 static void read_strv(FILE* f, re_arena* a, strv* str);
 
 void report_init(report* r)
@@ -68,32 +419,75 @@ void report_init(report* r)
 	memset(r, 0, sizeof(report));
 
 	darr_init(&r->summary_by_count);
+	darr_init(&r->summary_by_module);
+	darr_init(&r->summary_by_file);
 	multi_map_init(&r->records);
+	call_graph_init(&r->call_graph);
+	darr_init(&r->record_index.files);
 
 	size_t min_chunk_capacity = 4 * 1024;
 	re_arena_init(&r->arena, min_chunk_capacity);
 
 	string_store_init(&r->string_store);
+
+	file_mapper_init(&r->file_mapper);
+	readonly_file_init(&r->mapped_file);
 }
 
 void report_destroy(report* r)
 {
 	darr_destroy(&r->summary_by_count);
+	darr_destroy(&r->summary_by_module);
+	darr_destroy(&r->summary_by_file);
 
 	multi_map_init(&r->records);
+	call_graph_destroy(&r->call_graph);
+	darr_destroy(&r->record_index.files);
 
 	re_arena_destroy(&r->arena);
 
 	string_store_destroy(&r->string_store);
+
+	if (readonly_file_is_opened(&r->mapped_file))
+	{
+		file_mapper_close(&r->file_mapper, &r->mapped_file);
+	}
+	file_mapper_destroy(&r->file_mapper);
 }
 
 void report_clear(report* r)
 {
+	r->sample_count = 0;
+	r->kernel_sample_count = 0;
+
 	darr_clear(&r->summary_by_count);
+	darr_clear(&r->summary_by_module);
+	darr_clear(&r->summary_by_file);
 	
 	multi_map_clear(&r->records);
+	call_graph_clear(&r->call_graph);
+
+	/* The index points into the arena or the mapped file. */
+	record_files files = r->record_index.files;
+	darr_clear(&files);
+	memset(&r->record_index, 0, sizeof(record_index));
+	r->record_index.files = files;
+	memset(&r->load_timings, 0, sizeof(report_load_timings));
 
 	re_arena_clear(&r->arena);
+
+	if (readonly_file_is_opened(&r->mapped_file))
+	{
+		file_mapper_close(&r->file_mapper, &r->mapped_file);
+		readonly_file_init(&r->mapped_file);
+	}
+}
+
+void report_sort_by_count(report* r)
+{
+	samply_qsort(r->summary_by_count.data, r->summary_by_count.size, sizeof(summed_record), compare_summed_record);
+	samply_qsort(r->summary_by_module.data, r->summary_by_module.size, sizeof(rollup_record), compare_rollup_record);
+	samply_qsort(r->summary_by_file.data, r->summary_by_file.size, sizeof(rollup_record), compare_rollup_record);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -102,19 +496,64 @@ void report_clear(report* r)
 
 void report_print_to_file(report* r, FILE* f)
 {
-	double percent = 0;
+	report_print_grouped_to_file(r, report_group_by_SYMBOL, f);
+}
+
+void report_print_grouped_to_file(report* r, enum report_group_by group_by, FILE* f)
+{
 	double count_f = (double)r->sample_count;
 	fprintf(f, "Sample count: %zu\n", r->sample_count);
 
+	/* Only with kernel samples, the Windows sampler never has any. */
+	if (r->kernel_sample_count)
+	{
+		size_t user_sample_count = r->sample_count - r->kernel_sample_count;
+		fprintf(f, "User: %zu (%.2f)" "\t" "Kernel: %zu (%.2f)\n",
+			user_sample_count,
+			r->sample_count ? (double)user_sample_count / count_f : 0.0,
+			r->kernel_sample_count,
+			r->sample_count ? (double)r->kernel_sample_count / count_f : 0.0);
+	}
+
+	/* Heavy-hitter mode, the actual counter is between counter - error and counter. */
+	bool with_errors = has_error_bounds(r);
+	if (with_errors)
+	{
+		fprintf(f, "Counters are upper bounds, the third column is their maximum overestimation.\n");
+	}
+
+	if (group_by == report_group_by_MODULE)
+	{
+		print_rollup(r, &r->summary_by_module, with_errors, f);
+		return;
+	}
+
+	if (group_by == report_group_by_FILE)
+	{
+		print_rollup(r, &r->summary_by_file, with_errors, f);
+		return;
+	}
+
 	/* Print summary */
 	for (int i = 0; i < r->summary_by_count.size; i += 1)
 	{
 		summed_record item = r->summary_by_count.data[i];
-		percent = (double)item.counter / count_f;
-		printf("%.2f" "\t" "%zu" "\t" STRV_FMT "\n", percent, item.counter, STRV_ARG(item.symbol_name));
+		report_print_row_to_file(item.symbol_name, item.counter, item.error, r->sample_count, with_errors, f);
 	}
 }
 
+void report_print_load_timings(report* r, FILE* f)
+{
+	report_load_timings* t = &r->load_timings;
+	fprintf(f, "Load threads: %zu\n", t->thread_count);
+	fprintf(f, "Read:          %8.2f ms\n", t->read * 1000.0);
+	fprintf(f, "Decompression: %8.2f ms\n", t->decompression * 1000.0);
+	fprintf(f, "Summary:       %8.2f ms\n", t->summary * 1000.0);
+	fprintf(f, "Records:       %8.2f ms\n", t->records * 1000.0);
+	fprintf(f, "Call graph:    %8.2f ms\n", t->call_graph * 1000.0);
+	fprintf(f, "Total:         %8.2f ms\n", t->total * 1000.0);
+}
+
 bool report_save_to_filepath(report* r, const char* filepath)
 {
 	FILE* f = fopen(filepath, "wb");
@@ -131,36 +570,26 @@ bool report_save_to_filepath(report* r, const char* filepath)
 
 void report_save_to_file(report* r, FILE* f)
 {
-	summary_binary_header_v1 header =
-	{
-		.zero = zero,
-		.version_number = SMP_SUMMARY_VERSION_NUMBER,
-		.version_text = { SMP_SUMMARY_VERSION_TEXT },
-		.total_sampling_count = r->sample_count,
-		.total_entry_count = r->summary_by_count.size
-	};
-	memcpy(&header.magic1, &magic1_samp, sizeof(magic1_samp));
-	memcpy(&header.magic2, &magic2_summ, sizeof(magic2_summ));
-
-	write_bytes(f, &header, sizeof(summary_binary_header_v1));
+	save_to_file(r, f, false);
+}
 
-	for (int i = 0; i < r->summary_by_count.size; i += 1)
+bool report_save_compressed_to_filepath(report* r, const char* filepath)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
 	{
-		summed_record item = r->summary_by_count.data[i];
-		/* 1) symbol sampling count */
-		write_uint64(f, item.counter);
-		/* 2) symbol name size */
-		/* 3) symbol name data */
-		write_strv(f, item.symbol_name);
-		/* 4) module name size */
-		/* 5) module name data */
-		write_strv(f, item.module_name);
-		/* 6) source file name size */
-		/* 7) source file name data */
-		write_strv(f, item.source_file_name);
-		/* 8) closest line number */
-		write_uint64(f, item.closest_line_number);
+		log_error("Could not save to file '%s'", filepath);
+		return false;
 	}
+	report_save_compressed_to_file(r, f);
+
+	bool success = fclose(f) == 0;
+	return success;
+}
+
+void report_save_compressed_to_file(report* r, FILE* f)
+{
+	save_to_file(r, f, true);
 }
 
 /*-----------------------------------------------------------------------*/
@@ -168,58 +597,125 @@ void report_save_to_file(report* r, FILE* f)
 /*-----------------------------------------------------------------------*/
 
 void report_load_from_sampler(report* r, sampler* s)
+{
+	report_load_from_records(r, &s->results, s->sample_count);
+
+	if (s->collect_call_stacks)
+	{
+		call_graph_load_from_call_stacks(&r->call_graph, &s->call_stacks, &s->call_stack_frames);
+	}
+}
+
+void report_load_from_records(report* r, ht* results, size_t sample_count)
 {
 	report_clear(r);
 
-	r->sample_count = s->sample_count;
+	r->sample_count = sample_count;
 
 	ht_cursor c;
-	ht_cursor_init(&s->results, &c);
+	ht_cursor_init(results, &c);
 
 	size_t total_counter_check = 0;
 
+	/* Summary entry of each symbol, module and file, the entries themselves are in the summary arrays. */
+	ht slots;
+	ht module_slots;
+	ht file_slots;
+	summary_slots_init(&slots);
+	summary_slots_init(&module_slots);
+	summary_slots_init(&file_slots);
+
 	while (ht_cursor_next(&c))
 	{
 		record* item = ht_cursor_item(&c);
 
-		update_summary_with(r, item);
-		upsert_record(r, item);
+		update_summary_with(r, &slots, item);
+		update_rollup_with(&r->summary_by_module, &module_slots, item->module_name, item->counter, item->error);
+		update_rollup_with(&r->summary_by_file, &file_slots, item->source_file, item->counter, item->error);
+
+		if (is_kernel_module(item->module_name))
+		{
+			r->kernel_sample_count += item->counter;
+		}
 
 		total_counter_check += item->counter;
 	}
 
-	/* Sort entries by counters. */
-	samply_qsort(r->summary_by_count.data, r->summary_by_count.size, sizeof(summed_record), compare_summed_record);
+	ht_destroy(&file_slots);
+	ht_destroy(&module_slots);
+	ht_destroy(&slots);
+
+	report_build_records(r, results);
 
-	SMP_ASSERT(total_counter_check == s->sample_count);
+	report_sort_by_count(r);
+
+	SMP_ASSERT(total_counter_check == sample_count);
 }
 
 bool report_load_from_filepath(report* r, const char* filepath)
 {
-	FILE* f = fopen(filepath, "rb");
-	if (!f)
+	return load_from_filepath(r, filepath, false);
+}
+
+bool report_load_summary_from_filepath(report* r, const char* filepath)
+{
+	return load_from_filepath(r, filepath, true);
+}
+
+bool report_load_records_of_file(report* r, strv source_file, bool* inserted)
+{
+	record_index* index = &r->record_index;
+	size_t unloaded_count = index->unloaded_count;
+
+	/* Files with the same name are next to each other. */
+	for (size_t i = 0; i < index->files.size && index->unloaded_count; i += 1)
 	{
-		log_error("Could not save to file '%s'", filepath);
-		return false;
+		record_file* f = &index->files.data[i];
+		if (!f->is_loaded && strv_equals(f->source_file, source_file) && !load_record_file(r, f))
+		{
+			log_error("Corrupted records of '" STRV_FMT "'", STRV_ARG(source_file));
+			*inserted = index->unloaded_count != unloaded_count;
+			return false;
+		}
 	}
 
-	report_load_from_file(r, f);
+	*inserted = index->unloaded_count != unloaded_count;
+	return true;
+}
 
-	bool success = fclose(f) == 0;
-	return success;
+bool report_load_all_records(report* r, bool* inserted)
+{
+	record_index* index = &r->record_index;
+	size_t unloaded_count = index->unloaded_count;
+
+	for (size_t i = 0; i < index->files.size && index->unloaded_count; i += 1)
+	{
+		record_file* f = &index->files.data[i];
+		if (!f->is_loaded && !load_record_file(r, f))
+		{
+			log_error("Corrupted records of '" STRV_FMT "'", STRV_ARG(f->source_file));
+			*inserted = index->unloaded_count != unloaded_count;
+			return false;
+		}
+	}
+
+	*inserted = index->unloaded_count != unloaded_count;
+	return true;
 }
 
-void report_load_from_file(report* r, FILE* f)
+bool report_load_from_file(report* r, FILE* f)
 {
 	report_clear(r);
 
 	summary_binary_header_v1 header;
-	read_bytes(f, &header, sizeof(summary_binary_header_v1));
-
-	SMP_ASSERT(memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) == 0);
-	SMP_ASSERT(memcmp(&header.magic2, &magic2_summ, sizeof(header.magic2)) == 0);
-	SMP_ASSERT(header.zero == zero);
-	SMP_ASSERT(header.version_number == SMP_SUMMARY_VERSION_NUMBER);
+	if (fread(&header, sizeof(summary_binary_header_v1), 1, f) != 1
+		|| memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) != 0
+		|| memcmp(&header.magic2, &magic2_summ, sizeof(header.magic2)) != 0
+		|| header.zero != zero)
+	{
+		log_error("Not a report file");
+		return false;
+	}
 
 	log_debug("Loaded data:");
 	log_debug("magic1:         \"%c%c%c%c\"",
@@ -229,28 +725,26 @@ void report_load_from_file(report* r, FILE* f)
 	log_debug("version:        %zu",    header.version_number);
 	log_debug("version text:   \"%s\"", header.version_text);
 	log_debug("sampling count: %zu",    header.total_sampling_count);
-	log_debug("entry count:    %zu",    header.total_entry_count);
 
-	for (int i = 0; i < header.total_entry_count; i += 1)
+	if (header.version_number == SUMMARY_VERSION_NUMBER_V1)
 	{
-		summed_record item = {0};
-	
-		/* 1) symbol sampling count */
-		read_uint64(f, &item.counter);
-		/* 2) symbol name size */
-		/* 3) symbol name data */
-		read_strv(f, &r->arena, &item.symbol_name);
-		/* 4) module name size */
-		/* 5) module name data */
-		read_strv(f, &r->arena, &item.module_name);
-		/* 6) source file name size */
-		/* 7) source file name data */
-		read_strv(f, &r->arena, &item.source_file_name);
-		/* 8) closest line number */
-		read_uint64(f, &item.closest_line_number);
-		
-		darr_push_back(&r->summary_by_count, item);
+		load_v1_from_file(r, f, &header);
+		return true;
+	}
+
+	if (header.version_number == SMP_SUMMARY_VERSION_NUMBER)
+	{
+		if (!read_v2_from_file(r, f, &header))
+		{
+			report_clear(r);
+			log_error("Corrupted report file");
+			return false;
+		}
+		return true;
 	}
+
+	log_error("Unsupported report version %zu", (size_t)header.version_number);
+	return false;
 }
 
 record_range record_range_make()
@@ -288,11 +782,6 @@ record_range record_range_for_line(record* records, size_t count, size_t line_nu
 	return range;
 }
 
-static bool summed_record_by_count_predicate_less(const summed_record* left, const summed_record* right)
-{
-	return left->symbol_hash < right->symbol_hash;
-}
-
 static bool record_by_file_predicate_less(const record* left, const record* right)
 {
 	return strv_lexicagraphical_compare(left->source_file, right->source_file) < 0;
@@ -303,102 +792,1769 @@ static bool record_by_line_predicate_less(const record* left, const record* righ
 	return left->line_number < right->line_number;
 }
 
-/* Sort by source file, then by line number, then by address. */
-static bool record_predicate_less(const record* left, const record* right)
+/* Build the records sorted by source file, line number and address, with a single sort,
+   instead of inserting each record at its sorted position. */
+void report_build_records(report* r, ht* results)
 {
-	int cmp = strv_lexicagraphical_compare(left->source_file, right->source_file);
-	if (cmp != 0)
-		return cmp < 0;
+	size_t count = ht_size(results);
 
-	if (left->line_number != right->line_number)
-		return left->line_number < right->line_number;
+	ht ranks;
+	rank_source_files(results, &ranks);
 
-	return left->address < right->address;
-}
+	/* Build the sort key of each record. */
+	darr(record_sort_key) keys;
+	darr(record_sort_key) tmp;
+	darr_init(&keys);
+	darr_init(&tmp);
+	darr_ensure_space(&keys, count);
+	darr_ensure_space(&tmp, count);
 
-static void upsert_record(report* r, record* rec)
-{
-	record line = *rec;
-	size_t index = multip_map_lower_bound(&r->records, line, record_predicate_less);
+	ht_cursor c;
+	ht_cursor_init(results, &c);
 
-	/* Item has been found if the index is within the array, and the item queried is not equal to the item at the index*/
-	bool found = index != r->records.size
-		&& (!record_predicate_less(&line, &r->records.data[index]));
-	
-	/* If the item already exist we merge the counters. */
-	if (found)
-	{
-		r->records.data[index].counter += rec->counter;
-	}
-	else
+	while (ht_cursor_next(&c))
 	{
-		darr_insert_many(&r->records, index, &line, 1);
+		record* item = ht_cursor_item(&c);
+
+		file_rank value = { 0 };
+		value.file = item->source_file;
+		file_rank* rank = ht_get_or_insert(&ranks, &value);
+
+		/* Line numbers don't exceed 32 bits in practice. */
+		uint64_t line = item->line_number > UINT32_MAX ? UINT32_MAX : (uint64_t)item->line_number;
+
+		record_sort_key key;
+		key.file_and_line = ((uint64_t)rank->rank << 32) | line;
+		key.address = item->address;
+		key.item = item;
+
+		keys.data[keys.size++] = key;
 	}
-}
 
-static void update_summary_with(report* r, record* rec)
-{
-	summed_record init = { 0 };
-	init.symbol_hash = samply_djb2_hash(rec->symbol_name);
-	init.symbol_name = rec->symbol_name;
-	init.module_name = rec->module_name;
-	init.source_file_name = rec->source_file;
-	init.closest_line_number = rec->line_number;
+	radix_sort_record_keys(keys.data, tmp.data, keys.size);
 
-	summed_record* result = 0;
-	darr_get_or_insert(&r->summary_by_count, init, result, summed_record_by_count_predicate_less);
+	/* Gather records in sorted order, records with the same key are merged. */
+	multi_map_clear(&r->records);
+	darr_ensure_space(&r->records, count);
 
-	// Update closest line number
-	if (rec->line_number < result->closest_line_number)
+	for (size_t i = 0; i < keys.size; i += 1)
 	{
-		result->closest_line_number = rec->line_number;
+		record_sort_key* key = &keys.data[i];
+		record* item = key->item;
+
+		if (i > 0
+			&& key->file_and_line == keys.data[i - 1].file_and_line
+			&& key->address == keys.data[i - 1].address)
+		{
+			r->records.data[r->records.size - 1].counter += item->counter;
+			r->records.data[r->records.size - 1].error += item->error;
+		}
+		else
+		{
+			r->records.data[r->records.size++] = *item;
+		}
 	}
 
-	// Update counter
-	result->counter += rec->counter;
+	darr_destroy(&tmp);
+	darr_destroy(&keys);
+	ht_destroy(&ranks);
 }
 
-static int SMP_CDECL compare_summed_record(const summed_record* left, const summed_record* right)
+static ht_hash_t file_rank_hash(file_rank* item)
 {
-	if (left->counter < right->counter)
-		return 1;
-	if (left->counter > right->counter)
-		return -1;
-	return 0;
+	return string_store_interned_hash(item->file);
 }
 
-static void write_bytes(FILE* f, void* data, size_t byte_count)
+static bool file_rank_are_same(file_rank* left, file_rank* right)
 {
-	fwrite(data, byte_count, 1, f);
+	return string_store_interned_equals(left->file, right->file);
 }
 
-static void read_bytes(FILE* f, void* data, size_t byte_count)
+static void file_rank_swap(file_rank* left, file_rank* right)
 {
-	fread(data, byte_count, 1, f);
+	file_rank tmp = *left;
+	*left = *right;
+	*right = tmp;
 }
 
-static void write_uint64(FILE* f, uint64_t value)
+static int SMP_CDECL compare_file_rank(const file_rank* left, const file_rank* right)
 {
-	fwrite(&value, sizeof(uint64_t), 1, f);
+	return strv_lexicagraphical_compare(left->file, right->file);
 }
 
-static void read_uint64(FILE* f, uint64_t* v)
+/* Assign the lexicographical rank of each distinct source file of the results. */
+static void rank_source_files(ht* results, ht* ranks)
 {
-	fread(v, sizeof(uint64_t), 1, f);
+	ht_init(ranks, sizeof(file_rank), file_rank_hash, (ht_predicate_t)file_rank_are_same, file_rank_swap, 64);
+
+	ht_cursor c;
+	ht_cursor_init(results, &c);
+
+	while (ht_cursor_next(&c))
+	{
+		record* item = ht_cursor_item(&c);
+
+		file_rank value = { 0 };
+		value.file = item->source_file;
+		ht_get_or_insert(ranks, &value);
+	}
+
+	/* There are few distinct files compared to the number of records, sorting them is cheap. */
+	darr(file_rank) files;
+	darr_init(&files);
+	darr_ensure_space(&files, ht_size(ranks));
+
+	ht_cursor_init(ranks, &c);
+	while (ht_cursor_next(&c))
+	{
+		files.data[files.size++] = *(file_rank*)ht_cursor_item(&c);
+	}
+
+	samply_qsort(files.data, files.size, sizeof(file_rank), compare_file_rank);
+
+	/* Different pointers can have the same content (empty strings for instance), they get the same rank. */
+	uint32_t rank = 0;
+	for (size_t i = 0; i < files.size; i += 1)
+	{
+		if (i > 0 && compare_file_rank(&files.data[i - 1], &files.data[i]) != 0)
+		{
+			rank += 1;
+		}
+
+		file_rank* item = ht_get_or_insert(ranks, &files.data[i]);
+		item->rank = rank;
+	}
+
+	darr_destroy(&files);
 }
 
-static void write_strv(FILE* f, strv str)
+/* Least significant digit radix sort on (file_and_line, address), one byte at a time.
+   Passes where all the keys have the same byte are skipped,
+   which is most of them since addresses share their high bytes and line numbers are small. */
+static void radix_sort_record_keys(record_sort_key* keys, record_sort_key* tmp, size_t count)
 {
-	/* Write size first */
-	fwrite(&str.size, sizeof(str.size), 1, f);
-	/* Then write string data. */
-	fwrite(str.data, str.size, 1, f);
+	enum { digit_count = 16 };
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	size_t histograms[digit_count][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		for (int digit = 0; digit < 8; digit += 1)
+		{
+			histograms[digit][(keys[i].address >> (digit * 8)) & 0xFF] += 1;
+			histograms[digit + 8][(keys[i].file_and_line >> (digit * 8)) & 0xFF] += 1;
+		}
+	}
+
+	record_sort_key* src = keys;
+	record_sort_key* dst = tmp;
+
+	for (int digit = 0; digit < digit_count; digit += 1)
+	{
+		size_t* histogram = histograms[digit];
+		int shift = (digit % 8) * 8;
+		bool is_address = digit < 8;
+
+		/* All keys are in the same bucket. */
+		uint64_t first = is_address ? src[0].address : src[0].file_and_line;
+		if (histogram[(first >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		/* Convert counts to offsets. */
+		size_t offset = 0;
+		for (int b = 0; b < 256; b += 1)
+		{
+			size_t bucket_count = histogram[b];
+			histogram[b] = offset;
+			offset += bucket_count;
+		}
+
+		for (size_t i = 0; i < count; i += 1)
+		{
+			uint64_t value = is_address ? src[i].address : src[i].file_and_line;
+			dst[histogram[(value >> shift) & 0xFF]++] = src[i];
+		}
+
+		record_sort_key* swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	/* Sorted keys must end in the input array. */
+	if (src != keys)
+	{
+		memcpy(keys, src, count * sizeof(record_sort_key));
+	}
 }
 
-static void read_strv(FILE* f, re_arena* a, strv* str)
+static void update_summary_with(report* r, ht* slots, record* rec)
 {
-	size_t size;
-	fread(&size, sizeof(size_t), 1, f);
+	size_t index = summary_slot_get_index(slots, rec->symbol_name, r->summary_by_count.size);
+
+	/* First record of this symbol. */
+	if (index == r->summary_by_count.size)
+	{
+		summed_record init = { 0 };
+		init.symbol_name = rec->symbol_name;
+		init.module_name = rec->module_name;
+		init.source_file_name = rec->source_file;
+		init.closest_line_number = rec->line_number;
+
+		darr_push_back(&r->summary_by_count, init);
+	}
+
+	summed_record* result = &r->summary_by_count.data[index];
+
+	// Update closest line number
+	if (rec->line_number < result->closest_line_number)
+	{
+		result->closest_line_number = rec->line_number;
+	}
+
+	// Update counter
+	result->counter += rec->counter;
+	result->error += rec->error;
+}
+
+static void update_rollup_with(rollup_records* rollup, ht* slots, strv name, size_t counter, size_t error)
+{
+	size_t index = summary_slot_get_index(slots, name, rollup->size);
+
+	if (index == rollup->size)
+	{
+		rollup_record init = { 0 };
+		init.name = name;
+		darr_push_back(rollup, init);
+	}
+
+	rollup->data[index].counter += counter;
+	rollup->data[index].error += error;
+}
+
+static void summary_slots_init(ht* slots)
+{
+	ht_init(slots, sizeof(summary_slot), summary_slot_hash, (ht_predicate_t)summary_slot_are_same, summary_slot_swap, 1024);
+}
+
+/* Returns the index associated with the name, or next_index if the name is new. */
+static size_t summary_slot_get_index(ht* slots, strv name, size_t next_index)
+{
+	summary_slot value;
+	value.name = name;
+	value.index = next_index;
+
+	summary_slot* slot = ht_get_or_insert(slots, &value);
+	return slot->index;
+}
+
+/* Rollups of reports which don't store them are computed from the symbols,
+   the source file of a symbol is the one of its closest line. */
+void report_compute_rollups(report* r)
+{
+	darr_clear(&r->summary_by_module);
+	darr_clear(&r->summary_by_file);
+
+	/* Strings loaded from a file are not interned. */
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+		item->module_name = *string_store_get_or_create(&r->string_store, item->module_name);
+		item->source_file_name = *string_store_get_or_create(&r->string_store, item->source_file_name);
+	}
+
+	ht module_slots;
+	ht file_slots;
+	summary_slots_init(&module_slots);
+	summary_slots_init(&file_slots);
+
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+		update_rollup_with(&r->summary_by_module, &module_slots, item->module_name, item->counter, item->error);
+		update_rollup_with(&r->summary_by_file, &file_slots, item->source_file_name, item->counter, item->error);
+	}
+
+	ht_destroy(&file_slots);
+	ht_destroy(&module_slots);
+
+	samply_qsort(r->summary_by_module.data, r->summary_by_module.size, sizeof(rollup_record), compare_rollup_record);
+	samply_qsort(r->summary_by_file.data, r->summary_by_file.size, sizeof(rollup_record), compare_rollup_record);
+}
+
+static int SMP_CDECL compare_rollup_record(const rollup_record* left, const rollup_record* right)
+{
+	if (left->counter < right->counter)
+		return 1;
+	if (left->counter > right->counter)
+		return -1;
+	return 0;
+}
+
+static void print_rollup(report* r, rollup_records* rollup, bool with_errors, FILE* f)
+{
+	for (size_t i = 0; i < rollup->size; i += 1)
+	{
+		rollup_record item = rollup->data[i];
+		report_print_row_to_file(item.name, item.counter, item.error, r->sample_count, with_errors, f);
+	}
+}
+
+void report_print_row_to_file(strv name, size_t counter, size_t error, size_t sample_count, bool with_errors, FILE* f)
+{
+	double ratio = sample_count ? (double)counter / (double)sample_count : 0.0;
+	confidence_interval interval = wilson_interval(counter, sample_count);
+
+	fprintf(f, "%.2f" "\t" "%zu" "\t", ratio, counter);
+	if (with_errors)
+	{
+		fprintf(f, "-%zu" "\t", error);
+	}
+	fprintf(f, "[%.3f, %.3f]" "\t" STRV_FMT "\n", interval.low, interval.high, STRV_ARG(name));
+}
+
+static bool read_rollup(FILE* f, re_arena* a, rollup_records* rollup)
+{
+	darr_clear(rollup);
+
+	uint64_t count = 0;
+	if (fread(&count, sizeof(count), 1, f) != 1)
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < count; i += 1)
+	{
+		rollup_record item = { 0 };
+		read_uint64(f, &item.counter);
+		read_strv(f, a, &item.name);
+		darr_push_back(rollup, item);
+	}
+
+	return !ferror(f) && !feof(f);
+}
+
+static bool has_error_bounds(report* r)
+{
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		if (r->summary_by_count.data[i].error)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Read the errors following their magic number.
+   Returns false if they don't match the loaded entries. */
+static bool read_errors(FILE* f, report* r)
+{
+	uint64_t count = 0;
+	if (fread(&count, sizeof(count), 1, f) != 1 || count != r->summary_by_count.size)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		read_uint64(f, &r->summary_by_count.data[i].error);
+	}
+
+	if (fread(&count, sizeof(count), 1, f) != 1 || count != r->summary_by_module.size)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < r->summary_by_module.size; i += 1)
+	{
+		read_uint64(f, &r->summary_by_module.data[i].error);
+	}
+
+	if (fread(&count, sizeof(count), 1, f) != 1 || count != r->summary_by_file.size)
+	{
+		return false;
+	}
+	for (size_t i = 0; i < r->summary_by_file.size; i += 1)
+	{
+		read_uint64(f, &r->summary_by_file.data[i].error);
+	}
+
+	return !ferror(f) && !feof(f);
+}
+
+/* Reports without error bounds have exact counters. */
+static void clear_error_bounds(report* r)
+{
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		r->summary_by_count.data[i].error = 0;
+	}
+	for (size_t i = 0; i < r->summary_by_module.size; i += 1)
+	{
+		r->summary_by_module.data[i].error = 0;
+	}
+	for (size_t i = 0; i < r->summary_by_file.size; i += 1)
+	{
+		r->summary_by_file.data[i].error = 0;
+	}
+}
+
+/* Read the call graph following its magic number.
+   Returns false if the file is truncated or if an edge refers to an unknown symbol. */
+static bool read_call_graph(FILE* f, re_arena* a, call_graph* g)
+{
+	call_graph_clear(g);
+
+	uint64_t symbol_count = 0;
+	if (fread(&symbol_count, sizeof(symbol_count), 1, f) != 1)
+	{
+		return false;
+	}
+	for (uint64_t i = 0; i < symbol_count; i += 1)
+	{
+		strv name;
+		size_t self = 0;
+		size_t total = 0;
+		read_strv(f, a, &name);
+		read_uint64(f, &self);
+		read_uint64(f, &total);
+
+		darr_push_back(&g->symbols, name);
+		darr_push_back(&g->self_counters, self);
+		darr_push_back(&g->total_counters, total);
+	}
+
+	uint64_t edge_count = 0;
+	if (fread(&edge_count, sizeof(edge_count), 1, f) != 1)
+	{
+		return false;
+	}
+
+	call_pairs pairs;
+	darr_init(&pairs);
+	darr_ensure_space(&pairs, edge_count);
+
+	bool valid = true;
+	for (uint64_t i = 0; i < edge_count && valid; i += 1)
+	{
+		uint64_t caller = 0;
+		uint64_t callee = 0;
+		call_pair pair = {0};
+		read_uint64(f, &caller);
+		read_uint64(f, &callee);
+		read_uint64(f, &pair.counter);
+
+		valid = caller < symbol_count && callee < symbol_count;
+		pair.caller = (uint32_t)caller;
+		pair.callee = (uint32_t)callee;
+		pairs.data[pairs.size++] = pair;
+	}
+
+	valid = valid && !ferror(f) && !feof(f);
+	if (valid)
+	{
+		call_graph_load_edges(g, &pairs);
+	}
+
+	darr_destroy(&pairs);
+	return valid;
+}
+
+static void load_v1_from_file(report* r, FILE* f, summary_binary_header_v1* header)
+{
+	log_debug("entry count:    %zu",    header->total_entry_count);
+
+	r->sample_count = header->total_sampling_count;
+
+	for (int i = 0; i < header->total_entry_count; i += 1)
+	{
+		summed_record item = {0};
+	
+		/* 1) symbol sampling count */
+		read_uint64(f, &item.counter);
+		/* 2) symbol name size */
+		/* 3) symbol name data */
+		read_strv(f, &r->arena, &item.symbol_name);
+		/* 4) module name size */
+		/* 5) module name data */
+		read_strv(f, &r->arena, &item.module_name);
+		/* 6) source file name size */
+		/* 7) source file name data */
+		read_strv(f, &r->arena, &item.source_file_name);
+		/* 8) closest line number */
+		read_uint64(f, &item.closest_line_number);
+
+		/* The split is not stored, it is computed from the module names. */
+		if (is_kernel_module(item.module_name))
+		{
+			r->kernel_sample_count += item.counter;
+		}
+		
+		darr_push_back(&r->summary_by_count, item);
+	}
+
+	/* Reports saved before the rollups existed don't have them. */
+	char magic[4];
+	if (!read_magic(f, magic, magic_rollups)
+		|| !read_rollup(f, &r->arena, &r->summary_by_module)
+		|| !read_rollup(f, &r->arena, &r->summary_by_file))
+	{
+		report_compute_rollups(r);
+		return;
+	}
+
+	/* Optional sections, in the order they are written. */
+	bool has_section = read_magic(f, magic, NULL);
+
+	if (has_section && memcmp(magic, magic_errors, sizeof(magic)) == 0)
+	{
+		if (!read_errors(f, r))
+		{
+			clear_error_bounds(r);
+		}
+		has_section = read_magic(f, magic, NULL);
+	}
+
+	if (has_section && memcmp(magic, magic_call_graph, sizeof(magic)) == 0)
+	{
+		if (!read_call_graph(f, &r->arena, &r->call_graph))
+		{
+			call_graph_clear(&r->call_graph);
+		}
+	}
+}
+
+/* Files of the current version are mapped and used in place, records are only indexed if lazy. */
+static bool load_from_filepath(report* r, const char* filepath, bool lazy)
+{
+	double start = samply_time_now();
+
+	report_clear(r);
+
+	if (!file_mapper_open(&r->file_mapper, &r->mapped_file, strv_make_from_str(filepath)))
+	{
+		log_error("Could not open file '%s'", filepath);
+		return false;
+	}
+	r->load_timings.read = samply_time_now() - start;
+
+	/* Current version, the report is used in place and the file stays mapped until the report is cleared. */
+	strv view = r->mapped_file.view;
+	summary_binary_header_v2 header;
+	if (view.size >= sizeof(header))
+	{
+		memcpy(&header, view.data, sizeof(header));
+
+		if (memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) == 0
+			&& memcmp(&header.magic2, &magic2_summ, sizeof(header.magic2)) == 0
+			&& header.version_number == SMP_SUMMARY_VERSION_NUMBER)
+		{
+			if (!load_v2_from_memory(r, view, lazy))
+			{
+				report_clear(r);
+				log_error("Corrupted report file '%s'", filepath);
+				return false;
+			}
+			r->load_timings.total = samply_time_now() - start;
+			return true;
+		}
+	}
+
+	/* Older versions are read field by field. */
+	report_clear(r);
+
+	FILE* f = fopen(filepath, "rb");
+	if (!f)
+	{
+		log_error("Could not open file '%s'", filepath);
+		return false;
+	}
+
+	bool success = report_load_from_file(r, f);
+
+	success = fclose(f) == 0 && success;
+	r->load_timings.total = samply_time_now() - start;
+	return success;
+}
+
+/* The sections refer to offsets in the whole file, the rest of the file is read after a copy of the header.
+   The strings of the report point into this copy, owned by the arena of the report. */
+static bool read_v2_from_file(report* r, FILE* f, summary_binary_header_v1* header)
+{
+	int64_t start = samply_ftell64(f);
+	if (start < 0 || samply_fseek64(f, 0, SEEK_END) != 0)
+	{
+		return false;
+	}
+	int64_t end = samply_ftell64(f);
+	if (end < start || samply_fseek64(f, start, SEEK_SET) != 0)
+	{
+		return false;
+	}
+
+	size_t remaining = (size_t)(end - start);
+	char* data = re_arena_alloc(&r->arena, sizeof(summary_binary_header_v1) + remaining);
+	memcpy(data, header, sizeof(summary_binary_header_v1));
+
+	if (remaining && fread(data + sizeof(summary_binary_header_v1), remaining, 1, f) != 1)
+	{
+		return false;
+	}
+
+	return load_v2_from_memory(r, strv_make_from(data, sizeof(summary_binary_header_v1) + remaining), false);
+}
+
+/* Build the report from a whole v2 file, only the strings are not copied.
+   Each distinct string is stored once so equal names have the same data pointer, like interned strings.
+   If lazy, the records are only indexed when the file has a record index. The file must outlive the report. */
+static bool load_v2_from_memory(report* r, strv file, bool lazy)
+{
+	summary_binary_header_v2 header;
+	if (file.size < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, file.data, sizeof(header));
+
+	report_loader l;
+	memset(&l, 0, sizeof(report_loader));
+	l.r = r;
+	l.thread_count = r->load_thread_count ? r->load_thread_count : samply_cpu_count();
+	if (l.thread_count > LOAD_MAX_THREAD_COUNT)
+	{
+		l.thread_count = LOAD_MAX_THREAD_COUNT;
+	}
+	darr_init(&l.files);
+	darr_init(&l.jobs);
+
+	r->sample_count = header.total_sampling_count;
+	r->load_timings.thread_count = l.thread_count;
+
+	/* The records stay compressed if they are only decoded when a source file is opened. */
+	double start = samply_time_now();
+	bool valid = find_loaded_sections(&l, file, header.section_count)
+		&& decompress_sections(&l, lazy && l.sections[loaded_section_RECORD_INDEX].count);
+	r->load_timings.decompression = samply_time_now() - start;
+
+	start = samply_time_now();
+	valid = valid && load_summary(&l);
+	r->load_timings.summary = samply_time_now() - start;
+
+	start = samply_time_now();
+	valid = valid && load_records(&l, lazy);
+	r->load_timings.records = samply_time_now() - start;
+
+	start = samply_time_now();
+	valid = valid && load_call_graph(&l);
+	r->load_timings.call_graph = samply_time_now() - start;
+
+	darr_destroy(&l.jobs);
+	darr_destroy(&l.files);
+
+	return valid;
+}
+
+/* Find the known sections in the directory, compressed sections are only opened. */
+static bool find_loaded_sections(report_loader* l, strv file, uint64_t section_count)
+{
+	static char* magics[loaded_section_COUNT] = {
+		magic_section_strings,
+		magic_section_symbols,
+		magic_section_modules,
+		magic_section_files,
+		magic_section_record_names,
+		magic_section_records,
+		magic_section_record_index,
+		magic_section_call_symbols,
+		magic_section_call_edges,
+	};
+
+	for (size_t i = 0; i < loaded_section_COUNT; i += 1)
+	{
+		loaded_section* s = &l->sections[i];
+
+		section_entry_v2 entry;
+		if (!find_stored_section(file, section_count, magics[i], &s->data, &entry))
+		{
+			return false;
+		}
+
+		s->count = (size_t)entry.count;
+		s->is_compressed = (entry.flags & SUMMARY_SECTION_FLAG_COMPRESSED) != 0;
+		if (s->is_compressed && !compression_open(&s->blocks, s->data))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Decompress the blocks of all the compressed sections in the arena, then check the size of each section. */
+static bool decompress_sections(report_loader* l, bool keep_records_compressed)
+{
+	static size_t entry_sizes[loaded_section_COUNT] = {
+		1,
+		sizeof(symbol_entry_v2),
+		sizeof(rollup_entry_v2),
+		sizeof(rollup_entry_v2),
+		sizeof(string_ref_v2),
+		1,
+		sizeof(record_file_entry_v2),
+		sizeof(call_symbol_entry_v2),
+		sizeof(call_edge_entry_v2),
+	};
+
+	darr_clear(&l->jobs);
+
+	for (size_t i = 0; i < loaded_section_COUNT; i += 1)
+	{
+		loaded_section* s = &l->sections[i];
+		if (!s->is_compressed || (i == loaded_section_RECORDS && keep_records_compressed))
+		{
+			continue;
+		}
+
+		s->decompressed = re_arena_alloc(&l->r->arena, (size_t)s->blocks.uncompressed_size);
+
+		for (uint64_t block = 0; block < s->blocks.block_count; block += LOAD_BLOCKS_PER_JOB)
+		{
+			load_job job = { 0 };
+			job.section = i;
+			job.begin = (size_t)block;
+			job.end = (size_t)(block + LOAD_BLOCKS_PER_JOB < s->blocks.block_count ? block + LOAD_BLOCKS_PER_JOB : s->blocks.block_count);
+			darr_push_back(&l->jobs, job);
+		}
+	}
+
+	if (!run_load_jobs(l, decompress_job))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < loaded_section_COUNT; i += 1)
+	{
+		loaded_section* s = &l->sections[i];
+
+		/* The entry count of the records is their uncompressed size. */
+		if (s->is_compressed && !s->decompressed)
+		{
+			if (s->count != s->blocks.uncompressed_size)
+			{
+				return false;
+			}
+			continue;
+		}
+
+		if (s->decompressed)
+		{
+			s->data = strv_make_from(s->decompressed, (size_t)s->blocks.uncompressed_size);
+		}
+
+		if (s->count > s->data.size / entry_sizes[i]
+			|| s->count * entry_sizes[i] != s->data.size)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Symbols are read by ranges, modules and source files are few. */
+static bool load_summary(report_loader* l)
+{
+	report* r = l->r;
+	strv strings = l->sections[loaded_section_STRINGS].data;
+	size_t symbol_count = l->sections[loaded_section_SYMBOLS].count;
+
+	darr_clear(&l->jobs);
+	darr_ensure_space(&r->summary_by_count, symbol_count);
+
+	for (size_t i = 0; i < symbol_count; i += LOAD_SYMBOLS_PER_JOB)
+	{
+		load_job job = { 0 };
+		job.begin = i;
+		job.end = i + LOAD_SYMBOLS_PER_JOB < symbol_count ? i + LOAD_SYMBOLS_PER_JOB : symbol_count;
+		darr_push_back(&l->jobs, job);
+	}
+
+	if (!run_load_jobs(l, read_symbols_job))
+	{
+		return false;
+	}
+
+	r->summary_by_count.size = symbol_count;
+
+	/* The split is not stored, it is computed from the module names. */
+	for (size_t i = 0; i < l->jobs.size; i += 1)
+	{
+		r->kernel_sample_count += l->jobs.data[i].kernel_sample_count;
+	}
+
+	return read_rollup_entries(strings, l->sections[loaded_section_MODULES].data, l->sections[loaded_section_MODULES].count, &r->summary_by_module)
+		&& read_rollup_entries(strings, l->sections[loaded_section_FILES].data, l->sections[loaded_section_FILES].count, &r->summary_by_file);
+}
+
+/* Records are decoded by ranges of source files when there is a record index, each range to its place in the records.
+   If lazy, they are only indexed. */
+static bool load_records(report_loader* l, bool lazy)
+{
+	report* r = l->r;
+	strv strings = l->sections[loaded_section_STRINGS].data;
+	strv names = l->sections[loaded_section_RECORD_NAMES].data;
+	size_t name_count = l->sections[loaded_section_RECORD_NAMES].count;
+	loaded_section* stream = &l->sections[loaded_section_RECORDS];
+	loaded_section* index_section = &l->sections[loaded_section_RECORD_INDEX];
+
+	/* Files written before the index are decoded in one pass. */
+	if (index_section->count == 0)
+	{
+		return decode_records(strings, names, name_count, stream->data, &r->records);
+	}
+
+	bool is_compressed = stream->is_compressed && !stream->decompressed;
+	uint64_t stream_size = is_compressed ? stream->blocks.uncompressed_size : stream->data.size;
+
+	/* The index must describe the whole stream, which starts with the record count. */
+	uint64_t stream_record_count;
+	uint64_t count_size;
+	if (!read_record_count(stream, is_compressed, stream_size, &stream_record_count, &count_size))
+	{
+		return false;
+	}
+
+	if (lazy)
+	{
+		record_index* index = &r->record_index;
+		if (!read_record_index(strings, index_section->data, index_section->count, stream_size, stream_record_count, count_size, &index->files))
+		{
+			return false;
+		}
+
+		index->unloaded_count = index->files.size;
+		index->strings = strings;
+		index->names = names;
+		index->name_count = name_count;
+		index->stream = stream->data;
+		index->is_compressed = is_compressed;
+		index->blocks = stream->blocks;
+		return true;
+	}
+
+	if (!read_record_index(strings, index_section->data, index_section->count, stream_size, stream_record_count, count_size, &l->files))
+	{
+		return false;
+	}
+
+	darr_clear(&l->jobs);
+
+	load_job job = { 0 };
+	size_t job_size = 0;
+	size_t record_count = 0;
+	for (size_t i = 0; i < l->files.size; i += 1)
+	{
+		if (job_size >= LOAD_RECORD_BYTES_PER_JOB)
+		{
+			job.end = i;
+			darr_push_back(&l->jobs, job);
+
+			job.begin = i;
+			job.first_record = record_count;
+			job_size = 0;
+		}
+
+		job_size += l->files.data[i].size;
+		record_count += l->files.data[i].count;
+	}
+	job.end = l->files.size;
+	darr_push_back(&l->jobs, job);
+
+	darr_ensure_space(&r->records, record_count);
+
+	if (!run_load_jobs(l, decode_records_job))
+	{
+		return false;
+	}
+
+	r->records.size = record_count;
+	return true;
+}
+
+static bool load_call_graph(report_loader* l)
+{
+	strv strings = l->sections[loaded_section_STRINGS].data;
+	strv call_symbols = l->sections[loaded_section_CALL_SYMBOLS].data;
+	size_t call_symbol_count = l->sections[loaded_section_CALL_SYMBOLS].count;
+	strv call_edges = l->sections[loaded_section_CALL_EDGES].data;
+	size_t call_edge_count = l->sections[loaded_section_CALL_EDGES].count;
+
+	call_graph* g = &l->r->call_graph;
+	for (size_t i = 0; i < call_symbol_count; i += 1)
+	{
+		call_symbol_entry_v2 entry;
+		memcpy(&entry, call_symbols.data + i * sizeof(call_symbol_entry_v2), sizeof(call_symbol_entry_v2));
+
+		strv name;
+		size_t self = entry.self_counter;
+		size_t total = entry.total_counter;
+		if (!get_string(strings, entry.name, &name))
+		{
+			return false;
+		}
+
+		darr_push_back(&g->symbols, name);
+		darr_push_back(&g->self_counters, self);
+		darr_push_back(&g->total_counters, total);
+	}
+
+	call_pairs pairs;
+	darr_init(&pairs);
+	darr_ensure_space(&pairs, call_edge_count);
+
+	bool valid = true;
+	for (size_t i = 0; i < call_edge_count && valid; i += 1)
+	{
+		call_edge_entry_v2 entry;
+		memcpy(&entry, call_edges.data + i * sizeof(call_edge_entry_v2), sizeof(call_edge_entry_v2));
+
+		call_pair pair;
+		pair.caller = entry.caller;
+		pair.callee = entry.callee;
+		pair.counter = entry.counter;
+		pairs.data[pairs.size++] = pair;
+
+		valid = entry.caller < call_symbol_count && entry.callee < call_symbol_count;
+	}
+
+	if (valid && call_symbol_count)
+	{
+		call_graph_load_edges(g, &pairs);
+	}
+
+	darr_destroy(&pairs);
+	return valid;
+}
+
+/* Run the jobs on the calling thread and on up to thread_count - 1 other threads. Returns false if a job failed. */
+static bool run_load_jobs(report_loader* l, load_job_procedure procedure)
+{
+	l->procedure = procedure;
+	thread_atomic_int_store(&l->next_job, 0);
+	thread_atomic_int_store(&l->failure_count, 0);
+
+	size_t thread_count = l->thread_count < l->jobs.size ? l->thread_count : l->jobs.size;
+
+	/* Jobs not taken by a thread which could not be created are run by the calling thread. */
+	thread_ptr_t threads[LOAD_MAX_THREAD_COUNT];
+	size_t created_count = 1;
+	while (created_count < thread_count)
+	{
+		threads[created_count] = thread_create(load_worker_procedure, l, THREAD_STACK_SIZE_DEFAULT);
+		if (!threads[created_count])
+		{
+			log_warning("Could not create a thread to load the report, %zu threads are used.", created_count);
+			break;
+		}
+		created_count += 1;
+	}
+
+	load_worker_procedure(l);
+
+	for (size_t i = 1; i < created_count; i += 1)
+	{
+		thread_join(threads[i]);
+		thread_destroy(threads[i]);
+	}
+
+	return thread_atomic_int_load(&l->failure_count) == 0;
+}
+
+static int load_worker_procedure(void* user_data)
+{
+	report_loader* l = (report_loader*)user_data;
+
+	for (;;)
+	{
+		size_t index = (size_t)thread_atomic_int_inc(&l->next_job);
+		if (index >= l->jobs.size)
+		{
+			break;
+		}
+
+		if (!l->procedure(l, &l->jobs.data[index]))
+		{
+			thread_atomic_int_inc(&l->failure_count);
+		}
+	}
+
+	return 0;
+}
+
+static bool decompress_job(report_loader* l, load_job* job)
+{
+	loaded_section* s = &l->sections[job->section];
+	return compression_decompress_blocks(&s->blocks, job->begin, job->end - job->begin, s->decompressed);
+}
+
+static bool read_symbols_job(report_loader* l, load_job* job)
+{
+	report* r = l->r;
+	strv strings = l->sections[loaded_section_STRINGS].data;
+	strv symbols = l->sections[loaded_section_SYMBOLS].data;
+
+	for (size_t i = job->begin; i < job->end; i += 1)
+	{
+		/* Entries are copied, the memory of the FILE fallback is not necessarily aligned. */
+		symbol_entry_v2 entry;
+		memcpy(&entry, symbols.data + i * sizeof(symbol_entry_v2), sizeof(symbol_entry_v2));
+
+		summed_record item = { 0 };
+		item.counter = entry.counter;
+		item.error = entry.error;
+		item.closest_line_number = entry.closest_line_number;
+
+		if (!get_string(strings, entry.symbol_name, &item.symbol_name)
+			|| !get_string(strings, entry.module_name, &item.module_name)
+			|| !get_string(strings, entry.source_file_name, &item.source_file_name))
+		{
+			return false;
+		}
+
+		if (is_kernel_module(item.module_name))
+		{
+			job->kernel_sample_count += item.counter;
+		}
+
+		r->summary_by_count.data[i] = item;
+	}
+
+	return true;
+}
+
+static bool decode_records_job(report_loader* l, load_job* job)
+{
+	strv strings = l->sections[loaded_section_STRINGS].data;
+	strv names = l->sections[loaded_section_RECORD_NAMES].data;
+	size_t name_count = l->sections[loaded_section_RECORD_NAMES].count;
+	strv stream = l->sections[loaded_section_RECORDS].data;
+
+	record* out = l->r->records.data + job->first_record;
+	for (size_t i = job->begin; i < job->end; i += 1)
+	{
+		record_file* f = &l->files.data[i];
+		const uint8_t* cursor = (const uint8_t*)stream.data + f->offset;
+
+		if (!decode_record_range(strings, names, name_count, cursor, cursor + f->size, f->count, f->line, f->address, out))
+		{
+			return false;
+		}
+		out += f->count;
+	}
+
+	return true;
+}
+
+/* Find a section in the directory, its bytes are returned as they are stored. A missing section is empty, with a zero entry.
+   Returns false if the section does not fit in the file. */
+static bool find_stored_section(strv file, uint64_t section_count, char* magic, strv* section, section_entry_v2* entry)
+{
+	*section = strv_make();
+	memset(entry, 0, sizeof(section_entry_v2));
+
+	size_t directory_offset = sizeof(summary_binary_header_v2);
+	if (section_count > (file.size - directory_offset) / sizeof(section_entry_v2))
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < section_count; i += 1)
+	{
+		memcpy(entry, file.data + directory_offset + i * sizeof(section_entry_v2), sizeof(section_entry_v2));
+
+		if (memcmp(entry->magic, magic, sizeof(entry->magic)) != 0)
+		{
+			continue;
+		}
+
+		if (entry->offset % SUMMARY_SECTION_ALIGNMENT != 0
+			|| entry->offset > file.size
+			|| entry->size > file.size - entry->offset
+			|| (entry->flags & ~SUMMARY_SECTION_FLAG_COMPRESSED) != 0)
+		{
+			return false;
+		}
+
+		*section = strv_make_from(file.data + entry->offset, (size_t)entry->size);
+		return true;
+	}
+
+	memset(entry, 0, sizeof(section_entry_v2));
+	return true;
+}
+
+/* Read the record count at the beginning of the stream, and the size of its varint. */
+static bool read_record_count(loaded_section* stream, bool is_compressed, uint64_t stream_size, uint64_t* count, uint64_t* count_size)
+{
+	uint8_t bytes[SMP_VARINT_MAX_SIZE];
+	size_t size = stream_size < SMP_VARINT_MAX_SIZE ? (size_t)stream_size : SMP_VARINT_MAX_SIZE;
+
+	if (is_compressed)
+	{
+		if (!compression_decompress_range(&stream->blocks, 0, size, bytes))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		memcpy(bytes, stream->data.data, size);
+	}
+
+	const uint8_t* cursor = bytes;
+	if (!varint_read(&cursor, bytes + size, count))
+	{
+		return false;
+	}
+
+	*count_size = (uint64_t)(cursor - bytes);
+	return true;
+}
+
+/* Read the byte range of each source file in the record stream. Ranges must follow each other from first_offset,
+   so they can't overlap, and their counts must add up to record_count. */
+static bool read_record_index(strv strings, strv section, size_t count, uint64_t stream_size, uint64_t record_count, uint64_t first_offset, record_files* files)
+{
+	darr_clear(files);
+	darr_ensure_space(files, count);
+
+	uint64_t previous_end = first_offset;
+	uint64_t total_count = 0;
+	for (size_t i = 0; i < count; i += 1)
+	{
+		record_file_entry_v2 entry;
+		memcpy(&entry, section.data + i * sizeof(record_file_entry_v2), sizeof(record_file_entry_v2));
+
+		if (entry.offset != previous_end
+			|| entry.offset > stream_size
+			|| entry.size > stream_size - entry.offset
+			|| entry.count > entry.size / SUMMARY_MIN_RECORD_SIZE)
+		{
+			return false;
+		}
+		previous_end = entry.offset + entry.size;
+		total_count += entry.count;
+
+		record_file item = { 0 };
+		item.offset = (size_t)entry.offset;
+		item.size = (size_t)entry.size;
+		item.count = (size_t)entry.count;
+		item.line = entry.line;
+		item.address = entry.address;
+		if (!get_string(strings, entry.name, &item.source_file))
+		{
+			return false;
+		}
+
+		files->data[files->size++] = item;
+	}
+
+	return total_count == record_count;
+}
+
+/* Decode the records of a source file and insert them at their sorted position. */
+static bool load_record_file(report* r, record_file* f)
+{
+	record_index* index = &r->record_index;
+
+	encoded_bytes decompressed;
+	darr_init(&decompressed);
+
+	strv bytes = strv_make_from(index->stream.data + f->offset, f->size);
+	bool valid = true;
+	if (index->is_compressed)
+	{
+		darr_ensure_space(&decompressed, f->size);
+		valid = compression_decompress_range(&index->blocks, f->offset, f->size, decompressed.data);
+		bytes = strv_make_from((const char*)decompressed.data, f->size);
+	}
+
+	sorted_records recs;
+	multi_map_init(&recs);
+	darr_ensure_space(&recs, f->count);
+
+	const uint8_t* cursor = (const uint8_t*)bytes.data;
+	valid = valid && decode_record_range(index->strings, index->names, index->name_count, cursor, cursor + bytes.size, f->count, f->line, f->address, recs.data);
+	recs.size = valid ? f->count : 0;
+
+	if (valid && recs.size)
+	{
+		size_t position = mem_lower_bound_predicate(r->records.data, sizeof(record), 0, r->records.size, &recs.data[0], (darr_predicate_t)record_by_file_predicate_less);
+		darr_insert_many(&r->records, position, recs.data, recs.size);
+	}
+
+	if (valid)
+	{
+		f->is_loaded = true;
+		index->unloaded_count -= 1;
+	}
+
+	multi_map_destroy(&recs);
+	darr_destroy(&decompressed);
+
+	return valid;
+}
+
+static bool get_string(strv strings, string_ref_v2 ref, strv* str)
+{
+	if (ref.offset > strings.size || ref.size > strings.size - ref.offset)
+	{
+		return false;
+	}
+
+	*str = strv_make_from(strings.data + ref.offset, ref.size);
+	return true;
+}
+
+static bool read_rollup_entries(strv strings, strv section, size_t count, rollup_records* rollup)
+{
+	darr_ensure_space(rollup, count);
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		rollup_entry_v2 entry;
+		memcpy(&entry, section.data + i * sizeof(rollup_entry_v2), sizeof(rollup_entry_v2));
+
+		rollup_record item = { 0 };
+		item.counter = entry.counter;
+		item.error = entry.error;
+		if (!get_string(strings, entry.name, &item.name))
+		{
+			return false;
+		}
+
+		rollup->data[rollup->size++] = item;
+	}
+
+	return true;
+}
+
+static void save_to_file(report* r, FILE* f, bool compress)
+{
+	/* Upper bound of the number of distinct strings, to avoid growing the table. */
+	size_t string_count = r->summary_by_count.size * 3 + r->summary_by_module.size + r->summary_by_file.size + r->call_graph.symbols.size;
+
+	string_table strings;
+	string_table_init(&strings, string_count);
+
+	darr(symbol_entry_v2) symbols;
+	rollup_entries_v2 modules;
+	rollup_entries_v2 files;
+	darr(call_symbol_entry_v2) call_symbols;
+	darr(call_edge_entry_v2) call_edges;
+	string_refs_v2 record_names;
+	encoded_bytes records;
+	record_file_entries_v2 record_index;
+	darr_init(&symbols);
+	darr_init(&modules);
+	darr_init(&files);
+	darr_init(&call_symbols);
+	darr_init(&call_edges);
+	darr_init(&record_names);
+	darr_init(&records);
+	darr_init(&record_index);
+
+	darr_ensure_space(&symbols, r->summary_by_count.size);
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+
+		symbol_entry_v2 entry;
+		entry.counter = item->counter;
+		entry.error = item->error;
+		entry.symbol_name = string_table_add(&strings, item->symbol_name);
+		entry.module_name = string_table_add(&strings, item->module_name);
+		entry.source_file_name = string_table_add(&strings, item->source_file_name);
+		entry.closest_line_number = item->closest_line_number;
+		symbols.data[symbols.size++] = entry;
+	}
+
+	fill_rollup_entries(&strings, &r->summary_by_module, &modules);
+	fill_rollup_entries(&strings, &r->summary_by_file, &files);
+
+	/* Callers and callees, only if the call stacks were sampled. */
+	call_graph* g = &r->call_graph;
+
+	darr_ensure_space(&call_symbols, g->symbols.size);
+	for (size_t i = 0; i < g->symbols.size; i += 1)
+	{
+		call_symbol_entry_v2 entry;
+		entry.name = string_table_add(&strings, g->symbols.data[i]);
+		entry.self_counter = g->self_counters.data[i];
+		entry.total_counter = g->total_counters.data[i];
+		call_symbols.data[call_symbols.size++] = entry;
+	}
+
+	/* The rows of the callees contain all the edges once. */
+	darr_ensure_space(&call_edges, g->callees.size);
+	for (size_t caller = 0; caller < g->symbols.size; caller += 1)
+	{
+		for (uint32_t i = g->callee_offsets.data[caller]; i < g->callee_offsets.data[caller + 1]; i += 1)
+		{
+			call_edge_entry_v2 entry;
+			entry.caller = (uint32_t)caller;
+			entry.callee = g->callees.data[i].symbol;
+			entry.counter = g->callees.data[i].counter;
+			call_edges.data[call_edges.size++] = entry;
+		}
+	}
+
+	/* Address-level records, for the per-line information of the source view. */
+	encode_records(&strings, &r->records, &record_names, &records, &record_index);
+
+	pending_section sections[] = {
+		{ magic_section_strings, strings.bytes.data, strings.bytes.size, strings.bytes.size },
+		{ magic_section_symbols, symbols.data, symbols.size * sizeof(symbol_entry_v2), symbols.size },
+		{ magic_section_modules, modules.data, modules.size * sizeof(rollup_entry_v2), modules.size },
+		{ magic_section_files, files.data, files.size * sizeof(rollup_entry_v2), files.size },
+		{ magic_section_record_names, record_names.data, record_names.size * sizeof(string_ref_v2), record_names.size },
+		{ magic_section_records, records.data, records.size, records.size },
+		{ magic_section_record_index, record_index.data, record_index.size * sizeof(record_file_entry_v2), record_index.size },
+		{ magic_section_call_symbols, call_symbols.data, call_symbols.size * sizeof(call_symbol_entry_v2), call_symbols.size },
+		{ magic_section_call_edges, call_edges.data, call_edges.size * sizeof(call_edge_entry_v2), call_edges.size },
+	};
+
+	/* The call graph sections are last, they are only written if there is a call graph. */
+	size_t section_count = sizeof(sections) / sizeof(sections[0]);
+	if (call_graph_is_empty(g))
+	{
+		section_count -= 2;
+	}
+
+	write_sections(f, r, sections, section_count, compress);
+
+	darr_destroy(&record_index);
+	darr_destroy(&records);
+	darr_destroy(&record_names);
+	darr_destroy(&call_edges);
+	darr_destroy(&call_symbols);
+	darr_destroy(&files);
+	darr_destroy(&modules);
+	darr_destroy(&symbols);
+	string_table_destroy(&strings);
+}
+
+static void write_sections(FILE* f, report* r, pending_section* sections, size_t section_count, bool compress)
+{
+	summary_binary_header_v2 header =
+	{
+		.zero = zero,
+		.version_number = SMP_SUMMARY_VERSION_NUMBER,
+		.version_text = { SMP_SUMMARY_VERSION_TEXT },
+		.total_sampling_count = r->sample_count,
+		.section_count = section_count
+	};
+	memcpy(&header.magic1, &magic1_samp, sizeof(magic1_samp));
+	memcpy(&header.magic2, &magic2_summ, sizeof(magic2_summ));
+
+	write_bytes(f, &header, sizeof(summary_binary_header_v2));
+
+	/* Compressed sections are only kept if they are smaller. */
+	for (size_t i = 0; i < section_count; i += 1)
+	{
+		darr_init(&sections[i].compressed);
+
+		if (compress && sections[i].size >= SUMMARY_MIN_COMPRESSED_SECTION_SIZE)
+		{
+			compression_compress(sections[i].data, sections[i].size, &sections[i].compressed);
+			if (sections[i].compressed.size < sections[i].size)
+			{
+				sections[i].data = sections[i].compressed.data;
+				sections[i].size = sections[i].compressed.size;
+			}
+			else
+			{
+				darr_clear(&sections[i].compressed);
+			}
+		}
+	}
+
+	/* Directory, the sections follow it in the same order. */
+	uint64_t directory_end = sizeof(summary_binary_header_v2) + section_count * sizeof(section_entry_v2);
+	uint64_t offset = directory_end;
+
+	for (size_t i = 0; i < section_count; i += 1)
+	{
+		offset = (offset + SUMMARY_SECTION_ALIGNMENT - 1) & ~(uint64_t)(SUMMARY_SECTION_ALIGNMENT - 1);
+
+		section_entry_v2 entry = { 0 };
+		memcpy(entry.magic, sections[i].magic, sizeof(entry.magic));
+		entry.flags = sections[i].compressed.size ? SUMMARY_SECTION_FLAG_COMPRESSED : 0;
+		entry.offset = offset;
+		entry.size = sections[i].size;
+		entry.count = sections[i].count;
+		write_bytes(f, &entry, sizeof(section_entry_v2));
+
+		offset += sections[i].size;
+	}
+
+	/* Sections, padded to their aligned offset. */
+	uint64_t position = directory_end;
+	for (size_t i = 0; i < section_count; i += 1)
+	{
+		size_t padding = (size_t)((SUMMARY_SECTION_ALIGNMENT - position % SUMMARY_SECTION_ALIGNMENT) % SUMMARY_SECTION_ALIGNMENT);
+		if (padding)
+		{
+			write_bytes(f, &zero, padding);
+		}
+
+		if (sections[i].size)
+		{
+			write_bytes(f, (void*)sections[i].data, sections[i].size);
+		}
+
+		position += padding + sections[i].size;
+	}
+
+	for (size_t i = 0; i < section_count; i += 1)
+	{
+		darr_destroy(&sections[i].compressed);
+	}
+}
+
+static void fill_rollup_entries(string_table* strings, rollup_records* rollup, rollup_entries_v2* entries)
+{
+	darr_ensure_space(entries, rollup->size);
+
+	for (size_t i = 0; i < rollup->size; i += 1)
+	{
+		rollup_entry_v2 entry;
+		entry.counter = rollup->data[i].counter;
+		entry.error = rollup->data[i].error;
+		entry.name = string_table_add(strings, rollup->data[i].name);
+		entries->data[entries->size++] = entry;
+	}
+}
+
+/* Encode the records, each distinct name is added once to the names. */
+/* The bytes of each source file are added to the index, records are sorted by source file. */
+static void encode_records(string_table* strings, sorted_records* recs, string_refs_v2* names, encoded_bytes* stream, record_file_entries_v2* index)
+{
+	if (recs->size == 0)
+	{
+		return;
+	}
+
+	ht slots;
+	summary_slots_init(&slots);
+
+	darr_ensure_space(stream, SMP_VARINT_MAX_SIZE);
+	write_varint(stream, recs->size);
+
+	uint64_t previous_line = 0;
+	uint64_t previous_address = 0;
+
+	for (size_t i = 0; i < recs->size; i += 1)
+	{
+		record* item = &recs->data[i];
+
+		/* Enough space for all the fields, to not check the capacity for each byte. */
+		darr_ensure_space(stream, 9 * SMP_VARINT_MAX_SIZE);
+
+		uint64_t file_index = get_record_name_index(&slots, strings, names, item->source_file);
+
+		/* Different pointers with the same content have the same string in the table, they are the same file. */
+		string_ref_v2 file_name = names->data[file_index];
+		record_file_entry_v2* last = index->size ? &index->data[index->size - 1] : NULL;
+		if (!last || last->name.offset != file_name.offset || last->name.size != file_name.size)
+		{
+			if (last)
+			{
+				last->size = stream->size - last->offset;
+			}
+
+			record_file_entry_v2 entry = { 0 };
+			entry.name = file_name;
+			entry.offset = stream->size;
+			entry.line = previous_line;
+			entry.address = previous_address;
+			darr_push_back(index, entry);
+		}
+		index->data[index->size - 1].count += 1;
+
+		write_varint(stream, file_index);
+		write_varint(stream, zigzag_encode((int64_t)(item->line_number - previous_line)));
+		write_varint(stream, zigzag_encode((int64_t)(item->address - previous_address)));
+		write_varint(stream, get_record_name_index(&slots, strings, names, item->symbol_name));
+		write_varint(stream, get_record_name_index(&slots, strings, names, item->module_name));
+		write_varint(stream, item->counter);
+		write_varint(stream, item->error);
+
+		bool has_function = item->function_end > item->function_start && item->function_start <= item->address;
+		write_varint(stream, has_function ? item->address - item->function_start + 1 : 0);
+		if (has_function)
+		{
+			write_varint(stream, item->function_end - item->function_start);
+		}
+
+		previous_line = item->line_number;
+		previous_address = item->address;
+	}
+
+	index->data[index->size - 1].size = stream->size - index->data[index->size - 1].offset;
+
+	ht_destroy(&slots);
+}
+
+/* Index of the name in the record names, the name is added if it's new. */
+static uint64_t get_record_name_index(ht* slots, string_table* strings, string_refs_v2* names, strv name)
+{
+	size_t index = summary_slot_get_index(slots, name, names->size);
+
+	if (index == names->size)
+	{
+		darr_push_back(names, string_table_add(strings, name));
+	}
+
+	return index;
+}
+
+static bool decode_records(strv strings, strv names, size_t name_count, strv stream, sorted_records* recs)
+{
+	const uint8_t* cursor = (const uint8_t*)stream.data;
+	const uint8_t* end = cursor + stream.size;
+
+	if (stream.size == 0)
+	{
+		return true;
+	}
+
+	uint64_t count;
+	if (!varint_read(&cursor, end, &count) || count > stream.size / SUMMARY_MIN_RECORD_SIZE)
+	{
+		return false;
+	}
+
+	darr_ensure_space(recs, (size_t)count);
+	if (!decode_record_range(strings, names, name_count, cursor, end, count, 0, 0, recs->data + recs->size))
+	{
+		return false;
+	}
+
+	recs->size += (size_t)count;
+	return true;
+}
+
+/* Decode count records to out, they must end at end. line and addr are the values of the record before them. */
+static bool decode_record_range(strv strings, strv names, size_t name_count, const uint8_t* cursor, const uint8_t* end, uint64_t count, uint64_t line, uint64_t addr, record* out)
+{
+	for (uint64_t i = 0; i < count; i += 1)
+	{
+		uint64_t file_index, line_delta, address_delta, symbol_index, module_index, counter, error, function_start;
+		if (!varint_read(&cursor, end, &file_index)
+			|| !varint_read(&cursor, end, &line_delta)
+			|| !varint_read(&cursor, end, &address_delta)
+			|| !varint_read(&cursor, end, &symbol_index)
+			|| !varint_read(&cursor, end, &module_index)
+			|| !varint_read(&cursor, end, &counter)
+			|| !varint_read(&cursor, end, &error)
+			|| !varint_read(&cursor, end, &function_start))
+		{
+			return false;
+		}
+
+		line += (uint64_t)zigzag_decode(line_delta);
+		addr += (uint64_t)zigzag_decode(address_delta);
+
+		record item = { 0 };
+		item.address = addr;
+		item.line_number = (size_t)line;
+		item.counter = (size_t)counter;
+		item.error = (size_t)error;
+
+		if (!get_record_name(strings, names, name_count, file_index, &item.source_file)
+			|| !get_record_name(strings, names, name_count, symbol_index, &item.symbol_name)
+			|| !get_record_name(strings, names, name_count, module_index, &item.module_name))
+		{
+			return false;
+		}
+
+		if (function_start)
+		{
+			uint64_t function_size;
+			if (!varint_read(&cursor, end, &function_size))
+			{
+				return false;
+			}
+			item.function_start = addr - (function_start - 1);
+			item.function_end = item.function_start + function_size;
+		}
+
+		out[i] = item;
+	}
+
+	return cursor == end;
+}
+
+static bool get_record_name(strv strings, strv names, size_t name_count, uint64_t index, strv* name)
+{
+	if (index >= name_count)
+	{
+		return false;
+	}
+
+	string_ref_v2 ref;
+	memcpy(&ref, names.data + index * sizeof(string_ref_v2), sizeof(string_ref_v2));
+	return get_string(strings, ref, name);
+}
+
+/* The stream must have space for SMP_VARINT_MAX_SIZE bytes. */
+static void write_varint(encoded_bytes* stream, uint64_t v)
+{
+	stream->size += varint_write(stream->data + stream->size, v);
+}
+
+static void string_table_init(string_table* t, size_t string_count)
+{
+	memset(t, 0, sizeof(string_table));
+
+	darr_init(&t->bytes);
+
+	/* Buckets are indexed by masking the hash, the capacity must be a power of two.
+	   Growing the table would hash all the strings again. */
+	size_t capacity = 1024;
+	while (capacity < string_count * 2)
+	{
+		capacity *= 2;
+	}
+
+	ht_init(&t->slots, sizeof(string_table_slot), string_table_slot_hash, (ht_predicate_t)string_table_slot_are_same, string_table_slot_swap, capacity);
+}
+
+static void string_table_destroy(string_table* t)
+{
+	ht_destroy(&t->slots);
+	darr_destroy(&t->bytes);
+}
+
+/* Reference of the string, it's only added if an equal string has not been added yet. */
+static string_ref_v2 string_table_add(string_table* t, strv str)
+{
+	uint64_t pointer_hash = (uint64_t)(uintptr_t)str.data * 0x9E3779B97F4A7C15ull;
+	string_table_slot* cached = &t->cache[(pointer_hash >> 32) & (STRING_TABLE_CACHE_SIZE - 1)];
+
+	if (cached->name.data == str.data && cached->name.size == str.size)
+	{
+		return cached->ref;
+	}
+
+	string_table_slot value;
+	value.name = str;
+	value.ref.offset = (uint32_t)t->bytes.size;
+	value.ref.size = (uint32_t)str.size;
+
+	string_table_slot* slot = ht_get_or_insert(&t->slots, &value);
+
+	/* New string. */
+	if (slot->ref.offset == t->bytes.size && str.size)
+	{
+		darr_ensure_space(&t->bytes, str.size);
+		memcpy(t->bytes.data + t->bytes.size, str.data, str.size);
+		t->bytes.size += str.size;
+	}
+
+	*cached = *slot;
+	return slot->ref;
+}
+
+static ht_hash_t string_table_slot_hash(string_table_slot* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool string_table_slot_are_same(string_table_slot* left, string_table_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void string_table_slot_swap(string_table_slot* left, string_table_slot* right)
+{
+	string_table_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+/* Read the next magic number. Returns false at the end of the file, or if it's not the expected one. */
+static bool read_magic(FILE* f, char* magic, char* expected)
+{
+	if (fread(magic, 4, 1, f) != 1)
+	{
+		return false;
+	}
+	return !expected || memcmp(magic, expected, 4) == 0;
+}
+
+static ht_hash_t summary_slot_hash(summary_slot* item)
+{
+	return string_store_interned_hash(item->name);
+}
+
+static bool summary_slot_are_same(summary_slot* left, summary_slot* right)
+{
+	return string_store_interned_equals(left->name, right->name);
+}
+
+static void summary_slot_swap(summary_slot* left, summary_slot* right)
+{
+	summary_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static bool is_kernel_module(strv module_name)
+{
+	return strv_equals(module_name, (strv)STRV(SMP_KERNEL_MODULE_NAME));
+}
+
+static int SMP_CDECL compare_summed_record(const summed_record* left, const summed_record* right)
+{
+	if (left->counter < right->counter)
+		return 1;
+	if (left->counter > right->counter)
+		return -1;
+	return 0;
+}
+
+static void write_bytes(FILE* f, void* data, size_t byte_count)
+{
+	fwrite(data, byte_count, 1, f);
+}
+
+static void read_bytes(FILE* f, void* data, size_t byte_count)
+{
+	fread(data, byte_count, 1, f);
+}
+
+static void read_uint64(FILE* f, uint64_t* v)
+{
+	fread(v, sizeof(uint64_t), 1, f);
+}
+
+static void read_strv(FILE* f, re_arena* a, strv* str)
+{
+	size_t size = 0;
+	/* Truncated file. */
+	if (fread(&size, sizeof(size_t), 1, f) != 1)
+	{
+		*str = strv_make();
+		return;
+	}
 
 	void* mem = re_arena_alloc(a, size);
 	fread(mem, size, 1, f);
@@ -10,6 +10,9 @@
 #include "arena_alloc.h"
 #include "sampler.h" /* record */
 #include "string_store.h"
+#include "call_graph.h"
+#include "compression.h"
+#include "utils/file_mapper.h"
 
 #if __cplusplus
 extern "C" {
@@ -17,35 +20,110 @@ extern "C" {
 
 typedef struct summed_record summed_record;
 struct summed_record {
-	size_t symbol_hash;
 	strv symbol_name;
 	strv module_name;
 	strv source_file_name;
 	size_t closest_line_number;
 	size_t counter;
+	size_t error;   /* Maximum overestimation of the counter, only in heavy-hitter mode (see heavy_hitters.h). */
+};
+
+/* Number of samples of a module or a source file. */
+typedef struct rollup_record rollup_record;
+struct rollup_record {
+	strv name;
+	size_t counter;
+	size_t error;
 };
 
 typedef darr(record) records;
 typedef multi_map(record) sorted_records;
 typedef darr(summed_record) summed_records;
+typedef darr(rollup_record) rollup_records;
+
+/* Records of a source file in the record stream of a loaded file, see report_load_summary_from_filepath. */
+typedef struct record_file record_file;
+struct record_file {
+	strv source_file;
+	size_t offset;      /* In the record stream. */
+	size_t size;
+	size_t count;
+	uint64_t line;      /* Line number and address before the first record, the deltas start from them. */
+	uint64_t address;
+	bool is_loaded;
+};
+
+typedef darr(record_file) record_files;
+
+/* Records which are not decoded yet. The sections point into the loaded file. */
+typedef struct record_index record_index;
+struct record_index {
+	record_files files;
+	size_t unloaded_count;
+	strv strings;
+	strv names;
+	size_t name_count;
+	strv stream;
+	/* The record stream is compressed, only the blocks of a file are decompressed. */
+	bool is_compressed;
+	compressed_blocks blocks;
+};
+
+/* Duration of each stage of the last load from a file, in seconds. */
+typedef struct report_load_timings report_load_timings;
+struct report_load_timings {
+	double read;          /* Mapping or reading the file. */
+	double decompression;
+	double summary;       /* Symbols, modules and source files. */
+	double records;
+	double call_graph;
+	double total;
+	size_t thread_count;
+};
+
+enum report_group_by {
+	report_group_by_SYMBOL,
+	report_group_by_MODULE,
+	report_group_by_FILE
+};
 
 typedef struct report report;
 struct report {
 	string_store string_store;
 
 	size_t sample_count;
+	/* Number of samples in kernel code, the others are in user code. */
+	size_t kernel_sample_count;
 
 	/* Contains struct of (function name, number of sample), sorted by count:
 			func1 425
 			func2 11
 	*/
 	summed_records summary_by_count;
+	/* Number of samples by module and by source file, sorted by count.
+	   Computed in the same pass as summary_by_count. */
+	rollup_records summary_by_module;
+	rollup_records summary_by_file;
 	/* Array of record stored by filename, then symbol name, then by address. */
 	sorted_records records;
 
+	/* Callers and callees of each symbol, empty if the call stacks were not sampled. */
+	call_graph call_graph;
+
+	/* Records of the source files which are not in records yet, only after report_load_summary_from_filepath. */
+	record_index record_index;
+
+	/* Threads loading a file, one per processor if zero. Kept by report_clear. */
+	size_t load_thread_count;
+	report_load_timings load_timings;
+
 	/* TODO use string store instead of this arena, to allocate strings loaded from files. */
 	/* Arena to allocate data when loaded from a file. */
 	re_arena arena;
+
+	/* File mapped by report_load_from_filepath, the strings of the report point into it until the report is cleared. */
+	file_mapper file_mapper;
+	readonly_file mapped_file;
 };
 
 void report_init(report* r);
@@ -54,6 +132,12 @@ void report_destroy(report* r);
 /* Reset allocated buffers without deallocating them. */
 void report_clear(report* r);
 
+/* Sort symbols, modules and source files by counter, biggest first. */
+void report_sort_by_count(report* r);
+
+/* Compute the modules and source files from summary_by_count, for the summaries loaded without them. */
+void report_compute_rollups(report* r);
+
 /*-----------------------------------------------------------------------*/
 /* OUTPUT - Convert report to something else. */
 /*-----------------------------------------------------------------------*/
@@ -61,12 +145,27 @@ void report_clear(report* r);
 /* Print to FILE. */
 void report_print_to_file(report* s, FILE* f);
 
-/* Save summary to filepath */
+/* Print to FILE with one row per symbol, per module or per source file. */
+void report_print_grouped_to_file(report* r, enum report_group_by group_by, FILE* f);
+
+/* Print the duration of each stage of the last load from a file. */
+void report_print_load_timings(report* r, FILE* f);
+
+/* Print one row: ratio of sample_count, counter, error bound if with_errors, 95% confidence interval of the ratio and name. */
+void report_print_row_to_file(strv name, size_t counter, size_t error, size_t sample_count, bool with_errors, FILE* f);
+
+/* Save summary and records to filepath */
 bool report_save_to_filepath(report* r, const char* filepath);
 
-/* Save summary to FILE */
+/* Save summary and records to FILE */
 void report_save_to_file(report* r, FILE* f);
 
+/* Save summary and records to filepath, the sections which get smaller are compressed (see compression.h). */
+bool report_save_compressed_to_filepath(report* r, const char* filepath);
+
+/* Save summary and records to FILE, the sections which get smaller are compressed. */
+void report_save_compressed_to_file(report* r, FILE* f);
+
 /*-----------------------------------------------------------------------*/
 /* INPUT - Load report from something else. */
 /*-----------------------------------------------------------------------*/
@@ -74,11 +173,33 @@ void report_save_to_file(report* r, FILE* f);
 /* Clear report and load from sampler. */
 void report_load_from_sampler(report* r, sampler* s);
 
-/* Clear report and load from filepath. */
+/* Clear report and load from a map of records by address, like the results of the sampler. */
+void report_load_from_records(report* r, ht* results, size_t sample_count);
+
+/* Replace the records of report by the records of results, sorted by source file, line number and address.
+   Strings of the records must be interned in the string store of the report. */
+void report_build_records(report* r, ht* results);
+
+/* Clear report and load from filepath.
+   Files of the current version are mapped and used in place, without copying their strings.
+   Their sections are decompressed and decoded by load_thread_count threads. */
 bool report_load_from_filepath(report* r, const char* filepath);
 
-/* Clear report and load from FILE. */
-void report_load_from_file(report* r, FILE* f);
+/* Clear report and load from FILE. Returns false if it's not a report or if it's corrupted. */
+bool report_load_from_file(report* r, FILE* f);
+
+/* Clear report and load from filepath, without the records if the file has a record index.
+   The records of a source file are then added by report_load_records_of_file, the first time they are needed.
+   Files without index are loaded entirely. */
+bool report_load_summary_from_filepath(report* r, const char* filepath);
+
+/* Add the records of a source file to records, if they are not loaded yet.
+   inserted is set to true if records were added, the ones previously returned by record_range_for_file can then move.
+   Returns false if they are corrupted. */
+bool report_load_records_of_file(report* r, strv source_file, bool* inserted);
+
+/* Add all the records which are not loaded yet, see report_load_records_of_file. */
+bool report_load_all_records(report* r, bool* inserted);
 
 /*-----------------------------------------------------------------------*/
 /* Records range. */
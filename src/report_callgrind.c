@@ -0,0 +1,315 @@
+#include "report_callgrind.h"
+
+#include "string.h" /* memset */
+
+#include "samply.h"
+#include "utils/log.h"
+
+/* Buffer of the output file, lines are small and written one by one. */
+#define CALLGRIND_BUFFER_SIZE (256 * 1024)
+
+/* Id of a module, file or function name, for the name compression. */
+typedef struct callgrind_slot callgrind_slot;
+struct callgrind_slot {
+	strv name;
+	size_t id;
+};
+
+/* Ids of the names already written, by kind. */
+typedef struct callgrind_names callgrind_names;
+struct callgrind_names {
+	ht table;
+	size_t count;
+};
+
+/* Module and file of a symbol of the call graph, found in the records. */
+typedef struct callgrind_location callgrind_location;
+struct callgrind_location {
+	strv module_name;
+	strv source_file;
+	bool is_located;
+};
+
+typedef darr(callgrind_location) callgrind_locations;
+
+/* Current module, file and function of the output. */
+typedef struct callgrind_writer callgrind_writer;
+struct callgrind_writer {
+	FILE* f;
+	callgrind_names objects;
+	callgrind_names files;
+	callgrind_names functions;
+	strv module_name;
+	strv source_file;
+	strv symbol_name;
+	bool has_function;
+};
+
+static void write_costs(callgrind_writer* w, report* r, callgrind_locations* locations);
+static void write_calls(callgrind_writer* w, call_graph* g, callgrind_locations* locations);
+static void locate_symbol(callgrind_names* symbol_ids, callgrind_locations* locations, strv module_name, strv source_file, strv symbol_name);
+static void set_function(callgrind_writer* w, strv module_name, strv source_file, strv symbol_name);
+static void write_name(FILE* f, callgrind_names* names, const char* key, strv name);
+static void names_init(callgrind_names* names);
+static void names_destroy(callgrind_names* names);
+
+static ht_hash_t callgrind_slot_hash(callgrind_slot* item);
+static bool callgrind_slot_are_same(callgrind_slot* left, callgrind_slot* right);
+static void callgrind_slot_swap(callgrind_slot* left, callgrind_slot* right);
+
+bool report_save_callgrind(report* r, const char* filepath)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not save to file '%s'", filepath);
+		return false;
+	}
+
+	setvbuf(f, NULL, _IOFBF, CALLGRIND_BUFFER_SIZE);
+
+	bool success = report_save_callgrind_to_file(r, f);
+	success = fclose(f) == 0 && success;
+	return success;
+}
+
+/* Layout of the file:
+	# callgrind format
+	version: 1
+	creator: samply 0.0.4-dev
+	positions: line
+	events: Samples
+	summary: 436
+
+	ob=(1) app.exe
+	fl=(1) main.c
+	fn=(1) main
+	12 3
+	14 40
+	fn=(2) parse
+	30 2
+	cfn=(3) read_token
+	calls=17 0
+	0 17
+*/
+bool report_save_callgrind_to_file(report* r, FILE* f)
+{
+	fprintf(f, "# callgrind format\n");
+	fprintf(f, "version: 1\n");
+	fprintf(f, "creator: samply " SMP_APP_VERSION_TEXT "\n");
+	fprintf(f, "positions: line\n");
+	fprintf(f, "events: Samples\n");
+	fprintf(f, "summary: %zu\n\n", r->sample_count);
+
+	callgrind_writer w;
+	memset(&w, 0, sizeof(callgrind_writer));
+	w.f = f;
+	names_init(&w.objects);
+	names_init(&w.files);
+	names_init(&w.functions);
+
+	/* Location of each symbol of the call graph, the call graph itself only knows their names. */
+	callgrind_locations locations;
+	darr_init(&locations);
+	for (size_t i = 0; i < r->call_graph.symbols.size; i += 1)
+	{
+		callgrind_location location = { 0 };
+		darr_push_back(&locations, location);
+	}
+
+	write_costs(&w, r, &locations);
+	write_calls(&w, &r->call_graph, &locations);
+
+	darr_destroy(&locations);
+	names_destroy(&w.functions);
+	names_destroy(&w.files);
+	names_destroy(&w.objects);
+
+	return !ferror(f);
+}
+
+/* Samples of each line. Reports without records, like the ones loaded from old files, only have the closest line of each symbol. */
+static void write_costs(callgrind_writer* w, report* r, callgrind_locations* locations)
+{
+	/* Symbol id in the call graph by name. */
+	callgrind_names symbol_ids;
+	names_init(&symbol_ids);
+	for (size_t i = 0; i < r->call_graph.symbols.size; i += 1)
+	{
+		callgrind_slot value;
+		value.name = r->call_graph.symbols.data[i];
+		value.id = i;
+		ht_get_or_insert(&symbol_ids.table, &value);
+	}
+
+	if (r->records.size)
+	{
+		for (size_t i = 0; i < r->records.size; i += 1)
+		{
+			record* item = &r->records.data[i];
+
+			/* Records of a function are next to each other, it's only located once. */
+			if (locations->size && (i == 0 || !strv_equals(item->symbol_name, w->symbol_name)))
+			{
+				locate_symbol(&symbol_ids, locations, item->module_name, item->source_file, item->symbol_name);
+			}
+
+			set_function(w, item->module_name, item->source_file, item->symbol_name);
+			fprintf(w->f, "%zu %zu\n", item->line_number, item->counter);
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+		{
+			summed_record* item = &r->summary_by_count.data[i];
+
+			if (locations->size)
+			{
+				locate_symbol(&symbol_ids, locations, item->module_name, item->source_file_name, item->symbol_name);
+			}
+
+			set_function(w, item->module_name, item->source_file_name, item->symbol_name);
+			fprintf(w->f, "%zu %zu\n", item->closest_line_number, item->counter);
+		}
+	}
+
+	names_destroy(&symbol_ids);
+}
+
+/* Callees of each function with their inclusive samples. The call count is unknown, it's the number of samples too. */
+static void write_calls(callgrind_writer* w, call_graph* g, callgrind_locations* locations)
+{
+	if (call_graph_is_empty(g))
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < g->symbols.size; i += 1)
+	{
+		uint32_t begin = g->callee_offsets.data[i];
+		uint32_t end = g->callee_offsets.data[i + 1];
+		if (begin == end)
+		{
+			continue;
+		}
+
+		callgrind_location* caller = &locations->data[i];
+		set_function(w, caller->module_name, caller->source_file, g->symbols.data[i]);
+
+		for (uint32_t j = begin; j < end; j += 1)
+		{
+			call_edge* edge = &g->callees.data[j];
+			callgrind_location* callee = &locations->data[edge->symbol];
+
+			/* cob and cfi only apply to the next call. */
+			if (!strv_equals(callee->module_name, w->module_name))
+			{
+				write_name(w->f, &w->objects, "cob", callee->module_name);
+			}
+			if (!strv_equals(callee->source_file, w->source_file))
+			{
+				write_name(w->f, &w->files, "cfi", callee->source_file);
+			}
+			write_name(w->f, &w->functions, "cfn", g->symbols.data[edge->symbol]);
+
+			fprintf(w->f, "calls=%zu 0\n0 %zu\n", edge->counter, edge->counter);
+		}
+	}
+}
+
+/* The first module and file of a symbol are the ones of its calls, symbols which are not in the call graph are ignored. */
+static void locate_symbol(callgrind_names* symbol_ids, callgrind_locations* locations, strv module_name, strv source_file, strv symbol_name)
+{
+	callgrind_slot value;
+	value.name = symbol_name;
+	value.id = SIZE_MAX;
+
+	callgrind_slot* slot = ht_get_or_insert(&symbol_ids->table, &value);
+	if (slot->id == SIZE_MAX || locations->data[slot->id].is_located)
+	{
+		return;
+	}
+
+	locations->data[slot->id].module_name = module_name;
+	locations->data[slot->id].source_file = source_file;
+	locations->data[slot->id].is_located = true;
+}
+
+/* Write the names which changed since the previous line. A function belongs to the current module and file,
+   so it's written again when one of them changed. */
+static void set_function(callgrind_writer* w, strv module_name, strv source_file, strv symbol_name)
+{
+	bool function_changed = !w->has_function;
+
+	if (!w->has_function || !strv_equals(module_name, w->module_name))
+	{
+		write_name(w->f, &w->objects, "ob", module_name);
+		w->module_name = module_name;
+		function_changed = true;
+	}
+	if (!w->has_function || !strv_equals(source_file, w->source_file))
+	{
+		write_name(w->f, &w->files, "fl", source_file);
+		w->source_file = source_file;
+		function_changed = true;
+	}
+	if (function_changed || !strv_equals(symbol_name, w->symbol_name))
+	{
+		write_name(w->f, &w->functions, "fn", symbol_name);
+		w->symbol_name = symbol_name;
+	}
+
+	w->has_function = true;
+}
+
+/* "key=(id) name" the first time, "key=(id)" afterward. Unknown names are written like valgrind does. */
+static void write_name(FILE* f, callgrind_names* names, const char* key, strv name)
+{
+	static strv unknown = STRV("???");
+
+	callgrind_slot value;
+	value.name = name;
+	value.id = names->count + 1;
+
+	callgrind_slot* slot = ht_get_or_insert(&names->table, &value);
+	if (slot->id == names->count + 1)
+	{
+		names->count += 1;
+
+		strv written = name.size ? name : unknown;
+		fprintf(f, "%s=(%zu) " STRV_FMT "\n", key, slot->id, STRV_ARG(written));
+	}
+	else
+	{
+		fprintf(f, "%s=(%zu)\n", key, slot->id);
+	}
+}
+
+static void names_init(callgrind_names* names)
+{
+	ht_init(&names->table, sizeof(callgrind_slot), callgrind_slot_hash, (ht_predicate_t)callgrind_slot_are_same, callgrind_slot_swap, 1024);
+	names->count = 0;
+}
+
+static void names_destroy(callgrind_names* names)
+{
+	ht_destroy(&names->table);
+}
+
+static ht_hash_t callgrind_slot_hash(callgrind_slot* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool callgrind_slot_are_same(callgrind_slot* left, callgrind_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void callgrind_slot_swap(callgrind_slot* left, callgrind_slot* right)
+{
+	callgrind_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
@@ -0,0 +1,33 @@
+#ifndef SAMPLY_REPORT_CALLGRIND_H
+#define SAMPLY_REPORT_CALLGRIND_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Export of a report to the callgrind format, to browse the costs by source line in KCachegrind or QCachegrind.
+
+	Each record adds its samples to a line of its function. The records are already sorted by source file and line,
+	so they are written in a single pass and the functions of a file are next to each other.
+	Each module, file and function name is only written the first time, then referenced by its id: "fn=(12)".
+	If the call stacks were sampled, the callees of each function are written with their inclusive samples,
+	on line 0 since the call sites are not known.
+*/
+
+/* Save report to filepath in the callgrind format. */
+bool report_save_callgrind(report* r, const char* filepath);
+
+/* Save report to FILE in the callgrind format. Returns false if something could not be written. */
+bool report_save_callgrind_to_file(report* r, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_CALLGRIND_H */
@@ -0,0 +1,200 @@
+#include "report_diff.h"
+
+#include "string.h" /* memset */
+
+#include "samply.h"
+#include "statistics.h"
+
+/* Index of the diff record of a symbol of a module, symbols with the same name in different modules are different.
+   Names are interned in the comparison, so they are identified by their data pointer. */
+typedef struct diff_slot diff_slot;
+struct diff_slot {
+	strv name;
+	strv module_name;
+	size_t index;
+};
+
+static void join_summary(report_comparison* c, ht* slots, report* r, bool is_old);
+static size_t diff_slot_get_index(ht* slots, strv name, strv module_name, size_t next_index);
+static ht_hash_t diff_slot_hash(diff_slot* item);
+static bool diff_slot_are_same(diff_slot* left, diff_slot* right);
+static void diff_slot_swap(diff_slot* left, diff_slot* right);
+static int compare_diff_record(const diff_record* left, const diff_record* right);
+
+void report_comparison_init(report_comparison* c)
+{
+	memset(c, 0, sizeof(report_comparison));
+
+	darr_init(&c->records);
+
+	string_store_init(&c->string_store);
+}
+
+void report_comparison_destroy(report_comparison* c)
+{
+	darr_destroy(&c->records);
+
+	string_store_destroy(&c->string_store);
+}
+
+void report_comparison_clear(report_comparison* c)
+{
+	c->old_sample_count = 0;
+	c->new_sample_count = 0;
+
+	darr_clear(&c->records);
+	string_store_clear(&c->string_store);
+}
+
+void report_diff(report_comparison* c, report* old_report, report* new_report)
+{
+	report_comparison_clear(c);
+
+	c->old_sample_count = old_report->sample_count;
+	c->new_sample_count = new_report->sample_count;
+
+	/* Each symbol is looked up once per report, so the join is linear in the number of symbols. */
+	size_t capacity = 16;
+	size_t expected = old_report->summary_by_count.size + new_report->summary_by_count.size;
+	while (capacity < expected * 2)
+	{
+		capacity *= 2;
+	}
+
+	ht slots;
+	ht_init(&slots, sizeof(diff_slot), diff_slot_hash, (ht_predicate_t)diff_slot_are_same, diff_slot_swap, capacity);
+
+	darr_ensure_space(&c->records, expected);
+
+	/* Avoid rehashing the interned names while joining. */
+	if (c->string_store.map.bucket_capacity < capacity)
+	{
+		ht_reserve(&c->string_store.map, capacity);
+	}
+
+	join_summary(c, &slots, old_report, true);
+	join_summary(c, &slots, new_report, false);
+
+	ht_destroy(&slots);
+
+	double old_count_f = (double)c->old_sample_count;
+	double new_count_f = (double)c->new_sample_count;
+
+	for (size_t i = 0; i < c->records.size; i += 1)
+	{
+		diff_record* item = &c->records.data[i];
+		item->old_ratio = c->old_sample_count ? (double)item->old_counter / old_count_f : 0.0;
+		item->new_ratio = c->new_sample_count ? (double)item->new_counter / new_count_f : 0.0;
+		item->delta = item->new_ratio - item->old_ratio;
+		item->ratio = item->old_ratio > 0.0 ? item->new_ratio / item->old_ratio : 0.0;
+		item->is_significant = ratios_differ_significantly(
+			item->old_counter, c->old_sample_count,
+			item->new_counter, c->new_sample_count);
+	}
+
+	samply_qsort(c->records.data, c->records.size, sizeof(diff_record), compare_diff_record);
+}
+
+void report_comparison_print_to_file(report_comparison* c, bool significant_only, FILE* f)
+{
+	fprintf(f, "Sample count: %zu -> %zu\n", c->old_sample_count, c->new_sample_count);
+	fprintf(f, "delta" "\t" "ratio" "\t" "old" "\t" "new" "\t" "symbol\n");
+
+	for (size_t i = 0; i < c->records.size; i += 1)
+	{
+		diff_record item = c->records.data[i];
+		if (significant_only && !item.is_significant)
+		{
+			continue;
+		}
+
+		/* Significant changes are flagged, the other ones can be sampling noise. */
+		const char* flag = item.is_significant ? "*" : "";
+		if (item.old_counter == 0)
+		{
+			fprintf(f, "%+.2f%s" "\t" "new" "\t" "%.2f" "\t" "%.2f" "\t" STRV_FMT "\n",
+				item.delta, flag, item.old_ratio, item.new_ratio, STRV_ARG(item.symbol_name));
+		}
+		else
+		{
+			fprintf(f, "%+.2f%s" "\t" "%.2f" "\t" "%.2f" "\t" "%.2f" "\t" STRV_FMT "\n",
+				item.delta, flag, item.ratio, item.old_ratio, item.new_ratio, STRV_ARG(item.symbol_name));
+		}
+	}
+}
+
+/* Add the counters of a report to the record of each symbol, creating the records of new symbols. */
+static void join_summary(report_comparison* c, ht* slots, report* r, bool is_old)
+{
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+
+		/* Names of both reports come from different string stores, interning them again gives them the same identity. */
+		strv symbol_name = *string_store_get_or_create(&c->string_store, item->symbol_name);
+		strv module_name = *string_store_get_or_create(&c->string_store, item->module_name);
+
+		size_t index = diff_slot_get_index(slots, symbol_name, module_name, c->records.size);
+
+		/* First time this symbol is seen. */
+		if (index == c->records.size)
+		{
+			diff_record init = { 0 };
+			init.symbol_name = symbol_name;
+			init.module_name = module_name;
+			darr_push_back(&c->records, init);
+		}
+
+		diff_record* result = &c->records.data[index];
+		if (is_old)
+		{
+			result->old_counter += item->counter;
+		}
+		else
+		{
+			result->new_counter += item->counter;
+		}
+	}
+}
+
+/* Returns the index associated with the names, or next_index if the names are new. */
+static size_t diff_slot_get_index(ht* slots, strv name, strv module_name, size_t next_index)
+{
+	diff_slot value;
+	value.name = name;
+	value.module_name = module_name;
+	value.index = next_index;
+
+	diff_slot* slot = ht_get_or_insert(slots, &value);
+	return slot->index;
+}
+
+static ht_hash_t diff_slot_hash(diff_slot* item)
+{
+	return string_store_interned_hash(item->name) * 31 + string_store_interned_hash(item->module_name);
+}
+
+static bool diff_slot_are_same(diff_slot* left, diff_slot* right)
+{
+	return string_store_interned_equals(left->name, right->name)
+		&& string_store_interned_equals(left->module_name, right->module_name);
+}
+
+static void diff_slot_swap(diff_slot* left, diff_slot* right)
+{
+	diff_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+/* Biggest absolute change first. */
+static int SMP_CDECL compare_diff_record(const diff_record* left, const diff_record* right)
+{
+	double l = left->delta < 0.0 ? -left->delta : left->delta;
+	double r = right->delta < 0.0 ? -right->delta : right->delta;
+	if (l < r)
+		return 1;
+	if (l > r)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef SAMPLY_REPORT_DIFF_H
+#define SAMPLY_REPORT_DIFF_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+#include "report.h"
+#include "string_store.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Symbol present in at least one of the compared reports.
+   Counters are normalized by the sample count of their report, so runs of different length can be compared. */
+typedef struct diff_record diff_record;
+struct diff_record {
+	strv symbol_name;
+	strv module_name;
+	size_t old_counter;
+	size_t new_counter;
+	double old_ratio;   /* old_counter / old sample count */
+	double new_ratio;   /* new_counter / new sample count */
+	double delta;       /* new_ratio - old_ratio, negative means faster. */
+	double ratio;       /* new_ratio / old_ratio, zero if the symbol is not in the old report. */
+	bool is_significant; /* The change is not explained by the sampling noise, at the 95% level. */
+};
+
+typedef darr(diff_record) diff_records;
+
+typedef struct report_comparison report_comparison;
+struct report_comparison {
+	/* Names of both reports are interned here to join symbols on the pointer of their name. */
+	string_store string_store;
+
+	size_t old_sample_count;
+	size_t new_sample_count;
+
+	/* Sorted by absolute delta, biggest change first. */
+	diff_records records;
+};
+
+void report_comparison_init(report_comparison* c);
+void report_comparison_destroy(report_comparison* c);
+
+/* Reset allocated buffers without deallocating them. */
+void report_comparison_clear(report_comparison* c);
+
+/* Clear comparison and join the symbols of both reports. */
+void report_diff(report_comparison* c, report* old_report, report* new_report);
+
+/* Print to FILE. Significant changes are flagged with '*', the other ones are skipped if significant_only is set. */
+void report_comparison_print_to_file(report_comparison* c, bool significant_only, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_DIFF_H */
@@ -0,0 +1,568 @@
+#include "report_filter.h"
+
+#include "string.h" /* memset, memchr, memcmp */
+#include "stdlib.h" /* strtod */
+
+#include "samply.h"
+#include "statistics.h"
+
+/* Id of a distinct name, names loaded from a file are not interned so they are compared by content. */
+typedef struct name_slot name_slot;
+struct name_slot {
+	strv name;
+	uint32_t id;
+};
+
+/* Counter of a module or a source file of the result, to print them grouped. */
+typedef struct filter_group filter_group;
+struct filter_group {
+	uint32_t id;
+	size_t counter;
+	size_t error;
+};
+
+typedef darr(filter_group) filter_groups;
+
+static bool parse_min_percent(strv value, double* percent);
+static uint32_t name_get_id(ht* slots, filter_names* names, strv name);
+static void match_names(filter_names* names, filter_matches* matches, strv pattern);
+static void match_symbols(report_filter_index* index, strv pattern);
+static void find_symbols_containing(report_filter_index* index, strv pattern, filter_matches* matches);
+static strv longest_literal(strv pattern);
+
+static bool is_glob(strv pattern);
+static char fold_char(char c);
+static bool pattern_matches(strv pattern, strv text);
+static bool glob_matches(strv pattern, strv text);
+static bool contains_folded(strv text, strv pattern);
+
+static ht_hash_t name_slot_hash(name_slot* item);
+static bool name_slot_are_same(name_slot* left, name_slot* right);
+static void name_slot_swap(name_slot* left, name_slot* right);
+static int compare_filter_group(const filter_group* left, const filter_group* right);
+
+bool report_filter_parse(report_filter* filter, strv query)
+{
+	memset(filter, 0, sizeof(report_filter));
+
+	strv blanks = STRV(" \t");
+	strv rest = strv_trimmed_left_by(query, blanks);
+	while (rest.size)
+	{
+		/* Next term, until the next blank. */
+		size_t end = strv_find_first_of_chars(rest, blanks);
+		if (end == STRV_NPOS)
+		{
+			end = rest.size;
+		}
+		strv term = strv_substr_from(rest, 0, end);
+		rest = strv_trimmed_left_by(strv_remove_left(rest, end), blanks);
+
+		size_t colon = strv_find_char(term, ':');
+		if (colon == STRV_NPOS)
+		{
+			filter->symbol = term;
+			continue;
+		}
+
+		strv key = strv_substr_from(term, 0, colon);
+		strv value = strv_remove_left(term, colon + 1);
+
+		if (strv_equals_str(key, "module"))
+		{
+			filter->module = value;
+		}
+		else if (strv_equals_str(key, "file"))
+		{
+			filter->file = value;
+		}
+		else if (strv_equals_str(key, "symbol"))
+		{
+			filter->symbol = value;
+		}
+		else if (strv_equals_str(key, "min"))
+		{
+			if (!parse_min_percent(value, &filter->min_percent))
+			{
+				snprintf(filter->error, sizeof(filter->error), "Invalid filter value 'min:" STRV_FMT "', expected a percentage.", STRV_ARG(value));
+				return false;
+			}
+		}
+		else
+		{
+			snprintf(filter->error, sizeof(filter->error), "Unknown filter key '" STRV_FMT "', expected module, file, symbol or min.", STRV_ARG(key));
+			return false;
+		}
+	}
+	return true;
+}
+
+bool report_filter_is_empty(report_filter* filter)
+{
+	return filter->module.size == 0
+		&& filter->file.size == 0
+		&& filter->symbol.size == 0
+		&& filter->min_percent <= 0.0;
+}
+
+void report_filter_index_init(report_filter_index* index)
+{
+	memset(index, 0, sizeof(report_filter_index));
+
+	darr_init(&index->module_ids);
+	darr_init(&index->file_ids);
+	darr_init(&index->module_names);
+	darr_init(&index->file_names);
+	darr_init(&index->symbol_text);
+	darr_init(&index->symbol_offsets);
+	darr_init(&index->module_matches);
+	darr_init(&index->file_matches);
+	darr_init(&index->symbol_matches);
+}
+
+void report_filter_index_destroy(report_filter_index* index)
+{
+	darr_destroy(&index->module_ids);
+	darr_destroy(&index->file_ids);
+	darr_destroy(&index->module_names);
+	darr_destroy(&index->file_names);
+	darr_destroy(&index->symbol_text);
+	darr_destroy(&index->symbol_offsets);
+	darr_destroy(&index->module_matches);
+	darr_destroy(&index->file_matches);
+	darr_destroy(&index->symbol_matches);
+}
+
+void report_filter_index_build(report_filter_index* index, report* r)
+{
+	darr_clear(&index->module_ids);
+	darr_clear(&index->file_ids);
+	darr_clear(&index->module_names);
+	darr_clear(&index->file_names);
+	darr_clear(&index->symbol_text);
+	darr_clear(&index->symbol_offsets);
+
+	size_t count = r->summary_by_count.size;
+	darr_ensure_space(&index->module_ids, count);
+	darr_ensure_space(&index->file_ids, count);
+	darr_ensure_space(&index->symbol_offsets, count + 1);
+
+	ht module_slots;
+	ht file_slots;
+	ht_init(&module_slots, sizeof(name_slot), name_slot_hash, (ht_predicate_t)name_slot_are_same, name_slot_swap, 64);
+	ht_init(&file_slots, sizeof(name_slot), name_slot_hash, (ht_predicate_t)name_slot_are_same, name_slot_swap, 1024);
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+
+		index->module_ids.data[index->module_ids.size++] = name_get_id(&module_slots, &index->module_names, item->module_name);
+		index->file_ids.data[index->file_ids.size++] = name_get_id(&file_slots, &index->file_names, item->source_file_name);
+
+		/* Fold once here, instead of for each query. */
+		index->symbol_offsets.data[index->symbol_offsets.size++] = (uint32_t)index->symbol_text.size;
+		darr_ensure_space(&index->symbol_text, item->symbol_name.size + 1);
+		char* text = index->symbol_text.data + index->symbol_text.size;
+		for (size_t c = 0; c < item->symbol_name.size; c += 1)
+		{
+			text[c] = fold_char(item->symbol_name.data[c]);
+		}
+		/* Separator, a pattern never matches across two symbols since it can't contain it. */
+		text[item->symbol_name.size] = '\n';
+		index->symbol_text.size += item->symbol_name.size + 1;
+	}
+	index->symbol_offsets.data[index->symbol_offsets.size++] = (uint32_t)index->symbol_text.size;
+
+	memset(index->char_counts, 0, sizeof(index->char_counts));
+	for (size_t i = 0; i < index->symbol_text.size; i += 1)
+	{
+		index->char_counts[(unsigned char)index->symbol_text.data[i]] += 1;
+	}
+
+	ht_destroy(&file_slots);
+	ht_destroy(&module_slots);
+}
+
+void report_filter_result_init(report_filter_result* result)
+{
+	memset(result, 0, sizeof(report_filter_result));
+	darr_init(&result->rows);
+}
+
+void report_filter_result_destroy(report_filter_result* result)
+{
+	darr_destroy(&result->rows);
+}
+
+void report_filter_apply(report_filter_index* index, report* r, report_filter* filter, report_filter_result* result)
+{
+	darr_clear(&result->rows);
+	result->sample_count = 0;
+
+	size_t count = r->summary_by_count.size;
+	SMP_ASSERT(index->module_ids.size == count);
+
+	/* Patterns are evaluated once per distinct module and source file, rows only compare ids. */
+	match_names(&index->module_names, &index->module_matches, filter->module);
+	match_names(&index->file_names, &index->file_matches, filter->file);
+	match_symbols(index, filter->symbol);
+
+	size_t min_counter = 0;
+	if (filter->min_percent > 0.0)
+	{
+		double min = filter->min_percent / 100.0 * (double)r->sample_count;
+		min_counter = (size_t)min;
+		if ((double)min_counter < min)
+		{
+			min_counter += 1;
+		}
+	}
+
+	darr_ensure_space(&result->rows, count);
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		if (!index->symbol_matches.data[i]
+			|| !index->module_matches.data[index->module_ids.data[i]]
+			|| !index->file_matches.data[index->file_ids.data[i]])
+		{
+			continue;
+		}
+
+		size_t counter = r->summary_by_count.data[i].counter;
+		if (counter < min_counter)
+		{
+			continue;
+		}
+
+		result->rows.data[result->rows.size++] = (uint32_t)i;
+		result->sample_count += counter;
+	}
+}
+
+void report_filter_print_to_file(report_filter_index* index, report* r, report_filter_result* result, enum report_group_by group_by, FILE* f)
+{
+	fprintf(f, "Sample count: %zu (filtered from %zu)\n", result->sample_count, r->sample_count);
+
+	bool with_errors = false;
+	for (size_t i = 0; i < result->rows.size && !with_errors; i += 1)
+	{
+		with_errors = r->summary_by_count.data[result->rows.data[i]].error > 0;
+	}
+
+	if (group_by == report_group_by_SYMBOL)
+	{
+		for (size_t i = 0; i < result->rows.size; i += 1)
+		{
+			summed_record* item = &r->summary_by_count.data[result->rows.data[i]];
+			report_print_row_to_file(item->symbol_name, item->counter, item->error, result->sample_count, with_errors, f);
+		}
+		return;
+	}
+
+	/* Sum the matching symbols by module or source file id. */
+	bool by_module = group_by == report_group_by_MODULE;
+	filter_ids* ids = by_module ? &index->module_ids : &index->file_ids;
+	filter_names* names = by_module ? &index->module_names : &index->file_names;
+
+	filter_groups groups;
+	darr_init(&groups);
+	darr_ensure_space(&groups, names->size);
+	for (size_t i = 0; i < names->size; i += 1)
+	{
+		filter_group init = { 0 };
+		init.id = (uint32_t)i;
+		groups.data[groups.size++] = init;
+	}
+
+	for (size_t i = 0; i < result->rows.size; i += 1)
+	{
+		uint32_t row = result->rows.data[i];
+		filter_group* group = &groups.data[ids->data[row]];
+		group->counter += r->summary_by_count.data[row].counter;
+		group->error += r->summary_by_count.data[row].error;
+	}
+
+	samply_qsort(groups.data, groups.size, sizeof(filter_group), compare_filter_group);
+
+	for (size_t i = 0; i < groups.size && groups.data[i].counter; i += 1)
+	{
+		filter_group* group = &groups.data[i];
+		report_print_row_to_file(names->data[group->id], group->counter, group->error, result->sample_count, with_errors, f);
+	}
+
+	darr_destroy(&groups);
+}
+
+static bool parse_min_percent(strv value, double* percent)
+{
+	char buffer[32];
+	if (value.size == 0 || value.size >= sizeof(buffer))
+	{
+		return false;
+	}
+	memcpy(buffer, value.data, value.size);
+	buffer[value.size] = 0;
+
+	char* end = NULL;
+	*percent = strtod(buffer, &end);
+	return end == buffer + value.size && *percent >= 0.0;
+}
+
+static uint32_t name_get_id(ht* slots, filter_names* names, strv name)
+{
+	name_slot value;
+	value.name = name;
+	value.id = (uint32_t)names->size;
+
+	name_slot* slot = ht_get_or_insert(slots, &value);
+	if (slot->id == names->size)
+	{
+		darr_push_back(names, name);
+	}
+	return slot->id;
+}
+
+static void match_names(filter_names* names, filter_matches* matches, strv pattern)
+{
+	darr_clear(matches);
+	darr_ensure_space(matches, names->size);
+	matches->size = names->size;
+
+	for (size_t i = 0; i < names->size; i += 1)
+	{
+		matches->data[i] = pattern.size == 0 || pattern_matches(pattern, names->data[i]);
+	}
+}
+
+static void match_symbols(report_filter_index* index, strv pattern)
+{
+	size_t count = index->symbol_offsets.size - 1;
+
+	filter_matches* matches = &index->symbol_matches;
+	darr_clear(matches);
+	darr_ensure_space(matches, count);
+	matches->size = count;
+
+	if (pattern.size == 0)
+	{
+		memset(matches->data, 1, count);
+		return;
+	}
+
+	if (!is_glob(pattern))
+	{
+		memset(matches->data, 0, count);
+		find_symbols_containing(index, pattern, matches);
+		return;
+	}
+
+	/* A symbol can only match the glob if it contains its longest part without wildcard,
+	   the glob is only evaluated on these symbols. */
+	strv literal = longest_literal(pattern);
+	if (literal.size)
+	{
+		memset(matches->data, 0, count);
+		find_symbols_containing(index, literal, matches);
+	}
+	else
+	{
+		memset(matches->data, 1, count);
+	}
+
+	for (size_t i = 0; i < count; i += 1)
+	{
+		if (matches->data[i])
+		{
+			uint32_t begin = index->symbol_offsets.data[i];
+			uint32_t end = index->symbol_offsets.data[i + 1] - 1;
+			strv symbol = strv_make_from(index->symbol_text.data + begin, end - begin);
+			matches->data[i] = glob_matches(pattern, symbol);
+		}
+	}
+}
+
+/* Search the pattern once in the whole text, each occurrence is mapped back to its symbol. */
+static void find_symbols_containing(report_filter_index* index, strv pattern, filter_matches* matches)
+{
+	/* Long patterns are folded in a heap buffer. */
+	char buffer[256];
+	char* folded = pattern.size <= sizeof(buffer) ? buffer : SMP_MALLOC(pattern.size);
+
+	/* memchr on the least frequent char of the pattern, the others are only compared around it. */
+	size_t anchor = 0;
+	for (size_t i = 0; i < pattern.size; i += 1)
+	{
+		folded[i] = fold_char(pattern.data[i]);
+		if (index->char_counts[(unsigned char)folded[i]] < index->char_counts[(unsigned char)folded[anchor]])
+		{
+			anchor = i;
+		}
+	}
+
+	const char* text = index->symbol_text.data;
+	const char* text_end = text + index->symbol_text.size;
+	const char* cursor = text + anchor;
+	size_t row = 0;
+
+	while (cursor + (pattern.size - anchor) <= text_end)
+	{
+		cursor = memchr(cursor, folded[anchor], (size_t)(text_end - cursor) - (pattern.size - anchor) + 1);
+		if (!cursor)
+		{
+			break;
+		}
+
+		uint32_t position = (uint32_t)(cursor - anchor - text);
+		if (memcmp(text + position, folded, pattern.size) != 0)
+		{
+			cursor += 1;
+			continue;
+		}
+
+		/* Occurrences are found in order, the symbol is found by moving forward. */
+		while (index->symbol_offsets.data[row + 1] <= position)
+		{
+			row += 1;
+		}
+		matches->data[row] = 1;
+
+		/* Skip the rest of the symbol, it already matches. */
+		cursor = text + index->symbol_offsets.data[row + 1] + anchor;
+		row += 1;
+	}
+
+	if (folded != buffer)
+	{
+		SMP_FREE(folded);
+	}
+}
+
+static strv longest_literal(strv pattern)
+{
+	strv longest = strv_make();
+	size_t begin = 0;
+	for (size_t i = 0; i <= pattern.size; i += 1)
+	{
+		if (i == pattern.size || pattern.data[i] == '*' || pattern.data[i] == '?')
+		{
+			if (i - begin > longest.size)
+			{
+				longest = strv_substr_from(pattern, begin, i - begin);
+			}
+			begin = i + 1;
+		}
+	}
+	return longest;
+}
+
+static bool is_glob(strv pattern)
+{
+	return strv_contains_chars(pattern, (strv)STRV("*?"));
+}
+
+/* Lower case ASCII, and '\' becomes '/' so paths can be written with either. */
+static char fold_char(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+	{
+		return (char)(c - 'A' + 'a');
+	}
+	return c == '\\' ? '/' : c;
+}
+
+static bool pattern_matches(strv pattern, strv text)
+{
+	return is_glob(pattern)
+		? glob_matches(pattern, text)
+		: contains_folded(text, pattern);
+}
+
+/* '*' matches any sequence, '?' matches any char. Backtracks to the last '*' only, so it's linear in practice. */
+static bool glob_matches(strv pattern, strv text)
+{
+	size_t p = 0;
+	size_t t = 0;
+	size_t star = STRV_NPOS;
+	size_t star_text = 0;
+
+	while (t < text.size)
+	{
+		if (p < pattern.size && pattern.data[p] == '*')
+		{
+			star = p;
+			star_text = t;
+			p += 1;
+		}
+		else if (p < pattern.size
+			&& (pattern.data[p] == '?' || fold_char(pattern.data[p]) == fold_char(text.data[t])))
+		{
+			p += 1;
+			t += 1;
+		}
+		else if (star != STRV_NPOS)
+		{
+			p = star + 1;
+			star_text += 1;
+			t = star_text;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	while (p < pattern.size && pattern.data[p] == '*')
+	{
+		p += 1;
+	}
+	return p == pattern.size;
+}
+
+static bool contains_folded(strv text, strv pattern)
+{
+	if (pattern.size > text.size)
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i + pattern.size <= text.size; i += 1)
+	{
+		size_t j = 0;
+		while (j < pattern.size && fold_char(text.data[i + j]) == fold_char(pattern.data[j]))
+		{
+			j += 1;
+		}
+		if (j == pattern.size)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static ht_hash_t name_slot_hash(name_slot* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool name_slot_are_same(name_slot* left, name_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void name_slot_swap(name_slot* left, name_slot* right)
+{
+	name_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static int SMP_CDECL compare_filter_group(const filter_group* left, const filter_group* right)
+{
+	if (left->counter < right->counter)
+		return 1;
+	if (left->counter > right->counter)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,105 @@
+#ifndef SAMPLY_REPORT_FILTER_H
+#define SAMPLY_REPORT_FILTER_H
+
+#include "stdio.h"   /* FILE */
+#include "stdint.h"  /* uint32_t */
+#include "stdbool.h" /* bool */
+
+#include "strv.h"
+#include "darr.h"
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Query over the symbols of a report, all the conditions must match:
+
+		module:libssl file:*crypto* symbol:alloc min:0.5
+
+	- module:<pattern>  module name
+	- file:<pattern>    source file
+	- symbol:<pattern>  symbol name, a word without key is also a symbol pattern
+	- min:<percent>     minimum percentage of all the samples of the report
+
+	A pattern without '*' or '?' matches a part of the name, otherwise it must match the whole name.
+	Patterns ignore the case and '/' matches '\'.
+	Patterns point into the query, which must outlive the filter.
+*/
+typedef struct report_filter report_filter;
+struct report_filter {
+	strv module;
+	strv file;
+	strv symbol;
+	double min_percent;
+	/* Why the query could not be parsed, empty if it was parsed. */
+	char error[128];
+};
+
+typedef darr(uint32_t) filter_ids;
+typedef darr(strv) filter_names;
+typedef darr(char) filter_text;
+typedef darr(unsigned char) filter_matches;
+
+/* Precomputed data to filter the summary of a report without comparing strings for each row.
+   Must be rebuilt when the summary changes or is reordered. */
+typedef struct report_filter_index report_filter_index;
+struct report_filter_index {
+	/* Id of the module and of the source file of each symbol. */
+	filter_ids module_ids;
+	filter_ids file_ids;
+
+	/* Distinct names, by id. Patterns are matched once per distinct name. */
+	filter_names module_names;
+	filter_names file_names;
+
+	/* Symbol names folded to lower case and separated by '\n', searched in a single pass.
+	   Offset of each symbol in the text, followed by the size of the text. */
+	filter_text symbol_text;
+	filter_ids symbol_offsets;
+	/* Occurrences of each char in the text, substrings are searched from their least frequent char. */
+	size_t char_counts[256];
+
+	/* Result of the patterns for each module id, file id and symbol. */
+	filter_matches module_matches;
+	filter_matches file_matches;
+	filter_matches symbol_matches;
+};
+
+/* Symbols matching a filter. */
+typedef struct report_filter_result report_filter_result;
+struct report_filter_result {
+	/* Indexes in the summary of the report, in the same order. */
+	filter_ids rows;
+	/* Number of samples of the matching symbols, percentages of the results are relative to it. */
+	size_t sample_count;
+};
+
+/* Parse query. Returns false if the query contains an unknown key or an invalid value, the reason is written to filter->error.
+   Nothing is logged, so a query being typed can be parsed after each change. */
+bool report_filter_parse(report_filter* filter, strv query);
+
+/* The filter matches all the symbols. */
+bool report_filter_is_empty(report_filter* filter);
+
+void report_filter_index_init(report_filter_index* index);
+void report_filter_index_destroy(report_filter_index* index);
+
+/* Build index from the summary of the report. */
+void report_filter_index_build(report_filter_index* index, report* r);
+
+void report_filter_result_init(report_filter_result* result);
+void report_filter_result_destroy(report_filter_result* result);
+
+/* Clear result and fill it with the symbols matching the filter. */
+void report_filter_apply(report_filter_index* index, report* r, report_filter* filter, report_filter_result* result);
+
+/* Print the result to FILE, with one row per symbol, per module or per source file. */
+void report_filter_print_to_file(report_filter_index* index, report* r, report_filter_result* result, enum report_group_by group_by, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_FILTER_H */
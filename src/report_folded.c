@@ -0,0 +1,305 @@
+#include "report_folded.h"
+
+#include "string.h" /* memset, memchr */
+
+#include "samply.h"
+#include "utils/log.h"
+
+/* Largest sample count of a line, more digits could overflow. */
+#define FOLDED_MAX_COUNT_DIGITS (19)
+
+/* Frame of the folded stacks. Frames have no address, each name gets a fake one to build the call stacks. */
+typedef struct frame_slot frame_slot;
+struct frame_slot {
+	strv name;
+	address address;
+};
+
+typedef darr(size_t) folded_counters;
+typedef darr(address) folded_frames;
+
+/* State of the file being loaded. */
+typedef struct folded_loader folded_loader;
+struct folded_loader {
+	report* r;
+	ht frame_slots;
+	/* Frame records by fake address, only their name is set (see call_graph_load_from_call_stacks). */
+	ht frames;
+	ht call_stacks;
+	re_arena call_stack_arena;
+	/* Samples of each frame where it's the sampled function, by fake address - 1. */
+	folded_counters self_counters;
+	/* Frames of the current line, from the outermost caller. */
+	folded_frames line_frames;
+	size_t invalid_line_count;
+};
+
+static void load_line(folded_loader* l, strv line);
+static bool parse_count(strv str, size_t* count);
+static address get_frame_address(folded_loader* l, strv name);
+static void add_call_stack(folded_loader* l, size_t count);
+
+static ht_hash_t frame_slot_hash(frame_slot* item);
+static bool frame_slot_are_same(frame_slot* left, frame_slot* right);
+static void frame_slot_swap(frame_slot* left, frame_slot* right);
+
+bool report_load_from_folded(report* r, const char* filepath)
+{
+	report_clear(r);
+
+	readonly_file file;
+	readonly_file_init(&file);
+	if (!file_mapper_open(&r->file_mapper, &file, strv_make_from_str(filepath)))
+	{
+		log_error("Could not open file '%s'", filepath);
+		return false;
+	}
+
+	folded_loader l;
+	memset(&l, 0, sizeof(folded_loader));
+	l.r = r;
+	ht_init(&l.frame_slots, sizeof(frame_slot), frame_slot_hash, (ht_predicate_t)frame_slot_are_same, frame_slot_swap, 1024);
+	records_by_address_init(&l.frames, 1024);
+	call_stacks_init(&l.call_stacks);
+	re_arena_init(&l.call_stack_arena, 64 * 1024);
+	darr_init(&l.self_counters);
+	darr_init(&l.line_frames);
+
+	const char* cursor = file.view.data;
+	const char* end = file.view.data + file.view.size;
+	while (cursor < end)
+	{
+		const char* line_end = memchr(cursor, '\n', end - cursor);
+		if (!line_end)
+		{
+			line_end = end;
+		}
+
+		load_line(&l, strv_make_from(cursor, line_end - cursor));
+		cursor = line_end + 1;
+	}
+
+	file_mapper_close(&r->file_mapper, &file);
+
+	/* The sampled functions make the summary, folded stacks have no module and no source file. */
+	for (size_t i = 0; i < l.self_counters.size; i += 1)
+	{
+		if (l.self_counters.data[i] == 0)
+		{
+			continue;
+		}
+
+		record key = {0};
+		key.address = i + 1;
+		record* frame = ht_get_or_insert(&l.frames, &key);
+
+		summed_record item = {0};
+		item.symbol_name = frame->symbol_name;
+		item.counter = l.self_counters.data[i];
+		darr_push_back(&r->summary_by_count, item);
+
+		r->sample_count += item.counter;
+	}
+
+	call_graph_load_from_call_stacks(&r->call_graph, &l.call_stacks, &l.frames);
+
+	report_sort_by_count(r);
+	report_compute_rollups(r);
+
+	if (l.invalid_line_count)
+	{
+		log_warning("%zu invalid lines were ignored in '%s'", l.invalid_line_count, filepath);
+	}
+
+	darr_destroy(&l.line_frames);
+	darr_destroy(&l.self_counters);
+	re_arena_destroy(&l.call_stack_arena);
+	ht_destroy(&l.call_stacks);
+	ht_destroy(&l.frames);
+	ht_destroy(&l.frame_slots);
+
+	if (r->sample_count == 0)
+	{
+		log_error("No samples in '%s'", filepath);
+		return false;
+	}
+
+	return true;
+}
+
+bool report_save_folded(report* r, const char* filepath)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not save to file '%s'", filepath);
+		return false;
+	}
+
+	bool success = report_save_folded_to_file(r, f);
+	success = fclose(f) == 0 && success;
+	return success;
+}
+
+bool report_save_folded_to_file(report* r, FILE* f)
+{
+	static strv unknown = STRV("[unknown]");
+
+	bool success = true;
+	for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+	{
+		summed_record* item = &r->summary_by_count.data[i];
+		strv name = item->symbol_name.size ? item->symbol_name : unknown;
+
+		if (fprintf(f, STRV_FMT " %zu\n", STRV_ARG(name), item->counter) < 0)
+		{
+			success = false;
+		}
+	}
+	return success;
+}
+
+/* Line: frames separated by ';', then a space and the number of samples.
+   Empty lines and comments starting with '#' are ignored. */
+static void load_line(folded_loader* l, strv line)
+{
+	while (line.size && (line.data[line.size - 1] == '\r' || line.data[line.size - 1] == ' '))
+	{
+		line.size -= 1;
+	}
+	if (line.size == 0 || line.data[0] == '#')
+	{
+		return;
+	}
+
+	/* Names can contain spaces, the count is after the last one. */
+	size_t space = line.size;
+	while (space > 0 && line.data[space - 1] != ' ')
+	{
+		space -= 1;
+	}
+
+	size_t count;
+	if (space == 0 || !parse_count(strv_make_from(line.data + space, line.size - space), &count))
+	{
+		l->invalid_line_count += 1;
+		return;
+	}
+	if (count == 0)
+	{
+		return;
+	}
+
+	darr_clear(&l->line_frames);
+
+	const char* cursor = line.data;
+	const char* end = line.data + space - 1;
+	while (end > cursor && end[-1] == ' ')
+	{
+		end -= 1;
+	}
+	while (cursor < end)
+	{
+		const char* frame_end = memchr(cursor, ';', end - cursor);
+		if (!frame_end)
+		{
+			frame_end = end;
+		}
+
+		if (frame_end > cursor)
+		{
+			address addr = get_frame_address(l, strv_make_from(cursor, frame_end - cursor));
+			darr_push_back(&l->line_frames, addr);
+		}
+		cursor = frame_end + 1;
+	}
+
+	if (l->line_frames.size == 0)
+	{
+		l->invalid_line_count += 1;
+		return;
+	}
+
+	address leaf = l->line_frames.data[l->line_frames.size - 1];
+	l->self_counters.data[leaf - 1] += count;
+
+	add_call_stack(l, count);
+}
+
+static bool parse_count(strv str, size_t* count)
+{
+	if (str.size == 0 || str.size > FOLDED_MAX_COUNT_DIGITS)
+	{
+		return false;
+	}
+
+	size_t value = 0;
+	for (size_t i = 0; i < str.size; i += 1)
+	{
+		char c = str.data[i];
+		if (c < '0' || c > '9')
+		{
+			return false;
+		}
+		value = value * 10 + (size_t)(c - '0');
+	}
+
+	*count = value;
+	return true;
+}
+
+/* Fake address of a frame, the name is interned the first time it's seen. */
+static address get_frame_address(folded_loader* l, strv name)
+{
+	frame_slot value;
+	value.name = name;
+	value.address = l->self_counters.size + 1;
+
+	frame_slot* slot = ht_get_or_insert(&l->frame_slots, &value);
+	if (slot->address == l->self_counters.size + 1)
+	{
+		/* The slot pointed into the mapped file, it now points to the same content in the string store. */
+		slot->name = *string_store_get_or_create(&l->r->string_store, name);
+
+		record key = {0};
+		key.address = slot->address;
+		record* frame = ht_get_or_insert(&l->frames, &key);
+		frame->symbol_name = slot->name;
+
+		size_t zero = 0;
+		darr_push_back(&l->self_counters, zero);
+	}
+
+	return slot->address;
+}
+
+/* Call stacks go from the sampled function to the outermost caller, deepest callers are ignored. */
+static void add_call_stack(folded_loader* l, size_t count)
+{
+	address frames[SMP_MAX_CALL_STACK_DEPTH];
+	size_t frame_count = 0;
+	for (size_t i = l->line_frames.size; i > 0 && frame_count < SMP_MAX_CALL_STACK_DEPTH; i -= 1)
+	{
+		frames[frame_count] = l->line_frames.data[i - 1];
+		frame_count += 1;
+	}
+
+	call_stacks_add(&l->call_stacks, &l->call_stack_arena, frames, frame_count, count);
+}
+
+static ht_hash_t frame_slot_hash(frame_slot* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool frame_slot_are_same(frame_slot* left, frame_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void frame_slot_swap(frame_slot* left, frame_slot* right)
+{
+	frame_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
@@ -0,0 +1,40 @@
+#ifndef SAMPLY_REPORT_FOLDED_H
+#define SAMPLY_REPORT_FOLDED_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Collapsed stacks, also called folded stacks, the text format of the flame graph tools:
+
+		main;parse;read_token 42
+		main;render 17
+
+	One call stack per line, from the outermost caller to the sampled function, then the number of samples.
+	Files produced by other profilers (stackcollapse-perf.pl, async-profiler, ...) can be loaded as a report:
+	the sampled functions make the summary and the call stacks make the call graph (see call_graph.h).
+	Folded stacks have no address, no module and no source file.
+*/
+
+/* Clear report and load from a folded stack file.
+   The file is mapped and tokenized in place, frame names are interned in the string store of the report. */
+bool report_load_from_folded(report* r, const char* filepath);
+
+/* Save report to filepath as folded stacks. */
+bool report_save_folded(report* r, const char* filepath);
+
+/* Save report to FILE as folded stacks.
+   The report does not store its call stacks, so each symbol is written as a stack of a single frame. */
+bool report_save_folded_to_file(report* r, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_FOLDED_H */
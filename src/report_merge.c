@@ -0,0 +1,507 @@
+#include "report_merge.h"
+
+#include "string.h" /* memset */
+
+#include "thread.h"
+
+#include "samply.h"
+#include "utils/log.h"
+
+/* Names and records are spread over partitions by their hash. Each partition has its own lock,
+   so workers merging different reports rarely wait for each other. */
+#define SMP_MERGE_PARTITION_BITS (6)
+#define SMP_MERGE_PARTITION_COUNT (1 << SMP_MERGE_PARTITION_BITS)
+
+enum merge_kind {
+	merge_kind_SYMBOL,
+	merge_kind_MODULE,
+	merge_kind_FILE,
+	merge_kind_RECORD
+};
+
+/* Index of the merged entry of a name. The name is interned in the string store of the partition. */
+typedef struct merge_slot merge_slot;
+struct merge_slot {
+	strv name;
+	size_t index;
+};
+
+/* Merged symbols, modules, source files and records whose names belong to the partition.
+   Addresses of different runs can't be compared, records are merged by source line, symbol and module. */
+typedef struct merge_partition merge_partition;
+struct merge_partition {
+	thread_mutex_t mutex;
+	string_store string_store;
+
+	ht symbol_slots;
+	ht module_slots;
+	ht file_slots;
+
+	summed_records symbols;
+	rollup_records modules;
+	rollup_records files;
+
+	/* Records are stored in the table, with their names interned in the string store of the partition. */
+	ht records;
+};
+
+/* Entry of a loaded report, waiting to be merged in its partition. */
+typedef struct merge_entry merge_entry;
+struct merge_entry {
+	enum merge_kind kind;
+	ht_hash_t hash;
+	size_t index; /* Index in the summary, in the rollup or in the records of the loaded report. */
+};
+
+typedef darr(merge_entry) merge_entries;
+
+typedef struct report_merger report_merger;
+struct report_merger {
+	const char** filepaths;
+	size_t filepath_count;
+
+	/* Index of the next report to load. */
+	thread_atomic_int_t next_filepath;
+
+	merge_partition partitions[SMP_MERGE_PARTITION_COUNT];
+};
+
+/* A worker loads all its reports in the same report, so its memory is reused from one file to another. */
+typedef struct merge_worker merge_worker;
+struct merge_worker {
+	report_merger* merger;
+	thread_ptr_t thread;
+
+	report loaded;
+	merge_entries entries_by_partition[SMP_MERGE_PARTITION_COUNT];
+
+	size_t sample_count;
+	size_t kernel_sample_count;
+	size_t failure_count;
+};
+
+static int merge_worker_procedure(void* user_data);
+static void merge_loaded_report(merge_worker* w);
+static void push_entry(merge_worker* w, enum merge_kind kind, ht_hash_t hash, size_t index);
+static void merge_entry_in_partition(merge_partition* p, report* loaded, merge_entry* entry);
+static void merge_record_in_partition(merge_partition* p, record* item, ht_hash_t hash);
+static void append_partition(report* r, merge_partition* p, ht* records);
+
+static void merge_partition_init(merge_partition* p);
+static void merge_partition_destroy(merge_partition* p);
+static size_t partition_of(ht_hash_t hash);
+
+static merge_slot* merge_slot_get(ht* slots, strv name, ht_hash_t hash, size_t next_index);
+static ht_hash_t merge_name_hash(strv name);
+static ht_hash_t merge_slot_hash(merge_slot* item);
+static bool merge_slot_are_same(merge_slot* left, merge_slot* right);
+static void merge_slot_swap(merge_slot* left, merge_slot* right);
+
+static ht_hash_t merge_record_hash(record* item);
+static bool merge_record_are_same(record* left, record* right);
+static void merge_record_swap(record* left, record* right);
+
+bool report_merge_filepaths(report* r, const char** filepaths, size_t filepath_count, size_t thread_count)
+{
+	report_clear(r);
+
+	report_merger* m = SMP_MALLOC(sizeof(report_merger));
+	memset(m, 0, sizeof(report_merger));
+	m->filepaths = filepaths;
+	m->filepath_count = filepath_count;
+	thread_atomic_int_store(&m->next_filepath, 0);
+
+	for (size_t i = 0; i < SMP_MERGE_PARTITION_COUNT; i += 1)
+	{
+		merge_partition_init(&m->partitions[i]);
+	}
+
+	if (thread_count > filepath_count)
+	{
+		thread_count = filepath_count;
+	}
+	if (thread_count == 0)
+	{
+		thread_count = 1;
+	}
+
+	merge_worker* workers = SMP_MALLOC(sizeof(merge_worker) * thread_count);
+	memset(workers, 0, sizeof(merge_worker) * thread_count);
+
+	for (size_t i = 0; i < thread_count; i += 1)
+	{
+		merge_worker* w = &workers[i];
+		w->merger = m;
+		report_init(&w->loaded);
+		/* Reports are already loaded by one worker per processor. */
+		w->loaded.load_thread_count = 1;
+		for (size_t j = 0; j < SMP_MERGE_PARTITION_COUNT; j += 1)
+		{
+			darr_init(&w->entries_by_partition[j]);
+		}
+
+		w->thread = thread_create(merge_worker_procedure, w, THREAD_STACK_SIZE_DEFAULT);
+		if (!w->thread)
+		{
+			log_warning("Could not create a thread to merge the reports, the calling thread merges them instead.");
+		}
+	}
+
+	size_t failure_count = 0;
+	for (size_t i = 0; i < thread_count; i += 1)
+	{
+		merge_worker* w = &workers[i];
+		if (w->thread)
+		{
+			thread_join(w->thread);
+			thread_destroy(w->thread);
+		}
+		else
+		{
+			/* Reports not taken by the other workers are merged by the calling thread. */
+			merge_worker_procedure(w);
+		}
+
+		r->sample_count += w->sample_count;
+		r->kernel_sample_count += w->kernel_sample_count;
+		failure_count += w->failure_count;
+
+		report_destroy(&w->loaded);
+		for (size_t j = 0; j < SMP_MERGE_PARTITION_COUNT; j += 1)
+		{
+			darr_destroy(&w->entries_by_partition[j]);
+		}
+	}
+
+	ht records;
+	ht_init(&records, sizeof(record), merge_record_hash, (ht_predicate_t)merge_record_are_same, merge_record_swap, 1024);
+
+	for (size_t i = 0; i < SMP_MERGE_PARTITION_COUNT; i += 1)
+	{
+		append_partition(r, &m->partitions[i], &records);
+		merge_partition_destroy(&m->partitions[i]);
+	}
+
+	if (ht_size(&records))
+	{
+		report_build_records(r, &records);
+	}
+	report_sort_by_count(r);
+
+	ht_destroy(&records);
+
+	SMP_FREE(workers);
+	SMP_FREE(m);
+
+	return failure_count == 0;
+}
+
+static int merge_worker_procedure(void* user_data)
+{
+	merge_worker* w = (merge_worker*)user_data;
+	report_merger* m = w->merger;
+
+	for (;;)
+	{
+		size_t index = (size_t)thread_atomic_int_inc(&m->next_filepath);
+		if (index >= m->filepath_count)
+		{
+			break;
+		}
+
+		if (!report_load_from_filepath(&w->loaded, m->filepaths[index]))
+		{
+			w->failure_count += 1;
+			continue;
+		}
+
+		w->sample_count += w->loaded.sample_count;
+		w->kernel_sample_count += w->loaded.kernel_sample_count;
+
+		merge_loaded_report(w);
+	}
+
+	return 0;
+}
+
+static void merge_loaded_report(merge_worker* w)
+{
+	report* loaded = &w->loaded;
+
+	for (size_t i = 0; i < SMP_MERGE_PARTITION_COUNT; i += 1)
+	{
+		darr_clear(&w->entries_by_partition[i]);
+	}
+
+	/* Group the entries by partition to lock each partition once per report. */
+	for (size_t i = 0; i < loaded->summary_by_count.size; i += 1)
+	{
+		push_entry(w, merge_kind_SYMBOL, merge_name_hash(loaded->summary_by_count.data[i].symbol_name), i);
+	}
+	for (size_t i = 0; i < loaded->summary_by_module.size; i += 1)
+	{
+		push_entry(w, merge_kind_MODULE, merge_name_hash(loaded->summary_by_module.data[i].name), i);
+	}
+	for (size_t i = 0; i < loaded->summary_by_file.size; i += 1)
+	{
+		push_entry(w, merge_kind_FILE, merge_name_hash(loaded->summary_by_file.data[i].name), i);
+	}
+	for (size_t i = 0; i < loaded->records.size; i += 1)
+	{
+		push_entry(w, merge_kind_RECORD, merge_record_hash(&loaded->records.data[i]), i);
+	}
+
+	for (size_t i = 0; i < SMP_MERGE_PARTITION_COUNT; i += 1)
+	{
+		merge_entries* entries = &w->entries_by_partition[i];
+		if (entries->size == 0)
+		{
+			continue;
+		}
+
+		merge_partition* p = &w->merger->partitions[i];
+
+		thread_mutex_lock(&p->mutex);
+		for (size_t j = 0; j < entries->size; j += 1)
+		{
+			merge_entry_in_partition(p, loaded, &entries->data[j]);
+		}
+		thread_mutex_unlock(&p->mutex);
+	}
+}
+
+static void push_entry(merge_worker* w, enum merge_kind kind, ht_hash_t hash, size_t index)
+{
+	merge_entry entry;
+	entry.kind = kind;
+	entry.hash = hash;
+	entry.index = index;
+
+	darr_push_back(&w->entries_by_partition[partition_of(entry.hash)], entry);
+}
+
+static void merge_entry_in_partition(merge_partition* p, report* loaded, merge_entry* entry)
+{
+	if (entry->kind == merge_kind_RECORD)
+	{
+		merge_record_in_partition(p, &loaded->records.data[entry->index], entry->hash);
+	}
+	else if (entry->kind == merge_kind_SYMBOL)
+	{
+		summed_record* item = &loaded->summary_by_count.data[entry->index];
+		merge_slot* slot = merge_slot_get(&p->symbol_slots, item->symbol_name, entry->hash, p->symbols.size);
+
+		/* First report with this symbol. */
+		if (slot->index == p->symbols.size)
+		{
+			summed_record init = *item;
+			init.counter = 0;
+			init.error = 0;
+			init.symbol_name = *string_store_get_or_create(&p->string_store, item->symbol_name);
+			init.module_name = *string_store_get_or_create(&p->string_store, item->module_name);
+			init.source_file_name = *string_store_get_or_create(&p->string_store, item->source_file_name);
+
+			/* The memory of the loaded report is reused by the next report. */
+			slot->name = init.symbol_name;
+
+			darr_push_back(&p->symbols, init);
+		}
+
+		summed_record* result = &p->symbols.data[slot->index];
+		if (item->closest_line_number < result->closest_line_number)
+		{
+			result->closest_line_number = item->closest_line_number;
+		}
+		result->counter += item->counter;
+		result->error += item->error;
+	}
+	else
+	{
+		bool is_module = entry->kind == merge_kind_MODULE;
+		rollup_record* item = is_module
+			? &loaded->summary_by_module.data[entry->index]
+			: &loaded->summary_by_file.data[entry->index];
+		rollup_records* rollup = is_module ? &p->modules : &p->files;
+
+		merge_slot* slot = merge_slot_get(is_module ? &p->module_slots : &p->file_slots, item->name, entry->hash, rollup->size);
+
+		if (slot->index == rollup->size)
+		{
+			rollup_record init = { 0 };
+			init.name = *string_store_get_or_create(&p->string_store, item->name);
+
+			slot->name = init.name;
+
+			darr_push_back(rollup, init);
+		}
+
+		rollup->data[slot->index].counter += item->counter;
+		rollup->data[slot->index].error += item->error;
+	}
+}
+
+/* The address and the function range of a record are the ones of the first report with it. */
+static void merge_record_in_partition(merge_partition* p, record* item, ht_hash_t hash)
+{
+	size_t size = ht_size(&p->records);
+	record* result = ht_get_or_insert_h(&p->records, item, hash);
+
+	/* First report with this record, the memory of the loaded report is reused by the next report. */
+	if (ht_size(&p->records) != size)
+	{
+		result->symbol_name = *string_store_get_or_create(&p->string_store, item->symbol_name);
+		result->module_name = *string_store_get_or_create(&p->string_store, item->module_name);
+		result->source_file = *string_store_get_or_create(&p->string_store, item->source_file);
+		result->counter = 0;
+		result->error = 0;
+	}
+
+	result->counter += item->counter;
+	result->error += item->error;
+}
+
+/* Names are never in two partitions, so the entries of each partition are appended to the report.
+   Records are gathered in records, to be sorted once all partitions are appended. */
+static void append_partition(report* r, merge_partition* p, ht* records)
+{
+	for (size_t i = 0; i < p->symbols.size; i += 1)
+	{
+		summed_record item = p->symbols.data[i];
+		item.symbol_name = *string_store_get_or_create(&r->string_store, item.symbol_name);
+		item.module_name = *string_store_get_or_create(&r->string_store, item.module_name);
+		item.source_file_name = *string_store_get_or_create(&r->string_store, item.source_file_name);
+		darr_push_back(&r->summary_by_count, item);
+	}
+
+	for (size_t i = 0; i < p->modules.size; i += 1)
+	{
+		rollup_record item = p->modules.data[i];
+		item.name = *string_store_get_or_create(&r->string_store, item.name);
+		darr_push_back(&r->summary_by_module, item);
+	}
+
+	for (size_t i = 0; i < p->files.size; i += 1)
+	{
+		rollup_record item = p->files.data[i];
+		item.name = *string_store_get_or_create(&r->string_store, item.name);
+		darr_push_back(&r->summary_by_file, item);
+	}
+
+	/* The cursor stops on the temporary bucket after the table, which is only set by an insertion. */
+	if (ht_size(&p->records) == 0)
+	{
+		return;
+	}
+
+	ht_cursor c;
+	ht_cursor_init(&p->records, &c);
+
+	while (ht_cursor_next(&c))
+	{
+		record item = *(record*)ht_cursor_item(&c);
+		item.symbol_name = *string_store_get_or_create(&r->string_store, item.symbol_name);
+		item.module_name = *string_store_get_or_create(&r->string_store, item.module_name);
+		item.source_file = *string_store_get_or_create(&r->string_store, item.source_file);
+		ht_get_or_insert(records, &item);
+	}
+}
+
+static void merge_partition_init(merge_partition* p)
+{
+	thread_mutex_init(&p->mutex);
+	string_store_init(&p->string_store);
+
+	ht_init(&p->symbol_slots, sizeof(merge_slot), merge_slot_hash, (ht_predicate_t)merge_slot_are_same, merge_slot_swap, 64);
+	ht_init(&p->module_slots, sizeof(merge_slot), merge_slot_hash, (ht_predicate_t)merge_slot_are_same, merge_slot_swap, 16);
+	ht_init(&p->file_slots, sizeof(merge_slot), merge_slot_hash, (ht_predicate_t)merge_slot_are_same, merge_slot_swap, 64);
+	ht_init(&p->records, sizeof(record), merge_record_hash, (ht_predicate_t)merge_record_are_same, merge_record_swap, 256);
+
+	darr_init(&p->symbols);
+	darr_init(&p->modules);
+	darr_init(&p->files);
+}
+
+static void merge_partition_destroy(merge_partition* p)
+{
+	darr_destroy(&p->files);
+	darr_destroy(&p->modules);
+	darr_destroy(&p->symbols);
+
+	ht_destroy(&p->records);
+	ht_destroy(&p->file_slots);
+	ht_destroy(&p->module_slots);
+	ht_destroy(&p->symbol_slots);
+
+	string_store_destroy(&p->string_store);
+	thread_mutex_term(&p->mutex);
+}
+
+/* The high bits select the partition, the low bits are used by the hash tables of the partition. */
+static size_t partition_of(ht_hash_t hash)
+{
+	uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+	return (size_t)(mixed >> (64 - SMP_MERGE_PARTITION_BITS));
+}
+
+/* Returns the slot of the name, its index is next_index if the name is new. */
+static merge_slot* merge_slot_get(ht* slots, strv name, ht_hash_t hash, size_t next_index)
+{
+	merge_slot value;
+	value.name = name;
+	value.index = next_index;
+
+	return ht_get_or_insert_h(slots, &value, hash);
+}
+
+/* Hash of the content, the names of the loaded reports are not interned.
+   Computed once per entry, to select the partition and to lookup the slot. */
+static ht_hash_t merge_name_hash(strv name)
+{
+	ht_hash_t hash = (ht_hash_t)samply_djb2_hash(name);
+
+	/* Zero is reserved for the empty buckets. */
+	return hash != 0 ? hash : 1;
+}
+
+static ht_hash_t merge_slot_hash(merge_slot* item)
+{
+	return merge_name_hash(item->name);
+}
+
+static bool merge_slot_are_same(merge_slot* left, merge_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void merge_slot_swap(merge_slot* left, merge_slot* right)
+{
+	merge_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+/* Hash of the content, like merge_name_hash. */
+static ht_hash_t merge_record_hash(record* item)
+{
+	ht_hash_t hash = (ht_hash_t)samply_djb2_hash(item->source_file);
+	hash = hash * 31 + (ht_hash_t)item->line_number;
+	hash = hash * 31 + (ht_hash_t)samply_djb2_hash(item->symbol_name);
+	hash = hash * 31 + (ht_hash_t)samply_djb2_hash(item->module_name);
+
+	return hash != 0 ? hash : 1;
+}
+
+static bool merge_record_are_same(record* left, record* right)
+{
+	return left->line_number == right->line_number
+		&& strv_equals(left->source_file, right->source_file)
+		&& strv_equals(left->symbol_name, right->symbol_name)
+		&& strv_equals(left->module_name, right->module_name);
+}
+
+static void merge_record_swap(record* left, record* right)
+{
+	record tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
@@ -0,0 +1,24 @@
+#ifndef SAMPLY_REPORT_MERGE_H
+#define SAMPLY_REPORT_MERGE_H
+
+#include "stdbool.h" /* bool */
+
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Clear report and merge the saved reports of filepaths into it.
+   Reports are loaded by thread_count threads, counters of the same symbol, module or source file are summed.
+   Addresses of different runs cannot be compared, so records are merged by source line, symbol and module,
+   and call graphs are not merged.
+   Memory grows with the number of distinct names and source lines, not with the number of reports.
+   Returns false if a report could not be loaded, the other ones are still merged. */
+bool report_merge_filepaths(report* r, const char** filepaths, size_t filepath_count, size_t thread_count);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_MERGE_H */
@@ -0,0 +1,599 @@
+#include "report_pprof.h"
+
+#include "string.h" /* memset, memcpy */
+
+#include "samply.h"
+#include "utils/log.h"
+#include "utils/varint.h"
+
+/* Largest stored deflate block. */
+#define PPROF_BLOCK_SIZE (65535)
+
+/* Field numbers of profile.proto. */
+enum pprof_field {
+	pprof_field_PROFILE_SAMPLE_TYPE = 1,
+	pprof_field_PROFILE_SAMPLE = 2,
+	pprof_field_PROFILE_MAPPING = 3,
+	pprof_field_PROFILE_LOCATION = 4,
+	pprof_field_PROFILE_FUNCTION = 5,
+	pprof_field_PROFILE_STRING_TABLE = 6,
+
+	pprof_field_VALUE_TYPE_TYPE = 1,
+	pprof_field_VALUE_TYPE_UNIT = 2,
+
+	pprof_field_SAMPLE_LOCATION_ID = 1,
+	pprof_field_SAMPLE_VALUE = 2,
+
+	pprof_field_MAPPING_ID = 1,
+	pprof_field_MAPPING_MEMORY_START = 2,
+	pprof_field_MAPPING_MEMORY_LIMIT = 3,
+	pprof_field_MAPPING_FILENAME = 5,
+	pprof_field_MAPPING_HAS_FUNCTIONS = 7,
+	pprof_field_MAPPING_HAS_FILENAMES = 8,
+	pprof_field_MAPPING_HAS_LINE_NUMBERS = 9,
+
+	pprof_field_LOCATION_ID = 1,
+	pprof_field_LOCATION_MAPPING_ID = 2,
+	pprof_field_LOCATION_ADDRESS = 3,
+	pprof_field_LOCATION_LINE = 4,
+
+	pprof_field_LINE_FUNCTION_ID = 1,
+	pprof_field_LINE_LINE = 2,
+
+	pprof_field_FUNCTION_ID = 1,
+	pprof_field_FUNCTION_NAME = 2,
+	pprof_field_FUNCTION_SYSTEM_NAME = 3,
+	pprof_field_FUNCTION_FILENAME = 4,
+};
+
+enum pprof_wire_type {
+	pprof_wire_type_VARINT = 0,
+	pprof_wire_type_LENGTH_DELIMITED = 2,
+};
+
+typedef darr(uint8_t) pprof_bytes;
+
+/* Destination of the encoded profile, optionally wrapped in a gzip stream. */
+typedef struct pprof_output pprof_output;
+struct pprof_output {
+	FILE* f;
+	bool compress;
+	bool failed;
+	/* Bytes of the next deflate block. */
+	uint8_t block[PPROF_BLOCK_SIZE];
+	size_t block_size;
+	uint32_t crc;
+	uint32_t crc_table[256];
+	uint64_t total_size;
+};
+
+/* Id of a string, by content. */
+typedef struct pprof_slot pprof_slot;
+struct pprof_slot {
+	strv name;
+	uint64_t id;
+};
+
+/* Id of a function, functions with the same name in different files are different. */
+typedef struct pprof_function_slot pprof_function_slot;
+struct pprof_function_slot {
+	strv name;
+	strv filename;
+	uint64_t id;
+};
+
+/* Address range of a module, computed from its records. */
+typedef struct pprof_mapping pprof_mapping;
+struct pprof_mapping {
+	strv name;
+	uint64_t id;
+	uint64_t start;
+	uint64_t limit;
+};
+
+/* Tables shared by all the messages. */
+typedef struct pprof_tables pprof_tables;
+struct pprof_tables {
+	ht strings;
+	ht functions;
+	ht mappings;
+	uint64_t string_count;
+	uint64_t function_count;
+	/* Scratch buffers of the messages being encoded. */
+	pprof_bytes message;
+	pprof_bytes nested;
+};
+
+/* Location of one sample, from a record or from a symbol of the summary. */
+typedef struct pprof_location pprof_location;
+struct pprof_location {
+	uint64_t address;
+	strv symbol_name;
+	strv module_name;
+	strv source_file;
+	uint64_t line_number;
+	uint64_t counter;
+};
+
+static void write_mappings(pprof_output* out, pprof_tables* t, report* r);
+static void write_location(pprof_output* out, pprof_tables* t, pprof_location* location, uint64_t location_id);
+static uint64_t get_string_index(pprof_output* out, pprof_tables* t, strv str);
+static uint64_t get_function_id(pprof_output* out, pprof_tables* t, strv name, strv filename);
+static void update_mapping(ht* mappings, strv name, uint64_t addr);
+
+static void put_varint(pprof_bytes* bytes, uint64_t v);
+static void put_tag(pprof_bytes* bytes, uint32_t field, enum pprof_wire_type wire_type);
+static void put_uint64_field(pprof_bytes* bytes, uint32_t field, uint64_t v);
+static void put_bytes_field(pprof_bytes* bytes, uint32_t field, const void* data, size_t size);
+static void write_message(pprof_output* out, uint32_t field, pprof_bytes* message);
+
+static void output_init(pprof_output* out, FILE* f, bool compress);
+static void output_write(pprof_output* out, const void* data, size_t size);
+static void output_finish(pprof_output* out);
+static void write_block(pprof_output* out, bool is_final);
+static void write_raw(pprof_output* out, const void* data, size_t size);
+
+static ht_hash_t pprof_slot_hash(pprof_slot* item);
+static bool pprof_slot_are_same(pprof_slot* left, pprof_slot* right);
+static void pprof_slot_swap(pprof_slot* left, pprof_slot* right);
+static ht_hash_t pprof_function_slot_hash(pprof_function_slot* item);
+static bool pprof_function_slot_are_same(pprof_function_slot* left, pprof_function_slot* right);
+static void pprof_function_slot_swap(pprof_function_slot* left, pprof_function_slot* right);
+static ht_hash_t pprof_mapping_hash(pprof_mapping* item);
+static bool pprof_mapping_are_same(pprof_mapping* left, pprof_mapping* right);
+static void pprof_mapping_swap(pprof_mapping* left, pprof_mapping* right);
+
+bool report_save_pprof(report* r, const char* filepath, bool compress)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not save to file '%s'", filepath);
+		return false;
+	}
+
+	bool success = report_save_pprof_to_file(r, f, compress);
+	success = fclose(f) == 0 && success;
+	return success;
+}
+
+/* Fields of a message can be in any order and repeated fields can be interleaved,
+   so each string, function and mapping is written just before the first message using it. */
+bool report_save_pprof_to_file(report* r, FILE* f, bool compress)
+{
+	pprof_output* out = SMP_MALLOC(sizeof(pprof_output));
+	output_init(out, f, compress);
+
+	pprof_tables t;
+	memset(&t, 0, sizeof(pprof_tables));
+	ht_init(&t.strings, sizeof(pprof_slot), pprof_slot_hash, (ht_predicate_t)pprof_slot_are_same, pprof_slot_swap, 1024);
+	ht_init(&t.functions, sizeof(pprof_function_slot), pprof_function_slot_hash, (ht_predicate_t)pprof_function_slot_are_same, pprof_function_slot_swap, 1024);
+	ht_init(&t.mappings, sizeof(pprof_mapping), pprof_mapping_hash, (ht_predicate_t)pprof_mapping_are_same, pprof_mapping_swap, 64);
+	darr_init(&t.message);
+	darr_init(&t.nested);
+
+	/* The first string of the table must be empty. */
+	get_string_index(out, &t, strv_make());
+
+	/* Sample type. Strings are written before the message which uses them, the scratch buffer is shared. */
+	uint64_t type = get_string_index(out, &t, (strv)STRV("samples"));
+	uint64_t unit = get_string_index(out, &t, (strv)STRV("count"));
+
+	darr_clear(&t.message);
+	put_uint64_field(&t.message, pprof_field_VALUE_TYPE_TYPE, type);
+	put_uint64_field(&t.message, pprof_field_VALUE_TYPE_UNIT, unit);
+	write_message(out, pprof_field_PROFILE_SAMPLE_TYPE, &t.message);
+
+	write_mappings(out, &t, r);
+
+	if (r->records.size)
+	{
+		for (size_t i = 0; i < r->records.size; i += 1)
+		{
+			record* item = &r->records.data[i];
+
+			pprof_location location;
+			location.address = item->address;
+			location.symbol_name = item->symbol_name;
+			location.module_name = item->module_name;
+			location.source_file = item->source_file;
+			location.line_number = item->line_number;
+			location.counter = item->counter;
+
+			write_location(out, &t, &location, i + 1);
+		}
+	}
+	/* Reports loaded from files without records. */
+	else
+	{
+		for (size_t i = 0; i < r->summary_by_count.size; i += 1)
+		{
+			summed_record* item = &r->summary_by_count.data[i];
+
+			pprof_location location;
+			location.address = 0;
+			location.symbol_name = item->symbol_name;
+			location.module_name = item->module_name;
+			location.source_file = item->source_file_name;
+			location.line_number = item->closest_line_number;
+			location.counter = item->counter;
+
+			write_location(out, &t, &location, i + 1);
+		}
+	}
+
+	output_finish(out);
+	bool success = !out->failed;
+
+	darr_destroy(&t.nested);
+	darr_destroy(&t.message);
+	ht_destroy(&t.mappings);
+	ht_destroy(&t.functions);
+	ht_destroy(&t.strings);
+	SMP_FREE(out);
+
+	return success;
+}
+
+/* One mapping per module, covering the addresses of its records. */
+static void write_mappings(pprof_output* out, pprof_tables* t, report* r)
+{
+	for (size_t i = 0; i < r->records.size; i += 1)
+	{
+		update_mapping(&t->mappings, r->records.data[i].module_name, r->records.data[i].address);
+	}
+
+	/* Without records the addresses are unknown, the mappings only have a name. */
+	if (r->records.size == 0)
+	{
+		for (size_t i = 0; i < r->summary_by_module.size; i += 1)
+		{
+			update_mapping(&t->mappings, r->summary_by_module.data[i].name, 0);
+		}
+	}
+
+	/* Ids start at 1, zero means no mapping. */
+	uint64_t id = 1;
+
+	ht_cursor c;
+	ht_cursor_init(&t->mappings, &c);
+	while (ht_cursor_next(&c))
+	{
+		pprof_mapping* mapping = ht_cursor_item(&c);
+		mapping->id = id;
+
+		uint64_t filename = get_string_index(out, t, mapping->name);
+
+		darr_clear(&t->message);
+		put_uint64_field(&t->message, pprof_field_MAPPING_ID, id);
+		put_uint64_field(&t->message, pprof_field_MAPPING_MEMORY_START, mapping->start);
+		put_uint64_field(&t->message, pprof_field_MAPPING_MEMORY_LIMIT, mapping->limit);
+		put_uint64_field(&t->message, pprof_field_MAPPING_FILENAME, filename);
+		put_uint64_field(&t->message, pprof_field_MAPPING_HAS_FUNCTIONS, 1);
+		put_uint64_field(&t->message, pprof_field_MAPPING_HAS_FILENAMES, 1);
+		put_uint64_field(&t->message, pprof_field_MAPPING_HAS_LINE_NUMBERS, 1);
+		write_message(out, pprof_field_PROFILE_MAPPING, &t->message);
+
+		id += 1;
+	}
+}
+
+static void write_location(pprof_output* out, pprof_tables* t, pprof_location* location, uint64_t location_id)
+{
+	uint64_t function_id = get_function_id(out, t, location->symbol_name, location->source_file);
+
+	/* All the modules have been added by write_mappings. */
+	pprof_mapping key = { 0 };
+	key.name = location->module_name;
+	pprof_mapping* mapping = ht_get_or_insert(&t->mappings, &key);
+
+	/* Line */
+	darr_clear(&t->nested);
+	put_uint64_field(&t->nested, pprof_field_LINE_FUNCTION_ID, function_id);
+	put_uint64_field(&t->nested, pprof_field_LINE_LINE, location->line_number);
+
+	/* Location */
+	darr_clear(&t->message);
+	put_uint64_field(&t->message, pprof_field_LOCATION_ID, location_id);
+	put_uint64_field(&t->message, pprof_field_LOCATION_MAPPING_ID, mapping->id);
+	put_uint64_field(&t->message, pprof_field_LOCATION_ADDRESS, location->address);
+	put_bytes_field(&t->message, pprof_field_LOCATION_LINE, t->nested.data, t->nested.size);
+	write_message(out, pprof_field_PROFILE_LOCATION, &t->message);
+
+	/* Sample, packed repeated fields of a single value. */
+	darr_clear(&t->nested);
+	darr_ensure_space(&t->nested, SMP_VARINT_MAX_SIZE);
+	put_varint(&t->nested, location->counter);
+
+	uint8_t location_bytes[SMP_VARINT_MAX_SIZE];
+	pprof_bytes location_ids = { 0 };
+	location_ids.data = location_bytes;
+	location_ids.capacity = sizeof(location_bytes);
+	put_varint(&location_ids, location_id);
+
+	darr_clear(&t->message);
+	put_bytes_field(&t->message, pprof_field_SAMPLE_LOCATION_ID, location_ids.data, location_ids.size);
+	put_bytes_field(&t->message, pprof_field_SAMPLE_VALUE, t->nested.data, t->nested.size);
+	write_message(out, pprof_field_PROFILE_SAMPLE, &t->message);
+}
+
+/* Index of the string in the string table, the string is written if it's new. */
+static uint64_t get_string_index(pprof_output* out, pprof_tables* t, strv str)
+{
+	pprof_slot value;
+	value.name = str;
+	value.id = t->string_count;
+
+	pprof_slot* slot = ht_get_or_insert(&t->strings, &value);
+
+	if (slot->id == t->string_count)
+	{
+		darr_clear(&t->message);
+		if (str.size)
+		{
+			darr_ensure_space(&t->message, str.size);
+			memcpy(t->message.data, str.data, str.size);
+			t->message.size = str.size;
+		}
+		write_message(out, pprof_field_PROFILE_STRING_TABLE, &t->message);
+
+		t->string_count += 1;
+	}
+
+	return slot->id;
+}
+
+/* Id of the function, the function is written if it's new. Functions are identified by their name and their file. */
+static uint64_t get_function_id(pprof_output* out, pprof_tables* t, strv name, strv filename)
+{
+	pprof_function_slot value;
+	value.name = name;
+	value.filename = filename;
+	value.id = t->function_count + 1;
+
+	pprof_function_slot* slot = ht_get_or_insert(&t->functions, &value);
+	uint64_t id = slot->id;
+
+	if (id == t->function_count + 1)
+	{
+		t->function_count += 1;
+
+		uint64_t name_index = get_string_index(out, t, name);
+		uint64_t filename_index = get_string_index(out, t, filename);
+
+		darr_clear(&t->message);
+		put_uint64_field(&t->message, pprof_field_FUNCTION_ID, id);
+		put_uint64_field(&t->message, pprof_field_FUNCTION_NAME, name_index);
+		put_uint64_field(&t->message, pprof_field_FUNCTION_SYSTEM_NAME, name_index);
+		put_uint64_field(&t->message, pprof_field_FUNCTION_FILENAME, filename_index);
+		write_message(out, pprof_field_PROFILE_FUNCTION, &t->message);
+	}
+
+	return id;
+}
+
+static void update_mapping(ht* mappings, strv name, uint64_t addr)
+{
+	pprof_mapping value = { 0 };
+	value.name = name;
+	value.start = addr;
+	value.limit = addr + 1;
+
+	pprof_mapping* mapping = ht_get_or_insert(mappings, &value);
+
+	if (addr < mapping->start)
+	{
+		mapping->start = addr;
+	}
+	if (addr + 1 > mapping->limit)
+	{
+		mapping->limit = addr + 1;
+	}
+}
+
+/* The bytes must have space for SMP_VARINT_MAX_SIZE bytes. */
+static void put_varint(pprof_bytes* bytes, uint64_t v)
+{
+	bytes->size += varint_write(bytes->data + bytes->size, v);
+}
+
+static void put_tag(pprof_bytes* bytes, uint32_t field, enum pprof_wire_type wire_type)
+{
+	darr_ensure_space(bytes, SMP_VARINT_MAX_SIZE);
+	put_varint(bytes, ((uint64_t)field << 3) | wire_type);
+}
+
+/* Zero is the default value, it's not written. */
+static void put_uint64_field(pprof_bytes* bytes, uint32_t field, uint64_t v)
+{
+	if (v == 0)
+	{
+		return;
+	}
+
+	put_tag(bytes, field, pprof_wire_type_VARINT);
+	darr_ensure_space(bytes, SMP_VARINT_MAX_SIZE);
+	put_varint(bytes, v);
+}
+
+static void put_bytes_field(pprof_bytes* bytes, uint32_t field, const void* data, size_t size)
+{
+	put_tag(bytes, field, pprof_wire_type_LENGTH_DELIMITED);
+	darr_ensure_space(bytes, SMP_VARINT_MAX_SIZE + size);
+	put_varint(bytes, size);
+	memcpy(bytes->data + bytes->size, data, size);
+	bytes->size += size;
+}
+
+/* Write a field of the profile: tag, size and bytes of the message. */
+static void write_message(pprof_output* out, uint32_t field, pprof_bytes* message)
+{
+	uint8_t header_bytes[2 * SMP_VARINT_MAX_SIZE];
+	pprof_bytes header = { 0 };
+	header.data = header_bytes;
+	header.capacity = sizeof(header_bytes);
+
+	put_varint(&header, ((uint64_t)field << 3) | pprof_wire_type_LENGTH_DELIMITED);
+	put_varint(&header, message->size);
+
+	output_write(out, header.data, header.size);
+	output_write(out, message->data, message->size);
+}
+
+static void output_init(pprof_output* out, FILE* f, bool compress)
+{
+	memset(out, 0, sizeof(pprof_output));
+	out->f = f;
+	out->compress = compress;
+
+	if (!compress)
+	{
+		return;
+	}
+
+	/* CRC-32 of gzip, reflected polynomial. */
+	for (uint32_t i = 0; i < 256; i += 1)
+	{
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit += 1)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+		}
+		out->crc_table[i] = crc;
+	}
+	out->crc = 0xFFFFFFFFu;
+
+	/* Gzip header: deflate, no flags, no modification time, unknown operating system. */
+	uint8_t header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+	write_raw(out, header, sizeof(header));
+}
+
+static void output_write(pprof_output* out, const void* data, size_t size)
+{
+	if (!out->compress)
+	{
+		write_raw(out, data, size);
+		return;
+	}
+
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i += 1)
+	{
+		out->crc = out->crc_table[(out->crc ^ bytes[i]) & 0xFF] ^ (out->crc >> 8);
+	}
+	out->total_size += size;
+
+	while (size)
+	{
+		if (out->block_size == PPROF_BLOCK_SIZE)
+		{
+			write_block(out, false);
+		}
+
+		size_t count = PPROF_BLOCK_SIZE - out->block_size;
+		if (count > size)
+		{
+			count = size;
+		}
+
+		memcpy(out->block + out->block_size, bytes, count);
+		out->block_size += count;
+		bytes += count;
+		size -= count;
+	}
+}
+
+static void output_finish(pprof_output* out)
+{
+	if (!out->compress)
+	{
+		return;
+	}
+
+	/* The last block is written even if it's empty, it marks the end of the deflate stream. */
+	write_block(out, true);
+
+	uint32_t crc = out->crc ^ 0xFFFFFFFFu;
+	uint32_t size = (uint32_t)out->total_size;
+	uint8_t trailer[8] = {
+		(uint8_t)crc, (uint8_t)(crc >> 8), (uint8_t)(crc >> 16), (uint8_t)(crc >> 24),
+		(uint8_t)size, (uint8_t)(size >> 8), (uint8_t)(size >> 16), (uint8_t)(size >> 24),
+	};
+	write_raw(out, trailer, sizeof(trailer));
+}
+
+/* Stored deflate block: final flag, block type 0, then the size and its complement. */
+static void write_block(pprof_output* out, bool is_final)
+{
+	uint16_t size = (uint16_t)out->block_size;
+	uint8_t header[5] = {
+		is_final ? 1 : 0,
+		(uint8_t)size, (uint8_t)(size >> 8),
+		(uint8_t)~size, (uint8_t)(~size >> 8),
+	};
+
+	write_raw(out, header, sizeof(header));
+	write_raw(out, out->block, out->block_size);
+
+	out->block_size = 0;
+}
+
+static void write_raw(pprof_output* out, const void* data, size_t size)
+{
+	if (size && fwrite(data, size, 1, out->f) != 1)
+	{
+		out->failed = true;
+	}
+}
+
+static ht_hash_t pprof_slot_hash(pprof_slot* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool pprof_slot_are_same(pprof_slot* left, pprof_slot* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void pprof_slot_swap(pprof_slot* left, pprof_slot* right)
+{
+	pprof_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static ht_hash_t pprof_function_slot_hash(pprof_function_slot* item)
+{
+	return samply_djb2_hash(item->name) * 31 + samply_djb2_hash(item->filename);
+}
+
+static bool pprof_function_slot_are_same(pprof_function_slot* left, pprof_function_slot* right)
+{
+	return strv_equals(left->name, right->name)
+		&& strv_equals(left->filename, right->filename);
+}
+
+static void pprof_function_slot_swap(pprof_function_slot* left, pprof_function_slot* right)
+{
+	pprof_function_slot tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
+
+static ht_hash_t pprof_mapping_hash(pprof_mapping* item)
+{
+	return samply_djb2_hash(item->name);
+}
+
+static bool pprof_mapping_are_same(pprof_mapping* left, pprof_mapping* right)
+{
+	return strv_equals(left->name, right->name);
+}
+
+static void pprof_mapping_swap(pprof_mapping* left, pprof_mapping* right)
+{
+	pprof_mapping tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
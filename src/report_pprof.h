@@ -0,0 +1,35 @@
+#ifndef SAMPLY_REPORT_PPROF_H
+#define SAMPLY_REPORT_PPROF_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Export of a report to the pprof format (profile.proto), readable by `go tool pprof` and the tools built on it.
+
+	Each record becomes a sample with a single location: the sampled address, its function, source line and module.
+	Reports without records, like the ones loaded from old files, export one location per symbol.
+	Call stacks are not stored in the report, so the samples have no callers.
+
+	The message is encoded while it's written, only one location is in memory at a time.
+	The protobuf encoding is written by hand, the compressed output is a gzip stream of uncompressed deflate blocks
+	(pprof reads both, compressing is only useful for the tools which expect gzip).
+*/
+
+/* Save report to filepath in the pprof format. */
+bool report_save_pprof(report* r, const char* filepath, bool compress);
+
+/* Save report to FILE in the pprof format. Returns false if something could not be written. */
+bool report_save_pprof_to_file(report* r, FILE* f, bool compress);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_PPROF_H */
@@ -0,0 +1,229 @@
+#include "report_speedscope.h"
+
+#include "string.h" /* strlen, memcpy */
+
+#include "samply.h"
+#include "utils/log.h"
+
+/* Size of the output buffer. */
+#define SPEEDSCOPE_BUFFER_SIZE (64 * 1024)
+/* Largest escaped character or written number. */
+#define SPEEDSCOPE_MAX_TOKEN_SIZE (32)
+
+/* JSON written to a FILE through a fixed buffer. */
+typedef struct json_output json_output;
+struct json_output {
+	FILE* f;
+	bool failed;
+	char buffer[SPEEDSCOPE_BUFFER_SIZE];
+	size_t size;
+};
+
+static void json_init(json_output* out, FILE* f);
+static void json_flush(json_output* out);
+static void json_write(json_output* out, const char* data, size_t size);
+static void json_write_literal(json_output* out, const char* str);
+static void json_write_string(json_output* out, strv str);
+static void json_write_uint(json_output* out, uint64_t v);
+
+bool report_save_speedscope(report* r, const char* filepath)
+{
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not save to file '%s'", filepath);
+		return false;
+	}
+
+	bool success = report_save_speedscope_to_file(r, f);
+	success = fclose(f) == 0 && success;
+	return success;
+}
+
+/* Layout of the file:
+	{
+		"$schema": "https://www.speedscope.app/file-format-schema.json",
+		"exporter": "samply 0.0.4-dev",
+		"shared": { "frames": [ { "name": "func1", "file": "a.c", "line": 12 }, ... ] },
+		"profiles": [ {
+			"type": "sampled", "name": "samply", "unit": "none", "startValue": 0, "endValue": 436,
+			"samples": [ [0], [1], ... ],
+			"weights": [ 425, 11, ... ]
+		} ]
+	}
+   Frame i is the symbol i of summary_by_count, sample i is its only sample. */
+bool report_save_speedscope_to_file(report* r, FILE* f)
+{
+	json_output* out = SMP_MALLOC(sizeof(json_output));
+	json_init(out, f);
+
+	summed_records* summary = &r->summary_by_count;
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < summary->size; i += 1)
+	{
+		total += summary->data[i].counter;
+	}
+
+	json_write_literal(out, "{\"$schema\":\"https://www.speedscope.app/file-format-schema.json\",");
+	json_write_literal(out, "\"exporter\":\"samply " SMP_APP_VERSION_TEXT "\",");
+	json_write_literal(out, "\"name\":\"samply\",");
+
+	json_write_literal(out, "\"shared\":{\"frames\":[");
+	for (size_t i = 0; i < summary->size; i += 1)
+	{
+		summed_record* item = &summary->data[i];
+
+		json_write_literal(out, i ? ",\n{\"name\":" : "\n{\"name\":");
+		json_write_string(out, item->symbol_name);
+		if (item->source_file_name.size)
+		{
+			json_write_literal(out, ",\"file\":");
+			json_write_string(out, item->source_file_name);
+		}
+		if (item->closest_line_number)
+		{
+			json_write_literal(out, ",\"line\":");
+			json_write_uint(out, item->closest_line_number);
+		}
+		json_write_literal(out, "}");
+	}
+	json_write_literal(out, "]},");
+
+	json_write_literal(out, "\"profiles\":[{\"type\":\"sampled\",\"name\":\"samply\",\"unit\":\"none\",\"startValue\":0,\"endValue\":");
+	json_write_uint(out, total);
+
+	json_write_literal(out, ",\n\"samples\":[");
+	for (size_t i = 0; i < summary->size; i += 1)
+	{
+		json_write_literal(out, i ? ",[" : "[");
+		json_write_uint(out, i);
+		json_write_literal(out, "]");
+	}
+
+	json_write_literal(out, "],\n\"weights\":[");
+	for (size_t i = 0; i < summary->size; i += 1)
+	{
+		if (i)
+		{
+			json_write_literal(out, ",");
+		}
+		json_write_uint(out, summary->data[i].counter);
+	}
+	json_write_literal(out, "]}]}\n");
+
+	json_flush(out);
+	bool success = !out->failed;
+
+	SMP_FREE(out);
+
+	return success;
+}
+
+static void json_init(json_output* out, FILE* f)
+{
+	out->f = f;
+	out->failed = false;
+	out->size = 0;
+}
+
+static void json_flush(json_output* out)
+{
+	if (out->size && fwrite(out->buffer, out->size, 1, out->f) != 1)
+	{
+		out->failed = true;
+	}
+	out->size = 0;
+}
+
+static void json_write(json_output* out, const char* data, size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	if (out->size + size > SPEEDSCOPE_BUFFER_SIZE)
+	{
+		json_flush(out);
+
+		/* Too big for the buffer, written directly. */
+		if (size > SPEEDSCOPE_BUFFER_SIZE)
+		{
+			if (fwrite(data, size, 1, out->f) != 1)
+			{
+				out->failed = true;
+			}
+			return;
+		}
+	}
+
+	memcpy(out->buffer + out->size, data, size);
+	out->size += size;
+}
+
+static void json_write_literal(json_output* out, const char* str)
+{
+	json_write(out, str, strlen(str));
+}
+
+/* Quotes, backslashes and control characters are escaped, the other bytes are copied as they are. */
+static void json_write_string(json_output* out, strv str)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	json_write(out, "\"", 1);
+
+	size_t run_start = 0;
+	for (size_t i = 0; i < str.size; i += 1)
+	{
+		unsigned char c = (unsigned char)str.data[i];
+		if (c >= 0x20 && c != '"' && c != '\\')
+		{
+			continue;
+		}
+
+		/* Copy the characters which don't need to be escaped at once. */
+		json_write(out, str.data + run_start, i - run_start);
+		run_start = i + 1;
+
+		char escaped[SPEEDSCOPE_MAX_TOKEN_SIZE];
+		size_t size = 2;
+		escaped[0] = '\\';
+		switch (c)
+		{
+		case '"':  escaped[1] = '"'; break;
+		case '\\': escaped[1] = '\\'; break;
+		case '\n': escaped[1] = 'n'; break;
+		case '\r': escaped[1] = 'r'; break;
+		case '\t': escaped[1] = 't'; break;
+		default:
+			escaped[1] = 'u';
+			escaped[2] = '0';
+			escaped[3] = '0';
+			escaped[4] = hex[c >> 4];
+			escaped[5] = hex[c & 0xF];
+			size = 6;
+			break;
+		}
+		json_write(out, escaped, size);
+	}
+	json_write(out, str.data + run_start, str.size - run_start);
+
+	json_write(out, "\"", 1);
+}
+
+static void json_write_uint(json_output* out, uint64_t v)
+{
+	char digits[SPEEDSCOPE_MAX_TOKEN_SIZE];
+	char* end = digits + sizeof(digits);
+	char* begin = end;
+
+	do
+	{
+		*--begin = (char)('0' + v % 10);
+		v /= 10;
+	} while (v);
+
+	json_write(out, begin, end - begin);
+}
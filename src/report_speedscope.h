@@ -0,0 +1,34 @@
+#ifndef SAMPLY_REPORT_SPEEDSCOPE_H
+#define SAMPLY_REPORT_SPEEDSCOPE_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "report.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Export of a report to the speedscope file format (https://www.speedscope.app/file-format-schema.json),
+	a single JSON file which can be opened in the browser without samply.
+
+	The profile is "sampled" with one frame per symbol and one weighted sample per symbol.
+	Samples are not timestamped and call stacks are not stored in the report,
+	so the time order view is meaningless, the "Left Heavy" and "Sandwich" views are the useful ones.
+
+	The JSON is written while the summary is read, through a fixed buffer.
+*/
+
+/* Save report to filepath in the speedscope format. */
+bool report_save_speedscope(report* r, const char* filepath);
+
+/* Save report to FILE in the speedscope format. Returns false if something could not be written. */
+bool report_save_speedscope_to_file(report* r, FILE* f);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_REPORT_SPEEDSCOPE_H */
@@ -0,0 +1,825 @@
+#include "sample_log.h"
+
+#include "string.h" /* memset, memcpy, memcmp */
+
+#include "samply.h"
+#include "sampler.h"
+#include "capture.h"
+#include "compression.h"
+#include "utils/file_mapper.h"
+#include "utils/log.h"
+#include "utils/varint.h"
+
+static char magic1_samp[4] = { 's', 'a', 'm', 'p' };
+static char magic2_slog[4] = { 's', 'l', 'o', 'g' };
+static char magic_record_samples[4] = { 's', 'm', 'p', 'l' };
+static char magic_record_modules[4] = { 'm', 'o', 'd', 's' };
+static char magic_record_compressed[4] = { 'l', 'z', 'r', 'c' };
+static uint64_t zero = 0;
+
+/* Larger records are considered corrupted. */
+#define SAMPLE_LOG_MAX_RECORD_SIZE (64 * 1024 * 1024)
+
+/*
+
+Sample Log Binary Format:
+
+header	   |--------------------------|
+		   | 1) magic number 1        | b8 x 4  | 's' 'a' 'm' 'p'
+		   | 2) magic number 2        | b8 x 4  | 's' 'l' 'o' 'g'
+		   | 3) zero                  | uint64
+		   | 4) version number        | uint64
+		   | 5) version info          | b8 x 32 | // null-terminated string of 32 byte (which include the null-terminated char).
+record 0..N| -------------------       // Appended while sampling, the last one can be incomplete.
+		   | 1) magic number          | b8 x 4  | 's' 'm' 'p' 'l', 'm' 'o' 'd' 's' or 'l' 'z' 'r' 'c', unknown records are skipped.
+		   | 2) checksum              | uint32  | // FNV-1a of the payload.
+		   | 3) payload size          | uint64
+		   | 4) payload               | ...
+
+Payloads are made of LEB128 varints.
+
+samples    | 1) sample count          | varint
+		   | 2) address count         | varint
+address 0..N| 1) address              | varint  | // Delta from the previous address, addresses are sorted.
+		   | 2) sampling count        | varint
+
+modules    | 1) module count          | varint  | // All the modules known when the record was written.
+module 0..N| 1) base address          | varint
+		   | 2) image size            | varint
+		   | 3) build id size         | varint
+		   | 4) build id data         | ...
+		   | 5) path size             | varint
+		   | 6) path data             | ...
+
+compressed | 1) magic number          | b8 x 4  | // Magic number of the record which was compressed.
+		   | 2) compressed payload    | ...     | // Compressed blocks, see compression.h.
+
+Compressed logs only have compressed records, the checksum is the one of the compressed payload.
+*/
+
+typedef struct sample_log_header sample_log_header;
+struct sample_log_header {
+	char magic1[4];
+	char magic2[4];
+	uint64_t zero;
+	uint64_t version_number;
+	char version_text[32];
+};
+
+typedef struct sample_log_record_header sample_log_record_header;
+struct sample_log_record_header {
+	char magic[4];
+	uint32_t checksum;
+	uint64_t size;
+};
+
+typedef darr(uint8_t) encoded_bytes;
+
+static int writer_thread_procedure(sample_log* l);
+static void submit_chunk(sample_log* l, sample_log_chunk* chunk);
+static void write_samples(sample_log* l, sample_log_chunk* chunk);
+static void write_modules(sample_log* l, sample_log_modules* modules);
+static void write_record(sample_log* l, char* magic);
+
+static bool read_compressed(strv* payload, const char** magic, encoded_bytes* decompressed);
+static bool read_samples(strv payload, ht* samples, size_t* sample_count);
+static bool read_modules(strv payload, capture* c);
+static void keep_sampled_modules(capture* c);
+
+static uint32_t fnv1a_hash(const uint8_t* data, size_t size);
+static void write_varint(encoded_bytes* bytes, uint64_t v);
+static int compare_address(const address* left, const address* right);
+static int compare_module_by_base(const capture_module* left, const capture_module* right);
+static int compare_sample_by_address(const capture_sample* left, const capture_sample* right);
+
+void sample_log_init(sample_log* l)
+{
+	memset(l, 0, sizeof(sample_log));
+
+	darr_init(&l->encoded);
+	darr_init(&l->compressed);
+	darr_init(&l->written_modules);
+}
+
+void sample_log_destroy(sample_log* l)
+{
+	/* Closing takes an empty chunk, it must be done by the sampling thread. */
+	SMP_ASSERT(!sample_log_is_opened(l));
+
+	if (l->chunks)
+	{
+		for (size_t i = 0; i < SMP_SAMPLE_LOG_CHUNK_COUNT; i += 1)
+		{
+			darr_destroy(&l->chunks[i].modules);
+		}
+		SMP_FREE(l->chunks);
+	}
+
+	darr_destroy(&l->written_modules);
+	darr_destroy(&l->compressed);
+	darr_destroy(&l->encoded);
+}
+
+bool sample_log_open(sample_log* l, const char* filepath, symbol_manager* mgr, bool compress)
+{
+	SMP_ASSERT(!sample_log_is_opened(l));
+
+	FILE* f = fopen(filepath, "wb");
+	if (!f)
+	{
+		log_error("Could not create sample log '%s'", filepath);
+		return false;
+	}
+
+	sample_log_header header =
+	{
+		.zero = zero,
+		.version_number = SMP_SAMPLE_LOG_VERSION_NUMBER,
+		.version_text = { SMP_SAMPLE_LOG_VERSION_TEXT },
+	};
+	memcpy(&header.magic1, &magic1_samp, sizeof(magic1_samp));
+	memcpy(&header.magic2, &magic2_slog, sizeof(magic2_slog));
+
+	if (fwrite(&header, sizeof(sample_log_header), 1, f) != 1 || fflush(f) != 0)
+	{
+		log_error("Could not write sample log '%s'", filepath);
+		fclose(f);
+		return false;
+	}
+
+	/* Chunks are allocated once, they are reused by the next sessions. */
+	if (!l->chunks)
+	{
+		l->chunks = SMP_MALLOC(sizeof(sample_log_chunk) * SMP_SAMPLE_LOG_CHUNK_COUNT);
+		for (size_t i = 0; i < SMP_SAMPLE_LOG_CHUNK_COUNT; i += 1)
+		{
+			darr_init(&l->chunks[i].modules);
+		}
+	}
+
+	for (size_t i = 0; i < SMP_SAMPLE_LOG_CHUNK_COUNT; i += 1)
+	{
+		sample_log_chunk* chunk = &l->chunks[i];
+		chunk->count = 0;
+		chunk->has_modules = false;
+		chunk->is_last = false;
+		l->free_chunk_buffer[i] = chunk;
+	}
+
+	l->file = f;
+	l->mgr = mgr;
+	l->compress = compress;
+	/* Current modules are written with the first chunk. */
+	l->submitted_module_generation = mgr ? mgr->module_generation - 1 : 0;
+	l->current = NULL;
+	l->write_failed = false;
+	l->dropped_sample_count = 0;
+	darr_clear(&l->written_modules);
+
+	/* Queues are created for each session, each of them has a single producer thread and a single consumer thread. */
+	thread_queue_init(&l->free_chunks, SMP_SAMPLE_LOG_CHUNK_COUNT, l->free_chunk_buffer, SMP_SAMPLE_LOG_CHUNK_COUNT);
+	thread_queue_init(&l->full_chunks, SMP_SAMPLE_LOG_CHUNK_COUNT, l->full_chunk_buffer, 0);
+	thread_atomic_int_store(&l->flush_requested, 0);
+
+	l->writer = thread_create(writer_thread_procedure, l, THREAD_STACK_SIZE_DEFAULT);
+
+	/* Without writer the chunks are never emptied, sampling continues without the log. */
+	if (!l->writer)
+	{
+		log_error("Could not start the writer of sample log '%s'", filepath);
+		thread_queue_term(&l->full_chunks);
+		thread_queue_term(&l->free_chunks);
+		fclose(f);
+		l->file = NULL;
+
+		for (size_t i = 0; i < SMP_SAMPLE_LOG_CHUNK_COUNT; i += 1)
+		{
+			darr_destroy(&l->chunks[i].modules);
+		}
+		SMP_FREE(l->chunks);
+		l->chunks = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+bool sample_log_close(sample_log* l)
+{
+	SMP_ASSERT(sample_log_is_opened(l));
+
+	/* The last chunk can be empty, it's only used to stop the writer. */
+	sample_log_chunk* chunk = l->current
+		? l->current
+		: (sample_log_chunk*)thread_queue_consume(&l->free_chunks, THREAD_QUEUE_WAIT_INFINITE);
+
+	l->current = NULL;
+	chunk->is_last = true;
+	submit_chunk(l, chunk);
+
+	thread_join(l->writer);
+	thread_destroy(l->writer);
+
+	thread_queue_term(&l->full_chunks);
+	thread_queue_term(&l->free_chunks);
+
+	bool success = !l->write_failed;
+	success = fclose(l->file) == 0 && success;
+	l->file = NULL;
+
+	if (!success)
+	{
+		log_error("Could not write the sample log");
+	}
+
+	if (l->dropped_sample_count)
+	{
+		log_warning("%zu samples are missing from the sample log, the file could not be written fast enough.", l->dropped_sample_count);
+	}
+
+	return success;
+}
+
+bool sample_log_is_opened(sample_log* l)
+{
+	return l->file != NULL;
+}
+
+/* Hand the current chunk to the writer when it's full or when the writer asked for it, then take an empty one. */
+void sample_log_add_slow(sample_log* l, address addr)
+{
+	thread_atomic_int_store(&l->flush_requested, 0);
+
+	if (l->current && l->current->count)
+	{
+		submit_chunk(l, l->current);
+		l->current = NULL;
+	}
+
+	/* Never wait, the sampled thread is suspended while sampling. */
+	if (!l->current)
+	{
+		l->current = (sample_log_chunk*)thread_queue_consume(&l->free_chunks, 0);
+	}
+
+	if (!l->current)
+	{
+		l->dropped_sample_count += 1;
+		return;
+	}
+
+	l->current->addresses[l->current->count++] = addr;
+}
+
+bool sample_log_load_from_filepath(capture* c, const char* filepath)
+{
+	capture_clear(c);
+
+	FILE* f = fopen(filepath, "rb");
+	if (!f)
+	{
+		log_error("Could not open file '%s'", filepath);
+		return false;
+	}
+
+	sample_log_header header;
+	bool valid = fread(&header, sizeof(sample_log_header), 1, f) == 1
+		&& memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) == 0
+		&& memcmp(&header.magic2, &magic2_slog, sizeof(header.magic2)) == 0
+		&& header.zero == zero
+		&& header.version_number == SMP_SAMPLE_LOG_VERSION_NUMBER;
+
+	if (!valid)
+	{
+		log_error("Invalid sample log '%s'", filepath);
+		fclose(f);
+		return false;
+	}
+
+	ht samples;
+	records_by_address_init(&samples, 1024);
+
+	encoded_bytes payload;
+	darr_init(&payload);
+	encoded_bytes decompressed;
+	darr_init(&decompressed);
+
+	size_t record_count = 0;
+	bool complete = true;
+
+	while (complete)
+	{
+		sample_log_record_header record_header;
+		size_t read = fread(&record_header, 1, sizeof(sample_log_record_header), f);
+
+		/* End of the log. */
+		if (read == 0)
+		{
+			break;
+		}
+
+		complete = read == sizeof(sample_log_record_header)
+			&& record_header.size <= SAMPLE_LOG_MAX_RECORD_SIZE;
+
+		if (complete)
+		{
+			size_t size = (size_t)record_header.size;
+			darr_clear(&payload);
+			darr_ensure_space(&payload, size);
+
+			complete = (size == 0 || fread(payload.data, size, 1, f) == 1)
+				&& fnv1a_hash(payload.data, size) == record_header.checksum;
+
+			payload.size = complete ? size : 0;
+		}
+
+		if (complete)
+		{
+			strv data = strv_make_from((const char*)payload.data, payload.size);
+			const char* magic = record_header.magic;
+
+			if (memcmp(magic, magic_record_compressed, sizeof(record_header.magic)) == 0)
+			{
+				complete = read_compressed(&data, &magic, &decompressed);
+			}
+
+			if (complete && memcmp(magic, magic_record_samples, sizeof(record_header.magic)) == 0)
+			{
+				complete = read_samples(data, &samples, &c->sample_count);
+			}
+			else if (complete && memcmp(magic, magic_record_modules, sizeof(record_header.magic)) == 0)
+			{
+				complete = read_modules(data, c);
+			}
+		}
+
+		if (complete)
+		{
+			record_count += 1;
+		}
+	}
+
+	if (!complete)
+	{
+		log_warning("Sample log '%s' ends with an incomplete record, the %zu previous records are loaded.", filepath, record_count);
+	}
+
+	darr_ensure_space(&c->samples, ht_size(&samples));
+
+	ht_cursor cursor;
+	ht_cursor_init(&samples, &cursor);
+
+	while (ht_cursor_next(&cursor))
+	{
+		record* item = ht_cursor_item(&cursor);
+
+		capture_sample sample;
+		sample.address = item->address;
+		sample.counter = item->counter;
+		c->samples.data[c->samples.size++] = sample;
+	}
+
+	samply_qsort(c->samples.data, c->samples.size, sizeof(capture_sample), compare_sample_by_address);
+
+	keep_sampled_modules(c);
+
+	darr_destroy(&decompressed);
+	darr_destroy(&payload);
+	ht_destroy(&samples);
+	fclose(f);
+
+	return true;
+}
+
+bool sample_log_is_log_file(const char* filepath)
+{
+	FILE* f = fopen(filepath, "rb");
+	if (!f)
+	{
+		return false;
+	}
+
+	sample_log_header header;
+	bool is_log = fread(&header, sizeof(sample_log_header), 1, f) == 1
+		&& memcmp(&header.magic1, &magic1_samp, sizeof(header.magic1)) == 0
+		&& memcmp(&header.magic2, &magic2_slog, sizeof(header.magic2)) == 0;
+
+	fclose(f);
+	return is_log;
+}
+
+static int writer_thread_procedure(sample_log* l)
+{
+	bool is_last = false;
+
+	while (!is_last)
+	{
+		sample_log_chunk* chunk = (sample_log_chunk*)thread_queue_consume(&l->full_chunks, SMP_SAMPLE_LOG_FLUSH_INTERVAL_MS);
+
+		/* No full chunk for a while, ask for the current one. */
+		if (!chunk)
+		{
+			thread_atomic_int_store(&l->flush_requested, 1);
+			continue;
+		}
+
+		is_last = chunk->is_last;
+
+		/* Modules first, so the samples of a new module are never written before it. */
+		if (chunk->has_modules)
+		{
+			write_modules(l, &chunk->modules);
+		}
+		if (chunk->count)
+		{
+			write_samples(l, chunk);
+		}
+
+		/* Complete records are handed to the system, they are kept if samply crashes. */
+		if (fflush(l->file) != 0)
+		{
+			l->write_failed = true;
+		}
+
+		chunk->count = 0;
+		chunk->has_modules = false;
+
+		if (!is_last)
+		{
+			thread_queue_produce(&l->free_chunks, chunk, THREAD_QUEUE_WAIT_INFINITE);
+		}
+	}
+
+	return 0;
+}
+
+/* The modules are copied if they changed, so the writer never reads the modules of the sampler. */
+static void submit_chunk(sample_log* l, sample_log_chunk* chunk)
+{
+	if (l->mgr && l->mgr->module_generation != l->submitted_module_generation)
+	{
+		symbol_modules* modules = &l->mgr->modules;
+		darr_clear(&chunk->modules);
+		darr_ensure_space(&chunk->modules, modules->size);
+
+		for (size_t i = 0; i < modules->size; i += 1)
+		{
+			symbol_module* m = &modules->data[i];
+
+			sample_log_module module = { 0 };
+			module.base = m->base;
+			module.size = m->size;
+			module.path = m->path;
+			chunk->modules.data[chunk->modules.size++] = module;
+		}
+
+		chunk->has_modules = true;
+		l->submitted_module_generation = l->mgr->module_generation;
+	}
+
+	/* There is a slot for each chunk, it never waits. */
+	thread_queue_produce(&l->full_chunks, chunk, THREAD_QUEUE_WAIT_INFINITE);
+}
+
+/* Sort the addresses and write each distinct address once, with its counter. */
+static void write_samples(sample_log* l, sample_log_chunk* chunk)
+{
+	samply_qsort(chunk->addresses, chunk->count, sizeof(address), compare_address);
+
+	encoded_bytes* bytes = &l->encoded;
+	darr_clear(bytes);
+
+	/* Sample count, address count, and one address and one counter per sample at most. */
+	darr_ensure_space(bytes, (2 + 2 * chunk->count) * SMP_VARINT_MAX_SIZE);
+
+	size_t distinct_count = 0;
+	for (size_t i = 0; i < chunk->count; i += 1)
+	{
+		if (i == 0 || chunk->addresses[i] != chunk->addresses[i - 1])
+		{
+			distinct_count += 1;
+		}
+	}
+
+	write_varint(bytes, chunk->count);
+	write_varint(bytes, distinct_count);
+
+	address previous = 0;
+	size_t i = 0;
+	while (i < chunk->count)
+	{
+		address addr = chunk->addresses[i];
+		size_t counter = 0;
+		while (i < chunk->count && chunk->addresses[i] == addr)
+		{
+			counter += 1;
+			i += 1;
+		}
+
+		write_varint(bytes, addr - previous);
+		write_varint(bytes, counter);
+		previous = addr;
+	}
+
+	write_record(l, magic_record_samples);
+}
+
+static void write_modules(sample_log* l, sample_log_modules* modules)
+{
+	file_mapper fm;
+	file_mapper_init(&fm);
+
+	/* Build ids of the modules already written are reused, reading them maps the whole image. */
+	for (size_t i = 0; i < modules->size; i += 1)
+	{
+		sample_log_module* module = &modules->data[i];
+
+		bool found = false;
+		for (size_t j = 0; j < l->written_modules.size && !found; j += 1)
+		{
+			sample_log_module* written = &l->written_modules.data[j];
+			if (written->base == module->base && written->size == module->size && strv_equals(written->path, module->path))
+			{
+				module->build_id = written->build_id;
+				found = true;
+			}
+		}
+
+		if (!found && !capture_read_build_id(&fm, module->path, &module->build_id))
+		{
+			module->build_id.size = 0;
+		}
+	}
+
+	file_mapper_destroy(&fm);
+
+	encoded_bytes* bytes = &l->encoded;
+	darr_clear(bytes);
+	darr_ensure_space(bytes, SMP_VARINT_MAX_SIZE);
+	write_varint(bytes, modules->size);
+
+	for (size_t i = 0; i < modules->size; i += 1)
+	{
+		sample_log_module* module = &modules->data[i];
+
+		darr_ensure_space(bytes, 4 * SMP_VARINT_MAX_SIZE + module->build_id.size + module->path.size);
+
+		write_varint(bytes, module->base);
+		write_varint(bytes, module->size);
+		write_varint(bytes, module->build_id.size);
+		memcpy(bytes->data + bytes->size, module->build_id.bytes, module->build_id.size);
+		bytes->size += module->build_id.size;
+		write_varint(bytes, module->path.size);
+		memcpy(bytes->data + bytes->size, module->path.data, module->path.size);
+		bytes->size += module->path.size;
+	}
+
+	write_record(l, magic_record_modules);
+
+	darr_clear(&l->written_modules);
+	darr_ensure_space(&l->written_modules, modules->size);
+	memcpy(l->written_modules.data, modules->data, sizeof(sample_log_module) * modules->size);
+	l->written_modules.size = modules->size;
+}
+
+/* Write the encoded bytes as one record, with a single write. */
+static void write_record(sample_log* l, char* magic)
+{
+	encoded_bytes* bytes = &l->encoded;
+
+	/* The encoded bytes are replaced by a compressed record, which starts with the magic number of the record. */
+	if (l->compress)
+	{
+		compressed_bytes* compressed = &l->compressed;
+		darr_clear(compressed);
+		darr_ensure_space(compressed, sizeof(magic_record_compressed));
+		memcpy(compressed->data, magic, sizeof(magic_record_compressed));
+		compressed->size = sizeof(magic_record_compressed);
+
+		compression_compress(bytes->data, bytes->size, compressed);
+
+		darr_clear(bytes);
+		darr_ensure_space(bytes, compressed->size);
+		memcpy(bytes->data, compressed->data, compressed->size);
+		bytes->size = compressed->size;
+
+		magic = magic_record_compressed;
+	}
+
+	sample_log_record_header header;
+	memcpy(header.magic, magic, sizeof(header.magic));
+	header.checksum = fnv1a_hash(bytes->data, bytes->size);
+	header.size = bytes->size;
+
+	/* The header is put in front of the payload. */
+	darr_ensure_space(bytes, sizeof(sample_log_record_header));
+	memmove(bytes->data + sizeof(sample_log_record_header), bytes->data, bytes->size);
+	memcpy(bytes->data, &header, sizeof(sample_log_record_header));
+	bytes->size += sizeof(sample_log_record_header);
+
+	if (fwrite(bytes->data, bytes->size, 1, l->file) != 1)
+	{
+		l->write_failed = true;
+	}
+}
+
+/* Decompress the payload of a compressed record, payload and magic are replaced by the ones of the inner record. */
+static bool read_compressed(strv* payload, const char** magic, encoded_bytes* decompressed)
+{
+	if (payload->size < sizeof(magic_record_compressed))
+	{
+		return false;
+	}
+
+	compressed_blocks blocks;
+	strv data = strv_make_from(payload->data + sizeof(magic_record_compressed), payload->size - sizeof(magic_record_compressed));
+	if (!compression_open(&blocks, data)
+		|| blocks.uncompressed_size > SAMPLE_LOG_MAX_RECORD_SIZE)
+	{
+		return false;
+	}
+
+	size_t size = (size_t)blocks.uncompressed_size;
+	darr_clear(decompressed);
+	darr_ensure_space(decompressed, size);
+	if (!compression_decompress(&blocks, decompressed->data))
+	{
+		return false;
+	}
+	decompressed->size = size;
+
+	*magic = payload->data;
+	*payload = strv_make_from((const char*)decompressed->data, decompressed->size);
+	return true;
+}
+
+static bool read_samples(strv payload, ht* samples, size_t* sample_count)
+{
+	const uint8_t* cursor = (const uint8_t*)payload.data;
+	const uint8_t* end = cursor + payload.size;
+
+	uint64_t count;
+	uint64_t address_count;
+	if (!varint_read(&cursor, end, &count)
+		|| !varint_read(&cursor, end, &address_count))
+	{
+		return false;
+	}
+
+	uint64_t addr = 0;
+	for (uint64_t i = 0; i < address_count; i += 1)
+	{
+		uint64_t delta;
+		uint64_t counter;
+		if (!varint_read(&cursor, end, &delta)
+			|| !varint_read(&cursor, end, &counter))
+		{
+			return false;
+		}
+
+		addr += delta;
+
+		record item = { 0 };
+		item.address = addr;
+
+		record* inserted = (record*)ht_get_or_insert(samples, &item);
+		inserted->counter += (size_t)counter;
+	}
+
+	*sample_count += (size_t)count;
+	return cursor == end;
+}
+
+/* Modules replace the previous ones with the same base address. */
+static bool read_modules(strv payload, capture* c)
+{
+	const uint8_t* cursor = (const uint8_t*)payload.data;
+	const uint8_t* end = cursor + payload.size;
+
+	uint64_t count;
+	if (!varint_read(&cursor, end, &count))
+	{
+		return false;
+	}
+
+	for (uint64_t i = 0; i < count; i += 1)
+	{
+		uint64_t base;
+		uint64_t size;
+		uint64_t id_size;
+		uint64_t path_size;
+
+		if (!varint_read(&cursor, end, &base)
+			|| !varint_read(&cursor, end, &size)
+			|| !varint_read(&cursor, end, &id_size)
+			|| id_size > SMP_BUILD_ID_MAX_SIZE
+			|| id_size > (uint64_t)(end - cursor))
+		{
+			return false;
+		}
+
+		capture_module module = { 0 };
+		module.base = base;
+		module.size = (size_t)size;
+		memcpy(module.build_id.bytes, cursor, (size_t)id_size);
+		module.build_id.size = (uint32_t)id_size;
+		cursor += id_size;
+
+		if (!varint_read(&cursor, end, &path_size)
+			|| path_size > (uint64_t)(end - cursor))
+		{
+			return false;
+		}
+
+		char* path = re_arena_alloc(&c->arena, (size_t)path_size);
+		memcpy(path, cursor, (size_t)path_size);
+		module.path = strv_make_from(path, (size_t)path_size);
+		cursor += path_size;
+
+		bool replaced = false;
+		for (size_t j = 0; j < c->modules.size && !replaced; j += 1)
+		{
+			if (c->modules.data[j].base == module.base)
+			{
+				c->modules.data[j] = module;
+				replaced = true;
+			}
+		}
+
+		if (!replaced)
+		{
+			darr_push_back(&c->modules, module);
+		}
+	}
+
+	return cursor == end;
+}
+
+/* Modules and samples are both sorted, only keep the modules containing at least one sample. */
+static void keep_sampled_modules(capture* c)
+{
+	samply_qsort(c->modules.data, c->modules.size, sizeof(capture_module), compare_module_by_base);
+
+	size_t kept = 0;
+	size_t sample_index = 0;
+
+	for (size_t i = 0; i < c->modules.size && sample_index < c->samples.size; i += 1)
+	{
+		capture_module* m = &c->modules.data[i];
+
+		while (sample_index < c->samples.size && c->samples.data[sample_index].address < m->base)
+		{
+			sample_index += 1;
+		}
+
+		if (sample_index < c->samples.size && c->samples.data[sample_index].address < m->base + m->size)
+		{
+			c->modules.data[kept++] = *m;
+		}
+	}
+
+	c->modules.size = kept;
+}
+
+static uint32_t fnv1a_hash(const uint8_t* data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; i += 1)
+	{
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+/* The bytes must have space for SMP_VARINT_MAX_SIZE bytes. */
+static void write_varint(encoded_bytes* bytes, uint64_t v)
+{
+	bytes->size += varint_write(bytes->data + bytes->size, v);
+}
+
+static int SMP_CDECL compare_address(const address* left, const address* right)
+{
+	if (*left < *right)
+		return -1;
+	if (*left > *right)
+		return 1;
+	return 0;
+}
+
+static int SMP_CDECL compare_module_by_base(const capture_module* left, const capture_module* right)
+{
+	if (left->base < right->base)
+		return -1;
+	if (left->base > right->base)
+		return 1;
+	return 0;
+}
+
+static int SMP_CDECL compare_sample_by_address(const capture_sample* left, const capture_sample* right)
+{
+	if (left->address < right->address)
+		return -1;
+	if (left->address > right->address)
+		return 1;
+	return 0;
+}
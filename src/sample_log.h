@@ -0,0 +1,140 @@
+#ifndef SAMPLY_SAMPLE_LOG_H
+#define SAMPLY_SAMPLE_LOG_H
+
+#include "stdio.h"   /* FILE */
+#include "stdbool.h" /* bool */
+
+#include "thread.h"
+#include "darr.h"
+
+#include "process.h" /* address */
+#include "symbol_manager.h"
+#include "compression.h"
+#include "utils/pe_file.h" /* build_id */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+	Append-only log of the sampled addresses, written while sampling so a crash
+	of samply or of the sampled process does not lose the whole session.
+
+	The sampling thread stores each address in a chunk. Full chunks are handed to a writer thread
+	which encodes them (sorted addresses, delta-encoded, with their counter) and appends them to the file.
+	The writer also asks for the current chunk every SMP_SAMPLE_LOG_FLUSH_INTERVAL_MS, even if it's not full,
+	so at most a few seconds of samples are lost. The modules are appended each time their list changes.
+
+	Every record of the file is self-contained: reading stops at the first incomplete record,
+	all the previous ones are recovered. The log is converted to a capture, then symbolized like a capture.
+*/
+
+/* Number of addresses in a chunk. */
+#define SMP_SAMPLE_LOG_CHUNK_CAPACITY (64 * 1024)
+/* Number of chunks, samples are dropped if the writer falls behind all of them. */
+#define SMP_SAMPLE_LOG_CHUNK_COUNT (4)
+/* Maximum time a sample stays in memory before being handed to the writer, if samples keep coming. */
+#define SMP_SAMPLE_LOG_FLUSH_INTERVAL_MS (2000)
+
+struct capture;
+
+typedef struct sample_log_module sample_log_module;
+struct sample_log_module {
+	address base;
+	size_t size;
+	strv path;         /* Interned by the sampler. */
+	build_id build_id; /* Only read by the writer. */
+};
+
+typedef darr(sample_log_module) sample_log_modules;
+
+typedef struct sample_log_chunk sample_log_chunk;
+struct sample_log_chunk {
+	size_t count;
+	address addresses[SMP_SAMPLE_LOG_CHUNK_CAPACITY];
+	/* Copy of the modules, only if they changed since the previous chunk. */
+	bool has_modules;
+	sample_log_modules modules;
+	/* The writer thread exits after this chunk. */
+	bool is_last;
+};
+
+typedef struct sample_log sample_log;
+struct sample_log {
+	FILE* file;
+
+	/* Modules of the sampler, only read from the sampling thread. */
+	symbol_manager* mgr;
+	/* Module generation of the last modules handed to the writer. */
+	size_t submitted_module_generation;
+
+	/* Chunk being filled by the sampling thread, NULL if none was available. */
+	sample_log_chunk* current;
+	sample_log_chunk* chunks;
+
+	/* Empty chunks, from the writer to the sampling thread. */
+	thread_queue_t free_chunks;
+	void* free_chunk_buffer[SMP_SAMPLE_LOG_CHUNK_COUNT];
+	/* Chunks to write, from the sampling thread to the writer. */
+	thread_queue_t full_chunks;
+	void* full_chunk_buffer[SMP_SAMPLE_LOG_CHUNK_COUNT];
+
+	/* Set by the writer when the current chunk must be handed to it, even if it's not full. */
+	thread_atomic_int_t flush_requested;
+
+	thread_ptr_t writer;
+
+	/* Records are compressed, see compression.h. */
+	bool compress;
+
+	/* Writer thread only. */
+	darr(uint8_t) encoded;
+	compressed_bytes compressed;
+	/* Last modules written, to not read the build id of the same modules again. */
+	sample_log_modules written_modules;
+	bool write_failed;
+
+	/* Samples lost because no chunk was available. */
+	size_t dropped_sample_count;
+};
+
+void sample_log_init(sample_log* l);
+/* The log must be closed, see sample_log_close. */
+void sample_log_destroy(sample_log* l);
+
+/* Create the file and start the writer thread.
+   The modules of mgr are read from the thread which adds the samples. */
+bool sample_log_open(sample_log* l, const char* filepath, symbol_manager* mgr, bool compress);
+
+/* Hand the last samples to the writer, wait for it and close the file.
+   Only from the thread which adds the samples, it's the only consumer of the empty chunks.
+   Returns false if something could not be written. */
+bool sample_log_close(sample_log* l);
+
+bool sample_log_is_opened(sample_log* l);
+
+/* Add a sample, only from the sampling thread. */
+void sample_log_add_slow(sample_log* l, address addr);
+
+static inline void sample_log_add(sample_log* l, address addr)
+{
+	sample_log_chunk* chunk = l->current;
+	if (chunk && chunk->count < SMP_SAMPLE_LOG_CHUNK_CAPACITY && !thread_atomic_int_load(&l->flush_requested))
+	{
+		chunk->addresses[chunk->count++] = addr;
+		return;
+	}
+	sample_log_add_slow(l, addr);
+}
+
+/* Clear capture and load the complete records of the log, the log can be truncated. */
+bool sample_log_load_from_filepath(struct capture* c, const char* filepath);
+
+/* The file starts like a sample log. */
+bool sample_log_is_log_file(const char* filepath);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_SAMPLE_LOG_H */
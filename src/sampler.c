@@ -1,5 +1,9 @@
 #include "sampler.h"
 
+#if _WIN32
+#include <dbghelp.h> /* StackWalk64 */
+#endif
+
 #include "darr.h"
 #include "strv.h"
 
@@ -18,15 +22,71 @@ enum sample_status_result {
 static int sample_thread_procedure(sampler* s);
 static enum sample_result get_sample(sampler* s, process* process);
 
+static void resolve_record(sampler* s, record* item);
+static void load_results_from_heavy_hitters(sampler* s);
+static void resolve_call_stacks(sampler* s);
+#if _WIN32
+static PVOID CALLBACK function_table_access(HANDLE process_handle, DWORD64 addr_base);
+static DWORD64 CALLBACK get_module_base(HANDLE process_handle, DWORD64 addr);
+#endif
+
 static ht_hash_t hash_pointer(record* item);
 static bool items_are_same(record* left, record* right);
 static void items_swap(record* left, record* right);
 
+static ht_hash_t call_stack_hash(call_stack* item);
+static bool call_stack_are_same(call_stack* left, call_stack* right);
+static void call_stack_swap(call_stack* left, call_stack* right);
+
+/* Symbol manager of the stack being walked. The callbacks of StackWalk64 have no user data,
+   and each sampler walks stacks from its own thread. */
+static SMP_THREAD_LOCAL symbol_manager* walked_symbol_manager;
+
+void records_by_address_init(ht* results, size_t initial_capacity)
+{
+	/* Buckets are indexed by masking the hash, the capacity must be a power of two. */
+	size_t capacity = 16;
+	while (capacity < initial_capacity)
+	{
+		capacity *= 2;
+	}
+
+	ht_init(results, sizeof(record), hash_pointer, (ht_predicate_t)items_are_same, items_swap, capacity);
+}
+
+void call_stacks_init(ht* call_stacks)
+{
+	ht_init(call_stacks, sizeof(call_stack), call_stack_hash, (ht_predicate_t)call_stack_are_same, call_stack_swap, 1024);
+}
+
+void call_stacks_add(ht* call_stacks, re_arena* arena, address* frames, size_t frame_count, size_t counter)
+{
+	call_stack item = {0};
+	item.frames = frames;
+	item.frame_count = frame_count;
+
+	call_stack* inserted = (call_stack*)ht_get_or_insert(call_stacks, &item);
+
+	/* New call stack, its frames are copied from the stack buffer. */
+	if (inserted->counter == 0)
+	{
+		inserted->frames = re_arena_alloc(arena, sizeof(address) * frame_count);
+		memcpy(inserted->frames, frames, sizeof(address) * frame_count);
+	}
+	inserted->counter += counter;
+}
+
 void sampler_init(sampler* s)
 {
 	memset(s, 0, sizeof(sampler));
 
-	ht_init(&s->results, sizeof(record), hash_pointer, (ht_predicate_t)items_are_same, items_swap, 1024);
+	records_by_address_init(&s->results, 1024);
+
+	call_stacks_init(&s->call_stacks);
+	records_by_address_init(&s->call_stack_frames, 1024);
+	re_arena_init(&s->call_stack_arena, 64 * 1024);
+
+	sample_log_init(&s->log);
 
 	string_store_init(&s->string_store);
 	symbol_manager_init(&s->mgr, &s->string_store);
@@ -60,6 +120,14 @@ int sampler_destroy(sampler* s)
 
 	ht_destroy(&s->results);
 
+	ht_destroy(&s->call_stacks);
+	ht_destroy(&s->call_stack_frames);
+	re_arena_destroy(&s->call_stack_arena);
+
+	heavy_hitters_destroy(&s->heavy_hitters);
+
+	sample_log_destroy(&s->log);
+
 	string_store_destroy(&s->string_store);
 
 	thread_queue_term(&s->thread_queue);
@@ -72,6 +140,10 @@ int sampler_destroy(sampler* s)
 bool sampler_run(sampler* s, process* process)
 {
 	ht_clear(&s->results);
+	ht_clear(&s->call_stacks);
+	ht_clear(&s->call_stack_frames);
+	re_arena_clear(&s->call_stack_arena);
+	s->dropped_call_stack_count = 0;
 	s->sample_count = 0;
 
 	s->command.type = sampler_command_type_START_SAMPLING;
@@ -140,11 +212,31 @@ static int sample_thread_procedure(sampler* s)
 
 				symbol_manager_prepare_for_load(&s->mgr, process.process_handle);
 
-				/* Load process symbols. */
-				if (symbol_manager_load(&s->mgr, process.process_handle))
+				/* Load process symbols, or only track the modules if addresses are symbolized later. */
+				bool loaded = s->capture_only
+					? symbol_manager_load_modules_only(&s->mgr, process.process_handle)
+					: symbol_manager_load(&s->mgr, process.process_handle);
+
+				if (loaded)
 				{
 					enum sample_result status_result = sample_status_result_NONE;
 
+					if (s->max_address_count)
+					{
+						if (s->heavy_hitters.capacity != s->max_address_count)
+						{
+							heavy_hitters_destroy(&s->heavy_hitters);
+							heavy_hitters_init(&s->heavy_hitters, s->max_address_count);
+						}
+						heavy_hitters_clear(&s->heavy_hitters);
+					}
+
+					/* Sampling continues without the log if it can't be created. */
+					if (s->log_path)
+					{
+						sample_log_open(&s->log, s->log_path, &s->mgr, s->compress_log);
+					}
+
 					/* Get sample while the status is "success". */
 					while (!s->must_end_sampling
 						&& process_is_running(&process)
@@ -154,6 +246,22 @@ static int sample_thread_procedure(sampler* s)
 						/* Continue */
 					}
 
+					/* Before the modules are unloaded, the last chunk contains their final list. */
+					if (sample_log_is_opened(&s->log))
+					{
+						sample_log_close(&s->log);
+					}
+
+					/* Symbols must be resolved before they are unloaded. */
+					if (s->max_address_count)
+					{
+						load_results_from_heavy_hitters(s);
+					}
+					if (s->collect_call_stacks)
+					{
+						resolve_call_stacks(s);
+					}
+
 					symbol_manager_unload(&s->mgr);
 				}
 				else
@@ -201,8 +309,18 @@ static enum sample_result get_sample(sampler* s, process* process)
 		return sample_status_result_SUSPEND_FAILED;
 	}
 
+	/* Walking the stack needs the integer registers too, for the frame pointers. */
+	bool walk_call_stack = s->collect_call_stacks && !s->capture_only;
+
+	/* Fixed memory, call stacks are not walked anymore once the table is full. */
+	if (walk_call_stack && s->max_address_count && ht_size(&s->call_stacks) >= s->max_address_count)
+	{
+		walk_call_stack = false;
+		s->dropped_call_stack_count += 1;
+	}
+
 	CONTEXT thread_ctx = {0};
-	thread_ctx.ContextFlags = CONTEXT_CONTROL;
+	thread_ctx.ContextFlags = walk_call_stack ? CONTEXT_FULL : CONTEXT_CONTROL;
 
 	if (!GetThreadContext(thread_handle, &thread_ctx))
 	{
@@ -211,27 +329,67 @@ static enum sample_result get_sample(sampler* s, process* process)
 
 	address addr = thread_ctx.Rip;
 
+	/* The stack must be walked before the thread is resumed, it's modified as soon as it runs. */
+	address frames[SMP_MAX_CALL_STACK_DEPTH];
+	size_t frame_count = 0;
+	if (walk_call_stack)
+	{
+		STACKFRAME64 frame = {0};
+		frame.AddrPC.Offset = thread_ctx.Rip;
+		frame.AddrPC.Mode = AddrModeFlat;
+		frame.AddrFrame.Offset = thread_ctx.Rbp;
+		frame.AddrFrame.Mode = AddrModeFlat;
+		frame.AddrStack.Offset = thread_ctx.Rsp;
+		frame.AddrStack.Mode = AddrModeFlat;
+
+		/* Unwind data of the modules is found from the symbols loaded by the symbol_manager,
+		   the callbacks load the module of each frame before dbghelp looks for it. */
+		walked_symbol_manager = &s->mgr;
+		while (frame_count < SMP_MAX_CALL_STACK_DEPTH
+			&& StackWalk64(IMAGE_FILE_MACHINE_AMD64, process->process_handle, thread_handle, &frame, &thread_ctx, NULL, function_table_access, get_module_base, NULL)
+			&& frame.AddrPC.Offset != 0)
+		{
+			/* Return addresses point after the call instruction, which can be the start of the next function. */
+			frames[frame_count] = frame_count == 0 ? frame.AddrPC.Offset : frame.AddrPC.Offset - 1;
+			frame_count += 1;
+		}
+	}
+
 	DWORD resume_result = ResumeThread(thread_handle);
 	if (resume_result == (DWORD)(-1))
 	{
 		return sample_status_result_RESUME_FAILED;
 	}
 
-	record item = {0};
-	item.address = addr;
-	
-	/* @TODO document those lines. */
-	record* inserted = (record*)ht_get_or_insert(&s->results, &item);
-	inserted->counter += 1;
+	if (sample_log_is_opened(&s->log))
+	{
+		sample_log_add(&s->log, addr);
+	}
 
-	/* @TODO retrieve symbol name after sampling. */
-	if (inserted->symbol_name.size == 0) 
+	/* Fixed memory, the top addresses are resolved once the sampling is done. */
+	if (s->max_address_count)
 	{
-		inserted->symbol_name = symbol_manager_get_symbol_name(&s->mgr, addr);
+		heavy_hitters_add(&s->heavy_hitters, addr);
+	}
+	else
+	{
+		record item = {0};
+		item.address = addr;
 
-		symbol_manager_get_location(&s->mgr, addr, &inserted->source_file, &inserted->line_number);
+		/* @TODO document those lines. */
+		record* inserted = (record*)ht_get_or_insert(&s->results, &item);
+		inserted->counter += 1;
 
-		inserted->module_name = symbol_manager_get_module_name(&s->mgr, addr);
+		/* In capture mode only the module of a new address needs to be known. */
+		if (!s->capture_only || inserted->counter == 1)
+		{
+			resolve_record(s, inserted);
+		}
+	}
+
+	if (frame_count)
+	{
+		call_stacks_add(&s->call_stacks, &s->call_stack_arena, frames, frame_count, 1);
 	}
 
 #endif
@@ -240,6 +398,88 @@ static enum sample_result get_sample(sampler* s, process* process)
 	return sample_status_result_SUCCESS;
 }
 
+#if _WIN32
+/* Modules are loaded in dbghelp on first use (see symbol_manager.h), their unwind data is only available afterward. */
+static PVOID CALLBACK function_table_access(HANDLE process_handle, DWORD64 addr_base)
+{
+	symbol_manager_get_module(walked_symbol_manager, addr_base);
+	return SymFunctionTableAccess64(process_handle, addr_base);
+}
+
+static DWORD64 CALLBACK get_module_base(HANDLE process_handle, DWORD64 addr)
+{
+	symbol_manager_get_module(walked_symbol_manager, addr);
+	return SymGetModuleBase64(process_handle, addr);
+}
+#endif
+
+/* Resolve the symbol of a record, or only track its module if symbols are resolved later (see capture.h). */
+static void resolve_record(sampler* s, record* item)
+{
+	if (s->capture_only)
+	{
+		symbol_manager_track_module(&s->mgr, item->address);
+	}
+	else if (item->symbol_name.size == 0)
+	{
+		symbol_location location;
+		symbol_manager_resolve(&s->mgr, item->address, &location);
+
+		item->symbol_name = location.symbol_name;
+		item->source_file = location.source_file;
+		item->line_number = location.line_number;
+		item->module_name = location.module_name;
+		item->function_start = location.function_start;
+		item->function_end = location.function_end;
+	}
+}
+
+static void load_results_from_heavy_hitters(sampler* s)
+{
+	for (size_t i = 0; i < s->heavy_hitters.count; i += 1)
+	{
+		heavy_hitter* hitter = &s->heavy_hitters.items[i];
+
+		record item = {0};
+		item.address = hitter->address;
+
+		record* inserted = (record*)ht_get_or_insert(&s->results, &item);
+		inserted->counter += hitter->counter;
+		inserted->error += hitter->error;
+
+		resolve_record(s, inserted);
+	}
+}
+
+/* Resolve each distinct frame address once, call stacks share most of their frames. */
+static void resolve_call_stacks(sampler* s)
+{
+	if (s->dropped_call_stack_count)
+	{
+		log_warning("The call stacks of %zu samples were not walked, the table of %zu distinct call stacks was full.",
+			s->dropped_call_stack_count, s->max_address_count);
+	}
+
+	ht_cursor c;
+	ht_cursor_init(&s->call_stacks, &c);
+	while (ht_cursor_next(&c))
+	{
+		call_stack* stack = ht_cursor_item(&c);
+		for (size_t i = 0; i < stack->frame_count; i += 1)
+		{
+			record item = {0};
+			item.address = stack->frames[i];
+
+			record* inserted = (record*)ht_get_or_insert(&s->call_stack_frames, &item);
+			if (inserted->counter == 0)
+			{
+				resolve_record(s, inserted);
+			}
+			inserted->counter += stack->counter;
+		}
+	}
+}
+
 static ht_hash_t hash_pointer(record* item)
 {
 	return item->address;
@@ -255,4 +495,27 @@ static void items_swap(record* left, record* right)
 	record tmp = *left;
 	*left = *right;
 	*right = tmp;
-}
\ No newline at end of file
+}
+
+static ht_hash_t call_stack_hash(call_stack* item)
+{
+	ht_hash_t hash = (ht_hash_t)item->frame_count;
+	for (size_t i = 0; i < item->frame_count; i += 1)
+	{
+		hash = (hash ^ (ht_hash_t)item->frames[i]) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static bool call_stack_are_same(call_stack* left, call_stack* right)
+{
+	return left->frame_count == right->frame_count
+		&& memcmp(left->frames, right->frames, sizeof(address) * left->frame_count) == 0;
+}
+
+static void call_stack_swap(call_stack* left, call_stack* right)
+{
+	call_stack tmp = *left;
+	*left = *right;
+	*right = tmp;
+}
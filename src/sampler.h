@@ -6,9 +6,12 @@
 #include "thread.h"
 #include "darr.h"
 #include "insert_only_ht.h"
+#include "arena_alloc.h"
 
 #include "symbol_manager.h"
 #include "string_store.h"
+#include "heavy_hitters.h"
+#include "sample_log.h"
 
 #if __cplusplus
 extern "C" {
@@ -35,8 +38,24 @@ struct record {
 	strv source_file;    /* Source file associated with the address. */
 	size_t line_number;  /* Line number associated with the address. */
 	size_t counter;      /* Count number of time this address has been sampled. */
+	size_t error;        /* Maximum overestimation of the counter, only in heavy-hitter mode. */
+	/* Range [start, end) of the function, zero if unknown. uint64_t because the `address` member hides the type in C++. */
+	uint64_t function_start;
+	uint64_t function_end;
 };
 
+/* Sampled call stack, from the sampled address to the outermost caller.
+   Return addresses are stored minus one so they resolve to the call instruction. */
+typedef struct call_stack call_stack;
+struct call_stack {
+	address* frames;
+	size_t frame_count;
+	size_t counter;      /* Count number of time this call stack has been sampled. */
+};
+
+/* Maximum number of frames of a sampled call stack, deeper callers are ignored. */
+#define SMP_MAX_CALL_STACK_DEPTH (128)
+
 typedef struct sampler sampler;
 struct sampler {
 
@@ -61,18 +80,52 @@ struct sampler {
 	bool must_end_thread;
 
 	bool is_running;
+
+	/* Only capture addresses and modules, symbols are resolved later from another machine (see capture.h). */
+	bool capture_only;
 	/* Number of sample from the current or last task. */
 	size_t sample_count;
 
 	/* Map to store the results by address. */
 	ht results;
 
+	/* If not zero, only the top addresses are tracked during the sampling, in fixed memory.
+	   The results are filled with them once the sampling is done. */
+	size_t max_address_count;
+	heavy_hitters heavy_hitters;
+
+	/* Walk the call stack of each sample, to know the callers and the callees of each symbol (see call_graph.h). */
+	bool collect_call_stacks;
+	/* Distinct call stacks, their frames are allocated in the arena.
+	   With max_address_count, there are at most max_address_count of them, the walks stop when the table is full. */
+	ht call_stacks;
+	/* Samples whose call stack was not walked because the table was full. */
+	size_t dropped_call_stack_count;
+	re_arena call_stack_arena;
+	/* Record of each distinct frame address, resolved once the sampling is done. */
+	ht call_stack_frames;
+
+	/* If not NULL, the sampled addresses are also appended to this file while sampling (see sample_log.h). */
+	const char* log_path;
+	/* The records of the sample log are compressed. */
+	bool compress_log;
+	sample_log log;
+
 	/* We need the symbol_manager to load informations from a process
 	   to retrieve some information (module name, line number)
 	   and display them to the user. */
 	symbol_manager mgr;
 };
 
+/* Initialize map of records by address. Capacity is rounded up to a power of two. */
+void records_by_address_init(ht* results, size_t initial_capacity);
+
+/* Initialize map of distinct call stacks. */
+void call_stacks_init(ht* call_stacks);
+
+/* Add counter to the call stack, the frames of a new call stack are copied in arena. */
+void call_stacks_add(ht* call_stacks, re_arena* arena, address* frames, size_t frame_count, size_t counter);
+
 void sampler_init(sampler* s);
 
 /* Stop sampling and wait for the thread to be finished. */
@@ -7,6 +7,10 @@
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <windows.h>
+#else
+#include <sys/types.h> /* off_t */
+#include <time.h> /* clock_gettime */
+#include <unistd.h> /* sysconf */
 #endif
 
 void samply_qsort(void* item_ptr, size_t count, size_t size_of_element, int (*comp)(const void*, const void*))
@@ -34,6 +38,108 @@ size_t samply_djb2_hash(strv str)
 #undef SMP_HASH
 }
 
+double samply_time_now(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+uint64_t samply_time_now_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    /* Split to not overflow the multiplication. */
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    uint64_t seconds = (uint64_t)counter.QuadPart / (uint64_t)frequency.QuadPart;
+    uint64_t remainder = (uint64_t)counter.QuadPart % (uint64_t)frequency.QuadPart;
+    return seconds * 1000000000ull + remainder * 1000000000ull / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+int64_t samply_ftell64(FILE* f)
+{
+#ifdef _WIN32
+    return _ftelli64(f);
+#else
+    return (int64_t)ftello(f);
+#endif
+}
+
+int samply_fseek64(FILE* f, int64_t offset, int origin)
+{
+#ifdef _WIN32
+    return _fseeki64(f, offset, origin);
+#else
+    return fseeko(f, (off_t)offset, origin);
+#endif
+}
+
+size_t samply_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = (long)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? (size_t)count : 1;
+}
+
+bool samply_parse_hex(strv* str, uint64_t* value)
+{
+    strv s = strv_trimmed_left_by(*str, (strv)STRV(" \t"));
+
+    if (strv_starts_with(s, (strv)STRV("0x")))
+    {
+        s = strv_remove_left(s, 2);
+    }
+
+    uint64_t result = 0;
+    size_t digit_count = 0;
+
+    while (digit_count < s.size)
+    {
+        char c = s.data[digit_count];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else break;
+
+        result = (result << 4) | (uint64_t)digit;
+        digit_count += 1;
+    }
+
+    *str = strv_remove_left(s, digit_count);
+    *value = result;
+
+    return digit_count > 0;
+}
+
 #ifdef _WIN32
 
 int samply_convert_utf8_to_wchar_size(strv chars)
@@ -56,4 +162,23 @@ int samply_convert_utf8_to_wchar(wchar_t* buffer, size_t buffer_size, strv chars
     return result;
 }
 
+int samply_convert_wchar_to_utf8(char* buffer, size_t buffer_size, const wchar_t* chars)
+{
+    int result = 0;
+
+    if (buffer_size != 0)
+    {
+        /* Convert to UTF-8, -1 means the input is null-terminated and the null-terminated char is written as well. */
+        result = WideCharToMultiByte(CP_UTF8, 0, chars, -1, buffer, (int)buffer_size, NULL, NULL);
+    }
+
+    /* Returned value includes the null-terminated char on success. */
+    if (result > 0)
+    {
+        result -= 1;
+    }
+    buffer[result] = '\0';
+    return result;
+}
+
 #endif
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef SAMPLY_H
 #define SAMPLY_H
 
+#include <stdint.h> /* uint64_t */
+#include <stdio.h>  /* FILE */
+
 #include "strv.h"
 
 #define SMP_APP_NAME "Samply"
@@ -11,8 +14,16 @@
 #define SMP_APP_VERSION_TEXT "0.0.4-dev"
 
 /* Version of the binary file format of the summary. */
-#define SMP_SUMMARY_VERSION_NUMBER (1)
-#define SMP_SUMMARY_VERSION_TEXT "0.0.1-dev"
+#define SMP_SUMMARY_VERSION_NUMBER (2)
+#define SMP_SUMMARY_VERSION_TEXT "0.0.2-dev"
+
+/* Version of the binary file format of the raw address capture. */
+#define SMP_CAPTURE_VERSION_NUMBER (1)
+#define SMP_CAPTURE_VERSION_TEXT "0.0.1-dev"
+
+/* Version of the binary file format of the sample log. */
+#define SMP_SAMPLE_LOG_VERSION_NUMBER (1)
+#define SMP_SAMPLE_LOG_VERSION_TEXT "0.0.1-dev"
 
 #ifndef SMP_ASSERT
 #include <assert.h>
@@ -42,6 +53,12 @@
 #define SMP_CDECL
 #endif
 
+#ifdef _MSC_VER
+#define SMP_THREAD_LOCAL __declspec(thread)
+#else
+#define SMP_THREAD_LOCAL _Thread_local
+#endif
+
 #if __cplusplus
 extern "C" {
 #endif
@@ -50,12 +67,34 @@ void samply_qsort(void* item_ptr, size_t count, size_t size_of_element, int (*co
 
 size_t samply_djb2_hash(strv str);
 
+/* Monotonic time in seconds, only meaningful to compute durations. */
+double samply_time_now(void);
+
+/* Monotonic time in nanoseconds, on the clock of the jitdump timestamps:
+   CLOCK_MONOTONIC on Linux, QueryPerformanceCounter on Windows. */
+uint64_t samply_time_now_ns(void);
+
+/* Number of logical processors, at least 1. */
+size_t samply_cpu_count(void);
+
+/* ftell and fseek with 64-bit offsets, long is 32-bit on Windows. */
+int64_t samply_ftell64(FILE* f);
+
+int samply_fseek64(FILE* f, int64_t offset, int origin);
+
+/* Parse hexadecimal number, with or without "0x" prefix, after skipping the leading blanks.
+   The parsed characters are removed from the string. Returns false if there is no digit. */
+bool samply_parse_hex(strv* str, uint64_t* value);
+
 #ifdef _WIN32
 
 int samply_convert_utf8_to_wchar_size(strv chars);
 
 int samply_convert_utf8_to_wchar(wchar_t* buffer, size_t buffer_size, strv chars);
 
+/* Convert null-terminated wchar string to UTF-8. Returns the number of bytes written, without the null-terminated char. */
+int samply_convert_wchar_to_utf8(char* buffer, size_t buffer_size, const wchar_t* chars);
+
 #endif
 
 #if __cplusplus
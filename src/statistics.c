@@ -0,0 +1,60 @@
+#include "statistics.h"
+
+#include "math.h" /* sqrt */
+
+confidence_interval wilson_interval(size_t count, size_t sample_count)
+{
+	confidence_interval result = { 0.0, 0.0 };
+	if (sample_count == 0)
+	{
+		return result;
+	}
+
+	double n = (double)sample_count;
+	double p = (double)count / n;
+	double z = SMP_CONFIDENCE_Z;
+	double z2 = z * z;
+
+	double denominator = 1.0 + z2 / n;
+	double center = (p + z2 / (2.0 * n)) / denominator;
+	double half_width = z * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * n)) / denominator;
+
+	result.low = center - half_width;
+	result.high = center + half_width;
+
+	/* Rounding errors. */
+	if (result.low < 0.0)
+	{
+		result.low = 0.0;
+	}
+	if (result.high > 1.0)
+	{
+		result.high = 1.0;
+	}
+	return result;
+}
+
+bool ratios_differ_significantly(size_t count_a, size_t sample_count_a, size_t count_b, size_t sample_count_b)
+{
+	if (sample_count_a == 0 || sample_count_b == 0)
+	{
+		return false;
+	}
+
+	double n_a = (double)sample_count_a;
+	double n_b = (double)sample_count_b;
+	double p_a = (double)count_a / n_a;
+	double p_b = (double)count_b / n_b;
+
+	/* Under the hypothesis that both ratios are the same. */
+	double pooled = ((double)count_a + (double)count_b) / (n_a + n_b);
+	double variance = pooled * (1.0 - pooled) * (1.0 / n_a + 1.0 / n_b);
+	if (variance <= 0.0)
+	{
+		/* Both ratios are 0 or both are 1. */
+		return false;
+	}
+
+	double z = (p_b - p_a) / sqrt(variance);
+	return z > SMP_CONFIDENCE_Z || z < -SMP_CONFIDENCE_Z;
+}
@@ -0,0 +1,33 @@
+#ifndef SAMPLY_STATISTICS_H
+#define SAMPLY_STATISTICS_H
+
+#include "stddef.h"  /* size_t */
+#include "stdbool.h" /* bool */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Quantile of the normal distribution for a 95% confidence level. */
+#define SMP_CONFIDENCE_Z (1.96)
+
+/* Range of ratios which contains the actual ratio with a 95% confidence. */
+typedef struct confidence_interval confidence_interval;
+struct confidence_interval {
+	double low;
+	double high;
+};
+
+/* Wilson score interval of the ratio of samples in a symbol, a line, etc.
+   Unlike the normal approximation it stays within [0, 1] and is usable for small counts. */
+confidence_interval wilson_interval(size_t count, size_t sample_count);
+
+/* Two-proportion z-test, true if the difference between the ratios
+   count_a / sample_count_a and count_b / sample_count_b is significant at the 95% level. */
+bool ratios_differ_significantly(size_t count_a, size_t sample_count_a, size_t count_b, size_t sample_count_b);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_STATISTICS_H */
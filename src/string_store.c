@@ -1,6 +1,7 @@
 #include "string_store.h"
 
 #include "string.h" /* memcpy */
+#include "stdint.h" /* uint64_t, uintptr_t */
 
 #include "samply.h"
 
@@ -22,6 +23,12 @@ void string_store_destroy(string_store* s)
 	re_arena_destroy(&s->arena);
 }
 
+void string_store_clear(string_store* s)
+{
+	ht_clear(&s->map);
+	re_arena_clear(&s->arena);
+}
+
 strv* string_store_get_or_create(string_store* s, strv value)
 {
 	/* Save index if we need to rollback. */
@@ -48,6 +55,27 @@ strv* string_store_get_or_create(string_store* s, strv value)
 	return result;
 }
 
+ht_hash_t string_store_interned_hash(strv interned)
+{
+	if (interned.size == 0)
+	{
+		return 0;
+	}
+
+	/* Mix the pointer bits, the low ones are often zero because of the alignment. */
+	uint64_t h = (uint64_t)(uintptr_t)interned.data;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return (ht_hash_t)h;
+}
+
+bool string_store_interned_equals(strv left, strv right)
+{
+	return left.size == right.size
+		&& (left.size == 0 || left.data == right.data);
+}
+
 static ht_hash_t strv_hash(strv* item)
 {
 	return samply_djb2_hash(*item);
@@ -20,8 +20,16 @@ struct string_store {
 void string_store_init(string_store* s);
 void string_store_destroy(string_store* s);
 
+/* Forget all the strings without deallocating the buffers. Previously returned strings are invalidated. */
+void string_store_clear(string_store* s);
+
 strv* string_store_get_or_create(string_store* s, strv value);
 
+/* Interned strings are identified by their data pointer, their content is not read.
+   Empty strings are not always interned, they are all equal. */
+ht_hash_t string_store_interned_hash(strv interned);
+bool string_store_interned_equals(strv left, strv right);
+
 
 #if __cplusplus
 }
@@ -0,0 +1,162 @@
+#include "symbol_index.h"
+
+#include "samply.h"
+
+static bool range_ends_before(const symbol_range* item, const symbol_range* value);
+static bool range_by_start_less(const symbol_range* left, const symbol_range* right);
+static void replace_window(symbol_index* idx, size_t first, size_t last, symbol_range* values, size_t count);
+
+void symbol_index_init(symbol_index* idx)
+{
+	memset(idx, 0, sizeof(symbol_index));
+
+	darr_init(&idx->ranges);
+	darr_init(&idx->tmp);
+}
+
+void symbol_index_destroy(symbol_index* idx)
+{
+	darr_destroy(&idx->ranges);
+	darr_destroy(&idx->tmp);
+}
+
+void symbol_index_clear(symbol_index* idx)
+{
+	darr_clear(&idx->ranges);
+	darr_clear(&idx->tmp);
+}
+
+void symbol_index_insert(symbol_index* idx, symbol_range range)
+{
+	if (range.start >= range.end)
+	{
+		return;
+	}
+
+	symbol_range* data = idx->ranges.data;
+	size_t size = idx->ranges.size;
+
+	/* Ranges don't overlap so their ends are sorted as well. Get the first range ending after the start of the new one. */
+	size_t first = mem_lower_bound_predicate(data, sizeof(symbol_range), 0, size, &range, (darr_predicate_t)range_ends_before);
+
+	size_t last = first;
+	while (last < size && data[last].start < range.end)
+	{
+		last += 1;
+	}
+
+	/* No overlap, this is the usual case. */
+	if (first == last)
+	{
+		darr_insert_many(&idx->ranges, first, &range, 1);
+		return;
+	}
+
+	/* Rebuild the overlapped window, the new range only fills what is not covered by more recent ranges. */
+	darr_clear(&idx->tmp);
+
+	address cursor = range.start;
+	bool has_right_part = false;
+	symbol_range right_part = { 0 };
+
+	for (size_t i = first; i < last; i += 1)
+	{
+		symbol_range existing = data[i];
+
+		if (existing.timestamp > range.timestamp)
+		{
+			if (cursor < existing.start)
+			{
+				symbol_range piece = range;
+				piece.start = cursor;
+				piece.end = existing.start;
+				darr_push_back(&idx->tmp, piece);
+			}
+
+			darr_push_back(&idx->tmp, existing);
+
+			if (existing.end > cursor)
+			{
+				cursor = existing.end;
+			}
+		}
+		else
+		{
+			/* Existing range is replaced, only keep what is outside the new range. */
+			if (existing.start < range.start)
+			{
+				symbol_range piece = existing;
+				piece.end = range.start;
+				darr_push_back(&idx->tmp, piece);
+			}
+			if (existing.end > range.end)
+			{
+				right_part = existing;
+				right_part.start = range.end;
+				has_right_part = true;
+			}
+		}
+	}
+
+	if (cursor < range.end)
+	{
+		symbol_range piece = range;
+		piece.start = cursor;
+		darr_push_back(&idx->tmp, piece);
+	}
+
+	if (has_right_part)
+	{
+		darr_push_back(&idx->tmp, right_part);
+	}
+
+	replace_window(idx, first, last, idx->tmp.data, idx->tmp.size);
+}
+
+symbol_range* symbol_index_find(symbol_index* idx, address addr)
+{
+	symbol_range value = { 0 };
+	value.start = addr;
+
+	/* Get the first range starting after the address, the candidate is the previous one. */
+	size_t index = mem_upper_bound_predicate(idx->ranges.data, sizeof(symbol_range), 0, idx->ranges.size, &value, (darr_predicate_t)range_by_start_less);
+
+	if (index == 0)
+	{
+		return NULL;
+	}
+
+	symbol_range* range = &idx->ranges.data[index - 1];
+
+	return addr < range->end
+		? range
+		: NULL;
+}
+
+static bool range_ends_before(const symbol_range* item, const symbol_range* value)
+{
+	return item->end <= value->start;
+}
+
+static bool range_by_start_less(const symbol_range* left, const symbol_range* right)
+{
+	return left->start < right->start;
+}
+
+static void replace_window(symbol_index* idx, size_t first, size_t last, symbol_range* values, size_t count)
+{
+	size_t removed = last - first;
+
+	if (count > removed)
+	{
+		darr_ensure_space(&idx->ranges, count - removed);
+	}
+
+	symbol_range* data = idx->ranges.data;
+	size_t tail_count = idx->ranges.size - last;
+
+	memmove(data + first + count, data + last, tail_count * sizeof(symbol_range));
+	memcpy(data + first, values, count * sizeof(symbol_range));
+
+	idx->ranges.size = idx->ranges.size - removed + count;
+}
@@ -0,0 +1,53 @@
+#ifndef SAMPLY_SYMBOL_INDEX_H
+#define SAMPLY_SYMBOL_INDEX_H
+
+#include <stdint.h> /* uint64_t */
+
+#include "darr.h"
+#include "strv.h" /* strv */
+
+#include "process.h" /* address */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Address range [start, end) associated with a symbol.
+   Used for symbols that are not provided by the debug information of a module,
+   like JIT-compiled functions. */
+typedef struct symbol_range symbol_range;
+struct symbol_range {
+	address start;
+	address end;         /* Exclusive. */
+	strv name;           /* Symbol name. */
+	strv module_name;    /* Module name, like "[jit]". */
+	uint64_t timestamp;  /* When ranges overlap the most recent one wins. */
+};
+
+typedef darr(symbol_range) symbol_ranges;
+
+/* Sorted and non-overlapping ranges of symbols. */
+typedef struct symbol_index symbol_index;
+struct symbol_index {
+	symbol_ranges ranges;
+	/* Reusable buffer to split overlapping ranges. */
+	symbol_ranges tmp;
+};
+
+void symbol_index_init(symbol_index* idx);
+void symbol_index_destroy(symbol_index* idx);
+void symbol_index_clear(symbol_index* idx);
+
+/* Insert range. Parts of the existing ranges overlapped by a more recent range are removed.
+   Parts of the inserted range overlapped by more recent existing ranges are ignored.
+   Inserting ranges by increasing address is the fast path since nothing needs to be moved. */
+void symbol_index_insert(symbol_index* idx, symbol_range range);
+
+/* Returns the range containing the address or NULL. */
+symbol_range* symbol_index_find(symbol_index* idx, address addr);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_SYMBOL_INDEX_H */
@@ -4,19 +4,46 @@
 /* Specificaly include windows without "LEAN_AND_MEAN" here */
 #include <windows.h>
 #include <dbghelp.h> /* To retrieve the symbols. */
-#include <psapi.h> /* GetModuleBaseNameA  */
 #endif
 
 #include "samply.h"
 #include "utils/log.h"
 #include "string_store.h"
 
+/* Minimum delay between two refreshes of the module list. */
+#define SMP_MODULE_REFRESH_DELAY_SECONDS (0.1)
+
+static bool module_by_base_less(const symbol_module* left, const symbol_module* right);
+static symbol_module* find_module(symbol_manager* m, address addr);
+static void refresh_modules(symbol_manager* m);
+static void add_module(symbol_manager* m, address base, size_t size, strv path);
+static void load_module_symbols(symbol_manager* m, symbol_module* module);
+
+static void refresh_jit_symbols(symbol_manager* m);
+
+static void clear_function_cache(symbol_manager* m);
+static void clear_cached_functions_in_range(symbol_manager* m, address start, address end);
+static function_cache_entry* find_cached_function(symbol_manager* m, address addr);
+static bool resolve_function(symbol_manager* m, address addr, function_cache_entry* entry);
+static void location_from_cache_entry(function_cache_entry* entry, address addr, symbol_location* location);
+static bool function_line_less(const function_line* left, const function_line* right);
+static int compare_function_line(const void* left, const void* right);
+
 void symbol_manager_init(symbol_manager* m, struct string_store* s)
 {
 	memset(m, 0, sizeof(symbol_manager));
 
 	m->string_store = s;
 
+	darr_init(&m->modules);
+	jit_symbols_init(&m->jit, s);
+	m->kernel_module_name = *string_store_get_or_create(s, (strv)STRV(SMP_KERNEL_MODULE_NAME));
+
+	for (size_t i = 0; i < SMP_FUNCTION_CACHE_SIZE; i += 1)
+	{
+		darr_init(&m->function_cache[i].lines);
+	}
+
 #if _WIN32
 	// From the MSDN documentation:
 	//     https://learn.microsoft.com/en-us/windows/win32/debug/retrieving-symbol-information-by-address
@@ -29,6 +56,14 @@ void symbol_manager_init(symbol_manager* m, struct string_store* s)
 
 void symbol_manager_destroy(symbol_manager* m)
 {
+	darr_destroy(&m->modules);
+	jit_symbols_destroy(&m->jit);
+
+	for (size_t i = 0; i < SMP_FUNCTION_CACHE_SIZE; i += 1)
+	{
+		darr_destroy(&m->function_cache[i].lines);
+	}
+
 	SMP_FREE(m->symbol_buffer);
 }
 
@@ -62,7 +97,10 @@ bool symbol_manager_load(symbol_manager* m, handle process_handle)
 {
 #if _WIN32
 
-	SymSetOptions(SymGetOptions() | SYMOPT_LOAD_LINES | SYMOPT_DEBUG);
+	/* Symbols of a module are explicitly loaded with SymLoadModuleExW
+	   the first time an address of this module needs to be resolved,
+	   so we don't want the deferred loading of dbghelp here. */
+	SymSetOptions((SymGetOptions() | SYMOPT_LOAD_LINES | SYMOPT_DEBUG) & ~SYMOPT_DEFERRED_LOADS);
 
 	if (m->initialized)
 	{
@@ -70,8 +108,9 @@ bool symbol_manager_load(symbol_manager* m, handle process_handle)
 		return false;
 	}
 
-	/* Don't invade the process right now, SymRefreshModuleList will do it later.
-	   Module refresh is done once the search paths are setup.
+	/* Don't invade the process, it would load the symbols of all modules.
+	   Modules are only enumerated once the search paths are setup,
+	   and their symbols are loaded on demand.
 	*/
 	bool fInvadeProcess = false;
 
@@ -127,27 +166,99 @@ bool symbol_manager_load(symbol_manager* m, handle process_handle)
 		}
 	}
 
-	/* Not sure why but SymRefreshModuleList sometime fails and placing this Sleep fixed the issue... */
+	m->initialized = true;
+	m->process_handle = process_handle;
+
+	/* Not sure why but enumerating modules sometime fails and placing this Sleep fixed the issue... */
 	Sleep(1);
 
-	if (!SymRefreshModuleList(process_handle))
+	darr_clear(&m->modules);
+	m->module_generation += 1;
+	clear_function_cache(m);
+	m->last_module_refresh_time = 0;
+	refresh_modules(m);
+
+	jit_symbols_open(&m->jit, GetProcessId(process_handle));
+	jit_symbols_refresh(&m->jit);
+
+	if (m->modules.size == 0)
+	{
+		log_warning("No module found for process: %d", process_handle);
+	}
+
+#else
+#error "symbol_manager_load not implemented yet"
+#endif
+
+	return true;
+}
+
+bool symbol_manager_load_modules_only(symbol_manager* m, handle process_handle)
+{
+	m->process_handle = process_handle;
+	m->modules_only = true;
+
+	darr_clear(&m->modules);
+	m->module_generation += 1;
+	m->last_module_refresh_time = 0;
+	refresh_modules(m);
+
+	return true;
+}
+
+bool symbol_manager_load_offline(symbol_manager* m, strv search_path)
+{
+#if _WIN32
+	SymSetOptions((SymGetOptions() | SYMOPT_LOAD_LINES | SYMOPT_DEBUG) & ~SYMOPT_DEFERRED_LOADS);
+
+	if (m->initialized)
+	{
+		log_error("Symbol already initialized, this must be done only once.");
+		return false;
+	}
+
+	/* There is no process, the handle only needs to be a unique value. */
+	handle pseudo_handle = (handle)m;
+
+	if (!SymInitialize(pseudo_handle, NULL, FALSE))
 	{
-		log_warning("SymRefreshModuleList  failed: %ul", GetLastError());
+		log_error("Could not initialize symbols: %lu", GetLastError());
 		return false;
 	}
 
+	if (search_path.size)
+	{
+		wchar_t* buffer = (wchar_t*)m->symbol_buffer;
+		samply_convert_utf8_to_wchar(buffer, SMP_MAX_PATH_WCHAR_BUFFER_SIZE, search_path);
+
+		if (!SymSetSearchPathW(pseudo_handle, buffer))
+		{
+			log_warning("SymSetSearchPathW failed: %d", GetLastError());
+		}
+	}
+
 	m->initialized = true;
-	m->process_handle = process_handle;
+	m->offline = true;
+	m->process_handle = pseudo_handle;
 
+	darr_clear(&m->modules);
+	m->module_generation += 1;
+	clear_function_cache(m);
+	symbol_index_clear(&m->jit.index);
 #else
-#error "symbol_manager_load not implemented yet"
+#error "symbol_manager_load_offline not implemented yet"
 #endif
-
 	return true;
 }
 
 void symbol_manager_unload(symbol_manager* m)
 {
+	if (m->modules_only)
+	{
+		m->modules_only = false;
+		m->process_handle = 0;
+		return;
+	}
 #if _WIN32
 	if (!m->initialized)
 	{
@@ -158,8 +269,10 @@ void symbol_manager_unload(symbol_manager* m)
 	{
 		log_error("Could not cleanup symbols");
 	}
+	/* Modules are kept so statistics can still be displayed. */
 	m->process_handle = 0;
 	m->initialized = false;
+	m->offline = false;
 #else
 #error "symbol_manager_unload not implemented yet"
 #endif
@@ -172,7 +285,23 @@ strv symbol_manager_get_symbol_name(symbol_manager* m, address addr)
 		return (strv)STRV("");
 	}
 
+	/* Only the module of the kernel addresses is known. */
+	if (symbol_manager_is_kernel_address(addr))
+	{
+		return (strv)STRV("");
+	}
+
 #if _WIN32
+	/* Make sure the symbols of the module are loaded. */
+	symbol_module* module = symbol_manager_get_module(m, addr);
+
+	/* Address outside of any module, it might be JIT-compiled code. */
+	if (!module)
+	{
+		symbol_range* range = jit_symbols_find(&m->jit, addr);
+		return range ? range->name : (strv)STRV("");
+	}
+
 	DWORD64  dwDisplacement = 0;
 	PSYMBOL_INFO pSymbol = (PSYMBOL_INFO)m->symbol_buffer;
 
@@ -199,27 +328,20 @@ strv symbol_manager_get_module_name(symbol_manager* m, address addr)
 		return (strv)STRV("");
 	}
 
-	HMODULE hModule = NULL;
-	GetModuleHandleEx(
-		GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS
-		| GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT, /* DWORD dwFlags*/
-		(void*)addr, /* LPCWSTR lpModuleName */
-		&hModule   /* HMODULE* phModule */
-	);
-
-	DWORD name_len = GetModuleBaseNameA(GetCurrentProcess(), hModule, m->symbol_buffer, MAX_PATH);
-
-	if (name_len == 0)
+	/* Kernel addresses are attributed to the kernel, its symbols are not available. */
+	if (symbol_manager_is_kernel_address(addr))
 	{
-		return (strv)STRV("");
+		return m->kernel_module_name;
 	}
 
-	strv module_name;
-	module_name.data = m->symbol_buffer;
-	module_name.size = (size_t)name_len;
+	symbol_module* module = symbol_manager_get_module(m, addr);
+	if (module)
+	{
+		return module->name;
+	}
 
-	strv* s = string_store_get_or_create(m->string_store, module_name);
-	return *s;
+	symbol_range* range = jit_symbols_find(&m->jit, addr);
+	return range ? range->module_name : (strv)STRV("");
 }
 
 void symbol_manager_get_location(symbol_manager* m, address addr, strv* source_file, size_t* line_number)
@@ -229,6 +351,16 @@ void symbol_manager_get_location(symbol_manager* m, address addr, strv* source_f
 		return;
 	}
 
+	/* Make sure the symbols of the module are loaded.
+	   There is no line information for addresses outside of modules, nor for the kernel. */
+	if (symbol_manager_is_kernel_address(addr)
+		|| !symbol_manager_get_module(m, addr))
+	{
+		*source_file = (strv)STRV("");
+		*line_number = 0;
+		return;
+	}
+
 	DWORD displacement = 0;
 	IMAGEHLP_LINE64 line;
 	line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
@@ -245,4 +377,421 @@ void symbol_manager_get_location(symbol_manager* m, address addr, strv* source_f
 		*source_file = (strv)STRV("");
 		*line_number = 0;
 	}
-}
\ No newline at end of file
+}
+
+void symbol_manager_resolve(symbol_manager* m, address addr, symbol_location* location)
+{
+	memset(location, 0, sizeof(symbol_location));
+
+	if (!m->initialized)
+	{
+		return;
+	}
+
+	function_cache_entry* entry = find_cached_function(m, addr);
+
+	if (entry)
+	{
+		m->cache_hit_count += 1;
+		location_from_cache_entry(entry, addr, location);
+		return;
+	}
+
+	m->cache_miss_count += 1;
+
+	entry = &m->function_cache[(addr >> SMP_FUNCTION_CACHE_SHIFT) & (SMP_FUNCTION_CACHE_SIZE - 1)];
+
+	if (resolve_function(m, addr, entry))
+	{
+		m->last_hit = entry;
+		location_from_cache_entry(entry, addr, location);
+	}
+	else
+	{
+		/* Function range is unknown, resolve this address only. */
+		location->symbol_name = symbol_manager_get_symbol_name(m, addr);
+		location->module_name = symbol_manager_get_module_name(m, addr);
+		symbol_manager_get_location(m, addr, &location->source_file, &location->line_number);
+	}
+}
+
+void symbol_manager_add_module(symbol_manager* m, address base, size_t size, strv path)
+{
+	if (!find_module(m, base))
+	{
+		add_module(m, base, size, path);
+	}
+}
+
+void symbol_manager_track_module(symbol_manager* m, address addr)
+{
+	if (!symbol_manager_is_kernel_address(addr)
+		&& !find_module(m, addr)
+		&& samply_time_now() - m->last_module_refresh_time > SMP_MODULE_REFRESH_DELAY_SECONDS)
+	{
+		refresh_modules(m);
+	}
+}
+
+symbol_module* symbol_manager_get_module(symbol_manager* m, address addr)
+{
+	if (!m->initialized)
+	{
+		return NULL;
+	}
+
+	symbol_module* module = find_module(m, addr);
+
+	/* The module might have been loaded after the last refresh,
+	   or the address might belong to JIT-compiled code written after the last refresh. */
+	if (!module
+		&& !m->offline
+		&& samply_time_now() - m->last_module_refresh_time > SMP_MODULE_REFRESH_DELAY_SECONDS)
+	{
+		refresh_modules(m);
+		module = find_module(m, addr);
+
+		if (!module)
+		{
+			refresh_jit_symbols(m);
+		}
+	}
+
+	if (module && !module->loaded)
+	{
+		load_module_symbols(m, module);
+	}
+
+	return module;
+}
+
+symbol_module* symbol_manager_find_module(symbol_manager* m, address addr)
+{
+	return find_module(m, addr);
+}
+
+void symbol_manager_print_statistics(symbol_manager* m, FILE* f)
+{
+	size_t loaded_count = 0;
+	double total_seconds = 0;
+
+	fprintf(f, "Module load time:\n");
+	for (size_t i = 0; i < m->modules.size; i += 1)
+	{
+		symbol_module* module = &m->modules.data[i];
+		if (module->loaded)
+		{
+			fprintf(f, "%8.2f ms" "\t" STRV_FMT "%s\n",
+				module->load_seconds * 1000.0,
+				STRV_ARG(module->name),
+				module->load_failed ? " (failed)" : "");
+
+			loaded_count += 1;
+			total_seconds += module->load_seconds;
+		}
+	}
+	fprintf(f, "Loaded modules: %zu/%zu in %.2f ms\n", loaded_count, m->modules.size, total_seconds * 1000.0);
+
+	size_t lookup_count = m->cache_hit_count + m->cache_miss_count;
+	fprintf(f, "Function cache: %zu hits, %zu misses (%.2f%% hit rate)\n",
+		m->cache_hit_count,
+		m->cache_miss_count,
+		lookup_count ? (double)m->cache_hit_count / (double)lookup_count * 100.0 : 0.0);
+}
+
+static bool module_by_base_less(const symbol_module* left, const symbol_module* right)
+{
+	return left->base < right->base;
+}
+
+static symbol_module* find_module(symbol_manager* m, address addr)
+{
+	symbol_module value = { 0 };
+	value.base = addr;
+
+	/* Get the first module with a base greater than the address, the candidate is the previous one. */
+	size_t index = mem_upper_bound_predicate(m->modules.data, sizeof(symbol_module), 0, m->modules.size, &value, (darr_predicate_t)module_by_base_less);
+
+	if (index == 0)
+	{
+		return NULL;
+	}
+
+	symbol_module* module = &m->modules.data[index - 1];
+
+	return addr < module->base + module->size
+		? module
+		: NULL;
+}
+
+#if _WIN32
+
+static BOOL CALLBACK enumerate_module_callback(PCWSTR module_path, DWORD64 module_base, ULONG module_size, PVOID user_context)
+{
+	symbol_manager* m = (symbol_manager*)user_context;
+
+	/* Already known module. */
+	if (find_module(m, module_base))
+	{
+		return TRUE;
+	}
+
+	int path_len = samply_convert_wchar_to_utf8(m->symbol_buffer, SMP_MAX_PATH_BYTE_BUFFER_SIZE, module_path);
+
+	add_module(m, module_base, module_size, strv_make_from(m->symbol_buffer, path_len));
+
+	return TRUE;
+}
+
+#endif
+
+static void add_module(symbol_manager* m, address base, size_t size, strv path)
+{
+	symbol_module module = { 0 };
+	module.base = base;
+	module.size = size;
+	module.path = *string_store_get_or_create(m->string_store, path);
+
+	/* Module name is the last segment of the path. */
+	size_t last_separator = strv_find_last_of_chars(module.path, (strv)STRV("\\/"));
+	module.name = last_separator == STRV_NPOS
+		? module.path
+		: strv_substr_from(module.path, last_separator + 1, module.path.size - (last_separator + 1));
+
+	darr_insert_one_sorted(&m->modules, &module, (darr_predicate_t)module_by_base_less);
+	m->module_generation += 1;
+}
+
+static void refresh_modules(symbol_manager* m)
+{
+	/* Offline modules are explicitly registered. */
+	if (m->offline)
+	{
+		return;
+	}
+
+	m->last_module_refresh_time = samply_time_now();
+#if _WIN32
+	/* Only enumerate modules, this does not load any symbol. */
+	if (!EnumerateLoadedModulesW64(m->process_handle, enumerate_module_callback, m))
+	{
+		log_warning("EnumerateLoadedModulesW64 failed: %lu", GetLastError());
+	}
+#else
+#error "refresh_modules not implemented yet"
+#endif
+}
+
+static void load_module_symbols(symbol_manager* m, symbol_module* module)
+{
+	double start = samply_time_now();
+#if _WIN32
+	wchar_t* path = (wchar_t*)m->symbol_buffer;
+	samply_convert_utf8_to_wchar(path, SMP_MAX_PATH_WCHAR_BUFFER_SIZE, module->path);
+
+	DWORD64 base = SymLoadModuleExW(m->process_handle, NULL, path, NULL, module->base, (DWORD)module->size, NULL, 0);
+
+	/* Zero with ERROR_SUCCESS means the module was already loaded. */
+	if (base == 0 && GetLastError() != ERROR_SUCCESS)
+	{
+		log_warning("SymLoadModuleExW failed for '" STRV_FMT "': %lu", STRV_ARG(module->path), GetLastError());
+		module->load_failed = true;
+	}
+#else
+#error "load_module_symbols not implemented yet"
+#endif
+	module->loaded = true;
+	module->load_seconds = samply_time_now() - start;
+
+	log_debug("Symbols of '" STRV_FMT "' loaded in %.2f ms", STRV_ARG(module->name), module->load_seconds * 1000.0);
+}
+
+/* Functions cached before the refresh may have been replaced by new JIT-compiled code. */
+static void refresh_jit_symbols(symbol_manager* m)
+{
+	if (jit_symbols_refresh(&m->jit))
+	{
+		clear_cached_functions_in_range(m, m->jit.changed_start, m->jit.changed_end);
+	}
+}
+
+static void clear_function_cache(symbol_manager* m)
+{
+	for (size_t i = 0; i < SMP_FUNCTION_CACHE_SIZE; i += 1)
+	{
+		function_cache_entry* entry = &m->function_cache[i];
+		entry->start = 0;
+		entry->end = 0;
+		darr_clear(&entry->lines);
+	}
+	m->last_hit = NULL;
+	m->cache_hit_count = 0;
+	m->cache_miss_count = 0;
+}
+
+/* Clear the entries overlapping [start, end). */
+static void clear_cached_functions_in_range(symbol_manager* m, address start, address end)
+{
+	for (size_t i = 0; i < SMP_FUNCTION_CACHE_SIZE; i += 1)
+	{
+		function_cache_entry* entry = &m->function_cache[i];
+		if (entry->start < end && start < entry->end)
+		{
+			if (m->last_hit == entry)
+			{
+				m->last_hit = NULL;
+			}
+			entry->start = 0;
+			entry->end = 0;
+			darr_clear(&entry->lines);
+		}
+	}
+}
+
+static function_cache_entry* find_cached_function(symbol_manager* m, address addr)
+{
+	function_cache_entry* entry = m->last_hit;
+
+	if (entry && addr >= entry->start && addr < entry->end)
+	{
+		return entry;
+	}
+
+	entry = &m->function_cache[(addr >> SMP_FUNCTION_CACHE_SHIFT) & (SMP_FUNCTION_CACHE_SIZE - 1)];
+
+	if (addr >= entry->start && addr < entry->end)
+	{
+		m->last_hit = entry;
+		return entry;
+	}
+
+	return NULL;
+}
+
+/* Fill the entry with the function containing the address and its line table.
+   Returns false if the range of the function is unknown. */
+static bool resolve_function(symbol_manager* m, address addr, function_cache_entry* entry)
+{
+	/* The range of the kernel functions is unknown. */
+	if (symbol_manager_is_kernel_address(addr))
+	{
+		return false;
+	}
+
+	symbol_module* module = symbol_manager_get_module(m, addr);
+
+	/* Address outside of any module, which might be JIT-compiled code. There is no line information for it. */
+	if (!module)
+	{
+		symbol_range* range = jit_symbols_find(&m->jit, addr);
+		if (!range)
+		{
+			return false;
+		}
+
+		entry->start = range->start;
+		entry->end = range->end;
+		entry->symbol_name = range->name;
+		entry->module_name = range->module_name;
+		darr_clear(&entry->lines);
+		return true;
+	}
+
+#if _WIN32
+	DWORD64 displacement = 0;
+	PSYMBOL_INFO symbol = (PSYMBOL_INFO)m->symbol_buffer;
+
+	symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+	symbol->MaxNameLen = MAX_SYM_NAME;
+
+	/* Some symbols (like exports without debug information) don't have any size. */
+	if (!SymFromAddr(m->process_handle, addr, &displacement, symbol)
+		|| symbol->Size == 0)
+	{
+		return false;
+	}
+
+	entry->start = symbol->Address;
+	entry->end = symbol->Address + symbol->Size;
+	entry->symbol_name = *string_store_get_or_create(m->string_store, strv_make_from(symbol->Name, symbol->NameLen));
+	entry->module_name = module->name;
+	darr_clear(&entry->lines);
+
+	/* Walk the line table of the function. */
+	IMAGEHLP_LINE64 line;
+	memset(&line, 0, sizeof(line));
+	line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+	DWORD line_displacement = 0;
+	const char* previous_file = NULL;
+	strv source_file = strv_make();
+
+	bool has_line = SymGetLineFromAddr64(m->process_handle, entry->start, &line_displacement, &line);
+
+	while (has_line && line.Address < entry->end)
+	{
+		/* File names are owned by dbghelp, only intern them when they change. */
+		if (line.FileName != previous_file)
+		{
+			previous_file = line.FileName;
+			source_file = *string_store_get_or_create(m->string_store, strv_make_from_str(line.FileName));
+		}
+
+		function_line item;
+		item.address = line.Address;
+		item.source_file = source_file;
+		item.line_number = line.LineNumber;
+		darr_push_back(&entry->lines, item);
+
+		has_line = SymGetLineNext64(m->process_handle, &line);
+	}
+
+	/* The line table is not necessarily in address order, it's binary-searched by address. */
+	samply_qsort(entry->lines.data, entry->lines.size, sizeof(function_line), compare_function_line);
+
+	return true;
+#else
+#error "resolve_function not implemented yet"
+#endif
+}
+
+static void location_from_cache_entry(function_cache_entry* entry, address addr, symbol_location* location)
+{
+	location->symbol_name = entry->symbol_name;
+	location->module_name = entry->module_name;
+	location->function_start = entry->start;
+	location->function_end = entry->end;
+
+	/* Get the last line starting before or at the address. */
+	function_line value = { 0 };
+	value.address = addr;
+	size_t index = mem_upper_bound_predicate(entry->lines.data, sizeof(function_line), 0, entry->lines.size, &value, (darr_predicate_t)function_line_less);
+
+	if (index != 0)
+	{
+		function_line* line = &entry->lines.data[index - 1];
+		location->source_file = line->source_file;
+		location->line_number = line->line_number;
+	}
+	else
+	{
+		location->source_file = strv_make();
+		location->line_number = 0;
+	}
+}
+
+static bool function_line_less(const function_line* left, const function_line* right)
+{
+	return left->address < right->address;
+}
+
+static int compare_function_line(const void* left, const void* right)
+{
+	const function_line* l = (const function_line*)left;
+	const function_line* r = (const function_line*)right;
+	if (l->address < r->address)
+		return -1;
+	if (l->address > r->address)
+		return 1;
+	return 0;
+}
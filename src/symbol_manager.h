@@ -5,17 +5,105 @@
 #include "darr.h"
 #include "strv.h" /* strv */
 
+#include <stdio.h> /* FILE */
+
 #include "process.h" /* For handle type. */
+#include "jit_symbols.h"
 
 #if __cplusplus
 extern "C" {
 #endif
 
+/* Addresses above this one belong to the kernel (upper half of the canonical x86-64 address space). */
+#define SMP_KERNEL_ADDRESS_MIN (0xFFFF800000000000ull)
+
+/* Module name associated with all kernel addresses. Their symbols are not resolved. */
+#define SMP_KERNEL_MODULE_NAME "[kernel]"
+
+/* Module (executable or shared library) mapped in the address space of the process.
+   Symbols and line tables of a module are only loaded when the first address
+   belonging to this module needs to be resolved. */
+typedef struct symbol_module symbol_module;
+struct symbol_module {
+	address base;        /* Load address of the module. */
+	size_t size;         /* Size of the mapped image. */
+	strv name;           /* Module file name, like "kernel32.dll". */
+	strv path;           /* Full path of the module image. */
+	bool loaded;         /* Symbols have been loaded (successfully or not). */
+	bool load_failed;    /* Symbols could not be loaded, don't try again. */
+	double load_seconds; /* Time spent loading the symbols. */
+};
+
+/* Modules sorted by base address. */
+typedef darr(symbol_module) symbol_modules;
+
+/* Result of the resolution of an address. */
+typedef struct symbol_location symbol_location;
+struct symbol_location {
+	strv symbol_name;
+	strv module_name;
+	strv source_file;
+	size_t line_number;
+	/* Range [start, end) of the function, zero if unknown. */
+	address function_start;
+	address function_end;
+};
+
+/* First address of a source line inside a function. */
+typedef struct function_line function_line;
+struct function_line {
+	address address;
+	strv source_file;
+	size_t line_number;
+};
+
+typedef darr(function_line) function_lines;
+
+/* Resolved function [start, end) with its line table,
+   any address of this range can be resolved without calling the symbol engine. */
+typedef struct function_cache_entry function_cache_entry;
+struct function_cache_entry {
+	address start;
+	address end;          /* Exclusive. Zero means the entry is empty. */
+	strv symbol_name;
+	strv module_name;
+	function_lines lines; /* Sorted by address. */
+};
+
+/* Number of entries of the direct-mapped function cache. Must be a power of two. */
+#define SMP_FUNCTION_CACHE_SIZE (256)
+/* Entries are indexed by address bits above this shift. */
+#define SMP_FUNCTION_CACHE_SHIFT (8)
+
 typedef struct symbol_manager symbol_manager;
 struct symbol_manager {
 	struct string_store* string_store;
 	handle process_handle;
+	/* Symbol engine is initialized. */
 	bool initialized;
+	/* Symbol engine is not initialized, only the list of modules is tracked. */
+	bool modules_only;
+	/* Symbol engine is not attached to any process, modules are registered with symbol_manager_add_module. */
+	bool offline;
+
+	symbol_modules modules;
+	/* Incremented each time the list of modules changes. */
+	size_t module_generation;
+	/* Symbols of JIT-compiled code, for addresses outside of any module. */
+	jit_symbols jit;
+	/* Module name of the kernel addresses. */
+	strv kernel_module_name;
+
+	/* Time of the last refresh of the module list and JIT symbols, to avoid refreshing them for each unknown address. */
+	double last_module_refresh_time;
+
+	/* Recently resolved functions. Consecutive samples usually land in the same few functions. */
+	function_cache_entry function_cache[SMP_FUNCTION_CACHE_SIZE];
+	/* Entry of the last hit, checked before the direct-mapped entries. */
+	function_cache_entry* last_hit;
+	/* Counters to evaluate the efficiency of the cache. */
+	size_t cache_hit_count;
+	size_t cache_miss_count;
 #if _WIN32
 	char* symbol_buffer;
 #endif
@@ -27,9 +115,21 @@ void symbol_manager_destroy(symbol_manager* m);
 void symbol_manager_prepare_for_load(symbol_manager* m, handle process_handle);
 /* Load symbols of specified process. */
 bool symbol_manager_load(symbol_manager* m, handle process_handle);
+/* Only track the modules of the process, without loading any symbol.
+   Used to capture addresses which will be symbolized later. */
+bool symbol_manager_load_modules_only(symbol_manager* m, handle process_handle);
+/* Initialize the symbol engine without any process, to symbolize addresses captured on another machine.
+   Symbol files are searched in the semicolon-separated search path. */
+bool symbol_manager_load_offline(symbol_manager* m, strv search_path);
 /* Unload symbols of specified process. */
 void symbol_manager_unload(symbol_manager* m);
 
+/* Register a module for offline symbolization. */
+void symbol_manager_add_module(symbol_manager* m, address base, size_t size, strv path);
+
+/* Make sure the module containing the address is in the module list, without loading its symbols. */
+void symbol_manager_track_module(symbol_manager* m, address addr);
+
 /* Get symbol name from the process loaded by symbol_manager_load. */
 strv symbol_manager_get_symbol_name(symbol_manager* m, address addr);
 
@@ -39,6 +139,27 @@ strv symbol_manager_get_module_name(symbol_manager* m, address addr);
 /* Get location (source file and line number) from address. */
 void symbol_manager_get_location(symbol_manager* m, address addr, strv* source_file, size_t* line_number);
 
+/* Get symbol name, module name and location of an address.
+   Addresses of recently resolved functions are resolved from the function cache. */
+void symbol_manager_resolve(symbol_manager* m, address addr, symbol_location* location);
+
+/* Get module containing the address and load its symbols if they are not loaded yet.
+   Returns NULL if the address does not belong to any known module. */
+symbol_module* symbol_manager_get_module(symbol_manager* m, address addr);
+
+/* Get module containing the address without loading anything, NULL if the address does not belong to any known module.
+   Modules are still known after symbol_manager_unload. */
+symbol_module* symbol_manager_find_module(symbol_manager* m, address addr);
+
+static inline bool symbol_manager_is_kernel_address(address addr)
+{
+	return addr >= SMP_KERNEL_ADDRESS_MIN;
+}
+
+/* Print the modules whose symbols have been loaded, with the time spent to load them,
+   and the hit rate of the function cache. */
+void symbol_manager_print_statistics(symbol_manager* m, FILE* f);
+
 #if __cplusplus
 }
 #endif
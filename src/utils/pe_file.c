@@ -0,0 +1,179 @@
+#include "pe_file.h"
+
+#include <string.h> /* memcpy, memcmp */
+
+#define PE_DOS_HEADER_SIZE (64)
+#define PE_COFF_HEADER_SIZE (24) /* Including the "PE\0\0" signature. */
+#define PE_SECTION_HEADER_SIZE (40)
+#define PE_DEBUG_DIRECTORY_ENTRY_SIZE (28)
+#define PE_DEBUG_DIRECTORY_INDEX (6)
+#define PE_DEBUG_TYPE_CODEVIEW (2)
+#define PE_OPTIONAL_HEADER_MAGIC_32 (0x10b)
+#define PE_OPTIONAL_HEADER_MAGIC_64 (0x20b)
+
+static bool read_u16(strv image, size_t offset, uint16_t* value);
+static bool read_u32(strv image, size_t offset, uint32_t* value);
+
+bool build_id_equals(const build_id* left, const build_id* right)
+{
+    return left->size == right->size
+        && memcmp(left->bytes, right->bytes, left->size) == 0;
+}
+
+bool pe_file_init(pe_file* pe, strv image)
+{
+    memset(pe, 0, sizeof(pe_file));
+    pe->image = image;
+
+    if (image.size < PE_DOS_HEADER_SIZE
+        || image.data[0] != 'M'
+        || image.data[1] != 'Z')
+    {
+        return false;
+    }
+
+    uint32_t pe_offset;
+    if (!read_u32(image, 0x3C, &pe_offset)
+        || pe_offset + PE_COFF_HEADER_SIZE > image.size
+        || memcmp(image.data + pe_offset, "PE\0\0", 4) != 0)
+    {
+        return false;
+    }
+
+    uint16_t section_count;
+    uint16_t optional_header_size;
+    uint16_t magic;
+    read_u16(image, pe_offset + 6, &section_count);
+    read_u16(image, pe_offset + 20, &optional_header_size);
+
+    size_t optional_header = pe_offset + PE_COFF_HEADER_SIZE;
+    if (!read_u16(image, optional_header, &magic))
+    {
+        return false;
+    }
+
+    /* Data directories are located after the fields which size depends on 32 or 64-bit images. */
+    size_t directory_count_offset;
+    if (magic == PE_OPTIONAL_HEADER_MAGIC_64)
+    {
+        directory_count_offset = optional_header + 108;
+    }
+    else if (magic == PE_OPTIONAL_HEADER_MAGIC_32)
+    {
+        directory_count_offset = optional_header + 92;
+    }
+    else
+    {
+        return false;
+    }
+
+    uint32_t directory_count = 0;
+    read_u32(image, directory_count_offset, &directory_count);
+
+    if (directory_count > PE_DEBUG_DIRECTORY_INDEX)
+    {
+        size_t debug_directory = directory_count_offset + 4 + PE_DEBUG_DIRECTORY_INDEX * 8;
+        read_u32(image, debug_directory, &pe->debug_directory_rva);
+        read_u32(image, debug_directory + 4, &pe->debug_directory_size);
+    }
+
+    size_t sections = optional_header + optional_header_size;
+    if (sections + (size_t)section_count * PE_SECTION_HEADER_SIZE > image.size)
+    {
+        return false;
+    }
+
+    pe->sections = image.data + sections;
+    pe->section_count = section_count;
+
+    return true;
+}
+
+bool pe_file_rva_to_offset(pe_file* pe, uint32_t rva, size_t* offset)
+{
+    for (uint32_t i = 0; i < pe->section_count; i += 1)
+    {
+        const char* section = pe->sections + i * PE_SECTION_HEADER_SIZE;
+
+        uint32_t virtual_size;
+        uint32_t virtual_address;
+        uint32_t raw_size;
+        uint32_t raw_offset;
+        memcpy(&virtual_size, section + 8, 4);
+        memcpy(&virtual_address, section + 12, 4);
+        memcpy(&raw_size, section + 16, 4);
+        memcpy(&raw_offset, section + 20, 4);
+
+        /* Only the part of the section present in the file can be converted. */
+        if (rva >= virtual_address && rva < virtual_address + raw_size)
+        {
+            *offset = (size_t)(rva - virtual_address) + raw_offset;
+            return *offset < pe->image.size;
+        }
+    }
+
+    return false;
+}
+
+bool pe_file_get_build_id(pe_file* pe, build_id* id)
+{
+    memset(id, 0, sizeof(build_id));
+
+    size_t directory_offset;
+    if (pe->debug_directory_size == 0
+        || !pe_file_rva_to_offset(pe, pe->debug_directory_rva, &directory_offset))
+    {
+        return false;
+    }
+
+    uint32_t entry_count = pe->debug_directory_size / PE_DEBUG_DIRECTORY_ENTRY_SIZE;
+
+    for (uint32_t i = 0; i < entry_count; i += 1)
+    {
+        size_t entry = directory_offset + i * PE_DEBUG_DIRECTORY_ENTRY_SIZE;
+
+        uint32_t type;
+        uint32_t data_size;
+        uint32_t data_offset;
+
+        if (!read_u32(pe->image, entry + 12, &type)
+            || !read_u32(pe->image, entry + 16, &data_size)
+            || !read_u32(pe->image, entry + 24, &data_offset))
+        {
+            return false;
+        }
+
+        /* CodeView entry is: "RSDS", GUID (16 bytes), age (4 bytes), PDB path. */
+        if (type == PE_DEBUG_TYPE_CODEVIEW
+            && data_size >= 24
+            && (size_t)data_offset + 24 <= pe->image.size
+            && memcmp(pe->image.data + data_offset, "RSDS", 4) == 0)
+        {
+            memcpy(id->bytes, pe->image.data + data_offset + 4, 20);
+            id->size = 20;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool read_u16(strv image, size_t offset, uint16_t* value)
+{
+    if (offset + sizeof(uint16_t) > image.size)
+    {
+        return false;
+    }
+    memcpy(value, image.data + offset, sizeof(uint16_t));
+    return true;
+}
+
+static bool read_u32(strv image, size_t offset, uint32_t* value)
+{
+    if (offset + sizeof(uint32_t) > image.size)
+    {
+        return false;
+    }
+    memcpy(value, image.data + offset, sizeof(uint32_t));
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef SAMPLY_PE_FILE_H
+#define SAMPLY_PE_FILE_H
+
+#include <stdint.h> /* uint8_t, uint32_t */
+#include <stdbool.h>
+
+#include "strv.h"
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Build id is the GUID (16 bytes) followed by the age (4 bytes) of the PDB on Windows. */
+#define SMP_BUILD_ID_MAX_SIZE (32)
+
+/* Identifier of a binary, used to make sure symbols are loaded from the exact same binary. */
+typedef struct build_id build_id;
+struct build_id {
+    uint8_t bytes[SMP_BUILD_ID_MAX_SIZE];
+    uint32_t size;
+};
+
+bool build_id_equals(const build_id* left, const build_id* right);
+
+/* Minimal reader of Portable Executable images (.exe, .dll) mapped in memory,
+   only what is needed to read the build id and the bytes of the code. */
+typedef struct pe_file pe_file;
+struct pe_file {
+    strv image;              /* Content of the file. */
+    const char* sections;    /* First section header. */
+    uint32_t section_count;
+    uint32_t debug_directory_rva;
+    uint32_t debug_directory_size;
+};
+
+/* Returns false if the image is not a valid PE file. */
+bool pe_file_init(pe_file* pe, strv image);
+
+/* Convert relative virtual address (address - load address of the module) to an offset in the file. */
+bool pe_file_rva_to_offset(pe_file* pe, uint32_t rva, size_t* offset);
+
+/* Get build id from the CodeView debug directory entry. */
+bool pe_file_get_build_id(pe_file* pe, build_id* id);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_PE_FILE_H */
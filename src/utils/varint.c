@@ -0,0 +1,40 @@
+#include "varint.h"
+
+size_t varint_write(uint8_t* out, uint64_t v)
+{
+    uint8_t* start = out;
+    while (v >= 0x80)
+    {
+        *out++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = (uint8_t)v;
+
+    return (size_t)(out - start);
+}
+
+bool varint_read(const uint8_t** cursor, const uint8_t* end, uint64_t* v)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *cursor < end; shift += 7)
+    {
+        uint8_t byte = *(*cursor)++;
+        result |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            *v = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t zigzag_encode(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+int64_t zigzag_decode(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
@@ -0,0 +1,30 @@
+#ifndef SAMPLY_VARINT_H
+#define SAMPLY_VARINT_H
+
+#include <stdbool.h> /* bool */
+#include <stddef.h>  /* size_t */
+#include <stdint.h>  /* uint8_t, uint64_t */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Maximum size of a LEB128 encoded 64-bit integer. */
+#define SMP_VARINT_MAX_SIZE (10)
+
+/* Write v as LEB128, out must have space for SMP_VARINT_MAX_SIZE bytes. Returns the number of bytes written. */
+size_t varint_write(uint8_t* out, uint64_t v);
+
+/* Read a LEB128 integer and advance the cursor. Returns false if the varint is truncated or too long. */
+bool varint_read(const uint8_t** cursor, const uint8_t* end, uint64_t* v);
+
+/* Map signed integers to unsigned ones, small magnitudes give small values. */
+uint64_t zigzag_encode(int64_t v);
+
+int64_t zigzag_decode(uint64_t v);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_VARINT_H */
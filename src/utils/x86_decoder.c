@@ -0,0 +1,276 @@
+#include "x86_decoder.h"
+
+#include <stdbool.h>
+
+/* What follows the opcode. */
+enum {
+    X_ = 0x00,     /* Nothing. */
+    XM = 0x01,     /* ModR/M byte, with its SIB byte and displacement. */
+    X8 = 0x02,     /* 8-bit immediate. */
+    X16 = 0x04,    /* 16-bit immediate. */
+    XZ = 0x08,     /* 16-bit immediate with the operand-size prefix, 32-bit otherwise. */
+    XV = 0x10,     /* Like XZ, but 64-bit with REX.W (mov reg, imm64). */
+    XO = 0x20,     /* 64-bit memory offset, 32-bit with the address-size prefix. */
+    XG = 0x40,     /* The immediate is only present if ModR/M.reg is 0 or 1 (test in group 3). */
+    XX = 0x80      /* Invalid in 64-bit mode, or prefix handled before the opcode. */
+};
+
+#define XM8 (XM | X8)
+#define XMZ (XM | XZ)
+
+static const uint8_t one_byte_opcodes[256] = {
+    /*       0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F */
+    /* 0 */  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,
+    /* 1 */  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,
+    /* 2 */  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,
+    /* 3 */  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,  XM,  XM,  XM,  XM,  X8,  XZ,  XX,  XX,
+    /* 4 */  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+    /* 5 */  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,
+    /* 6 */  XX,  XX,  XX,  XM,  XX,  XX,  XX,  XX,  XZ,  XMZ, X8,  XM8, X_,  X_,  X_,  X_,
+    /* 7 */  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,
+    /* 8 */  XM8, XMZ, XX,  XM8, XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 9 */  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  XX,  X_,  X_,  X_,  X_,  X_,
+    /* A */  XO,  XO,  XO,  XO,  X_,  X_,  X_,  X_,  X8,  XZ,  X_,  X_,  X_,  X_,  X_,  X_,
+    /* B */  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  XV,  XV,  XV,  XV,  XV,  XV,  XV,  XV,
+    /* C */  XM8, XM8, X16, X_,  XX,  XX,  XM8, XMZ, X16 | X8, X_, X16, X_, X_, X8,  XX,  X_,
+    /* D */  XM,  XM,  XM,  XM,  XX,  XX,  XX,  X_,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* E */  X8,  X8,  X8,  X8,  X8,  X8,  X8,  X8,  XZ,  XZ,  XX,  X8,  X_,  X_,  X_,  X_,
+    /* F */  XX,  X_,  XX,  XX,  X_,  X_,  XM8 | XG, XMZ | XG, X_, X_, X_, X_, X_, X_, XM, XM,
+};
+
+/* Opcodes following 0x0F, also used for the map 1 of the VEX and EVEX prefixes. */
+static const uint8_t two_byte_opcodes[256] = {
+    /*       0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F */
+    /* 0 */  XM,  XM,  XM,  XM,  XX,  X_,  X_,  X_,  X_,  X_,  XX,  X_,  XX,  XM,  X_,  XM8,
+    /* 1 */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 2 */  XM,  XM,  XM,  XM,  XX,  XX,  XX,  XX,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 3 */  X_,  X_,  X_,  X_,  X_,  X_,  XX,  X_,  XX,  XX,  XX,  XX,  XX,  XX,  XX,  XX,
+    /* 4 */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 5 */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 6 */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* 7 */  XM8, XM8, XM8, XM8, XM,  XM,  XM,  X_,  XM,  XM,  XX,  XX,  XM,  XM,  XM,  XM,
+    /* 8 */  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,  XZ,
+    /* 9 */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* A */  X_,  X_,  X_,  XM,  XM8, XM,  XX,  XX,  X_,  X_,  X_,  XM,  XM8, XM,  XM,  XM,
+    /* B */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM8, XM,  XM,  XM,  XM,  XM,
+    /* C */  XM,  XM,  XM8, XM,  XM8, XM8, XM8, XM,  X_,  X_,  X_,  X_,  X_,  X_,  X_,  X_,
+    /* D */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* E */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+    /* F */  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,  XM,
+};
+
+static bool is_legacy_prefix(uint8_t byte);
+static bool skip_modrm(const uint8_t* code, size_t size, size_t* i, uint8_t* reg);
+static size_t immediate_size(uint8_t flags, uint8_t reg, bool operand_size_16, bool address_size_32, bool rex_w);
+
+size_t x86_decoder_instruction_length(const uint8_t* code, size_t size)
+{
+    if (size > SMP_X86_MAX_INSTRUCTION_LENGTH)
+    {
+        size = SMP_X86_MAX_INSTRUCTION_LENGTH;
+    }
+
+    size_t i = 0;
+    bool operand_size_16 = false;
+    bool address_size_32 = false;
+    bool rex_w = false;
+
+    while (i < size && is_legacy_prefix(code[i]))
+    {
+        operand_size_16 |= code[i] == 0x66;
+        address_size_32 |= code[i] == 0x67;
+        i += 1;
+    }
+
+    /* REX is only meaningful right before the opcode. */
+    if (i < size && (code[i] & 0xF0) == 0x40)
+    {
+        rex_w = (code[i] & 0x08) != 0;
+        i += 1;
+    }
+
+    if (i >= size)
+    {
+        return 0;
+    }
+
+    uint8_t opcode = code[i];
+    i += 1;
+
+    uint8_t flags;
+
+    /* VEX (C4, C5), EVEX (62) and XOP (8F with a map above 7, otherwise it's pop r/m). */
+    bool is_xop = opcode == 0x8F && i < size && (code[i] & 0x1F) >= 8;
+    if (opcode == 0xC4 || opcode == 0xC5 || opcode == 0x62 || is_xop)
+    {
+        size_t prefix_size = opcode == 0xC5 ? 1 : opcode == 0x62 ? 3 : 2;
+        if (i + prefix_size >= size)
+        {
+            return 0;
+        }
+
+        uint8_t map = opcode == 0xC5 ? 1
+            : opcode == 0x62 ? (code[i] & 0x07)
+            : (code[i] & 0x1F);
+
+        i += prefix_size;
+        uint8_t vex_opcode = code[i];
+        i += 1;
+
+        /* vzeroupper and vzeroall have no operand. */
+        if (opcode != 0x62 && map == 1 && vex_opcode == 0x77)
+        {
+            return i;
+        }
+
+        flags = XM;
+        if (map == 1)
+        {
+            flags |= two_byte_opcodes[vex_opcode] & X8;
+        }
+        else if (map == 3 || map == 8)
+        {
+            flags |= X8;
+        }
+        else if (map == 0x0A)
+        {
+            flags |= XZ;
+        }
+        else if (map == 0 || map == 4 || map == 7 || map > 0x0A)
+        {
+            return 0;
+        }
+
+        /* The operand-size prefix is part of the VEX prefix, the immediate is never 16-bit. */
+        operand_size_16 = false;
+    }
+    else if (opcode == 0x0F)
+    {
+        if (i >= size)
+        {
+            return 0;
+        }
+
+        uint8_t second = code[i];
+        i += 1;
+
+        /* Three-byte opcodes always have a ModR/M byte, and an 8-bit immediate for 0F 3A. */
+        if (second == 0x38 || second == 0x3A)
+        {
+            i += 1;
+            flags = second == 0x38 ? XM : XM8;
+        }
+        else
+        {
+            flags = two_byte_opcodes[second];
+        }
+    }
+    else
+    {
+        flags = one_byte_opcodes[opcode];
+    }
+
+    if (flags & XX)
+    {
+        return 0;
+    }
+
+    uint8_t reg = 0;
+    if ((flags & XM) && !skip_modrm(code, size, &i, &reg))
+    {
+        return 0;
+    }
+
+    i += immediate_size(flags, reg, operand_size_16, address_size_32, rex_w);
+
+    return i <= size ? i : 0;
+}
+
+static bool is_legacy_prefix(uint8_t byte)
+{
+    switch (byte)
+    {
+    case 0x26: case 0x2E: case 0x36: case 0x3E: case 0x64: case 0x65: /* Segments. */
+    case 0x66: case 0x67:                                             /* Operand and address size. */
+    case 0xF0: case 0xF2: case 0xF3:                                  /* Lock and repeat. */
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* 32-bit and 64-bit addressing have the same encoding, only 16-bit addressing differs and it does not exist in 64-bit mode. */
+static bool skip_modrm(const uint8_t* code, size_t size, size_t* i, uint8_t* reg)
+{
+    if (*i >= size)
+    {
+        return false;
+    }
+
+    uint8_t modrm = code[*i];
+    *i += 1;
+
+    uint8_t mod = modrm >> 6;
+    uint8_t rm = modrm & 0x07;
+    *reg = (modrm >> 3) & 0x07;
+
+    if (mod == 3)
+    {
+        return true;
+    }
+
+    size_t displacement = mod == 1 ? 1 : mod == 2 ? 4 : 0;
+
+    if (rm == 4)
+    {
+        if (*i >= size)
+        {
+            return false;
+        }
+        /* No base register, 32-bit displacement only. */
+        if (mod == 0 && (code[*i] & 0x07) == 5)
+        {
+            displacement = 4;
+        }
+        *i += 1;
+    }
+    /* RIP-relative. */
+    else if (mod == 0 && rm == 5)
+    {
+        displacement = 4;
+    }
+
+    *i += displacement;
+    return true;
+}
+
+static size_t immediate_size(uint8_t flags, uint8_t reg, bool operand_size_16, bool address_size_32, bool rex_w)
+{
+    if ((flags & XG) && reg > 1)
+    {
+        return 0;
+    }
+
+    size_t size = 0;
+    if (flags & X8)
+    {
+        size += 1;
+    }
+    if (flags & X16)
+    {
+        size += 2;
+    }
+    if (flags & XZ)
+    {
+        size += operand_size_16 ? 2 : 4;
+    }
+    if (flags & XV)
+    {
+        size += rex_w ? 8 : operand_size_16 ? 2 : 4;
+    }
+    if (flags & XO)
+    {
+        size += address_size_32 ? 4 : 8;
+    }
+    return size;
+}
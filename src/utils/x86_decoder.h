@@ -0,0 +1,23 @@
+#ifndef SAMPLY_X86_DECODER_H
+#define SAMPLY_X86_DECODER_H
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Maximum length of an x86 instruction. */
+#define SMP_X86_MAX_INSTRUCTION_LENGTH (15)
+
+/* Length of the 64-bit mode x86 instruction starting at code, without decoding its operands.
+   Handles the legacy, REX, VEX, EVEX and XOP prefixes.
+   Returns 0 if the instruction is invalid or does not fit in size bytes. */
+size_t x86_decoder_instruction_length(const uint8_t* code, size_t size);
+
+#if __cplusplus
+}
+#endif
+
+#endif /* SAMPLY_X86_DECODER_H */